@@ -1,5 +1,7 @@
 #ifndef PICOMOQ_H
 #define PICOMOQ_H
+#include <stdint.h>
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -36,6 +38,21 @@ extern "C" {
 #define PMOQ_STRM_HEADER_SUBGROUP  0x4
 
 
+/* Protocol versions, as negotiated in CLIENT_SETUP and SERVER_SETUP.
+ */
+#define PMOQ_VERSION_DRAFT_07 0xff000007
+#define PMOQ_ALPN "moq-00"
+
+/* Session termination codes, used as QUIC application close codes
+ */
+#define PMOQ_ERROR_NO_ERROR 0x0
+#define PMOQ_ERROR_INTERNAL_ERROR 0x1
+#define PMOQ_ERROR_UNAUTHORIZED 0x2
+#define PMOQ_ERROR_PROTOCOL_VIOLATION 0x3
+#define PMOQ_ERROR_DUPLICATE_TRACK_ALIAS 0x4
+#define PMOQ_ERROR_PARAMETER_LENGTH_MISMATCH 0x5
+#define PMOQ_ERROR_GOAWAY_TIMEOUT 0x10
+
 #define PMOQ_PARAMETERS_NUMBER_MAX 16
 #define PMOQ_VERSION_NUMBER_MAX 16
 
@@ -51,6 +68,8 @@ extern "C" {
 #define PMOQ_TUPLE_SIZE_MAX 32
 
 #define PMOQ_PARAMETER_AUTHORIZATION_INFO 0x02
+#define PMOQ_PARAMETER_DELIVERY_TIMEOUT 0x03
+#define PMOQ_PARAMETER_MAX_CACHE_DURATION 0x04
     
 typedef struct st_pmoq_parameter_t {
     uint64_t p_type;
@@ -74,9 +93,15 @@ typedef struct st_pmoq_bits_t {
     uint8_t* bits;
 } pmoq_bits_t;
 
+/* The items of a tuple are kept in a separate array, so that the
+ * message structures stay small. When formatting, "items" points to
+ * nb_items values. When parsing, the caller provides an array of
+ * items_max entries; tuples with more items are rejected.
+ */
 typedef struct st_pmoq_tuple_t {
     uint64_t nb_items;
-    pmoq_bits_t items[PMOQ_TUPLE_SIZE_MAX];
+    size_t items_max;
+    pmoq_bits_t* items;
 } pmoq_tuple_t;
 
 #define PMOQ_TRACK_STATUS_IN_PROGRESS 0x00
@@ -99,9 +124,80 @@ typedef struct st_pmoq_tuple_t {
 #define PMOQ_SUBSCRIBE_ERROR_TIMEOUT 5
 #define PMOQ_SUBSCRIBE_ERROR_MAX 5
 
+/* Parameter registry.
+ * The keys of the parameters that the library knows, role and path in
+ * the setup messages, authorization info, delivery timeout and max cache
+ * duration in the other messages, are decoded into the members of the
+ * parameter structures below. Applications register their own keys,
+ * with a decoder: varint, bytes, or custom. The parameters with these
+ * keys are decoded in the same pass, into the "extensions" of the
+ * parameter structure, and those with keys that are not registered are
+ * ignored. A key that appears twice in a message is an error.
+ * As the namespace items, the extensions are stored in an array provided
+ * by the caller, "param_values" in pmoq_msg_t, which can hold up to
+ * "param_values_max" values, or in the arena; a message with more
+ * registered parameters than the array holds is malformed.
+ * The registry is used when parsing, if set in pmoq_msg_t, or with
+ * pmoq_msg_parser_set_registry() or pmoq_session_set_param_registry().
+ * Keys are registered before the registry is used, and the registry
+ * must be kept as long as it is used. Keys are looked up with a perfect
+ * hash, recomputed at each registration.
+ * The custom decoder is called with the value bytes; it may check them,
+ * and set "varint". It returns 0, or -1 if the value is malformed, in
+ * which case the message is malformed. It may be called more than once
+ * for the same message, if parsing is retried when bytes are missing.
+ * For varint parameters, "varint" holds the value. The value bytes
+ * point into the parsed message, as the other parameter values.
+ * When formatting, the extensions are encoded as varint if "is_varint"
+ * is set, or else as bytes.
+ * Each message holds at most PMOQ_PARAM_VALUES_MAX extensions, so at
+ * most that number of keys can be registered for the setup messages, and
+ * for the other messages.
+ */
+#define PMOQ_PARAM_VALUES_MAX 8
+
+typedef enum {
+    pmoq_param_type_varint = 0,
+    pmoq_param_type_bytes,
+    pmoq_param_type_custom
+} pmoq_param_type_enum;
+
+typedef struct st_pmoq_param_value_t {
+    uint64_t key;
+    uint64_t varint;
+    size_t length;
+    uint8_t* bytes;
+    uint8_t is_varint;
+} pmoq_param_value_t;
+
+typedef struct st_pmoq_param_values_t {
+    size_t nb_values;
+    size_t values_max;
+    pmoq_param_value_t* values;
+} pmoq_param_values_t;
+
+typedef int (*pmoq_param_decode_fn)(void* decode_ctx, pmoq_param_value_t* value);
+typedef struct st_pmoq_param_registry_t pmoq_param_registry_t;
+
+pmoq_param_registry_t* pmoq_param_registry_create();
+void pmoq_param_registry_delete(pmoq_param_registry_t* registry);
+/* Returns -1 if the key is already registered, if the registry is full,
+ * or if the decoder is missing for a custom type. */
+int pmoq_param_registry_add(pmoq_param_registry_t* registry, uint64_t key, int is_setup,
+    pmoq_param_type_enum param_type, pmoq_param_decode_fn decode_fn, void* decode_ctx);
+/* Returns NULL if the parameter was not in the message */
+const pmoq_param_value_t* pmoq_param_values_find(const pmoq_param_values_t* values, uint64_t key);
+
+/* The delivery timeout and max cache duration are in milliseconds, and
+ * only present if the matching flag is set. */
 typedef struct st_pmoq_subscribe_parameters_t {
     size_t auth_info_len;
     uint8_t * auth_info;
+    uint8_t has_delivery_timeout;
+    uint8_t has_max_cache_duration;
+    uint64_t delivery_timeout;
+    uint64_t max_cache_duration;
+    pmoq_param_values_t extensions;
 } pmoq_subscribe_parameters_t;
 
 #define     pmoq_setup_role_undef 0
@@ -116,76 +212,223 @@ typedef struct st_pmoq_setup_parameters_t {
     uint8_t role;
     size_t path_length;
     uint8_t* path;
+    pmoq_param_values_t extensions;
 } pmoq_setup_parameters_t;
 
-typedef struct st_pmoq_msg_t {
-    uint64_t msg_type;
-    pmoq_tuple_t track_namespace;
-    pmoq_bits_t track_name;
+/* One structure per message type. Messages that share the same
+ * layout share the same structure.
+ */
+typedef struct st_pmoq_subscribe_update_t {
     uint64_t subscribe_id;
-    uint64_t track_alias;
-    uint64_t filter_type;
-    uint64_t expires;
-    uint8_t content_exists; /* value: 0 or 1 */
-    uint64_t error_code;
-    uint64_t status_code;
     uint64_t start_group;
     uint64_t start_object;
     uint64_t end_group;
     uint64_t end_object;
+    pmoq_subscribe_parameters_t subscribe_parameters;
+} pmoq_subscribe_update_t;
+
+typedef struct st_pmoq_subscribe_t {
+    uint64_t subscribe_id;
+    uint64_t track_alias;
+    pmoq_tuple_t track_namespace;
+    pmoq_bits_t track_name;
+    uint64_t filter_type;
+    uint64_t start_group; /* Only present if filter is absolute start or range */
+    uint64_t start_object;
+    uint64_t end_group; /* Only present if filter is absolute range */
+    uint64_t end_object;
+    pmoq_subscribe_parameters_t subscribe_parameters;
+} pmoq_subscribe_t;
+
+typedef struct st_pmoq_subscribe_ok_t {
+    uint64_t subscribe_id;
+    uint64_t expires;
     uint64_t largest_group_id; /* Only present if content_exists == 1 */
     uint64_t largest_object_id; /* Only present if content_exists == 1 */
-    uint64_t last_group_id; /* Only present if status code requires it */
-    uint64_t last_object_id; /* Only present if status code requires it */
+    pmoq_subscribe_parameters_t subscribe_parameters;
+    uint8_t content_exists; /* value: 0 or 1 */
+} pmoq_subscribe_ok_t;
+
+typedef struct st_pmoq_subscribe_error_t {
+    uint64_t subscribe_id;
+    uint64_t error_code;
+    pmoq_bits_t reason_phrase;
+    uint64_t track_alias;
+} pmoq_subscribe_error_t;
+
+typedef struct st_pmoq_announce_t {
+    pmoq_tuple_t track_namespace;
+    pmoq_subscribe_parameters_t subscribe_parameters;
+} pmoq_announce_t;
+
+typedef pmoq_announce_t pmoq_subscribe_namespace_t;
+
+typedef struct st_pmoq_announce_ok_t {
+    pmoq_tuple_t track_namespace;
+} pmoq_announce_ok_t;
+
+typedef pmoq_announce_ok_t pmoq_unannounce_t;
+typedef pmoq_announce_ok_t pmoq_subscribe_namespace_ok_t;
+typedef pmoq_announce_ok_t pmoq_unsubscribe_namespace_t;
+
+typedef struct st_pmoq_announce_error_t {
+    pmoq_tuple_t track_namespace;
+    uint64_t error_code;
+    pmoq_bits_t reason_phrase;
+} pmoq_announce_error_t;
+
+typedef pmoq_announce_error_t pmoq_announce_cancel_t;
+typedef pmoq_announce_error_t pmoq_subscribe_namespace_error_t;
+
+typedef struct st_pmoq_unsubscribe_t {
+    uint64_t subscribe_id;
+} pmoq_unsubscribe_t;
+
+typedef pmoq_unsubscribe_t pmoq_max_subscribe_id_t;
+
+typedef struct st_pmoq_subscribe_done_t {
+    uint64_t subscribe_id;
+    uint64_t status_code;
+    pmoq_bits_t reason_phrase;
     uint64_t final_group_id; /* Only present if content_exists == 1 */
     uint64_t final_object_id; /* Only present if content_exists == 1 */
-    pmoq_bits_t reason_phrase;
+    uint8_t content_exists; /* value: 0 or 1 */
+} pmoq_subscribe_done_t;
+
+typedef struct st_pmoq_track_status_request_t {
+    pmoq_tuple_t track_namespace;
+    pmoq_bits_t track_name;
+} pmoq_track_status_request_t;
+
+typedef struct st_pmoq_track_status_t {
+    pmoq_tuple_t track_namespace;
+    pmoq_bits_t track_name;
+    uint64_t status_code;
+    uint64_t last_group_id; /* Only present if status code requires it */
+    uint64_t last_object_id; /* Only present if status code requires it */
+} pmoq_track_status_t;
+
+typedef struct st_pmoq_goaway_t {
     pmoq_bits_t uri;
-    pmoq_subscribe_parameters_t subscribe_parameters;
-    uint32_t selected_version;
+} pmoq_goaway_t;
+
+typedef struct st_pmoq_client_setup_t {
     uint64_t supported_versions_nb;
     uint32_t supported_versions[PMOQ_VERSION_NUMBER_MAX];
     pmoq_setup_parameters_t setup_parameters;
+} pmoq_client_setup_t;
+
+typedef struct st_pmoq_server_setup_t {
+    uint32_t selected_version;
+    pmoq_setup_parameters_t setup_parameters;
+} pmoq_server_setup_t;
+
+/* Bump arena for the side data of parsed messages.
+ * The storage is provided by the caller, typically one region per
+ * connection. Allocations only move the "used" mark, and
+ * pmoq_arena_reset() releases all of them at once, e.g., when the
+ * messages parsed from a receive buffer have been processed.
+ * pmoq_arena_alloc() returns NULL if the region is full; align must
+ * be a power of 2.
+ */
+typedef struct st_pmoq_arena_t {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+} pmoq_arena_t;
+
+void pmoq_arena_init(pmoq_arena_t* arena, uint8_t* base, size_t size);
+void* pmoq_arena_alloc(pmoq_arena_t* arena, size_t length, size_t align);
+void pmoq_arena_reset(pmoq_arena_t* arena);
+
+/* Tagged union of all control messages. The member of "u" is
+ * selected by msg_type.
+ * The parse functions store the items of the track namespace in
+ * the array "namespace_items", provided by the caller, which
+ * can hold up to "namespace_items_max" items.
+ * By default, the bit strings, namespace items and parameter values
+ * point into the parsed buffer, which must be kept as long as they are
+ * used. If "arena" is set, they are copied into the arena, in one
+ * contiguous block, once the message is parsed, and the buffer can be
+ * released. If "namespace_items" or "param_values" is NULL, the array
+ * of items or of values is then also allocated in the arena. Parsing
+ * fails with *err set to -1 if the arena is too small, and the arena is
+ * left unchanged.
+ * If "registry" is set, the parameters with the keys registered in it
+ * are decoded into the array "param_values", which can hold up to
+ * "param_values_max" values, see pmoq_param_registry_add().
+ */
+typedef struct st_pmoq_msg_t {
+    uint64_t msg_type;
+    pmoq_bits_t* namespace_items;
+    size_t namespace_items_max;
+    pmoq_param_value_t* param_values;
+    size_t param_values_max;
+    pmoq_arena_t* arena;
+    const pmoq_param_registry_t* registry;
+    union {
+        pmoq_subscribe_update_t subscribe_update;
+        pmoq_subscribe_t subscribe;
+        pmoq_subscribe_ok_t subscribe_ok;
+        pmoq_subscribe_error_t subscribe_error;
+        pmoq_announce_t announce;
+        pmoq_announce_ok_t announce_ok;
+        pmoq_announce_error_t announce_error;
+        pmoq_unannounce_t unannounce;
+        pmoq_unsubscribe_t unsubscribe;
+        pmoq_subscribe_done_t subscribe_done;
+        pmoq_announce_cancel_t announce_cancel;
+        pmoq_track_status_request_t track_status_request;
+        pmoq_track_status_t track_status;
+        pmoq_goaway_t goaway;
+        pmoq_subscribe_namespace_t subscribe_namespace;
+        pmoq_subscribe_namespace_ok_t subscribe_namespace_ok;
+        pmoq_subscribe_namespace_error_t subscribe_namespace_error;
+        pmoq_unsubscribe_namespace_t unsubscribe_namespace;
+        pmoq_max_subscribe_id_t max_subscribe_id;
+        pmoq_client_setup_t client_setup;
+        pmoq_server_setup_t server_setup;
+    } u;
 } pmoq_msg_t;
 
-uint8_t* pmoq_msg_subscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe);
-const uint8_t* pmoq_msg_subscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * subscribe);
+uint8_t* pmoq_msg_subscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_subscribe_t* subscribe);
+const uint8_t* pmoq_msg_subscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_subscribe_t* subscribe);
 
-uint8_t* pmoq_msg_subscribe_ok_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_ok);
-const uint8_t* pmoq_msg_subscribe_ok_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * subscribe_ok);
+uint8_t* pmoq_msg_subscribe_ok_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_subscribe_ok_t* subscribe_ok);
+const uint8_t* pmoq_msg_subscribe_ok_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_subscribe_ok_t* subscribe_ok);
 
-uint8_t* pmoq_msg_subscribe_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_error);
-const uint8_t* pmoq_msg_subscribe_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * subscribe_error);
+uint8_t* pmoq_msg_subscribe_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_subscribe_error_t* subscribe_error);
+const uint8_t* pmoq_msg_subscribe_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_subscribe_error_t* subscribe_error);
 
-uint8_t* pmoq_msg_announce_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * announce);
-const uint8_t* pmoq_msg_announce_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * announce);
+uint8_t* pmoq_msg_announce_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_announce_t* announce);
+const uint8_t* pmoq_msg_announce_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_announce_t* announce);
 
-uint8_t* pmoq_msg_track_namespace_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * announce_ok);
-const uint8_t* pmoq_msg_track_namespace_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * announce_ok);
+uint8_t* pmoq_msg_track_namespace_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_announce_ok_t* announce_ok);
+const uint8_t* pmoq_msg_track_namespace_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_announce_ok_t* announce_ok);
 
-uint8_t* pmoq_msg_announce_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * announce_error);
-const uint8_t* pmoq_msg_announce_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * announce_error);
+uint8_t* pmoq_msg_announce_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_announce_error_t* announce_error);
+const uint8_t* pmoq_msg_announce_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_announce_error_t* announce_error);
 
-uint8_t* pmoq_msg_unsubscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * unsubscribe);
-const uint8_t* pmoq_msg_unsubscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * unsubscribe);
+uint8_t* pmoq_msg_unsubscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_unsubscribe_t* unsubscribe);
+const uint8_t* pmoq_msg_unsubscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_unsubscribe_t* unsubscribe);
 
-uint8_t* pmoq_msg_subscribe_done_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_done);
-const uint8_t* pmoq_msg_subscribe_done_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * subscribe_done);
+uint8_t* pmoq_msg_subscribe_done_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_subscribe_done_t* subscribe_done);
+const uint8_t* pmoq_msg_subscribe_done_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_subscribe_done_t* subscribe_done);
 
-uint8_t* pmoq_msg_track_status_request_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * track_status_request);
-const uint8_t* pmoq_msg_track_status_request_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * track_status_request);
+uint8_t* pmoq_msg_track_status_request_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_track_status_request_t* track_status_request);
+const uint8_t* pmoq_msg_track_status_request_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_track_status_request_t* track_status_request);
 
-uint8_t* pmoq_msg_track_status_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * track_status);
-const uint8_t* pmoq_msg_track_status_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * track_status);
+uint8_t* pmoq_msg_track_status_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_track_status_t* track_status);
+const uint8_t* pmoq_msg_track_status_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_track_status_t* track_status);
 
-uint8_t* pmoq_msg_goaway_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * goaway);
-const uint8_t* pmoq_msg_goaway_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * goaway);
+uint8_t* pmoq_msg_goaway_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_goaway_t* goaway);
+const uint8_t* pmoq_msg_goaway_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_goaway_t* goaway);
 
-uint8_t* pmoq_msg_client_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * client_setup);
-const uint8_t* pmoq_msg_client_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * client_setup);
+uint8_t* pmoq_msg_client_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_client_setup_t* client_setup);
+const uint8_t* pmoq_msg_client_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_client_setup_t* client_setup);
 
-uint8_t* pmoq_msg_server_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * server_setup);
-const uint8_t* pmoq_msg_server_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * server_setup);
+uint8_t* pmoq_msg_server_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_server_setup_t* server_setup);
+const uint8_t* pmoq_msg_server_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_server_setup_t* server_setup);
 
 uint8_t* pmoq_msg_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_msg_t* msg);
 uint8_t* pmoq_msg_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* msg);
@@ -193,6 +436,44 @@ uint8_t* pmoq_msg_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_ms
 const uint8_t* pmoq_msg_keyed_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t msg_type, pmoq_msg_t* msg);
 const uint8_t* pmoq_msg_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* msg);
 
+/* Track namespace of the message, or NULL if the message type has none */
+pmoq_tuple_t* pmoq_msg_keyed_namespace(uint64_t msg_type, pmoq_msg_t* msg);
+pmoq_tuple_t* pmoq_msg_namespace(pmoq_msg_t* msg);
+
+/* Exact number of bytes that the _format() functions would write,
+ * computed without encoding anything. Returns 0 if the message cannot
+ * be encoded, e.g., unknown type or integer value above 2^62.
+ */
+size_t pmoq_msg_keyed_encoded_size(uint64_t msg_type, const pmoq_msg_t* msg);
+size_t pmoq_msg_encoded_size(const pmoq_msg_t* msg);
+
+/* Resumable parser for the control stream.
+ * The data is fed as it arrives, in segments of any size. The parser
+ * keeps track of the current field between calls, so each byte is
+ * decoded only once. Strings, parameter values and namespace items
+ * are copied in the parser's storage, and the segments need not be kept.
+ * pmoq_msg_parser_feed() returns a pointer to the first unused byte,
+ * which is bytes_max unless a message was completed before, or NULL
+ * with *err set to -1 if the message is malformed.
+ * pmoq_msg_parser_next() returns the completed message, or NULL if
+ * more data is needed. The message remains valid until the next call
+ * to pmoq_msg_parser_feed().
+ * The messages are decoded with the default codec until another one is
+ * set with pmoq_msg_parser_set_codec(), e.g., once the version is
+ * negotiated. The codecs are described below. The parameters are
+ * decoded with the registry set with pmoq_msg_parser_set_registry(), or
+ * with the keys known to the library if it is not set.
+ */
+typedef struct st_pmoq_msg_parser_t pmoq_msg_parser_t;
+typedef struct st_pmoq_codec_t pmoq_codec_t;
+
+pmoq_msg_parser_t* pmoq_msg_parser_create();
+void pmoq_msg_parser_delete(pmoq_msg_parser_t* parser);
+const uint8_t* pmoq_msg_parser_feed(pmoq_msg_parser_t* parser, const uint8_t* bytes, const uint8_t* bytes_max, int* err);
+const pmoq_msg_t* pmoq_msg_parser_next(pmoq_msg_parser_t* parser);
+void pmoq_msg_parser_set_codec(pmoq_msg_parser_t* parser, const pmoq_codec_t* codec);
+void pmoq_msg_parser_set_registry(pmoq_msg_parser_t* parser, const pmoq_param_registry_t* registry);
+
 
 typedef struct st_pmoq_strm_t {
     uint64_t msg_type;
@@ -220,9 +501,171 @@ const uint8_t* pmoq_strm_header_subgroup_parse(const uint8_t* bytes, const uint8
 uint8_t* pmoq_strm_object_subgroup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object);
 const uint8_t* pmoq_strm_object_subgroup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* object);
 
+/* Scatter-gather formatting of objects. The header is written in the
+ * buffer provided by the caller, which can be as small as
+ * PMOQ_STRM_HEADER_SIZE_MAX, and iov is set to { header, payload }. The
+ * payload is referenced, not copied; it must remain valid until sent.
+ * Returns a pointer to the end of the header, or NULL if the header
+ * does not fit. *nb_iov is 1 if the payload is empty, 2 otherwise.
+ * pmoq_iovec_gather() copies length bytes starting at offset in the
+ * concatenation of the iovec, e.g., into the packet buffer provided by
+ * picoquic_provide_stream_data_buffer(), and returns the number of
+ * bytes copied.
+ */
+#define PMOQ_STRM_HEADER_SIZE_MAX 64
+
+typedef struct st_pmoq_iovec_t {
+    const uint8_t* base;
+    size_t len;
+} pmoq_iovec_t;
+
+uint8_t* pmoq_strm_object_datagram_format_iov(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* datagram,
+    const uint8_t* payload, pmoq_iovec_t iov[2], size_t* nb_iov);
+uint8_t* pmoq_strm_object_subgroup_format_iov(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object,
+    const uint8_t* payload, pmoq_iovec_t iov[2], size_t* nb_iov);
+size_t pmoq_iovec_gather(uint8_t* bytes, size_t length, const pmoq_iovec_t* iov, size_t nb_iov, size_t offset);
+
+/* Batch parsing of the objects that follow the header of a subgroup stream.
+ * Each object is encoded as object ID, payload length, object status if the
+ * length is 0, then the payload. One record is filled for each object
+ * whose header and payload are complete in the buffer, up to objects_max.
+ * The payload offset is counted from the start of the buffer, so payloads
+ * can be forwarded without copying.
+ * Returns a pointer to the first byte that was not consumed, i.e., the
+ * start of the incomplete tail, with *err set to the number of bytes
+ * missing to complete the next object, or 0 if the buffer ends on an
+ * object boundary or objects_max was reached. Returns NULL with *err set
+ * to -1 if an object is malformed.
+ * The layout of the objects is that of the codec, see pmoq_codec_get();
+ * pmoq_strm_subgroup_parse_batch() uses the default codec.
+ */
+typedef struct st_pmoq_strm_object_ref_t {
+    uint64_t object_id;
+    uint64_t payload_length;
+    uint64_t object_status;
+    size_t payload_offset;
+} pmoq_strm_object_ref_t;
+
+const uint8_t* pmoq_strm_subgroup_parse_batch(const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    pmoq_strm_object_ref_t* objects, size_t objects_max, size_t* nb_objects);
+const uint8_t* pmoq_codec_subgroup_parse_batch(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    pmoq_strm_object_ref_t* objects, size_t objects_max, size_t* nb_objects);
+
 uint8_t* pmoq_strm_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_strm_t* msg);
 const uint8_t* pmoq_strm_keyed_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t msg_type, pmoq_strm_t* msg);
 
+uint8_t* pmoq_strm_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* msg);
+const uint8_t* pmoq_strm_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* msg);
+
+size_t pmoq_strm_object_datagram_size(const pmoq_strm_t* datagram);
+size_t pmoq_strm_header_track_size(const pmoq_strm_t* header_track);
+size_t pmoq_strm_object_track_size(const pmoq_strm_t* object);
+size_t pmoq_strm_header_subgroup_size(const pmoq_strm_t* header_subgroup);
+size_t pmoq_strm_object_subgroup_size(const pmoq_strm_t* object);
+size_t pmoq_strm_keyed_encoded_size(uint64_t msg_type, const pmoq_strm_t* msg);
+size_t pmoq_strm_encoded_size(const pmoq_strm_t* msg);
+
+/* Codecs. Each version of the protocol has a codec, i.e., the layouts of
+ * its messages. The session selects the codec of the version negotiated
+ * in CLIENT_SETUP and SERVER_SETUP, and the pmoq_codec_ functions encode
+ * and decode with that codec, without testing the version for each
+ * message. The functions without codec argument use the codec of
+ * PMOQ_VERSION_DRAFT_07.
+ * pmoq_codec_get() returns NULL if the version is not supported.
+ * The pmoq_codec_object_ functions process the objects that follow a
+ * stream header of type header_type, PMOQ_STRM_HEADER_TRACK or
+ * PMOQ_STRM_HEADER_SUBGROUP.
+ */
+const pmoq_codec_t* pmoq_codec_get(uint32_t version);
+uint32_t pmoq_codec_version(const pmoq_codec_t* codec);
+
+uint8_t* pmoq_codec_msg_format(const pmoq_codec_t* codec, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* msg);
+size_t pmoq_codec_msg_encoded_size(const pmoq_codec_t* codec, const pmoq_msg_t* msg);
+const uint8_t* pmoq_codec_msg_parse(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* msg);
+
+uint8_t* pmoq_codec_strm_format(const pmoq_codec_t* codec, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* msg);
+size_t pmoq_codec_strm_encoded_size(const pmoq_codec_t* codec, const pmoq_strm_t* msg);
+const uint8_t* pmoq_codec_strm_parse(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* msg);
+
+uint8_t* pmoq_codec_object_format(const pmoq_codec_t* codec, uint64_t header_type, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object);
+size_t pmoq_codec_object_size(const pmoq_codec_t* codec, uint64_t header_type, const pmoq_strm_t* object);
+const uint8_t* pmoq_codec_object_parse(const pmoq_codec_t* codec, uint64_t header_type, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* object);
+
+/* Validation without decoding, e.g., for a relay that forwards messages
+ * as opaque byte ranges. The skip functions check the structure of the
+ * message as the parse functions do, but write no field: they return a
+ * pointer to the end of the message, so that its length is the
+ * difference, and set *msg_type to its type. As when parsing, they
+ * return NULL with *err set to the number of bytes missing, or to -1 if
+ * the message is malformed or its type is unknown. The values of the
+ * parameters are not checked.
+ * pmoq_codec_strm_skip() skips a stream header or the header of an object
+ * datagram, whose payload is the rest of the datagram.
+ * pmoq_codec_object_skip() skips an object that follows a stream header,
+ * with its payload.
+ */
+const uint8_t* pmoq_codec_msg_skip(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type);
+const uint8_t* pmoq_codec_strm_skip(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type);
+const uint8_t* pmoq_codec_object_skip(const pmoq_codec_t* codec, uint64_t header_type, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed);
+const uint8_t* pmoq_msg_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type);
+const uint8_t* pmoq_strm_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type);
+
+/* Lazy view of a control message, e.g., to reject a SUBSCRIBE from its
+ * subscribe_id and track_alias without decoding the namespace, the track
+ * name and the parameters. pmoq_msg_view() scans the message once, as
+ * pmoq_msg_skip() does, and records where each field starts; it returns
+ * the end of the message, or NULL with *err set as when parsing. The
+ * view points into the bytes, which must be kept until the fields are
+ * decoded.
+ * The fields are designated by the message type and their offset in
+ * pmoq_msg_t, obtained with PMOQ_MSG_VIEW_FIELD(), e.g.,
+ * PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_alias).
+ * pmoq_msg_view_varint() decodes a numeric field; pmoq_msg_view_field()
+ * decodes any field into the corresponding member of "msg", and the
+ * namespace items into the array msg->namespace_items, as without arena.
+ * Both return -1 if the message has no such field, including if it is
+ * not of the designated type, if the field is absent, e.g., end_group of
+ * a subscribe without range, or if its value is malformed.
+ */
+#define PMOQ_MSG_VIEW_FIELDS_MAX 12
+#define PMOQ_MSG_VIEW_ABSENT UINT32_MAX
+#define PMOQ_MSG_VIEW_FIELD(type, m, f) ((pmoq_msg_view_field_t){ (type), offsetof(pmoq_msg_t, u.m.f) })
+
+typedef struct st_pmoq_msg_view_field_t {
+    uint64_t msg_type;
+    size_t offset;
+} pmoq_msg_view_field_t;
+
+typedef struct st_pmoq_msg_view_t {
+    uint64_t msg_type;
+    const struct st_pmoq_msg_def_t* def;
+    /* Fields of the message, after the type */
+    const uint8_t* bytes;
+    const uint8_t* bytes_end;
+    uint32_t starts[PMOQ_MSG_VIEW_FIELDS_MAX];
+} pmoq_msg_view_t;
+
+const uint8_t* pmoq_codec_msg_view(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_view_t* view);
+const uint8_t* pmoq_msg_view(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_view_t* view);
+int pmoq_msg_view_varint(const pmoq_msg_view_t* view, pmoq_msg_view_field_t field, uint64_t* v);
+int pmoq_msg_view_field(const pmoq_msg_view_t* view, pmoq_msg_view_field_t field, pmoq_msg_t* msg);
+
+/* Decoder used for the object headers on the data path, see varint_fast.c.
+ * The SWAR decoder extracts each varint from a single 64 bit load; the
+ * scalar decoder reads the bytes one by one. Both produce the same results.
+ * The library uses the fastest decoder for the host, chosen at compile
+ * time, i.e., auto. The selection is meant for tests and benchmarks: it is
+ * not synchronized, and must not happen while other threads parse objects.
+ * Returns the decoder actually selected.
+ */
+typedef enum {
+    pmoq_varint_decoder_auto = 0,
+    pmoq_varint_decoder_scalar,
+    pmoq_varint_decoder_swar
+} pmoq_varint_decoder_enum;
+
+pmoq_varint_decoder_enum pmoq_varint_decoder_select(pmoq_varint_decoder_enum mode);
+
 #ifdef __cplusplus
 }
 #endif
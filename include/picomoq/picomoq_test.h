@@ -8,6 +8,65 @@ extern "C" {
 int pmoq_msg_format_test_parse();
 int pmoq_msg_format_test_format();
 int pmoq_msg_format_test_varlen();
+int pmoq_msg_format_test_stream();
+int pmoq_msg_format_test_size();
+int pmoq_msg_format_test_arena();
+int pmoq_msg_format_test_fast_decode();
+int pmoq_msg_format_test_subgroup_batch();
+int pmoq_msg_format_test_iov();
+int pmoq_msg_format_test_codec();
+int pmoq_msg_format_test_skip();
+int pmoq_msg_format_test_view();
+int pmoq_session_test_setup();
+int pmoq_session_test_errors();
+int pmoq_cache_test_basic();
+int pmoq_cache_test_eviction();
+int pmoq_cache_test_expiry();
+int pmoq_subs_test_basic();
+int pmoq_subs_test_scale();
+int pmoq_ns_test_basic();
+int pmoq_ns_test_scale();
+int pmoq_intern_test_basic();
+int pmoq_sched_test_order();
+int pmoq_sched_test_deadline();
+int pmoq_timer_test_wheel();
+int pmoq_dgram_test_relay();
+int pmoq_dgram_test_drops();
+int pmoq_shard_test_route();
+int pmoq_shard_test_threads();
+int pmoq_sendq_test_fanout();
+int pmoq_sendq_test_refcount();
+int pmoq_stats_test_histo();
+int pmoq_stats_test_counts();
+int pmoq_params_test_registry();
+int pmoq_params_test_decode();
+
+int pmoq_format_bench(FILE* F, uint64_t nb_iterations, int is_csv);
+
+/* End to end relay benchmark, over simulated links. Times in microseconds,
+ * link rate in bits per second. */
+typedef struct st_pmoq_relay_bench_config_t {
+    size_t nb_subscribers;
+    uint64_t duration;
+    uint64_t link_latency;
+    uint64_t link_rate;
+    char const* cert_file;
+    char const* key_file;
+} pmoq_relay_bench_config_t;
+
+int pmoq_relay_bench(FILE* F, const pmoq_relay_bench_config_t* config, int is_csv);
+
+/* Loopback benchmark of the sharded relay, with 1, 2, 4... up to
+ * nb_shards_max shards. Duration of each run in microseconds. */
+typedef struct st_pmoq_shard_bench_config_t {
+    size_t nb_shards_max;
+    uint64_t duration;
+    uint16_t port;
+    char const* cert_file;
+    char const* key_file;
+} pmoq_shard_bench_config_t;
+
+int pmoq_shard_bench(FILE* F, const pmoq_shard_bench_config_t* config, int is_csv);
 #ifdef __cplusplus
 }
 #endif
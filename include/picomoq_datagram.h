@@ -0,0 +1,80 @@
+#ifndef PICOMOQ_DATAGRAM_H
+#define PICOMOQ_DATAGRAM_H
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Object datagrams.
+ *
+ * Each connection that sends or receives OBJECT_DATAGRAM has a datagram
+ * context. On the send side, pmoq_dgram_send() formats the header of the
+ * object at once and queues it with a reference to the cached payload, so
+ * that answering picoquic only costs a copy of the header and payload
+ * into the packet. The queue holds up to queue_max datagrams, in order.
+ * When it is full, e.g., because the congestion controller does not let
+ * the datagrams out, the oldest is dropped, since the most recent
+ * objects matter most on the tracks that use datagrams. Objects whose
+ * datagram would exceed max_datagram_size, typically the max_datagram_
+ * frame_size of the peer, are dropped when queued. picoquic is told that
+ * datagrams are ready when the queue stops being empty.
+ *
+ * On picoquic_callback_prepare_datagram, pmoq_dgram_picoquic_prepare()
+ * provides the next datagram if it fits in the space left in the packet,
+ * and keeps the datagrams active while the queue is not empty. The same
+ * can be done without picoquic with pmoq_dgram_next_size() and
+ * pmoq_dgram_write_next(), which returns NULL if the datagram does not
+ * fit in the buffer.
+ *
+ * On picoquic_callback_datagram, pmoq_dgram_receive() parses the frame
+ * and adds the object to the cache, copying the payload from the frame
+ * directly. The payload must fill the rest of the frame. Returns the
+ * cached object, or NULL if the datagram is malformed or the object
+ * cannot be cached.
+ *
+ * The headers are encoded and decoded with the codec of the session,
+ * set by pmoq_dgram_set_codec(), or the default codec.
+ */
+typedef struct st_pmoq_dgram_t pmoq_dgram_t;
+
+typedef struct st_pmoq_dgram_stats_t {
+    uint64_t nb_queued;
+    uint64_t nb_sent;
+    uint64_t nb_received;
+    /* Datagram larger than max_datagram_size */
+    uint64_t drops_too_large;
+    /* Oldest datagram dropped because the queue was full */
+    uint64_t drops_congestion;
+    uint64_t drops_malformed;
+    /* Received object that the cache did not accept */
+    uint64_t drops_not_cached;
+} pmoq_dgram_stats_t;
+
+#define PMOQ_DGRAM_QUEUE_MAX_DEFAULT 64
+
+/* cnx may be NULL, e.g., in tests. A queue_max of 0 selects the default. */
+pmoq_dgram_t* pmoq_dgram_create(picoquic_cnx_t* cnx, size_t queue_max, size_t max_datagram_size);
+/* The payload references of the datagrams still queued are released */
+void pmoq_dgram_delete(pmoq_dgram_t* dgram);
+void pmoq_dgram_set_codec(pmoq_dgram_t* dgram, const pmoq_codec_t* codec);
+void pmoq_dgram_set_max_size(pmoq_dgram_t* dgram, size_t max_datagram_size);
+size_t pmoq_dgram_count(const pmoq_dgram_t* dgram);
+void pmoq_dgram_stats(const pmoq_dgram_t* dgram, pmoq_dgram_stats_t* stats);
+
+/* The header is that of OBJECT_DATAGRAM; msg_type is ignored. The payload
+ * holds at least header->payload_length bytes, and may be NULL if the
+ * length is 0. Returns -1 if the datagram is dropped. */
+int pmoq_dgram_send(pmoq_dgram_t* dgram, const pmoq_strm_t* header, pmoq_cache_payload_t* payload);
+/* Size of the next datagram, or 0 if the queue is empty */
+size_t pmoq_dgram_next_size(const pmoq_dgram_t* dgram);
+uint8_t* pmoq_dgram_write_next(pmoq_dgram_t* dgram, uint8_t* bytes, const uint8_t* bytes_max);
+int pmoq_dgram_picoquic_prepare(pmoq_dgram_t* dgram, void* context, size_t length);
+
+pmoq_cache_object_t* pmoq_dgram_receive(pmoq_dgram_t* dgram, pmoq_cache_t* cache, const uint8_t* bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_DATAGRAM_H */
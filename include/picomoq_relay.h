@@ -0,0 +1,226 @@
+#ifndef PICOMOQ_RELAY_H
+#define PICOMOQ_RELAY_H
+#include "picomoq.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Data structures used by relays.
+*/
+
+/* Object cache.
+ *
+ * Objects are cached per track alias, in a ring of the most recent
+ * groups: the group G is kept in slot G % ring_size, so finding an
+ * object by (group, object) is two array lookups. Within a group the
+ * objects are stored by object ID, counted from the lowest ID received.
+ *
+ * The payloads are reference counted. A subscriber that is sending an
+ * object takes a reference with pmoq_cache_payload_ref(), and the payload
+ * stays valid after the object is evicted, until the matching
+ * pmoq_cache_payload_unref(). The reference counts are atomic, so the
+ * references to a payload can be passed to and released by the other
+ * threads of a sharded relay. The payload itself must not be modified once
+ * shared. pmoq_cache_payload_create() allocates a payload outside of the
+ * cache, with one reference.
+ *
+ * The memory used by the payloads is bounded by the budget set at
+ * creation. When it is exceeded, whole groups are evicted, oldest first
+ * across all tracks. Groups are also evicted when a group that is more
+ * recent by ring_size or more arrives on the same track.
+ */
+#define PMOQ_CACHE_RING_SIZE_DEFAULT 4
+#define PMOQ_CACHE_GROUP_OBJECTS_MAX 0x10000
+#define PMOQ_CACHE_OBJECT_OVERHEAD 64
+
+typedef struct st_pmoq_cache_t pmoq_cache_t;
+typedef struct st_pmoq_cache_group_t pmoq_cache_group_t;
+
+typedef struct st_pmoq_cache_payload_t {
+    size_t refcount;
+    size_t length;
+    uint8_t* data;
+} pmoq_cache_payload_t;
+
+typedef struct st_pmoq_cache_object_t {
+    uint64_t object_id;
+    uint64_t object_status;
+    uint64_t payload_length;
+    /* Number of bytes of the payload received so far */
+    uint64_t received;
+    pmoq_cache_payload_t* payload;
+    uint8_t publisher_priority;
+    uint8_t is_present;
+} pmoq_cache_object_t;
+
+pmoq_cache_t* pmoq_cache_create(size_t memory_budget, size_t ring_size);
+void pmoq_cache_delete(pmoq_cache_t* cache);
+size_t pmoq_cache_memory_used(const pmoq_cache_t* cache);
+
+/* Add an object, from the parsed stream or datagram header. For objects
+ * received on subgroup streams, the header combines the track alias and
+ * group ID of the stream header with the fields of the object.
+ * pmoq_cache_add_object() copies the whole payload. pmoq_cache_start_object()
+ * only reserves it, and the payload is then copied as it arrives with
+ * pmoq_cache_append_object(). Both return NULL if the object cannot be
+ * cached: group too old for the ring, object larger than the budget,
+ * or object ID too far from the first in the group. Adding an object
+ * that is already present returns the cached object. */
+pmoq_cache_object_t* pmoq_cache_add_object(pmoq_cache_t* cache, const pmoq_strm_t* header, const uint8_t* payload);
+pmoq_cache_object_t* pmoq_cache_start_object(pmoq_cache_t* cache, const pmoq_strm_t* header);
+int pmoq_cache_append_object(pmoq_cache_object_t* object, const uint8_t* bytes, size_t length);
+int pmoq_cache_object_is_complete(const pmoq_cache_object_t* object);
+
+pmoq_cache_object_t* pmoq_cache_get_object(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id, uint64_t object_id);
+pmoq_cache_group_t* pmoq_cache_get_group(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id);
+/* Most recent group of the track, e.g., for pmoq_msg_filter_latest_group.
+ * Returns -1 if nothing is cached for the track. */
+int pmoq_cache_latest_group(pmoq_cache_t* cache, uint64_t track_alias, uint64_t* group_id);
+void pmoq_cache_remove_track(pmoq_cache_t* cache, uint64_t track_alias);
+
+/* Objects of a group, by increasing object ID. Ranks between
+ * 0 and pmoq_cache_group_span() may be absent (NULL). */
+uint64_t pmoq_cache_group_id(const pmoq_cache_group_t* group);
+size_t pmoq_cache_group_span(const pmoq_cache_group_t* group);
+pmoq_cache_object_t* pmoq_cache_group_object(pmoq_cache_group_t* group, size_t rank);
+
+pmoq_cache_payload_t* pmoq_cache_payload_create(size_t length);
+void pmoq_cache_payload_ref(pmoq_cache_payload_t* payload);
+void pmoq_cache_payload_unref(pmoq_cache_payload_t* payload);
+size_t pmoq_cache_payload_refcount(const pmoq_cache_payload_t* payload);
+
+/* Max cache duration, in microseconds.
+ *
+ * A group of a track with a max duration is evicted when that duration
+ * has elapsed since its first object was added, which is no later than
+ * the expiry of each of its objects. The duration applies to the groups
+ * created after it is set. The time is that of the last call to
+ * pmoq_cache_expire(), which evicts the groups that have expired and
+ * returns their number; pmoq_cache_next_expiry() returns the time of the
+ * next expiry, or UINT64_MAX.
+ */
+#define PMOQ_CACHE_DURATION_UNLIMITED UINT64_MAX
+
+int pmoq_cache_set_max_duration(pmoq_cache_t* cache, uint64_t track_alias, uint64_t max_duration);
+size_t pmoq_cache_expire(pmoq_cache_t* cache, uint64_t current_time);
+uint64_t pmoq_cache_next_expiry(const pmoq_cache_t* cache);
+
+/* Subscription table.
+ *
+ * Subscriptions are identified by (connection ID, subscribe ID), where the
+ * connection ID is chosen by the application, and attached to a track key,
+ * typically the track alias of the upstream track. Two open addressing
+ * hash tables index them: by (connection ID, subscribe ID) for the
+ * SUBSCRIBE_UPDATE and UNSUBSCRIBE messages, and by track key for the
+ * objects. For each track key, the subscriptions form a contiguous
+ * fan-out array that also holds the start and end of each filter, so
+ * matching an object scans a single array.
+ *
+ * The start of the latest group and latest object filters is set by the
+ * first object matched after the subscription. For absolute ranges, an
+ * end object of 0 means the whole end group.
+ * The pointers returned by the table are valid until the next addition
+ * or removal.
+ */
+typedef struct st_pmoq_subs_t pmoq_subs_t;
+
+typedef struct st_pmoq_subscription_t {
+    uint64_t connection_id;
+    uint64_t subscribe_id;
+    uint64_t track_alias;
+    uint64_t track_key;
+    uint64_t filter_type;
+    void* app_ctx;
+} pmoq_subscription_t;
+
+pmoq_subs_t* pmoq_subs_create();
+void pmoq_subs_delete(pmoq_subs_t* subs);
+size_t pmoq_subs_count(const pmoq_subs_t* subs);
+
+/* Returns -1 if the subscribe ID is already used on the connection, or
+ * if the filter is invalid. */
+int pmoq_subs_add(pmoq_subs_t* subs, uint64_t connection_id, uint64_t track_key,
+    const pmoq_subscribe_t* subscribe, void* app_ctx);
+int pmoq_subs_update(pmoq_subs_t* subs, uint64_t connection_id, const pmoq_subscribe_update_t* update);
+int pmoq_subs_remove(pmoq_subs_t* subs, uint64_t connection_id, uint64_t subscribe_id);
+void pmoq_subs_remove_connection(pmoq_subs_t* subs, uint64_t connection_id);
+pmoq_subscription_t* pmoq_subs_find(pmoq_subs_t* subs, uint64_t connection_id, uint64_t subscribe_id);
+
+/* Subscriptions of the track whose filter includes the object. Up to
+ * matches_max are returned per call; *cursor is set to 0 before the
+ * first call and updated, so that the next call continues the scan. */
+size_t pmoq_subs_match(pmoq_subs_t* subs, uint64_t track_key, uint64_t group_id, uint64_t object_id,
+    size_t* cursor, pmoq_subscription_t** matches, size_t matches_max);
+
+/* Track namespace trie.
+ *
+ * Indexes namespace tuples, e.g., the prefixes of SUBSCRIBE_NAMESPACE or
+ * the namespaces of ANNOUNCE, with one node per tuple item. Each namespace
+ * holds a list of entries, one per owner ID, typically the connection
+ * that sent the message. Entries are removed one by one on UNANNOUNCE,
+ * ANNOUNCE_CANCEL or UNSUBSCRIBE_NAMESPACE, or all the entries of an
+ * owner when the connection closes.
+ *
+ * pmoq_ns_trie_prefixes() calls fn for the entries of the namespaces that
+ * are prefixes of ns, ns included, from the shortest; the cost depends on
+ * the number of items of ns, not on the size of the trie. This matches an
+ * ANNOUNCE against the namespace subscriptions. pmoq_ns_trie_subtree()
+ * calls fn for the entries of the namespaces that start with the prefix,
+ * for matching a new SUBSCRIBE_NAMESPACE against the announcements. The
+ * depth passed to fn is the number of items of the namespace. The walks
+ * stop when fn returns a non zero value, which they return. The trie must
+ * not be modified from fn.
+ */
+typedef struct st_pmoq_ns_trie_t pmoq_ns_trie_t;
+
+typedef struct st_pmoq_ns_entry_t {
+    uint64_t owner_id;
+    void* app_ctx;
+} pmoq_ns_entry_t;
+
+typedef int (*pmoq_ns_trie_fn)(void* callback_ctx, const pmoq_ns_entry_t* entry, size_t depth);
+
+pmoq_ns_trie_t* pmoq_ns_trie_create();
+void pmoq_ns_trie_delete(pmoq_ns_trie_t* trie);
+size_t pmoq_ns_trie_count(const pmoq_ns_trie_t* trie);
+/* Returns -1 if the owner already has an entry for the namespace */
+int pmoq_ns_trie_add(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, uint64_t owner_id, void* app_ctx);
+int pmoq_ns_trie_remove(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, uint64_t owner_id);
+void pmoq_ns_trie_remove_owner(pmoq_ns_trie_t* trie, uint64_t owner_id);
+int pmoq_ns_trie_prefixes(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, pmoq_ns_trie_fn fn, void* callback_ctx);
+int pmoq_ns_trie_subtree(pmoq_ns_trie_t* trie, const pmoq_tuple_t* prefix, pmoq_ns_trie_fn fn, void* callback_ctx);
+
+/* Interned full track names.
+ *
+ * The namespace and name of a track, as parsed, point into the receive
+ * buffer. pmoq_intern_track() copies them once in the table, and returns
+ * an ID that stays the same for as long as the name is referenced, so that
+ * the other tables can use it as an integer key, e.g., as track key of
+ * the subscription table. Each call to pmoq_intern_track() or
+ * pmoq_intern_ref() takes a reference, released by pmoq_intern_release();
+ * the ID may be reused once all references are released.
+ * pmoq_intern_find() returns the ID without taking a reference.
+ *
+ * pmoq_intern_get() sets the namespace items and the name to point to
+ * the copy held by the table; the caller provides the items array, as
+ * when parsing.
+ */
+#define PMOQ_INTERN_ID_NONE 0
+
+typedef struct st_pmoq_intern_t pmoq_intern_t;
+typedef uint32_t pmoq_intern_id_t;
+
+pmoq_intern_t* pmoq_intern_create();
+void pmoq_intern_delete(pmoq_intern_t* intern);
+size_t pmoq_intern_count(const pmoq_intern_t* intern);
+pmoq_intern_id_t pmoq_intern_track(pmoq_intern_t* intern, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name);
+pmoq_intern_id_t pmoq_intern_find(pmoq_intern_t* intern, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name);
+void pmoq_intern_ref(pmoq_intern_t* intern, pmoq_intern_id_t id);
+void pmoq_intern_release(pmoq_intern_t* intern, pmoq_intern_id_t id);
+uint64_t pmoq_intern_hash(const pmoq_intern_t* intern, pmoq_intern_id_t id);
+int pmoq_intern_get(const pmoq_intern_t* intern, pmoq_intern_id_t id, pmoq_tuple_t* track_namespace, pmoq_bits_t* track_name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_RELAY_H */
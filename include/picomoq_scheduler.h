@@ -0,0 +1,102 @@
+#ifndef PICOMOQ_SCHEDULER_H
+#define PICOMOQ_SCHEDULER_H
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_timer.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Send scheduler.
+ *
+ * Orders the objects waiting to be sent on a connection, by subscriber
+ * priority, then publisher priority, then group ID in the group order of
+ * the subscription, then object ID. For priorities, lower values are
+ * sent first. Between subscriptions that use different group orders,
+ * the group order is compared before the group ID. Pending objects are
+ * kept in a binary heap, so adding, updating or removing an entry costs
+ * O(log n).
+ *
+ * The entries are provided by the application, typically in the context
+ * of each subgroup stream, and the scheduler does not allocate them. The
+ * entries are zeroed before first use. An
+ * entry is in the scheduler from pmoq_sched_push() until it is removed
+ * or popped. After changing the group or object of a queued entry, e.g.,
+ * when the stream moves on to its next object, the application calls
+ * pmoq_sched_update().
+ *
+ * Datagrams are scheduled by popping the first entry when picoquic asks
+ * for a datagram. For streams, picoquic chooses which stream sends next;
+ * pmoq_sched_picoquic_activate() sets the picoquic priority of the stream
+ * from the entry, see pmoq_sched_stream_priority(), and marks the stream
+ * active, or the datagram ready.
+ */
+#define PMOQ_GROUP_ORDER_ASCENDING 1
+#define PMOQ_GROUP_ORDER_DESCENDING 2
+
+#define PMOQ_SCHED_DATAGRAM UINT64_MAX
+
+typedef struct st_pmoq_sched_t pmoq_sched_t;
+
+typedef struct st_pmoq_sched_entry_t {
+    uint8_t subscriber_priority;
+    uint8_t publisher_priority;
+    uint8_t group_order;
+    uint64_t group_id;
+    uint64_t object_id;
+    /* Stream of the object, or PMOQ_SCHED_DATAGRAM */
+    uint64_t stream_id;
+    void* app_ctx;
+    /* Managed by the scheduler */
+    size_t heap_index;
+    pmoq_timer_t deadline;
+} pmoq_sched_entry_t;
+
+pmoq_sched_t* pmoq_sched_create();
+void pmoq_sched_delete(pmoq_sched_t* sched);
+size_t pmoq_sched_count(const pmoq_sched_t* sched);
+
+/* Returns -1 if the entry is already queued */
+int pmoq_sched_push(pmoq_sched_t* sched, pmoq_sched_entry_t* entry);
+void pmoq_sched_update(pmoq_sched_t* sched, pmoq_sched_entry_t* entry);
+void pmoq_sched_remove(pmoq_sched_t* sched, pmoq_sched_entry_t* entry);
+int pmoq_sched_is_queued(const pmoq_sched_t* sched, const pmoq_sched_entry_t* entry);
+pmoq_sched_entry_t* pmoq_sched_peek(pmoq_sched_t* sched);
+pmoq_sched_entry_t* pmoq_sched_pop(pmoq_sched_t* sched);
+/* Negative if a is sent before b */
+int pmoq_sched_compare(const pmoq_sched_entry_t* a, const pmoq_sched_entry_t* b);
+
+/* picoquic has 8 bits of stream priority, lower first. The subscriber
+ * priority is kept in the upper 4 bits and the publisher priority in the
+ * next 3, so the order between streams is coarser than in the heap. The
+ * lowest bit is set: picoquic sends the streams of an odd priority in
+ * order of stream ID, i.e., older groups first, and those of an even
+ * priority round robin. */
+uint8_t pmoq_sched_stream_priority(const pmoq_sched_entry_t* entry);
+int pmoq_sched_picoquic_activate(picoquic_cnx_t* cnx, pmoq_sched_entry_t* entry);
+
+/* Delivery timeout.
+ *
+ * pmoq_sched_set_deadline() sets the time by which the current object of
+ * the entry must be sent, typically the time the object was received
+ * plus the delivery timeout of the subscription, in microseconds. The
+ * deadline holds whether the entry is queued or has been popped and is
+ * being sent, until it is cleared, e.g., when the object is sent and the
+ * entry moves on to the next object. pmoq_sched_expire() removes the
+ * entries whose deadline has passed from the scheduler and calls fn for
+ * each; fn then drops the datagram or resets the stream, e.g., with
+ * pmoq_sched_picoquic_drop(). The deadline of an entry must be cleared
+ * before the entry is released.
+ */
+typedef void (*pmoq_sched_expired_fn)(void* callback_ctx, pmoq_sched_entry_t* entry);
+
+void pmoq_sched_set_deadline(pmoq_sched_t* sched, pmoq_sched_entry_t* entry, uint64_t deadline);
+void pmoq_sched_clear_deadline(pmoq_sched_t* sched, pmoq_sched_entry_t* entry);
+size_t pmoq_sched_expire(pmoq_sched_t* sched, uint64_t current_time, pmoq_sched_expired_fn fn, void* callback_ctx);
+uint64_t pmoq_sched_next_deadline(const pmoq_sched_t* sched);
+int pmoq_sched_picoquic_drop(picoquic_cnx_t* cnx, const pmoq_sched_entry_t* entry, uint64_t error_code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_SCHEDULER_H */
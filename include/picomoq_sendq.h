@@ -0,0 +1,65 @@
+#ifndef PICOMOQ_SENDQ_H
+#define PICOMOQ_SENDQ_H
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Stream send queues.
+ *
+ * A relay that forwards an object to many subscribers receives the
+ * payload once, in the cache, and shares it between the subscribers. Each
+ * subgroup or track stream sent to a subscriber has a send queue, in the
+ * context of the stream. Queuing an object only formats its header, a few
+ * bytes, and takes a reference to the payload, so that the cost per
+ * subscriber does not depend on the size of the object; the payload is
+ * copied once per subscriber, into the packet, when picoquic asks for
+ * the stream data. The datagrams are sent the same way, see
+ * pmoq_dgram_send().
+ *
+ * pmoq_sendq_push_header() queues the stream header, PMOQ_STRM_HEADER_TRACK
+ * or PMOQ_STRM_HEADER_SUBGROUP, which carries the subscribe ID and track
+ * alias of the subscriber; it must come first. pmoq_sendq_push_object()
+ * then queues the objects, with the layout of that header type. The
+ * payload holds at least object->payload_length bytes, and may be NULL if
+ * the length is 0. pmoq_sendq_finish() closes the stream after the
+ * queued data. Nothing can be queued after that.
+ *
+ * On picoquic_callback_prepare_to_send, pmoq_sendq_picoquic_prepare()
+ * provides as much of the queued data as fits, with the FIN once all is
+ * sent. The same can be done without picoquic with pmoq_sendq_output().
+ * The payload references are released as the objects are sent, or when
+ * the queue is deleted. If cnx is set, the stream is marked active when
+ * the queue stops being empty.
+ *
+ * The headers are encoded with the codec of the session, set by
+ * pmoq_sendq_set_codec(), or the default codec.
+ */
+typedef struct st_pmoq_sendq_t pmoq_sendq_t;
+
+/* cnx may be NULL, e.g., in tests */
+pmoq_sendq_t* pmoq_sendq_create(picoquic_cnx_t* cnx, uint64_t stream_id);
+void pmoq_sendq_delete(pmoq_sendq_t* sendq);
+void pmoq_sendq_set_codec(pmoq_sendq_t* sendq, const pmoq_codec_t* codec);
+
+int pmoq_sendq_push_header(pmoq_sendq_t* sendq, const pmoq_strm_t* header);
+int pmoq_sendq_push_object(pmoq_sendq_t* sendq, const pmoq_strm_t* object, pmoq_cache_payload_t* payload);
+int pmoq_sendq_finish(pmoq_sendq_t* sendq);
+
+/* Number of headers and objects not yet fully sent, and number of bytes */
+size_t pmoq_sendq_count(const pmoq_sendq_t* sendq);
+size_t pmoq_sendq_pending(const pmoq_sendq_t* sendq);
+/* All the data and the FIN are sent */
+int pmoq_sendq_is_done(const pmoq_sendq_t* sendq);
+
+/* Copies up to length bytes, and returns their number. *is_fin is set if
+ * they end the stream. */
+size_t pmoq_sendq_output(pmoq_sendq_t* sendq, uint8_t* bytes, size_t length, int* is_fin);
+int pmoq_sendq_picoquic_prepare(pmoq_sendq_t* sendq, void* context, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_SENDQ_H */
@@ -0,0 +1,97 @@
+#ifndef PICOMOQ_SESSION_H
+#define PICOMOQ_SESSION_H
+#include <picoquic.h>
+#include "picomoq.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* MoQ session on top of a picoquic connection.
+ *
+ * The session owns the bidirectional control stream. The client opens it
+ * with pmoq_session_start(), which sends CLIENT_SETUP; the server adopts
+ * the first bidirectional stream opened by the client, answers with
+ * SERVER_SETUP, and selects the first of its versions that the client
+ * supports. Once the setup is complete, the control messages received
+ * are passed to the session callback, and pmoq_session_send() queues
+ * messages for the peer.
+ *
+ * The session is driven by the picoquic callbacks and never blocks.
+ * Messages are decoded by a resumable parser and encoded in a send
+ * buffer; both only grow when a message is larger than any before, so
+ * there is no allocation per message.
+ *
+ * The core of the session does not depend on the connection:
+ * pmoq_session_input() processes bytes received on the control stream,
+ * and pmoq_session_output() retrieves the bytes to send. When the
+ * session is created with a connection, pmoq_session_picoquic_callback()
+ * calls these functions, closes the connection on protocol errors, and
+ * passes the events of other streams to the application callback.
+ */
+
+#define PMOQ_SESSION_SEND_BUFFER_MIN 2048
+
+typedef struct st_pmoq_session_t pmoq_session_t;
+
+typedef enum {
+    pmoq_session_state_init = 0,
+    pmoq_session_state_setup_sent,
+    pmoq_session_state_ready,
+    pmoq_session_state_closed
+} pmoq_session_state_enum;
+
+typedef enum {
+    pmoq_session_event_ready = 0, /* Setup complete, msg is the setup message of the peer */
+    pmoq_session_event_msg, /* Control message received */
+    pmoq_session_event_closed /* Session closed, msg is NULL */
+} pmoq_session_event_enum;
+
+/* The message is only valid during the callback. Returning a non zero
+ * value closes the session with PMOQ_ERROR_INTERNAL_ERROR. The session
+ * must not be deleted from within the callback. */
+typedef int (*pmoq_session_cb_fn)(pmoq_session_t* session, pmoq_session_event_enum event,
+    const pmoq_msg_t* msg, void* callback_ctx);
+
+/* If cnx is not NULL, the session installs pmoq_session_picoquic_callback
+ * as the connection callback. */
+pmoq_session_t* pmoq_session_create(picoquic_cnx_t* cnx, int is_client,
+    pmoq_session_cb_fn callback_fn, void* callback_ctx);
+void pmoq_session_delete(pmoq_session_t* session);
+
+/* Configuration, before the setup. The versions are listed by order of
+ * preference, the default is PMOQ_VERSION_DRAFT_07. Only the versions
+ * that have a codec, see pmoq_codec_get(), can be negotiated. The path
+ * is copied. The parameters of the messages received are decoded with
+ * the registry, which must be kept until the session is deleted. */
+int pmoq_session_set_versions(pmoq_session_t* session, const uint32_t* versions, size_t nb_versions);
+int pmoq_session_set_setup_parameters(pmoq_session_t* session, uint8_t role, const uint8_t* path, size_t path_length);
+void pmoq_session_set_param_registry(pmoq_session_t* session, const pmoq_param_registry_t* registry);
+void pmoq_session_set_app_callback(pmoq_session_t* session, picoquic_stream_data_cb_fn app_callback_fn, void* app_callback_ctx);
+
+int pmoq_session_start(pmoq_session_t* session);
+int pmoq_session_send(pmoq_session_t* session, const pmoq_msg_t* msg);
+void pmoq_session_close(pmoq_session_t* session, uint64_t error_code);
+
+pmoq_session_state_enum pmoq_session_state(const pmoq_session_t* session);
+uint32_t pmoq_session_version(const pmoq_session_t* session);
+/* Codec of the negotiated version, to encode and decode the data streams */
+const pmoq_codec_t* pmoq_session_codec(const pmoq_session_t* session);
+uint8_t pmoq_session_peer_role(const pmoq_session_t* session);
+uint64_t pmoq_session_error(const pmoq_session_t* session);
+picoquic_cnx_t* pmoq_session_cnx(const pmoq_session_t* session);
+uint64_t pmoq_session_control_stream_id(const pmoq_session_t* session);
+
+/* Connection independent core. pmoq_session_input() returns 0, or -1 if
+ * the session was closed, with the reason in pmoq_session_error().
+ * pmoq_session_output() returns the number of bytes copied. */
+int pmoq_session_input(pmoq_session_t* session, const uint8_t* bytes, size_t length);
+size_t pmoq_session_output(pmoq_session_t* session, uint8_t* bytes, size_t length);
+size_t pmoq_session_output_pending(const pmoq_session_t* session);
+
+int pmoq_session_picoquic_callback(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t* bytes, size_t length,
+    picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_SESSION_H */
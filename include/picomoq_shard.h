@@ -0,0 +1,120 @@
+#ifndef PICOMOQ_SHARD_H
+#define PICOMOQ_SHARD_H
+#include <picoquic.h>
+#include <picosocks.h>
+#include "picomoq.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Sharded relay.
+ *
+ * A relay runs one worker thread per core. Each worker, or shard, has its
+ * own picoquic context and its own UDP socket, all bound to the same port
+ * with SO_REUSEPORT, so that the kernel spreads the incoming packets
+ * between the sockets. Nothing is shared between the picoquic contexts:
+ * each connection belongs to a single shard, and so do the sessions,
+ * caches and tables used by that connection.
+ *
+ * The connections are sharded by connection ID. The picoquic context of
+ * each shard uses pmoq_shard_cnx_id_callback(), which writes the index of
+ * the shard in the first byte of the connection IDs that it chooses. The
+ * Initial and 0-RTT packets carry a connection ID chosen by the client,
+ * and are processed by the shard that receives them, which then owns the
+ * connection. The other packets are routed by their destination
+ * connection ID; a packet that arrived on the socket of another shard,
+ * e.g., after a NAT rebinding, is forwarded to its owner.
+ *
+ * Shards exchange data through lock-free single producer, single consumer
+ * rings, one per ordered pair of shards: forwarded packets, and items of
+ * the application, e.g., objects that a publisher on one shard sends to
+ * subscribers on another. An item is posted by the thread of the sending
+ * shard and delivered to the item function of the receiving shard, in
+ * order. Ownership of the item passes with it.
+ */
+#define PMOQ_SHARD_MAX 256
+#define PMOQ_SHARD_RING_SIZE_DEFAULT 1024
+/* Max wait in the worker loop, which also bounds the delay of the items
+ * posted by other shards, in microseconds */
+#define PMOQ_SHARD_POLL_DELAY 1000
+
+/* Single producer, single consumer ring of pointers. The capacity is
+ * rounded up to a power of 2. push returns -1 if the ring is full, pop
+ * returns NULL if it is empty. */
+typedef struct st_pmoq_spsc_ring_t pmoq_spsc_ring_t;
+
+pmoq_spsc_ring_t* pmoq_spsc_ring_create(size_t capacity);
+void pmoq_spsc_ring_delete(pmoq_spsc_ring_t* ring);
+int pmoq_spsc_ring_push(pmoq_spsc_ring_t* ring, void* item);
+void* pmoq_spsc_ring_pop(pmoq_spsc_ring_t* ring);
+size_t pmoq_spsc_ring_count(const pmoq_spsc_ring_t* ring);
+
+typedef struct st_pmoq_shards_t pmoq_shards_t;
+typedef struct st_pmoq_shard_t pmoq_shard_t;
+
+/* The statistics are updated by the thread of the shard, and can be read
+ * by that thread or once the workers are joined. */
+typedef struct st_pmoq_shard_stats_t {
+    uint64_t nb_packets_received;
+    uint64_t nb_packets_forwarded;
+    uint64_t nb_packets_sent;
+    uint64_t nb_items_posted;
+    uint64_t nb_items_delivered;
+    /* Packets or items dropped because the ring to the other shard was full */
+    uint64_t drops_ring_full;
+} pmoq_shard_stats_t;
+
+/* A ring size of 0 selects the default */
+pmoq_shards_t* pmoq_shards_create(size_t nb_shards, size_t ring_size);
+/* The shards must be stopped. The items still in the rings are not
+ * delivered, and the application keeps ownership of them. */
+void pmoq_shards_delete(pmoq_shards_t* shards);
+size_t pmoq_shards_count(const pmoq_shards_t* shards);
+pmoq_shard_t* pmoq_shards_get(pmoq_shards_t* shards, size_t index);
+size_t pmoq_shard_index(const pmoq_shard_t* shard);
+void pmoq_shard_stats(const pmoq_shard_t* shard, pmoq_shard_stats_t* stats);
+
+/* Items between shards. Returns -1 if the ring is full, or if the target
+ * is the sending shard or does not exist. pmoq_shard_drain() delivers up
+ * to max_items items posted to the shard, and returns their number. */
+typedef void (*pmoq_shard_item_fn)(pmoq_shard_t* shard, size_t from, void* item, void* app_ctx);
+
+int pmoq_shard_post(pmoq_shard_t* shard, size_t to, void* item);
+size_t pmoq_shard_drain(pmoq_shard_t* shard, pmoq_shard_item_fn item_fn, void* app_ctx, size_t max_items);
+
+/* Sharding by connection ID. cnx_id_cb_data is the shard. */
+void pmoq_shard_cnx_id_callback(picoquic_quic_t* quic, picoquic_connection_id_t cnx_id_local,
+    picoquic_connection_id_t cnx_id_remote, void* cnx_id_cb_data, picoquic_connection_id_t* cnx_id_returned);
+/* Shard that owns the connection of the packet, or self if the packet is
+ * processed by the shard that received it */
+size_t pmoq_shard_route_packet(const uint8_t* bytes, size_t length, size_t nb_shards, size_t self);
+
+/* Workers. pmoq_shards_start() runs worker_fn in one thread per shard.
+ * The workers return when pmoq_shard_is_stopping(), after
+ * pmoq_shards_stop(). pmoq_shards_join() waits for all of them and
+ * returns the first non zero value returned by a worker. */
+typedef int (*pmoq_shard_worker_fn)(pmoq_shard_t* shard, void* app_ctx);
+
+int pmoq_shards_start(pmoq_shards_t* shards, pmoq_shard_worker_fn worker_fn, void* app_ctx);
+void pmoq_shards_stop(pmoq_shards_t* shards);
+int pmoq_shard_is_stopping(const pmoq_shard_t* shard);
+int pmoq_shards_join(pmoq_shards_t* shards);
+
+/* UDP socket of a shard, bound to the port shared by all shards with
+ * SO_REUSEPORT. Returns INVALID_SOCKET if the platform does not
+ * support SO_REUSEPORT. */
+SOCKET_TYPE pmoq_shard_socket_open(int af, uint16_t port);
+
+/* Loop of a worker: receives the packets on the socket of the shard and
+ * forwards those of other shards, delivers the packets and items posted
+ * by the other shards, and sends the packets prepared by the picoquic
+ * context, until the shard is stopping. The picoquic context must use
+ * pmoq_shard_cnx_id_callback() with this shard. Returns 0, or the error
+ * of picoquic. */
+int pmoq_shard_run(pmoq_shard_t* shard, picoquic_quic_t* quic, SOCKET_TYPE fd,
+    pmoq_shard_item_fn item_fn, void* app_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_SHARD_H */
@@ -0,0 +1,108 @@
+#ifndef PICOMOQ_STATS_H
+#define PICOMOQ_STATS_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Codec statistics.
+ *
+ * When the library is built with PMOQ_STATS defined (cmake -DPMOQ_STATS=ON),
+ * the codec counts, for each type of control message and of data stream
+ * header or object, the messages parsed and formatted, the parse or
+ * format failures, the parse attempts that stopped for lack of bytes,
+ * and the bytes processed; it also keeps a histogram of the time spent
+ * in each call. The calls counted are those of the pmoq_codec_ functions,
+ * including the functions without codec argument that use them, and each
+ * call to pmoq_msg_parser_feed(). Without PMOQ_STATS, the counting code is
+ * compiled out, and the functions below report zeros.
+ *
+ * Each thread counts in its own block, aligned on a cache line, so that
+ * counting costs no atomic operation nor cache line transfer between
+ * threads. The blocks are allocated on first use and kept until the
+ * process exits, so the counts of threads that stopped are not lost.
+ * pmoq_stats_aggregate() sums the blocks of all threads; it may run on
+ * any thread, at any time, and costs a pass over the blocks, so a
+ * metrics exporter can poll it. The counts only increase; rates are
+ * computed from the differences between two polls.
+ *
+ * Control messages are counted per type, in slots: the types up to
+ * PMOQ_MSG_MAX_SUBSCRIBE_ID have their own slot, then CLIENT_SETUP and
+ * SERVER_SETUP; all other types share the last slot. pmoq_stats_msg_slot()
+ * returns the slot of a type. Data streams are counted per
+ * pmoq_stats_strm_enum.
+ *
+ * The histograms are log-linear, as in HdrHistogram: values below 4 have
+ * their own bucket, and each power of 2 above is split in 4 buckets, so
+ * that a bucket spans at most a quarter of its value. Values are in
+ * nanoseconds; values from 2^32 ns up fall in the last bucket.
+ */
+#define PMOQ_STATS_MSG_SLOTS 0x19
+#define PMOQ_STATS_HISTO_SUB_BITS 2
+#define PMOQ_STATS_HISTO_BUCKETS 124
+
+typedef enum {
+    pmoq_stats_strm_object_datagram = 0,
+    pmoq_stats_strm_header_track,
+    pmoq_stats_strm_header_subgroup,
+    /* Objects that follow a track or subgroup stream header */
+    pmoq_stats_strm_object_track,
+    pmoq_stats_strm_object_subgroup,
+    /* Unknown types */
+    pmoq_stats_strm_other,
+    pmoq_stats_strm_max
+} pmoq_stats_strm_enum;
+
+typedef enum {
+    pmoq_stats_op_parse = 0,
+    pmoq_stats_op_format,
+    pmoq_stats_op_max
+} pmoq_stats_op_enum;
+
+typedef struct st_pmoq_stats_histo_t {
+    uint64_t counts[PMOQ_STATS_HISTO_BUCKETS];
+} pmoq_stats_histo_t;
+
+typedef struct st_pmoq_stats_entry_t {
+    uint64_t nb_parsed;
+    uint64_t nb_formatted;
+    /* Malformed or unexpected */
+    uint64_t nb_parse_failed;
+    /* Buffer too small, or value that cannot be encoded */
+    uint64_t nb_format_failed;
+    uint64_t nb_needs_more_bytes;
+    uint64_t bytes_parsed;
+    uint64_t bytes_formatted;
+    pmoq_stats_histo_t latency[pmoq_stats_op_max];
+} pmoq_stats_entry_t;
+
+typedef struct st_pmoq_stats_t {
+    pmoq_stats_entry_t msg[PMOQ_STATS_MSG_SLOTS];
+    pmoq_stats_entry_t strm[pmoq_stats_strm_max];
+} pmoq_stats_t;
+
+/* Returns 1 if the library counts, i.e., was built with PMOQ_STATS */
+int pmoq_stats_enabled();
+void pmoq_stats_aggregate(pmoq_stats_t* stats);
+
+size_t pmoq_stats_msg_slot(uint64_t msg_type);
+pmoq_stats_strm_enum pmoq_stats_strm_slot(uint64_t msg_type);
+
+/* Bucket of a value, and smallest value of a bucket */
+size_t pmoq_stats_histo_bucket(uint64_t value);
+uint64_t pmoq_stats_histo_bucket_min(size_t bucket);
+uint64_t pmoq_stats_histo_count(const pmoq_stats_histo_t* histo);
+/* Smallest value of the bucket that holds the given percentile, 0 if
+ * the histogram is empty */
+uint64_t pmoq_stats_histo_percentile(const pmoq_stats_histo_t* histo, double percentile);
+
+/* Writes the entries that are not zero, one JSON object per line, with
+ * the counts and the 50th, 99th and max latency percentiles. */
+int pmoq_stats_dump(FILE* F, const pmoq_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_STATS_H */
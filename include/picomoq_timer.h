@@ -0,0 +1,58 @@
+#ifndef PICOMOQ_TIMER_H
+#define PICOMOQ_TIMER_H
+#include <stdint.h>
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Timer wheel.
+ *
+ * Expiry times are in microseconds, on the same clock as picoquic. The
+ * wheel has nb_slots slots, of one tick each; a timer is kept in the
+ * slot of its expiry tick modulo the number of slots, so setting or
+ * cancelling a timer is O(1). pmoq_timer_wheel_advance() visits the slots
+ * of the ticks elapsed since the previous call, and fires the timers
+ * that have expired; timers that are more than a turn ahead stay in
+ * their slot. Timers fire in the tick of their expiry, not before.
+ *
+ * The timers are provided by the application, embedded in the structure
+ * that they refer to. A timer must be zeroed before first use, and
+ * cancelled before its memory is released. The callback may set or
+ * cancel any timer, including the one that fired.
+ */
+typedef struct st_pmoq_timer_t {
+    uint64_t expiry;
+    struct st_pmoq_timer_t* next;
+    struct st_pmoq_timer_t* previous;
+    void* app_ctx;
+} pmoq_timer_t;
+
+typedef struct st_pmoq_timer_wheel_t pmoq_timer_wheel_t;
+
+typedef void (*pmoq_timer_fn)(void* callback_ctx, pmoq_timer_t* timer);
+
+#define PMOQ_TIMER_TICK_DEFAULT 1000
+#define PMOQ_TIMER_SLOTS_DEFAULT 1024
+
+/* The number of slots is rounded up to a power of 2. A tick or number
+ * of slots of 0 selects the default. */
+pmoq_timer_wheel_t* pmoq_timer_wheel_create(uint64_t tick, size_t nb_slots, uint64_t current_time);
+/* The timers still set are cancelled */
+void pmoq_timer_wheel_delete(pmoq_timer_wheel_t* wheel);
+size_t pmoq_timer_wheel_count(const pmoq_timer_wheel_t* wheel);
+
+void pmoq_timer_set(pmoq_timer_wheel_t* wheel, pmoq_timer_t* timer, uint64_t expiry);
+void pmoq_timer_cancel(pmoq_timer_wheel_t* wheel, pmoq_timer_t* timer);
+int pmoq_timer_is_set(const pmoq_timer_t* timer);
+
+/* Returns the number of timers fired */
+size_t pmoq_timer_wheel_advance(pmoq_timer_wheel_t* wheel, uint64_t current_time, pmoq_timer_fn fn, void* callback_ctx);
+/* Earliest expiry of the timers set, e.g., for picoquic_set_app_wake_time().
+ * UINT64_MAX if no timer is set. */
+uint64_t pmoq_timer_wheel_next_expiry(const pmoq_timer_wheel_t* wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_TIMER_H */
@@ -0,0 +1,479 @@
+/* Relay object cache.
+*
+* The tracks are found by track alias in a hash table. Each track holds
+* a ring of groups, and each group a dense array of objects indexed by
+* object ID. The groups in use are also chained in the order in which
+* they were created, so that the oldest group can be evicted when the
+* memory budget is exceeded.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#endif
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_timer.h"
+#include "picomoq_internal.h"
+
+typedef struct st_pmoq_cache_track_t pmoq_cache_track_t;
+
+struct st_pmoq_cache_group_t {
+    pmoq_cache_track_t* track;
+    uint64_t group_id;
+    uint64_t first_object_id;
+    size_t span;
+    size_t capacity;
+    pmoq_cache_object_t* objects;
+    size_t memory;
+    int is_used;
+    pmoq_cache_group_t* previous;
+    pmoq_cache_group_t* next;
+    pmoq_timer_t expiry_timer;
+};
+
+struct st_pmoq_cache_track_t {
+    uint64_t track_alias;
+    uint64_t max_duration;
+    pmoq_cache_group_t* groups;
+};
+
+struct st_pmoq_cache_t {
+    size_t memory_budget;
+    size_t memory_used;
+    size_t ring_size;
+    /* Hash table of pointers to the tracks */
+    pmoq_hash_table_t tracks;
+    /* Groups in use, oldest first */
+    pmoq_cache_group_t* first_group;
+    pmoq_cache_group_t* last_group;
+    /* Expiry of the groups of tracks that have a max duration */
+    pmoq_timer_wheel_t* wheel;
+    uint64_t current_time;
+};
+
+#define PMOQ_CACHE_TABLE_SIZE_MIN 16
+
+static uint64_t pmoq_cache_hash(uint64_t track_alias)
+{
+    return (track_alias * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+static uint64_t pmoq_cache_track_hash(void* hash_ctx, const void* element)
+{
+    (void)hash_ctx;
+    return pmoq_cache_hash((*(pmoq_cache_track_t* const*)element)->track_alias);
+}
+
+static int pmoq_cache_track_match(const void* key, const void* element)
+{
+    return (*(pmoq_cache_track_t* const*)element)->track_alias == *(const uint64_t*)key;
+}
+
+/* The references of a payload may be taken and released by several
+ * threads. Taking a reference needs no ordering, since the caller already
+ * holds one; the last release must see all the accesses of the others. */
+#ifdef _WINDOWS
+#ifdef _WIN64
+#define PMOQ_REFCOUNT_INCREMENT(p) (size_t)InterlockedIncrement64((LONG64 volatile*)(p))
+#define PMOQ_REFCOUNT_DECREMENT(p) (size_t)InterlockedDecrement64((LONG64 volatile*)(p))
+#else
+#define PMOQ_REFCOUNT_INCREMENT(p) (size_t)InterlockedIncrement((LONG volatile*)(p))
+#define PMOQ_REFCOUNT_DECREMENT(p) (size_t)InterlockedDecrement((LONG volatile*)(p))
+#endif
+#else
+#define PMOQ_REFCOUNT_INCREMENT(p) __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+#define PMOQ_REFCOUNT_DECREMENT(p) __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#endif
+
+void pmoq_cache_payload_ref(pmoq_cache_payload_t* payload)
+{
+    if (payload != NULL) {
+        (void)PMOQ_REFCOUNT_INCREMENT(&payload->refcount);
+    }
+}
+
+void pmoq_cache_payload_unref(pmoq_cache_payload_t* payload)
+{
+    if (payload != NULL && PMOQ_REFCOUNT_DECREMENT(&payload->refcount) == 0) {
+        free(payload);
+    }
+}
+
+size_t pmoq_cache_payload_refcount(const pmoq_cache_payload_t* payload)
+{
+#ifdef _WINDOWS
+    return *(volatile const size_t*)&payload->refcount;
+#else
+    return __atomic_load_n(&payload->refcount, __ATOMIC_RELAXED);
+#endif
+}
+
+pmoq_cache_payload_t* pmoq_cache_payload_create(size_t length)
+{
+    pmoq_cache_payload_t* payload = (pmoq_cache_payload_t*)malloc(sizeof(pmoq_cache_payload_t) + length);
+
+    if (payload != NULL) {
+        payload->refcount = 1;
+        payload->length = length;
+        payload->data = (uint8_t*)(payload + 1);
+    }
+    return payload;
+}
+
+pmoq_cache_t* pmoq_cache_create(size_t memory_budget, size_t ring_size)
+{
+    pmoq_cache_t* cache = (pmoq_cache_t*)malloc(sizeof(pmoq_cache_t));
+
+    if (cache != NULL) {
+        memset(cache, 0, sizeof(pmoq_cache_t));
+        cache->memory_budget = memory_budget;
+        cache->ring_size = (ring_size == 0) ? PMOQ_CACHE_RING_SIZE_DEFAULT : ring_size;
+        if (pmoq_hash_table_init(&cache->tracks, sizeof(pmoq_cache_track_t*), PMOQ_CACHE_TABLE_SIZE_MIN,
+            pmoq_cache_track_hash, NULL) != 0 ||
+            (cache->wheel = pmoq_timer_wheel_create(0, 0, 0)) == NULL) {
+            pmoq_cache_delete(cache);
+            cache = NULL;
+        }
+    }
+    return cache;
+}
+
+static void pmoq_cache_evict_group(pmoq_cache_t* cache, pmoq_cache_group_t* group)
+{
+    pmoq_timer_cancel(cache->wheel, &group->expiry_timer);
+    for (size_t i = 0; i < group->span; i++) {
+        pmoq_cache_payload_unref(group->objects[i].payload);
+    }
+    if (group->objects != NULL) {
+        free(group->objects);
+    }
+    if (group->previous == NULL) {
+        cache->first_group = group->next;
+    }
+    else {
+        group->previous->next = group->next;
+    }
+    if (group->next == NULL) {
+        cache->last_group = group->previous;
+    }
+    else {
+        group->next->previous = group->previous;
+    }
+    cache->memory_used -= group->memory;
+    memset(group, 0, sizeof(pmoq_cache_group_t));
+}
+
+static void pmoq_cache_track_free(pmoq_cache_t* cache, pmoq_cache_track_t* track)
+{
+    for (size_t i = 0; i < cache->ring_size; i++) {
+        if (track->groups[i].is_used) {
+            pmoq_cache_evict_group(cache, &track->groups[i]);
+        }
+    }
+    free(track->groups);
+    free(track);
+}
+
+void pmoq_cache_delete(pmoq_cache_t* cache)
+{
+    if (cache != NULL) {
+        for (size_t i = 0; cache->tracks.slots != NULL && i < cache->tracks.size; i++) {
+            pmoq_cache_track_t* track = *(pmoq_cache_track_t**)PMOQ_HASH_TABLE_SLOT(&cache->tracks, i);
+
+            if (track != NULL) {
+                pmoq_cache_track_free(cache, track);
+            }
+        }
+        pmoq_hash_table_release(&cache->tracks);
+        pmoq_timer_wheel_delete(cache->wheel);
+        free(cache);
+    }
+}
+
+size_t pmoq_cache_memory_used(const pmoq_cache_t* cache)
+{
+    return cache->memory_used;
+}
+
+static size_t pmoq_cache_track_slot(const pmoq_cache_t* cache, uint64_t track_alias)
+{
+    return pmoq_hash_table_probe(&cache->tracks, pmoq_cache_hash(track_alias), pmoq_cache_track_match, &track_alias);
+}
+
+static pmoq_cache_track_t* pmoq_cache_find_track(pmoq_cache_t* cache, uint64_t track_alias)
+{
+    return *(pmoq_cache_track_t**)PMOQ_HASH_TABLE_SLOT(&cache->tracks, pmoq_cache_track_slot(cache, track_alias));
+}
+
+static pmoq_cache_track_t* pmoq_cache_get_track(pmoq_cache_t* cache, uint64_t track_alias)
+{
+    pmoq_cache_track_t* track = pmoq_cache_find_track(cache, track_alias);
+
+    if (track == NULL) {
+        if (pmoq_hash_table_reserve(&cache->tracks) != 0) {
+            return NULL;
+        }
+        if ((track = (pmoq_cache_track_t*)malloc(sizeof(pmoq_cache_track_t))) != NULL) {
+            track->track_alias = track_alias;
+            track->max_duration = PMOQ_CACHE_DURATION_UNLIMITED;
+            if ((track->groups = (pmoq_cache_group_t*)calloc(cache->ring_size, sizeof(pmoq_cache_group_t))) == NULL) {
+                free(track);
+                track = NULL;
+            }
+            else {
+                pmoq_hash_table_insert(&cache->tracks, pmoq_cache_track_slot(cache, track_alias), &track);
+            }
+        }
+    }
+    return track;
+}
+
+void pmoq_cache_remove_track(pmoq_cache_t* cache, uint64_t track_alias)
+{
+    size_t slot = pmoq_cache_track_slot(cache, track_alias);
+    pmoq_cache_track_t* track = *(pmoq_cache_track_t**)PMOQ_HASH_TABLE_SLOT(&cache->tracks, slot);
+
+    if (track != NULL) {
+        pmoq_hash_table_remove(&cache->tracks, slot);
+        pmoq_cache_track_free(cache, track);
+    }
+}
+
+/* Make sure that the object ID has a slot in the group's array */
+static int pmoq_cache_group_reserve(pmoq_cache_group_t* group, uint64_t object_id)
+{
+    uint64_t first = (group->span == 0 || object_id < group->first_object_id) ? object_id : group->first_object_id;
+    uint64_t last = (group->span == 0 || object_id > group->first_object_id + group->span - 1) ?
+        object_id : group->first_object_id + group->span - 1;
+    size_t shift = (group->span == 0) ? 0 : (size_t)(group->first_object_id - first);
+    size_t new_span;
+
+    if (last - first >= PMOQ_CACHE_GROUP_OBJECTS_MAX) {
+        return -1;
+    }
+    new_span = (size_t)(last - first) + 1;
+    if (new_span > group->capacity) {
+        size_t new_capacity = (group->capacity == 0) ? 8 : group->capacity;
+        pmoq_cache_object_t* new_objects;
+
+        while (new_capacity < new_span) {
+            new_capacity *= 2;
+        }
+        if ((new_objects = (pmoq_cache_object_t*)realloc(group->objects, new_capacity * sizeof(pmoq_cache_object_t))) == NULL) {
+            return -1;
+        }
+        group->objects = new_objects;
+        group->capacity = new_capacity;
+    }
+    if (shift > 0) {
+        memmove(group->objects + shift, group->objects, group->span * sizeof(pmoq_cache_object_t));
+        memset(group->objects, 0, shift * sizeof(pmoq_cache_object_t));
+    }
+    if (new_span > group->span + shift) {
+        memset(group->objects + group->span + shift, 0, (new_span - group->span - shift) * sizeof(pmoq_cache_object_t));
+    }
+    group->first_object_id = first;
+    group->span = new_span;
+    return 0;
+}
+
+static pmoq_cache_object_t* pmoq_cache_insert(pmoq_cache_t* cache, const pmoq_strm_t* header, int* is_new)
+{
+    pmoq_cache_track_t* track;
+    pmoq_cache_group_t* group;
+    pmoq_cache_object_t* object;
+    size_t need;
+
+    *is_new = 0;
+    if (header->payload_length > SIZE_MAX - PMOQ_CACHE_OBJECT_OVERHEAD ||
+        (need = (size_t)header->payload_length + PMOQ_CACHE_OBJECT_OVERHEAD) > cache->memory_budget ||
+        (track = pmoq_cache_get_track(cache, header->track_alias)) == NULL) {
+        return NULL;
+    }
+
+    group = &track->groups[header->group_id % cache->ring_size];
+    if (group->is_used && group->group_id != header->group_id) {
+        if (group->group_id > header->group_id) {
+            /* Older than the groups in the ring */
+            return NULL;
+        }
+        pmoq_cache_evict_group(cache, group);
+    }
+    if (!group->is_used) {
+        group->is_used = 1;
+        group->track = track;
+        group->group_id = header->group_id;
+        group->expiry_timer.app_ctx = group;
+        if (track->max_duration != PMOQ_CACHE_DURATION_UNLIMITED) {
+            pmoq_timer_set(cache->wheel, &group->expiry_timer, cache->current_time + track->max_duration);
+        }
+        group->previous = cache->last_group;
+        if (cache->last_group == NULL) {
+            cache->first_group = group;
+        }
+        else {
+            cache->last_group->next = group;
+        }
+        cache->last_group = group;
+    }
+
+    if (header->object_id >= group->first_object_id && header->object_id - group->first_object_id < group->span &&
+        group->objects[header->object_id - group->first_object_id].is_present) {
+        return &group->objects[header->object_id - group->first_object_id];
+    }
+
+    while (cache->memory_used + need > cache->memory_budget && cache->first_group != group) {
+        pmoq_cache_evict_group(cache, cache->first_group);
+    }
+    if (cache->memory_used + need > cache->memory_budget ||
+        pmoq_cache_group_reserve(group, header->object_id) != 0) {
+        if (group->span == 0) {
+            pmoq_cache_evict_group(cache, group);
+        }
+        return NULL;
+    }
+
+    object = &group->objects[header->object_id - group->first_object_id];
+    if (header->payload_length > 0 &&
+        (object->payload = pmoq_cache_payload_create((size_t)header->payload_length)) == NULL) {
+        return NULL;
+    }
+    object->object_id = header->object_id;
+    object->object_status = header->object_status;
+    object->payload_length = header->payload_length;
+    object->received = 0;
+    object->publisher_priority = header->publisher_priority;
+    object->is_present = 1;
+    group->memory += need;
+    cache->memory_used += need;
+    *is_new = 1;
+
+    return object;
+}
+
+pmoq_cache_object_t* pmoq_cache_start_object(pmoq_cache_t* cache, const pmoq_strm_t* header)
+{
+    int is_new;
+
+    return pmoq_cache_insert(cache, header, &is_new);
+}
+
+pmoq_cache_object_t* pmoq_cache_add_object(pmoq_cache_t* cache, const pmoq_strm_t* header, const uint8_t* payload)
+{
+    int is_new;
+    pmoq_cache_object_t* object = pmoq_cache_insert(cache, header, &is_new);
+
+    if (object != NULL && is_new && object->payload_length > 0) {
+        (void)pmoq_cache_append_object(object, payload, (size_t)object->payload_length);
+    }
+    return object;
+}
+
+int pmoq_cache_append_object(pmoq_cache_object_t* object, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+
+    if (length > object->payload_length - object->received) {
+        ret = -1;
+    }
+    else if (length > 0) {
+        memcpy(object->payload->data + object->received, bytes, length);
+        object->received += length;
+    }
+    return ret;
+}
+
+int pmoq_cache_object_is_complete(const pmoq_cache_object_t* object)
+{
+    return object->received == object->payload_length;
+}
+
+pmoq_cache_group_t* pmoq_cache_get_group(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id)
+{
+    pmoq_cache_group_t* group = NULL;
+    pmoq_cache_track_t* track = pmoq_cache_find_track(cache, track_alias);
+
+    if (track != NULL) {
+        group = &track->groups[group_id % cache->ring_size];
+        if (!group->is_used || group->group_id != group_id) {
+            group = NULL;
+        }
+    }
+    return group;
+}
+
+pmoq_cache_object_t* pmoq_cache_get_object(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id, uint64_t object_id)
+{
+    pmoq_cache_object_t* object = NULL;
+    pmoq_cache_group_t* group = pmoq_cache_get_group(cache, track_alias, group_id);
+
+    if (group != NULL && object_id >= group->first_object_id && object_id - group->first_object_id < group->span) {
+        object = &group->objects[object_id - group->first_object_id];
+        if (!object->is_present) {
+            object = NULL;
+        }
+    }
+    return object;
+}
+
+int pmoq_cache_latest_group(pmoq_cache_t* cache, uint64_t track_alias, uint64_t* group_id)
+{
+    int ret = -1;
+    pmoq_cache_track_t* track = pmoq_cache_find_track(cache, track_alias);
+
+    if (track != NULL) {
+        for (size_t i = 0; i < cache->ring_size; i++) {
+            if (track->groups[i].is_used && (ret != 0 || track->groups[i].group_id > *group_id)) {
+                *group_id = track->groups[i].group_id;
+                ret = 0;
+            }
+        }
+    }
+    return ret;
+}
+
+uint64_t pmoq_cache_group_id(const pmoq_cache_group_t* group)
+{
+    return group->group_id;
+}
+
+size_t pmoq_cache_group_span(const pmoq_cache_group_t* group)
+{
+    return group->span;
+}
+
+pmoq_cache_object_t* pmoq_cache_group_object(pmoq_cache_group_t* group, size_t rank)
+{
+    return (rank < group->span && group->objects[rank].is_present) ? &group->objects[rank] : NULL;
+}
+
+int pmoq_cache_set_max_duration(pmoq_cache_t* cache, uint64_t track_alias, uint64_t max_duration)
+{
+    pmoq_cache_track_t* track = pmoq_cache_get_track(cache, track_alias);
+
+    if (track == NULL) {
+        return -1;
+    }
+    track->max_duration = max_duration;
+    return 0;
+}
+
+static void pmoq_cache_expiry_fn(void* callback_ctx, pmoq_timer_t* timer)
+{
+    pmoq_cache_evict_group((pmoq_cache_t*)callback_ctx, (pmoq_cache_group_t*)timer->app_ctx);
+}
+
+size_t pmoq_cache_expire(pmoq_cache_t* cache, uint64_t current_time)
+{
+    if (current_time > cache->current_time) {
+        cache->current_time = current_time;
+    }
+    return pmoq_timer_wheel_advance(cache->wheel, cache->current_time, pmoq_cache_expiry_fn, cache);
+}
+
+uint64_t pmoq_cache_next_expiry(const pmoq_cache_t* cache)
+{
+    return pmoq_timer_wheel_next_expiry(cache->wheel);
+}
@@ -0,0 +1,198 @@
+/* Object datagrams.
+*
+* The send queue is a ring of entries, each holding the formatted header
+* of the datagram and a reference to the payload, which is only copied
+* when picoquic provides the packet buffer.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_datagram.h"
+
+typedef struct st_pmoq_dgram_entry_t {
+    uint8_t header[PMOQ_STRM_HEADER_SIZE_MAX];
+    size_t header_length;
+    pmoq_cache_payload_t* payload;
+    size_t payload_length;
+} pmoq_dgram_entry_t;
+
+struct st_pmoq_dgram_t {
+    picoquic_cnx_t* cnx;
+    const pmoq_codec_t* codec;
+    size_t max_datagram_size;
+    pmoq_dgram_entry_t* entries;
+    size_t queue_max;
+    size_t first;
+    size_t count;
+    pmoq_dgram_stats_t stats;
+};
+
+pmoq_dgram_t* pmoq_dgram_create(picoquic_cnx_t* cnx, size_t queue_max, size_t max_datagram_size)
+{
+    pmoq_dgram_t* dgram = (pmoq_dgram_t*)malloc(sizeof(pmoq_dgram_t));
+
+    if (dgram != NULL) {
+        memset(dgram, 0, sizeof(pmoq_dgram_t));
+        dgram->cnx = cnx;
+        dgram->codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+        dgram->max_datagram_size = max_datagram_size;
+        dgram->queue_max = (queue_max == 0) ? PMOQ_DGRAM_QUEUE_MAX_DEFAULT : queue_max;
+        if ((dgram->entries = (pmoq_dgram_entry_t*)malloc(dgram->queue_max * sizeof(pmoq_dgram_entry_t))) == NULL) {
+            free(dgram);
+            dgram = NULL;
+        }
+    }
+    return dgram;
+}
+
+/* Remove the first datagram of the queue, sent or dropped */
+static void pmoq_dgram_release_first(pmoq_dgram_t* dgram)
+{
+    pmoq_cache_payload_unref(dgram->entries[dgram->first].payload);
+    dgram->first = (dgram->first + 1 == dgram->queue_max) ? 0 : dgram->first + 1;
+    dgram->count--;
+}
+
+void pmoq_dgram_delete(pmoq_dgram_t* dgram)
+{
+    if (dgram != NULL) {
+        while (dgram->count > 0) {
+            pmoq_dgram_release_first(dgram);
+        }
+        free(dgram->entries);
+        free(dgram);
+    }
+}
+
+void pmoq_dgram_set_codec(pmoq_dgram_t* dgram, const pmoq_codec_t* codec)
+{
+    dgram->codec = codec;
+}
+
+void pmoq_dgram_set_max_size(pmoq_dgram_t* dgram, size_t max_datagram_size)
+{
+    dgram->max_datagram_size = max_datagram_size;
+}
+
+size_t pmoq_dgram_count(const pmoq_dgram_t* dgram)
+{
+    return dgram->count;
+}
+
+void pmoq_dgram_stats(const pmoq_dgram_t* dgram, pmoq_dgram_stats_t* stats)
+{
+    *stats = dgram->stats;
+}
+
+int pmoq_dgram_send(pmoq_dgram_t* dgram, const pmoq_strm_t* header, pmoq_cache_payload_t* payload)
+{
+    int ret = 0;
+    pmoq_strm_t datagram = *header;
+    size_t header_length;
+    pmoq_dgram_entry_t* entry;
+
+    datagram.msg_type = PMOQ_STRM_OBJECT_DATAGRAM;
+    header_length = pmoq_codec_strm_encoded_size(dgram->codec, &datagram);
+
+    if (header_length == 0 || header_length > PMOQ_STRM_HEADER_SIZE_MAX ||
+        (header->payload_length > 0 && (payload == NULL || payload->length < header->payload_length))) {
+        /* Unexpected */
+        return -1;
+    }
+    if (header_length + header->payload_length > dgram->max_datagram_size) {
+        dgram->stats.drops_too_large++;
+        return -1;
+    }
+    if (dgram->count == dgram->queue_max) {
+        pmoq_dgram_release_first(dgram);
+        dgram->stats.drops_congestion++;
+    }
+
+    entry = &dgram->entries[(dgram->first + dgram->count) % dgram->queue_max];
+    (void)pmoq_codec_strm_format(dgram->codec, entry->header, entry->header + header_length, &datagram);
+    entry->header_length = header_length;
+    entry->payload_length = (size_t)header->payload_length;
+    entry->payload = (entry->payload_length > 0) ? payload : NULL;
+    pmoq_cache_payload_ref(entry->payload);
+    dgram->count++;
+    dgram->stats.nb_queued++;
+
+    if (dgram->count == 1 && dgram->cnx != NULL) {
+        ret = picoquic_mark_datagram_ready(dgram->cnx, 1);
+    }
+    return ret;
+}
+
+size_t pmoq_dgram_next_size(const pmoq_dgram_t* dgram)
+{
+    const pmoq_dgram_entry_t* entry = &dgram->entries[dgram->first];
+
+    return (dgram->count == 0) ? 0 : entry->header_length + entry->payload_length;
+}
+
+uint8_t* pmoq_dgram_write_next(pmoq_dgram_t* dgram, uint8_t* bytes, const uint8_t* bytes_max)
+{
+    size_t l = pmoq_dgram_next_size(dgram);
+    const pmoq_dgram_entry_t* entry = &dgram->entries[dgram->first];
+
+    if (l == 0 || l > (size_t)(bytes_max - bytes)) {
+        return NULL;
+    }
+    memcpy(bytes, entry->header, entry->header_length);
+    bytes += entry->header_length;
+    if (entry->payload_length > 0) {
+        memcpy(bytes, entry->payload->data, entry->payload_length);
+        bytes += entry->payload_length;
+    }
+    pmoq_dgram_release_first(dgram);
+    dgram->stats.nb_sent++;
+
+    return bytes;
+}
+
+int pmoq_dgram_picoquic_prepare(pmoq_dgram_t* dgram, void* context, size_t length)
+{
+    int ret = 0;
+    size_t l = pmoq_dgram_next_size(dgram);
+
+    if (l > 0 && l <= length) {
+        uint8_t* buffer = picoquic_provide_datagram_buffer_ex(context, l,
+            (dgram->count > 1) ? picoquic_datagram_active_any_path : picoquic_datagram_not_active);
+
+        if (buffer == NULL) {
+            ret = -1;
+        }
+        else {
+            (void)pmoq_dgram_write_next(dgram, buffer, buffer + l);
+        }
+    }
+    else {
+        /* Nothing to send, or wait for a packet with more room */
+        (void)picoquic_provide_datagram_buffer_ex(context, 0,
+            (l > 0) ? picoquic_datagram_active_any_path : picoquic_datagram_not_active);
+    }
+    return ret;
+}
+
+pmoq_cache_object_t* pmoq_dgram_receive(pmoq_dgram_t* dgram, pmoq_cache_t* cache, const uint8_t* bytes, size_t length)
+{
+    pmoq_cache_object_t* object = NULL;
+    pmoq_strm_t header = { 0 };
+    const uint8_t* bytes_max = bytes + length;
+    int err = 0;
+
+    if ((bytes = pmoq_codec_strm_parse(dgram->codec, bytes, bytes_max, &err, 0, &header)) == NULL ||
+        header.msg_type != PMOQ_STRM_OBJECT_DATAGRAM || (uint64_t)(bytes_max - bytes) != header.payload_length) {
+        dgram->stats.drops_malformed++;
+    }
+    else if ((object = pmoq_cache_add_object(cache, &header, bytes)) == NULL) {
+        dgram->stats.drops_not_cached++;
+    }
+    else {
+        dgram->stats.nb_received++;
+    }
+    return object;
+}
@@ -1,7 +1,8 @@
 /* Code to encode, decode, skip, etc.
 * The _format() functions take a message structure as input
 * and produce a string of bytes; the _parse() functions do
-* the reverse.
+* the reverse. The messages are described by the tables in
+* msg_schema.c, which drive the parsing, formatting and sizing.
 * 
 * TODO: we are going to receive data from the network as segments
 * of message. There are no message boundaries, so we don't know
@@ -16,11 +17,15 @@
 * Question: do names have size limits?
 */
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <picoquic.h>
 #include <picoquic_utils.h>
 #include "picomoq.h"
+#include "picomoq_stats.h"
+#include "picomoq_internal.h"
+#include "msg_schema.h"
 
 const uint8_t* pmoq_varint_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t * v)
 {
@@ -45,6 +50,59 @@ const uint8_t* pmoq_uint8_parse(const uint8_t* bytes, const uint8_t* bytes_max,
     return r_bytes;
 }
 
+/* Size computation.
+* The _size() functions return the exact number of bytes that the
+* corresponding _format() function would write, or 0 if the value
+* cannot be encoded. Every encoding is at least one byte long, so
+* 0 is never a valid size.
+*/
+size_t pmoq_varint_size(uint64_t v)
+{
+    size_t l;
+
+    if (v < 0x40) {
+        l = 1;
+    }
+    else if (v < 0x4000) {
+        l = 2;
+    }
+    else if (v < 0x40000000) {
+        l = 4;
+    }
+    else if (v < 0x4000000000000000ull) {
+        l = 8;
+    }
+    else {
+        l = 0;
+    }
+    return l;
+}
+
+size_t pmoq_size_add(size_t l, size_t x)
+{
+    return (l == 0 || x == 0) ? 0 : l + x;
+}
+
+size_t pmoq_bits_size(const pmoq_bits_t* bits_string)
+{
+    size_t l = pmoq_varint_size(bits_string->nb_bits);
+
+    if (l > 0) {
+        l += (size_t)((bits_string->nb_bits + 7) >> 3);
+    }
+    return l;
+}
+
+size_t pmoq_tuple_size(const pmoq_tuple_t* tuple)
+{
+    size_t l = (tuple->nb_items > PMOQ_TUPLE_SIZE_MAX) ? 0 : pmoq_varint_size(tuple->nb_items);
+
+    for (uint64_t item_rank = 0; l > 0 && item_rank < tuple->nb_items; item_rank++) {
+        l = pmoq_size_add(l, pmoq_bits_size(&tuple->items[item_rank]));
+    }
+    return l;
+}
+
 uint8_t* pmoq_bits_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_bits_t* bits_string)
 {
     if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, bits_string->nb_bits)) != NULL) {
@@ -84,6 +142,10 @@ const uint8_t* pmoq_bits_parse(const uint8_t* bytes, const uint8_t* bytes_max, i
 uint8_t * pmoq_tuple_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_tuple_t* tuple)
 {
     uint64_t item_rank = 0;
+    /* Same limit as pmoq_tuple_size and pmoq_tuple_parse */
+    if (tuple->nb_items > PMOQ_TUPLE_SIZE_MAX) {
+        return NULL;
+    }
     bytes = picoquic_frames_varint_encode(bytes, bytes_max, tuple->nb_items);
     while (bytes != NULL && item_rank < tuple->nb_items) {
         bytes = pmoq_bits_format(bytes, bytes_max, &tuple->items[item_rank++]);
@@ -95,7 +157,8 @@ const uint8_t * pmoq_tuple_parse(const uint8_t* bytes, const uint8_t* bytes_max,
 {
     uint64_t item_rank = 0;
     if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &tuple->nb_items)) != NULL) {
-        if (tuple->nb_items > PMOQ_TUPLE_SIZE_MAX) {
+        if (tuple->nb_items > PMOQ_TUPLE_SIZE_MAX || tuple->nb_items > tuple->items_max) {
+            *err = -1;
             bytes = NULL;
         }
         else {
@@ -151,20 +214,84 @@ const uint8_t* pmoq_msg_parameter_parse(const uint8_t* bytes, const uint8_t* byt
     }
     return bytes;
 }
+size_t pmoq_msg_string_parameter_size(uint64_t key, size_t l)
+{
+    size_t lk = pmoq_varint_size(key);
+    size_t ll = pmoq_varint_size(l);
+
+    return (lk == 0 || ll == 0) ? 0 : lk + ll + l;
+}
+
+size_t pmoq_msg_varint_parameter_size(uint64_t key, uint64_t v)
+{
+    /* The length of the value is encoded on a single byte */
+    return pmoq_size_add(pmoq_size_add(pmoq_varint_size(key), 1), pmoq_varint_size(v));
+}
+
+/* Parameters of the application, see pmoq_param_registry_add(). The size
+* is 0 if there are too many values. */
+static size_t pmoq_param_values_size(size_t l, const pmoq_param_values_t* values)
+{
+    if (values->nb_values > PMOQ_PARAM_VALUES_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < values->nb_values; i++) {
+        const pmoq_param_value_t* value = &values->values[i];
+
+        l = pmoq_size_add(l, (value->is_varint) ? pmoq_msg_varint_parameter_size(value->key, value->varint) :
+            pmoq_msg_string_parameter_size(value->key, value->length));
+    }
+    return l;
+}
+
+static uint8_t* pmoq_param_values_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_param_values_t* values)
+{
+    for (size_t i = 0; bytes != NULL && i < values->nb_values; i++) {
+        const pmoq_param_value_t* value = &values->values[i];
+
+        bytes = (value->is_varint) ? pmoq_msg_varint_parameter_format(bytes, bytes_max, value->key, value->varint) :
+            pmoq_msg_string_parameter_format(bytes, bytes_max, value->key, value->length, value->bytes);
+    }
+    return bytes;
+}
+
+size_t pmoq_msg_setup_parameters_size(const pmoq_setup_parameters_t* param)
+{
+    uint64_t nb_params = ((param->path == NULL) ? 1 : 2) + (uint64_t)param->extensions.nb_values;
+    size_t l = pmoq_size_add(pmoq_varint_size(nb_params),
+        pmoq_msg_varint_parameter_size(PMOQ_SETUP_PARAMETER_ROLE, (uint64_t)param->role));
+
+    if (param->path != NULL) {
+        l = pmoq_size_add(l, pmoq_msg_string_parameter_size(PMOQ_SETUP_PARAMETER_PATH, param->path_length));
+    }
+    return pmoq_param_values_size(l, &param->extensions);
+}
+
 uint8_t* pmoq_msg_setup_parameters_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_setup_parameters_t* param)
 {
-    uint64_t nb_params = (param->path == NULL) ? 1: 2;
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, nb_params)) != NULL &&
+    uint64_t nb_params = ((param->path == NULL) ? 1: 2) + (uint64_t)param->extensions.nb_values;
+
+    if (param->extensions.nb_values > PMOQ_PARAM_VALUES_MAX) {
+        bytes = NULL;
+    }
+    else if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, nb_params)) != NULL &&
         (bytes = pmoq_msg_varint_parameter_format(bytes, bytes_max, PMOQ_SETUP_PARAMETER_ROLE, (uint64_t)param->role)) != NULL){
         if (param->path != NULL) {
             bytes = pmoq_msg_string_parameter_format(bytes, bytes_max, PMOQ_SETUP_PARAMETER_PATH, param->path_length, param->path);
         }
+        bytes = pmoq_param_values_format(bytes, bytes_max, &param->extensions);
     }
     return bytes;
 }
-const uint8_t* pmoq_msg_setup_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_setup_parameters_t * param) {
+const uint8_t* pmoq_msg_setup_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, pmoq_setup_parameters_t * param) {
     uint64_t nb_params = 0;
+    pmoq_param_values_t extensions = param->extensions;
+
+    /* The extensions go to the array set by the caller */
     memset(param, 0, sizeof(pmoq_setup_parameters_t));
+    param->extensions.values = extensions.values;
+    param->extensions.values_max = extensions.values_max;
     if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_params)) != NULL) {
         if (nb_params > PMOQ_PARAMETERS_NUMBER_MAX) {
             *err = -1;
@@ -185,38 +312,10 @@ const uint8_t* pmoq_msg_setup_parameters_parse(const uint8_t* bytes, const uint8
                     needed + 2 * ((int)nb_params - i - 1), &key, &l, &v)) == NULL) {
                     break;
                 }
-                else {
-                    switch (key) {
-                    case PMOQ_SETUP_PARAMETER_ROLE:
-                        if (l != 1 || *v == pmoq_setup_role_undef || *v > pmoq_setup_role_max) {
-                            /* malformed! */
-                            bytes = NULL;
-                            *err = -1;
-                        }
-                        else if (param->role != pmoq_setup_role_undef) {
-                            /* Double definition! */
-                            bytes = NULL;
-                            *err = -1;
-                        }
-                        else {
-                            param->role = (uint8_t)*v;
-                        }
-                        break;
-                    case PMOQ_SETUP_PARAMETER_PATH:
-                        if (param->path != NULL) {
-                            /* Double definition! */
-                            bytes = NULL;
-                            *err = -1;
-                        }
-                        else {
-                            param->path = v;
-                            param->path_length = (size_t)l;
-                        }
-                        break;
-                    default:
-                        /* By default, ignore unused parameters */
-                        break;
-                    }
+                else if (pmoq_setup_parameter_set(registry, param, key, l, v) != 0) {
+                    bytes = NULL;
+                    *err = -1;
+                    break;
                 }
             }
         }
@@ -225,20 +324,57 @@ const uint8_t* pmoq_msg_setup_parameters_parse(const uint8_t* bytes, const uint8
     return bytes;
 }
 
+static uint64_t pmoq_subscribe_parameters_count(const pmoq_subscribe_parameters_t* param)
+{
+    return (uint64_t)(param->auth_info != NULL) + param->has_delivery_timeout + param->has_max_cache_duration +
+        (uint64_t)param->extensions.nb_values;
+}
+
+size_t pmoq_subscribe_parameters_size(const pmoq_subscribe_parameters_t* param)
+{
+    size_t l = pmoq_varint_size(pmoq_subscribe_parameters_count(param));
+
+    if (param->auth_info != NULL) {
+        l = pmoq_size_add(l, pmoq_msg_string_parameter_size(PMOQ_PARAMETER_AUTHORIZATION_INFO, param->auth_info_len));
+    }
+    if (param->has_delivery_timeout) {
+        l = pmoq_size_add(l, pmoq_msg_varint_parameter_size(PMOQ_PARAMETER_DELIVERY_TIMEOUT, param->delivery_timeout));
+    }
+    if (param->has_max_cache_duration) {
+        l = pmoq_size_add(l, pmoq_msg_varint_parameter_size(PMOQ_PARAMETER_MAX_CACHE_DURATION, param->max_cache_duration));
+    }
+    return pmoq_param_values_size(l, &param->extensions);
+}
+
 uint8_t* pmoq_subscribe_parameters_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_subscribe_parameters_t* param)
 {
-    uint64_t nb_params = (param->auth_info == NULL) ? 0 : 1;
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, nb_params)) != NULL){
+    if (param->extensions.nb_values > PMOQ_PARAM_VALUES_MAX) {
+        bytes = NULL;
+    }
+    else if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, pmoq_subscribe_parameters_count(param))) != NULL){
         if (param->auth_info != NULL) {
             bytes = pmoq_msg_string_parameter_format(bytes, bytes_max, PMOQ_PARAMETER_AUTHORIZATION_INFO, param->auth_info_len, param->auth_info);
         }
-        /* TODO: Delivery Timeout, Max Cache Duration */
+        if (bytes != NULL && param->has_delivery_timeout) {
+            bytes = pmoq_msg_varint_parameter_format(bytes, bytes_max, PMOQ_PARAMETER_DELIVERY_TIMEOUT, param->delivery_timeout);
+        }
+        if (bytes != NULL && param->has_max_cache_duration) {
+            bytes = pmoq_msg_varint_parameter_format(bytes, bytes_max, PMOQ_PARAMETER_MAX_CACHE_DURATION, param->max_cache_duration);
+        }
+        bytes = pmoq_param_values_format(bytes, bytes_max, &param->extensions);
     }
     return bytes;
 }
-const uint8_t* pmoq_subscribe_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_subscribe_parameters_t * param) {
+
+const uint8_t* pmoq_subscribe_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, pmoq_subscribe_parameters_t * param) {
     uint64_t nb_params = 0;
-    memset(param, 0, sizeof(pmoq_setup_parameters_t));
+    pmoq_param_values_t extensions = param->extensions;
+
+    /* The extensions go to the array set by the caller */
+    memset(param, 0, sizeof(pmoq_subscribe_parameters_t));
+    param->extensions.values = extensions.values;
+    param->extensions.values_max = extensions.values_max;
     if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_params)) != NULL) {
         if (nb_params > PMOQ_PARAMETERS_NUMBER_MAX) {
             *err = -1;
@@ -254,24 +390,10 @@ const uint8_t* pmoq_subscribe_parameters_parse(const uint8_t* bytes, const uint8
                     needed + 2*((int)nb_params-i-1), &key, &l, &v)) == NULL) {
                     break;
                 }
-                else {
-                    switch (key) {
-                    case PMOQ_PARAMETER_AUTHORIZATION_INFO:
-                        if (param->auth_info != NULL) {
-                            /* Double definition! */
-                            bytes = NULL;
-                            *err = -1;
-                        }
-                        else {
-                            param->auth_info = v;
-                            param->auth_info_len = (size_t)l;
-                        }
-                        /* TODO: Delivery Timeout, Max Cache Duration */
-                        break;
-                    default:
-                        /* By default, ignore unused parameters */
-                        break;
-                    }
+                else if (pmoq_subscribe_parameter_set(registry, param, key, l, v) != 0) {
+                    bytes = NULL;
+                    *err = -1;
+                    break;
                 }
             }
         }
@@ -280,821 +402,1383 @@ const uint8_t* pmoq_subscribe_parameters_parse(const uint8_t* bytes, const uint8
     return bytes;
 }
 
-uint8_t* pmoq_msg_subscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe)
-{
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->track_alias)) != NULL &&
-        (bytes = pmoq_tuple_format(bytes, bytes_max, &subscribe->track_namespace)) != NULL &&
-        (bytes = pmoq_bits_format(bytes, bytes_max, &subscribe->track_name)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->filter_type)) != NULL) {
-        if (subscribe->filter_type == pmoq_msg_filter_absolute_start ||
-            subscribe->filter_type == pmoq_msg_filter_absolute_range) {
-            if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->start_group)) != NULL &&
-                (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->start_object)) != NULL &&
-                subscribe->filter_type == pmoq_msg_filter_absolute_range) {
-                if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->end_group)) != NULL)
-                    bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->end_object);
-            }
-        }
-        if (bytes != NULL) {
-            bytes = pmoq_subscribe_parameters_format(bytes, bytes_max, &subscribe->subscribe_parameters);
-        }
+/* Specialized codec.
+* The layout of each message is described in msg_schema.h. The parse,
+* format and size functions of each layout are generated from the list
+* of its fields, so the type, the condition and the check of each field
+* are known at compile time: the compiler inlines the field primitives
+* below and removes the tests of the conditions that do not apply.
+*/
+static const uint8_t* pmoq_versions_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_client_setup_t* client_setup)
+{
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &client_setup->supported_versions_nb)) != NULL &&
+        client_setup->supported_versions_nb > PMOQ_VERSION_NUMBER_MAX) {
+        *err = -1;
+        bytes = NULL;
     }
-    return bytes;
-}
-const uint8_t* pmoq_msg_subscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe)
-{
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 4, &subscribe->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &subscribe->track_alias)) != NULL &&
-        (bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 2, &subscribe->track_namespace)) != NULL &&
-        (bytes = pmoq_bits_parse(bytes, bytes_max, err, needed + 1, &subscribe->track_name)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->filter_type)) != NULL) {
-        if (subscribe->filter_type == pmoq_msg_filter_absolute_start ||
-            subscribe->filter_type == pmoq_msg_filter_absolute_range) {
-            if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->start_group)) != NULL &&
-                (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->start_object)) != NULL &&
-                subscribe->filter_type == pmoq_msg_filter_absolute_range) {
-                if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->end_group)) != NULL)
-                    bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->end_object);
-            }
-        }
-        else if (subscribe->filter_type == 0 ||
-            subscribe->filter_type > pmoq_msg_filter_max) {
-            *err = -1;
-            bytes = NULL;
-        }
+    for (uint64_t i = 0; bytes != NULL && i < client_setup->supported_versions_nb; i++) {
+        uint64_t v;
 
-        if (bytes != NULL) {
-            bytes = pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, &subscribe->subscribe_parameters);
+        if ((bytes = pmoq_varint_parse(bytes, bytes_max, err,
+            needed + (int)(client_setup->supported_versions_nb - i - 1), &v)) != NULL) {
+            if (v > UINT32_MAX) {
+                *err = -1;
+                bytes = NULL;
+            }
+            else {
+                client_setup->supported_versions[i] = (uint32_t)v;
+            }
         }
     }
     return bytes;
 }
 
-
-uint8_t* pmoq_msg_subscribe_update_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe)
+static uint8_t* pmoq_versions_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_client_setup_t* client_setup)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->start_group)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->start_object)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->end_group)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe->end_object)) != NULL) {
-        bytes = pmoq_subscribe_parameters_format(bytes, bytes_max, &subscribe->subscribe_parameters);
+    if (client_setup->supported_versions_nb > PMOQ_VERSION_NUMBER_MAX) {
+        bytes = NULL;
     }
-    return bytes;
-}
-
-const uint8_t* pmoq_msg_subscribe_update_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe)
-{
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 4, &subscribe->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe->start_group)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe->start_object)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe->end_group)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe->end_object)) != NULL) {
-        bytes = pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, &subscribe->subscribe_parameters);
+    else {
+        bytes = picoquic_frames_varint_encode(bytes, bytes_max, client_setup->supported_versions_nb);
+        for (uint64_t i = 0; bytes != NULL && i < client_setup->supported_versions_nb; i++) {
+            bytes = picoquic_frames_varint_encode(bytes, bytes_max, client_setup->supported_versions[i]);
+        }
     }
     return bytes;
 }
 
-uint8_t* pmoq_msg_subscribe_ok_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_ok)
+static size_t pmoq_versions_size(const pmoq_client_setup_t* client_setup)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_ok->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_ok->expires)) != NULL &&
-        (bytes = picoquic_frames_uint8_encode(bytes, bytes_max, subscribe_ok->content_exists)) != NULL) {
-        if (subscribe_ok->content_exists > 0) {
-            if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_ok->largest_group_id)) != NULL) {
-                bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_ok->largest_object_id);
-            }
-        }
-        if (bytes != NULL) {
-            bytes = pmoq_subscribe_parameters_format(bytes, bytes_max, &subscribe_ok->subscribe_parameters);
+    size_t l = 0;
+
+    if (client_setup->supported_versions_nb <= PMOQ_VERSION_NUMBER_MAX) {
+        l = pmoq_varint_size(client_setup->supported_versions_nb);
+        for (uint64_t i = 0; l > 0 && i < client_setup->supported_versions_nb; i++) {
+            l = pmoq_size_add(l, pmoq_varint_size(client_setup->supported_versions[i]));
         }
     }
-    return bytes;
+    return l;
 }
-const uint8_t* pmoq_msg_subscribe_ok_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_ok)
-{
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &subscribe_ok->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe_ok->expires)) != NULL &&
-        (bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, &subscribe_ok->content_exists)) != NULL) {
-        if (subscribe_ok->content_exists == 1) {
-            if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe_ok->largest_group_id)) != NULL) {
-                bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe_ok->largest_object_id);
-            }
-        }
-        else if (subscribe_ok->content_exists > 1) {
-            *err = -1;
-            bytes = NULL;
+
+/* Minimal number of bytes of the fields that follow the field of rank "rank".
+* Each field takes at least one byte. The optional fields are only counted
+* if their presence is already known, i.e., if no field with a check is
+* found before them. */
+static int pmoq_fields_needed(const pmoq_msg_def_t* def, size_t rank, uint64_t selector)
+{
+    int is_known = (def->fields[rank].check == pmoq_field_check_none);
+    int nb_bytes = 0;
+
+    for (size_t i = rank + 1; i < def->nb_fields; i++) {
+        const pmoq_field_def_t* field = &def->fields[i];
+
+        if (field->cond == pmoq_field_cond_none ||
+            (is_known && pmoq_field_is_present(selector, field->cond))) {
+            nb_bytes++;
         }
-        if (bytes != NULL) {
-            bytes = pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, &subscribe_ok->subscribe_parameters);
+        if (field->check != pmoq_field_check_none) {
+            is_known = 0;
         }
     }
-    return bytes;
+    return nb_bytes;
 }
 
-uint8_t* pmoq_msg_subscribe_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_error)
+/* Field primitives, one per type of field. The value that may become
+* the selector is returned in "v". */
+static const uint8_t* pmoq_field_varint_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_error->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_error->error_code)) != NULL &&
-        (bytes = pmoq_bits_format(bytes, bytes_max, &subscribe_error->reason_phrase)) != NULL) {
-        bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_error->track_alias);
-    }
-    return bytes; 
-}
-const uint8_t* pmoq_msg_subscribe_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_error)
-{
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &subscribe_error->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &subscribe_error->error_code)) != NULL &&
-        (bytes = pmoq_bits_parse(bytes, bytes_max, err, needed + 1, &subscribe_error->reason_phrase)) != NULL) {
-        bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe_error->track_alias);
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, (uint64_t*)target)) != NULL) {
+        *v = *(uint64_t*)target;
     }
     return bytes;
 }
 
-uint8_t* pmoq_msg_announce_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * announce)
+static const uint8_t* pmoq_field_uint8_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &announce->track_namespace)) != NULL) {
-        bytes = pmoq_subscribe_parameters_format(bytes, bytes_max, &announce->subscribe_parameters);
+    if ((bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, target)) != NULL) {
+        *v = *target;
     }
- 
     return bytes;
 }
-const uint8_t* pmoq_msg_announce_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * announce)
+
+static const uint8_t* pmoq_field_version_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed+1, &announce->track_namespace)) != NULL) {
-        bytes = pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, &announce->subscribe_parameters);
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, v)) != NULL) {
+        if (*v > UINT32_MAX) {
+            *err = -1;
+            bytes = NULL;
+        }
+        else {
+            *(uint32_t*)target = (uint32_t)*v;
+        }
     }
-
     return bytes;
 }
 
-uint8_t* pmoq_msg_track_namespace_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * tns)
+static const uint8_t* pmoq_field_bits_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    /* is there a size limit ? */
-    return pmoq_tuple_format(bytes, bytes_max, &tns->track_namespace);
+    return pmoq_bits_parse(bytes, bytes_max, err, needed, (pmoq_bits_t*)target);
 }
-const uint8_t* pmoq_msg_track_namespace_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* tns)
+
+static const uint8_t* pmoq_field_tuple_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    return pmoq_tuple_parse(bytes, bytes_max, err, needed, &tns->track_namespace);
+    return pmoq_tuple_parse(bytes, bytes_max, err, needed, (pmoq_tuple_t*)target);
 }
 
-uint8_t* pmoq_msg_announce_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * announce_error)
+static const uint8_t* pmoq_field_versions_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &announce_error->track_namespace)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, announce_error->error_code)) != NULL) {
-        bytes = pmoq_bits_format(bytes, bytes_max, &announce_error->reason_phrase);
-    }
-    return bytes;
+    return pmoq_versions_parse(bytes, bytes_max, err, needed, (pmoq_client_setup_t*)target);
 }
-const uint8_t* pmoq_msg_announce_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* announce_error)
+
+static const uint8_t* pmoq_field_subscribe_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 1, &announce_error->track_namespace)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &announce_error->error_code)) != NULL) {
-        bytes = pmoq_bits_parse(bytes, bytes_max, err, needed, &announce_error->reason_phrase);
-    }
-    return bytes;
+    return pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, registry, (pmoq_subscribe_parameters_t*)target);
 }
 
-
-uint8_t* pmoq_msg_announce_cancel_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* announce_cancel)
+static const uint8_t* pmoq_field_setup_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, uint8_t* target, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &announce_cancel->track_namespace)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, announce_cancel->error_code)) != NULL) {
-        bytes = pmoq_bits_format(bytes, bytes_max, &announce_cancel->reason_phrase);
-    }
-    return bytes;
+    return pmoq_msg_setup_parameters_parse(bytes, bytes_max, err, needed, registry, (pmoq_setup_parameters_t*)target);
 }
-const uint8_t* pmoq_msg_announce_cancel_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* announce_cancel)
+
+static uint8_t* pmoq_field_varint_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 1, &announce_cancel->track_namespace)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &announce_cancel->error_code)) != NULL) {
-        bytes = pmoq_bits_parse(bytes, bytes_max, err, needed, &announce_cancel->reason_phrase);
-    }
-    return bytes;
+    *v = *(const uint64_t*)source;
+    return picoquic_frames_varint_encode(bytes, bytes_max, *v);
 }
 
-uint8_t* pmoq_msg_unsubscribe_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * unsubscribe)
+static uint8_t* pmoq_field_uint8_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    return bytes = picoquic_frames_varint_encode(bytes, bytes_max, unsubscribe->subscribe_id);
+    *v = *source;
+    return picoquic_frames_uint8_encode(bytes, bytes_max, *source);
 }
-const uint8_t* pmoq_msg_unsubscribe_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * unsubscribe)
+
+static uint8_t* pmoq_field_version_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    return bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &unsubscribe->subscribe_id);
+    *v = *(const uint32_t*)source;
+    return picoquic_frames_varint_encode(bytes, bytes_max, *v);
 }
 
-uint8_t* pmoq_msg_subscribe_done_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * subscribe_done)
+static uint8_t* pmoq_field_bits_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_done->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_done->status_code)) != NULL &&
-        (bytes = pmoq_bits_format(bytes, bytes_max, &subscribe_done->reason_phrase)) != NULL &&
-        (bytes = picoquic_frames_uint8_encode(bytes, bytes_max, subscribe_done->content_exists)) != NULL) {
-        if (subscribe_done->content_exists > 0) {
-            if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_done->final_group_id)) != NULL) {
-                bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_done->final_object_id);
-            }
-        }
-    }
-    return bytes;
+    return pmoq_bits_format(bytes, bytes_max, (const pmoq_bits_t*)source);
 }
-const uint8_t* pmoq_msg_subscribe_done_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_done)
+
+static uint8_t* pmoq_field_tuple_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &subscribe_done->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &subscribe_done->status_code)) != NULL &&
-        (bytes = pmoq_bits_parse(bytes, bytes_max, err, needed + 1, &subscribe_done->reason_phrase)) != NULL &&
-        (bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, &subscribe_done->content_exists)) != NULL) {
-        if (subscribe_done->content_exists == 1) {
-            if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe_done->final_group_id)) != NULL) {
-                bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &subscribe_done->final_object_id);
-            }
-        }
-        else if (subscribe_done->content_exists > 1) {
-            *err = -1;
-            bytes = NULL;
-        }
-    }
-    return bytes;
+    return pmoq_tuple_format(bytes, bytes_max, (const pmoq_tuple_t*)source);
 }
 
-uint8_t* pmoq_msg_track_status_request_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * track_status_request)
+static uint8_t* pmoq_field_versions_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &track_status_request->track_namespace)) != NULL) {
-        bytes = pmoq_bits_format(bytes, bytes_max, &track_status_request->track_name);
-    }
-    return bytes; 
+    return pmoq_versions_format(bytes, bytes_max, (const pmoq_client_setup_t*)source);
 }
-const uint8_t* pmoq_msg_track_status_request_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* track_status_request)
+
+static uint8_t* pmoq_field_subscribe_parameters_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 1, &track_status_request->track_namespace)) != NULL) {
-        bytes = pmoq_bits_parse(bytes, bytes_max, err, needed, &track_status_request->track_name);
-    }
-    return bytes;
+    return pmoq_subscribe_parameters_format(bytes, bytes_max, (const pmoq_subscribe_parameters_t*)source);
 }
 
-uint8_t* pmoq_msg_track_status_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * track_status)
+static uint8_t* pmoq_field_setup_parameters_format(uint8_t* bytes, const uint8_t* bytes_max, const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &track_status->track_namespace)) != NULL &&
-        (bytes = pmoq_bits_format(bytes, bytes_max, &track_status->track_name)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, track_status->status_code)) != NULL) {
-        if (track_status->status_code == PMOQ_TRACK_STATUS_IN_PROGRESS) {
-            if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, track_status->last_group_id)) != NULL) {
-                bytes = picoquic_frames_varint_encode(bytes, bytes_max, track_status->last_object_id);
-            }
-        }
-    }
-    return bytes; 
+    return pmoq_msg_setup_parameters_format(bytes, bytes_max, (const pmoq_setup_parameters_t*)source);
 }
-const uint8_t* pmoq_msg_track_status_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* track_status)
+
+static size_t pmoq_field_varint_size(const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 2, &track_status->track_namespace)) != NULL &&
-        (bytes = pmoq_bits_parse(bytes, bytes_max, err, needed + 1, &track_status->track_name)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &track_status->status_code)) != NULL) {
-        if (track_status->status_code == PMOQ_TRACK_STATUS_IN_PROGRESS) {
-            if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &track_status->last_group_id)) != NULL) {
-                bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &track_status->last_object_id);
-            }
-        }
-        else if (track_status->status_code > PMOQ_TRACK_STATUS_MAX) {
-            *err = -1;
-            bytes = NULL;
-        }
-    }
-    return bytes;
+    *v = *(const uint64_t*)source;
+    return pmoq_varint_size(*v);
 }
 
-uint8_t* pmoq_msg_goaway_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * goaway)
+static size_t pmoq_field_uint8_size(const uint8_t* source, uint64_t* v)
 {
-    return pmoq_bits_format(bytes, bytes_max, &goaway->uri);
+    *v = *source;
+    return 1;
 }
-const uint8_t* pmoq_msg_goaway_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * goaway)
+
+static size_t pmoq_field_version_size(const uint8_t* source, uint64_t* v)
 {
-    return pmoq_bits_parse(bytes, bytes_max, err, needed, &goaway->uri);
+    *v = *(const uint32_t*)source;
+    return pmoq_varint_size(*v);
 }
 
-uint8_t* pmoq_msg_subscribe_namespace_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* subscribe_namespace)
+static size_t pmoq_field_bits_size(const uint8_t* source, uint64_t* v)
 {
-
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &subscribe_namespace->track_namespace)) != NULL) {
-        bytes = pmoq_subscribe_parameters_format(bytes, bytes_max, &subscribe_namespace->subscribe_parameters);
-    }
-    return bytes;
+    return pmoq_bits_size((const pmoq_bits_t*)source);
 }
-const uint8_t* pmoq_msg_subscribe_namespace_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_namespace)
+
+static size_t pmoq_field_tuple_size(const uint8_t* source, uint64_t* v)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed, &subscribe_namespace->track_namespace)) != NULL) {
-        bytes = pmoq_subscribe_parameters_parse(bytes, bytes_max, err, needed, &subscribe_namespace->subscribe_parameters);
-    }
-    return bytes;
+    return pmoq_tuple_size((const pmoq_tuple_t*)source);
 }
 
-uint8_t* pmoq_msg_unsubscribe_namespace_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* unsubscribe_namespace)
+static size_t pmoq_field_versions_size(const uint8_t* source, uint64_t* v)
 {
-    return bytes = pmoq_tuple_format(bytes, bytes_max, &unsubscribe_namespace->track_namespace);
+    return pmoq_versions_size((const pmoq_client_setup_t*)source);
 }
-const uint8_t* pmoq_msg_unsubscribe_namespace_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* unsubscribe_namespace)
+
+static size_t pmoq_field_subscribe_parameters_size(const uint8_t* source, uint64_t* v)
 {
-    return pmoq_tuple_parse(bytes, bytes_max, err, needed, &unsubscribe_namespace->track_namespace);
+    return pmoq_subscribe_parameters_size((const pmoq_subscribe_parameters_t*)source);
 }
 
-uint8_t* pmoq_msg_subscribe_namespace_ok_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* subscribe_namespace_ok)
+static size_t pmoq_field_setup_parameters_size(const uint8_t* source, uint64_t* v)
 {
-    return bytes = pmoq_tuple_format(bytes, bytes_max, &subscribe_namespace_ok->track_namespace);
+    return pmoq_msg_setup_parameters_size((const pmoq_setup_parameters_t*)source);
 }
-const uint8_t* pmoq_msg_subscribe_namespace_ok_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_namespace_ok)
+
+/* Values decoded by the fast decoder, for the fields of the data streams */
+static void pmoq_field_varint_store(uint8_t* target, uint64_t v)
 {
-    return pmoq_tuple_parse(bytes, bytes_max, err, needed, &subscribe_namespace_ok->track_namespace);
+    *(uint64_t*)target = v;
 }
 
-uint8_t* pmoq_msg_subscribe_namespace_error_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* subscribe_namespace_error)
+static void pmoq_field_uint8_store(uint8_t* target, uint64_t v)
 {
-    if ((bytes = pmoq_tuple_format(bytes, bytes_max, &subscribe_namespace_error->track_namespace)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, subscribe_namespace_error->error_code)) != NULL) {
-        bytes = pmoq_bits_format(bytes, bytes_max, &subscribe_namespace_error->reason_phrase);
+    *target = (uint8_t)v;
+}
+
+/* Parse one field of a type only known at run time, for the view */
+static const uint8_t* pmoq_field_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, pmoq_field_type_enum field_type, uint8_t* target, uint64_t* v)
+{
+    switch (field_type) {
+    case pmoq_field_varint:
+        return pmoq_field_varint_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_uint8:
+        return pmoq_field_uint8_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_version:
+        return pmoq_field_version_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_bits:
+        return pmoq_field_bits_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_tuple:
+        return pmoq_field_tuple_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_versions:
+        return pmoq_field_versions_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_subscribe_parameters:
+        return pmoq_field_subscribe_parameters_parse(bytes, bytes_max, err, needed, registry, target, v);
+    case pmoq_field_setup_parameters:
+        return pmoq_field_setup_parameters_parse(bytes, bytes_max, err, needed, registry, target, v);
+    default:
+        *err = -1;
+        return NULL;
     }
-    return bytes;
 }
-const uint8_t* pmoq_msg_subscribe_namespace_error_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* subscribe_namespace_error)
+
+pmoq_param_values_t* pmoq_field_param_values(pmoq_field_type_enum field_type, uint8_t* target)
 {
-    if ((bytes = pmoq_tuple_parse(bytes, bytes_max, err, needed + 1, &subscribe_namespace_error->track_namespace)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &subscribe_namespace_error->error_code)) != NULL) {
-        bytes = pmoq_bits_parse(bytes, bytes_max, err, needed, &subscribe_namespace_error->reason_phrase);
+    switch (field_type) {
+    case pmoq_field_subscribe_parameters:
+        return &((pmoq_subscribe_parameters_t*)target)->extensions;
+    case pmoq_field_setup_parameters:
+        return &((pmoq_setup_parameters_t*)target)->extensions;
+    default:
+        return NULL;
     }
-    return bytes;
 }
 
-uint8_t* pmoq_msg_max_subscribe_id_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* max_subscribe_id)
-{
-    return picoquic_frames_varint_encode(bytes, bytes_max, max_subscribe_id->subscribe_id);
+/* Generated code. A field is parsed if it is present, and from rank
+* "first" on; the hint returned when bytes are missing adds the minimal
+* size of the fields that are not parsed yet. */
+#define PMOQ_FIELD_PARSE(T, t, c, k, f) \
+    if (bytes != NULL && rank >= first && PMOQ_FIELD_COND_##c(selector)) { \
+        uint64_t v = 0; \
+        if ((bytes = pmoq_field_##t##_parse(bytes, bytes_max, err, needed, registry, \
+            (uint8_t*)body + offsetof(T, f), &v)) == NULL) { \
+            if (*err > 0) { \
+                *err += pmoq_fields_needed(def, rank, selector); \
+            } \
+        } \
+        else if (pmoq_field_check_##k != pmoq_field_check_none) { \
+            if (PMOQ_FIELD_INVALID_##k(v)) { \
+                *err = -1; \
+                bytes = NULL; \
+            } \
+            else { \
+                selector = v; \
+            } \
+        } \
+    } \
+    rank++;
+
+#define PMOQ_FIELD_FORMAT(T, t, c, k, f) \
+    if (bytes != NULL && PMOQ_FIELD_COND_##c(selector)) { \
+        uint64_t v = 0; \
+        bytes = pmoq_field_##t##_format(bytes, bytes_max, (const uint8_t*)body + offsetof(T, f), &v); \
+        if (pmoq_field_check_##k != pmoq_field_check_none) { \
+            selector = v; \
+        } \
+    }
+
+#define PMOQ_FIELD_SIZE(T, t, c, k, f) \
+    if (is_valid && PMOQ_FIELD_COND_##c(selector)) { \
+        uint64_t v = 0; \
+        size_t x = pmoq_field_##t##_size((const uint8_t*)body + offsetof(T, f), &v); \
+        is_valid = (x > 0); \
+        l += x; \
+        if (pmoq_field_check_##k != pmoq_field_check_none) { \
+            selector = v; \
+        } \
+    }
+
+/* Object headers are on the data path. The leading fields that are always
+* present are decoded in one pass by the fast decoder when the buffer is
+* long enough, the rest of the fields by the bounded parsers. The fast
+* layout and its length are constants. */
+#define PMOQ_FAST_FIELD_varint PMOQ_FAST_FIELD_VARINT
+#define PMOQ_FAST_FIELD_uint8 PMOQ_FAST_FIELD_UINT8
+#define PMOQ_FIELD_FAST_CODE(T, t, c, k, f) PMOQ_FAST_FIELD_##t,
+#define PMOQ_FIELD_FAST_COUNT(T, t, c, k, f) ((pmoq_field_cond_##c == pmoq_field_cond_none) ? 1 +
+#define PMOQ_FIELD_FAST_COUNT_END(T, t, c, k, f) : 0)
+
+#define PMOQ_FIELD_FAST_STORE(T, t, c, k, f) \
+    if (rank < nb_fast) { \
+        pmoq_field_##t##_store((uint8_t*)body + offsetof(T, f), v[rank]); \
+        if (pmoq_field_check_##k != pmoq_field_check_none) { \
+            if (PMOQ_FIELD_INVALID_##k(v[rank])) { \
+                *err = -1; \
+                return NULL; \
+            } \
+            selector = v[rank]; \
+        } \
+    } \
+    rank++;
+
+#define PMOQ_LAYOUT_FORMAT_SIZE(name, T, list) \
+uint8_t* pmoq_layout_##name##_format(uint8_t* bytes, const uint8_t* bytes_max, const void* body) \
+{ \
+    uint64_t selector = 0; \
+    (void)selector; \
+    list(PMOQ_FIELD_FORMAT, T) \
+    return bytes; \
+} \
+size_t pmoq_layout_##name##_size(const void* body) \
+{ \
+    uint64_t selector = 0; \
+    int is_valid = 1; \
+    size_t l = 0; \
+    (void)selector; \
+    list(PMOQ_FIELD_SIZE, T) \
+    return (is_valid) ? l : 0; \
 }
-const uint8_t* pmoq_msg_max_subscribe_id_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* max_subscribe_id)
+
+#define PMOQ_MSG_LAYOUT_CODEC(name, T, list) \
+const uint8_t* pmoq_layout_##name##_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, \
+    const pmoq_param_registry_t* registry, void* body) \
+{ \
+    const pmoq_msg_def_t* def = &pmoq_layout_##name##_def; \
+    uint64_t selector = 0; \
+    size_t first = 0; \
+    size_t rank = 0; \
+    list(PMOQ_FIELD_PARSE, T) \
+    return bytes; \
+} \
+PMOQ_LAYOUT_FORMAT_SIZE(name, T, list)
+
+#define PMOQ_STRM_LAYOUT_CODEC(name, T, list) \
+const uint8_t* pmoq_layout_##name##_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, \
+    const pmoq_param_registry_t* registry, void* body) \
+{ \
+    static const uint8_t layout[] = { list(PMOQ_FIELD_FAST_CODE, T) }; \
+    const size_t nb_fast = list(PMOQ_FIELD_FAST_COUNT, T) 0 list(PMOQ_FIELD_FAST_COUNT_END, T); \
+    const pmoq_msg_def_t* def = &pmoq_layout_##name##_def; \
+    const uint8_t* fast_bytes; \
+    uint64_t v[sizeof(layout)]; \
+    uint64_t selector = 0; \
+    size_t first = 0; \
+    size_t rank = 0; \
+    if ((fast_bytes = pmoq_varint_fast_decode(bytes, bytes_max, layout, nb_fast, v)) != NULL) { \
+        bytes = fast_bytes; \
+        list(PMOQ_FIELD_FAST_STORE, T) \
+        first = nb_fast; \
+        rank = 0; \
+    } \
+    list(PMOQ_FIELD_PARSE, T) \
+    return bytes; \
+} \
+PMOQ_LAYOUT_FORMAT_SIZE(name, T, list)
+
+PMOQ_MSG_LAYOUTS(PMOQ_MSG_LAYOUT_CODEC)
+PMOQ_STRM_LAYOUTS(PMOQ_STRM_LAYOUT_CODEC)
+
+/* Validation only. The skip functions apply the same structural checks
+* as the parse functions, e.g., lengths, counts and field values that
+* govern the layout, but write nothing: the strings, tuples and
+* parameters are stepped over without being decoded. */
+static const uint8_t* pmoq_bytes_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t nb_bytes)
 {
-    return pmoq_varint_parse(bytes, bytes_max, err, needed, &max_subscribe_id->subscribe_id);
+    if (nb_bytes > (uint64_t)(bytes_max - bytes)) {
+        uint64_t missing = nb_bytes - (uint64_t)(bytes_max - bytes) + (uint64_t)needed;
+        *err = (missing > INT32_MAX) ? INT32_MAX : (int)missing;
+        return NULL;
+    }
+    return bytes + nb_bytes;
 }
 
-uint8_t* pmoq_msg_client_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * client_setup)
+static const uint8_t* pmoq_bits_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, client_setup->supported_versions_nb)) != NULL) {
-        if (client_setup->supported_versions_nb > PMOQ_VERSION_NUMBER_MAX) {
+    uint64_t nb_bits;
+
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_bits)) != NULL) {
+        uint64_t nb_bytes = (nb_bits + 7) >> 3;
+
+        if (nb_bytes > (uint64_t)(bytes_max - bytes) && nb_bits > PMOQ_BIT_STRING_SIZE_MAX) {
+            *err = -1;
             bytes = NULL;
         }
         else {
-            for (uint64_t i = 0; i < client_setup->supported_versions_nb; i++) {
-                if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, client_setup->supported_versions[i])) == NULL) {
-                    break;
-                }
-            }
-            if (bytes != NULL) {
-                /* Encode parameters */
-                bytes = pmoq_msg_setup_parameters_format(bytes, bytes_max, &client_setup->setup_parameters);
-            }
+            bytes = pmoq_bytes_skip(bytes, bytes_max, err, needed, nb_bytes);
         }
     }
-
     return bytes;
 }
-const uint8_t* pmoq_msg_client_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * client_setup)
+
+static const uint8_t* pmoq_tuple_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &client_setup->supported_versions_nb)) != NULL) {
-        if (client_setup->supported_versions_nb > PMOQ_VERSION_NUMBER_MAX) {
+    uint64_t nb_items;
+
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_items)) != NULL) {
+        if (nb_items > PMOQ_TUPLE_SIZE_MAX) {
+            *err = -1;
             bytes = NULL;
         }
-        else {
-            for (int i = 0; i < (int)client_setup->supported_versions_nb; i++) {
-                uint64_t v;
-                if ((bytes = pmoq_varint_parse(bytes, bytes_max, err,
-                    needed + (int)client_setup->supported_versions_nb - i, &v)) == NULL ||
-                    v > UINT32_MAX) {
-                    bytes = NULL;
-                    break;
-                }
-                client_setup->supported_versions[i] = (uint32_t)v;
-            }
-            if (bytes != NULL) {
-                /* Decode parameters */
-                bytes = pmoq_msg_setup_parameters_parse(bytes, bytes_max, err, needed, &client_setup->setup_parameters);
-            }
+        for (uint64_t i = 0; bytes != NULL && i < nb_items; i++) {
+            bytes = pmoq_bits_skip(bytes, bytes_max, err, needed);
         }
     }
-    
     return bytes;
 }
 
-uint8_t* pmoq_msg_server_setup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* server_setup)
+static const uint8_t* pmoq_versions_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, server_setup->selected_version)) != NULL) {
-        bytes = pmoq_msg_setup_parameters_format(bytes, bytes_max, &server_setup->setup_parameters);
+    uint64_t nb_versions;
+
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_versions)) != NULL &&
+        nb_versions > PMOQ_VERSION_NUMBER_MAX) {
+        *err = -1;
+        bytes = NULL;
     }
-    return bytes;
-}
-const uint8_t* pmoq_msg_server_setup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* server_setup)
-{
-    uint64_t v;
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed+1, &v)) != NULL) {
-        if (v > UINT32_MAX) {
-            bytes = NULL;
+    for (uint64_t i = 0; bytes != NULL && i < nb_versions; i++) {
+        uint64_t v;
+
+        if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + (int)(nb_versions - i - 1), &v)) != NULL &&
+            v > UINT32_MAX) {
             *err = -1;
-        }
-        else {
-            server_setup->selected_version = (uint32_t)v;
-            bytes = pmoq_msg_setup_parameters_parse(bytes, bytes_max, err, needed, &server_setup->setup_parameters);
+            bytes = NULL;
         }
     }
     return bytes;
 }
 
-#if 0
-uint8_t* pmoq_msg_stream_header_group_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * header_group)
-{ 
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_group->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_group->track_alias)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_group->group_id)) != NULL)
-    {
-        bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_group->object_send_order);
-    }
-    return bytes;
-}
-const uint8_t* pmoq_msg_stream_header_group_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* header_group)
+/* The values of the parameters are not checked, and unknown or repeated
+ * parameters are not detected */
+static const uint8_t* pmoq_parameters_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, int is_setup)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &header_group->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &header_group->track_alias)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &header_group->group_id)) != NULL) {
-        bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &header_group->object_send_order);
-    }
-    return bytes;
-}
+    uint64_t nb_params;
 
-uint8_t* pmoq_msg_stream_object_header_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t * object_header)
-{ 
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, object_header->object_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, object_header->payload_length)) != NULL) {
-        if (object_header->payload_length == 0) {
-            bytes = picoquic_frames_varint_encode(bytes, bytes_max, object_header->object_status);
-        }
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &nb_params)) != NULL &&
+        (nb_params > PMOQ_PARAMETERS_NUMBER_MAX || (is_setup && nb_params == 0))) {
+        *err = -1;
+        bytes = NULL;
     }
-    return bytes;
-}
-const uint8_t* pmoq_msg_stream_object_header_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t * object_header)
-{ 
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed+1, &object_header->object_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &object_header->payload_length)) != NULL) {
-        if (object_header->payload_length == 0) {
-            bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &object_header->object_status);
-            if (object_header->object_status > PMOQ_OBJECT_STATUS_END_OF_GROUP_AND_TRACK) {
-                *err = -1;
-                bytes = NULL;
-            }
-        }
+    for (uint64_t i = 0; bytes != NULL && i < nb_params; i++) {
+        uint64_t key;
+        uint64_t l;
+        uint8_t* v;
+
+        bytes = pmoq_msg_parameter_parse(bytes, bytes_max, err, needed + 2 * (int)(nb_params - i - 1), &key, &l, &v);
     }
     return bytes;
 }
-#endif
 
-uint8_t * pmoq_msg_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_msg_t* msg)
+static const uint8_t* pmoq_field_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    pmoq_field_type_enum field_type, uint64_t* v)
 {
-    switch (msg_type) {
-    case PMOQ_MSG_SUBSCRIBE_UPDATE:
-        bytes = pmoq_msg_subscribe_update_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE:
-        bytes = pmoq_msg_subscribe_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_OK:
-        bytes = pmoq_msg_subscribe_ok_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_ERROR:
-        bytes = pmoq_msg_subscribe_error_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE:
-        bytes = pmoq_msg_announce_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE_OK:
-        bytes = pmoq_msg_track_namespace_format(bytes, bytes_max, msg);
+    uint8_t v8;
+
+    switch (field_type) {
+    case pmoq_field_varint:
+        bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, v);
         break;
-    case PMOQ_MSG_ANNOUNCE_ERROR:
-        bytes = pmoq_msg_announce_error_format(bytes, bytes_max, msg);
+    case pmoq_field_uint8:
+        if ((bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, &v8)) != NULL) {
+            *v = v8;
+        }
         break;
-    case PMOQ_MSG_UNANNOUNCE:
-        bytes = pmoq_msg_track_namespace_format(bytes, bytes_max, msg);
+    case pmoq_field_version:
+        if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, v)) != NULL && *v > UINT32_MAX) {
+            *err = -1;
+            bytes = NULL;
+        }
         break;
-    case PMOQ_MSG_UNSUBSCRIBE:
-        bytes = pmoq_msg_unsubscribe_format(bytes, bytes_max,  msg);
+    case pmoq_field_bits:
+        bytes = pmoq_bits_skip(bytes, bytes_max, err, needed);
         break;
-    case PMOQ_MSG_SUBSCRIBE_DONE:
-        bytes = pmoq_msg_subscribe_done_format(bytes, bytes_max, msg);
+    case pmoq_field_tuple:
+        bytes = pmoq_tuple_skip(bytes, bytes_max, err, needed);
         break;
-    case PMOQ_MSG_ANNOUNCE_CANCEL:
-        bytes = pmoq_msg_announce_cancel_format(bytes, bytes_max, msg);
+    case pmoq_field_versions:
+        bytes = pmoq_versions_skip(bytes, bytes_max, err, needed);
         break;
-    case PMOQ_MSG_TRACK_STATUS_REQUEST:
-        bytes = pmoq_msg_track_status_request_format(bytes, bytes_max, msg);
+    case pmoq_field_subscribe_parameters:
+        bytes = pmoq_parameters_skip(bytes, bytes_max, err, needed, 0);
         break;
-    case PMOQ_MSG_TRACK_STATUS:
-        bytes = pmoq_msg_track_status_format(bytes, bytes_max, msg);
+    case pmoq_field_setup_parameters:
+        bytes = pmoq_parameters_skip(bytes, bytes_max, err, needed, 1);
         break;
-    case PMOQ_MSG_GOAWAY:
-        bytes = pmoq_msg_goaway_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE:
-        bytes = pmoq_msg_subscribe_namespace_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_UNSUBSCRIBE_NAMESPACE:
-        bytes = pmoq_msg_unsubscribe_namespace_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_OK:
-        bytes = pmoq_msg_subscribe_namespace_ok_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_ERROR:
-        bytes = pmoq_msg_subscribe_namespace_error_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_MAX_SUBSCRIBE_ID:
-        bytes = pmoq_msg_max_subscribe_id_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_CLIENT_SETUP:
-        bytes = pmoq_msg_client_setup_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_MSG_SERVER_SETUP:
-        bytes = pmoq_msg_server_setup_format(bytes, bytes_max, msg);
-        break;
-    default:
-        /* Unexpected */
-        bytes = NULL;
+    default:
+        *err = -1;
+        bytes = NULL;
         break;
     }
     return bytes;
 }
 
-const uint8_t * pmoq_msg_keyed_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t msg_type, pmoq_msg_t* msg)
-{
-    switch (msg_type) {
-    case PMOQ_MSG_SUBSCRIBE_UPDATE: 
-        bytes = pmoq_msg_subscribe_update_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE: 
-        bytes = pmoq_msg_subscribe_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_OK:
-        bytes = pmoq_msg_subscribe_ok_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_ERROR:
-        bytes = pmoq_msg_subscribe_error_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE:
-        bytes = pmoq_msg_announce_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE_OK:
-        bytes = pmoq_msg_track_namespace_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE_ERROR:
-        bytes = pmoq_msg_announce_cancel_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_UNANNOUNCE:
-        bytes = pmoq_msg_track_namespace_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_UNSUBSCRIBE:
-        bytes = pmoq_msg_unsubscribe_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_DONE:
-        bytes = pmoq_msg_subscribe_done_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_ANNOUNCE_CANCEL:
-        bytes = pmoq_msg_announce_cancel_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_TRACK_STATUS_REQUEST:
-        bytes = pmoq_msg_track_status_request_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_TRACK_STATUS:
-        bytes = pmoq_msg_track_status_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_GOAWAY:
-        bytes = pmoq_msg_goaway_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE:
-        bytes = pmoq_msg_subscribe_namespace_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_UNSUBSCRIBE_NAMESPACE:
-        bytes = pmoq_msg_unsubscribe_namespace_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_OK:
-        bytes = pmoq_msg_subscribe_namespace_ok_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_ERROR:
-        bytes = pmoq_msg_subscribe_namespace_error_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_MAX_SUBSCRIBE_ID:
-        bytes = pmoq_msg_max_subscribe_id_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_CLIENT_SETUP:
-        bytes = pmoq_msg_client_setup_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    case PMOQ_MSG_SERVER_SETUP:
-        bytes = pmoq_msg_server_setup_parse(bytes, bytes_max, err, needed, msg);
-        break;
-    default:
+/* The payload length, if the layout has one, is returned for the objects.
+* If "starts" is not NULL, the offset of each field from "bytes" is
+* recorded in it, or PMOQ_MSG_VIEW_ABSENT if the field is not present. */
+static const uint8_t* pmoq_fields_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_msg_def_t* def, uint64_t* payload_length, uint32_t* starts)
+{
+    const uint8_t* first = bytes;
+    uint64_t selector = 0;
+
+    if (def == NULL) {
         /* Unexpected */
         *err = -1;
-        bytes = NULL;
-        break;
+        return NULL;
+    }
+    *payload_length = 0;
+    for (size_t i = 0; bytes != NULL && i < def->nb_fields; i++) {
+        const pmoq_field_def_t* field = &def->fields[i];
+        uint64_t v = 0;
+
+        if (!pmoq_field_is_present(selector, field->cond)) {
+            if (starts != NULL) {
+                starts[i] = PMOQ_MSG_VIEW_ABSENT;
+            }
+            continue;
+        }
+        if (starts != NULL) {
+            starts[i] = (uint32_t)(bytes - first);
+        }
+        if ((bytes = pmoq_field_skip(bytes, bytes_max, err, needed, field->field_type, &v)) == NULL) {
+            if (*err > 0) {
+                *err += pmoq_fields_needed(def, i, selector);
+            }
+        }
+        else if (field->check != pmoq_field_check_none) {
+            if (pmoq_field_check(v, field->check) != 0) {
+                *err = -1;
+                bytes = NULL;
+            }
+            else {
+                selector = v;
+                if (field->check == pmoq_field_check_payload_length) {
+                    *payload_length = v;
+                }
+            }
+        }
     }
     return bytes;
 }
 
-uint8_t* pmoq_msg_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* msg)
+/* Per message functions of the API, for the messages that have a structure of their own */
+#define PMOQ_MSG_CODEC(name, body_type, layout) \
+uint8_t* pmoq_msg_##name##_format(uint8_t* bytes, const uint8_t* bytes_max, const body_type* body) \
+{ \
+    return pmoq_layout_##layout##_format(bytes, bytes_max, body); \
+} \
+const uint8_t* pmoq_msg_##name##_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, body_type* body) \
+{ \
+    return pmoq_layout_##layout##_parse(bytes, bytes_max, err, needed, NULL, body); \
+}
+
+PMOQ_MSG_CODEC(subscribe, pmoq_subscribe_t, subscribe)
+PMOQ_MSG_CODEC(subscribe_ok, pmoq_subscribe_ok_t, subscribe_ok)
+PMOQ_MSG_CODEC(subscribe_error, pmoq_subscribe_error_t, subscribe_error)
+PMOQ_MSG_CODEC(announce, pmoq_announce_t, namespace_parameters)
+PMOQ_MSG_CODEC(track_namespace, pmoq_announce_ok_t, namespace)
+PMOQ_MSG_CODEC(announce_error, pmoq_announce_error_t, namespace_error)
+PMOQ_MSG_CODEC(unsubscribe, pmoq_unsubscribe_t, subscribe_id)
+PMOQ_MSG_CODEC(subscribe_done, pmoq_subscribe_done_t, subscribe_done)
+PMOQ_MSG_CODEC(track_status_request, pmoq_track_status_request_t, track_status_request)
+PMOQ_MSG_CODEC(track_status, pmoq_track_status_t, track_status)
+PMOQ_MSG_CODEC(goaway, pmoq_goaway_t, goaway)
+PMOQ_MSG_CODEC(client_setup, pmoq_client_setup_t, client_setup)
+PMOQ_MSG_CODEC(server_setup, pmoq_server_setup_t, server_setup)
+
+/* Control messages, for a layout found in the codec. The layout is NULL,
+ * which is unexpected, if the type is unknown. */
+static uint8_t* pmoq_msg_def_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_def_t* def, const pmoq_msg_t* msg)
+{
+    return (def == NULL) ? NULL : def->format(bytes, bytes_max, &msg->u);
+}
+
+static size_t pmoq_msg_def_size(const pmoq_msg_def_t* def, const pmoq_msg_t* msg)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, msg->msg_type)) != NULL) {
-        bytes = pmoq_msg_keyed_format(bytes, bytes_max, msg->msg_type, msg);
+    return (def == NULL) ? 0 : def->size(&msg->u);
+}
+
+uint8_t * pmoq_msg_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_msg_t* msg)
+{
+    return pmoq_msg_def_format(bytes, bytes_max, pmoq_msg_def_get(msg_type), msg);
+}
+
+size_t pmoq_msg_keyed_encoded_size(uint64_t msg_type, const pmoq_msg_t* msg)
+{
+    return pmoq_msg_def_size(pmoq_msg_def_get(msg_type), msg);
+}
+
+void pmoq_arena_init(pmoq_arena_t* arena, uint8_t* base, size_t size)
+{
+    arena->base = base;
+    arena->size = (base == NULL) ? 0 : size;
+    arena->used = 0;
+}
+
+void* pmoq_arena_alloc(pmoq_arena_t* arena, size_t length, size_t align)
+{
+    size_t offset = (size_t)((((uintptr_t)arena->base + arena->used + align - 1) & ~((uintptr_t)align - 1)) - (uintptr_t)arena->base);
+    void* p = NULL;
+
+    if (arena->base != NULL && offset <= arena->size && length <= arena->size - offset) {
+        p = arena->base + offset;
+        arena->used = offset + length;
     }
-    return bytes;
+    return p;
 }
 
-const uint8_t* pmoq_msg_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* msg)
+void pmoq_arena_reset(pmoq_arena_t* arena)
+{
+    arena->used = 0;
+}
+
+/* Copy a value in the arena and point to the copy. Empty values also get
+ * a pointer in the arena, so that the parameters that are present keep a
+ * non NULL pointer. */
+static int pmoq_arena_copy(pmoq_arena_t* arena, uint8_t** v, size_t length)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &msg->msg_type)) != NULL) {
-        bytes = pmoq_msg_keyed_parse(bytes, bytes_max, err, needed, msg->msg_type, msg);
+    uint8_t* copy;
+
+    if (*v == NULL) {
+        return 0;
     }
-    return bytes;
+    if ((copy = (uint8_t*)pmoq_arena_alloc(arena, length, 1)) == NULL) {
+        return -1;
+    }
+    if (length > 0) {
+        memcpy(copy, *v, length);
+    }
+    *v = copy;
+    return 0;
+}
+
+static int pmoq_arena_copy_bits(pmoq_arena_t* arena, pmoq_bits_t* bits_string)
+{
+    return pmoq_arena_copy(arena, &bits_string->bits, (size_t)((bits_string->nb_bits + 7) >> 3));
+}
+
+static int pmoq_arena_copy_values(pmoq_arena_t* arena, pmoq_param_values_t* values, int copy_values)
+{
+    int ret = 0;
+
+    if (copy_values) {
+        pmoq_param_value_t* copy = (pmoq_param_value_t*)pmoq_arena_alloc(arena, values->nb_values * sizeof(pmoq_param_value_t), sizeof(uint64_t));
+
+        if (copy == NULL) {
+            return -1;
+        }
+        if (values->nb_values > 0) {
+            memcpy(copy, values->values, values->nb_values * sizeof(pmoq_param_value_t));
+        }
+        values->values = copy;
+        values->values_max = values->nb_values;
+    }
+    for (size_t i = 0; ret == 0 && i < values->nb_values; i++) {
+        ret = pmoq_arena_copy(arena, &values->values[i].bytes, values->values[i].length);
+    }
+    return ret;
 }
 
-/* Todo: the code spaces for datagrams, object, and track headers is
-* separate
-*             | 0x1 | OBJECT_DATAGRAM (Section 7.2)          |
-                         +-----+----------------------------------------+
-                         | 0x2 | STREAM_HEADER_TRACK (Section 7.3.1)    |
-                         +-----+----------------------------------------+
-                         | 0x4 | STREAM_HEADER_SUBGROUP (Section 7.3.2) |
- */
+static int pmoq_arena_copy_tuple(pmoq_arena_t* arena, pmoq_tuple_t* tuple, int copy_items)
+{
+    int ret = 0;
+
+    if (copy_items) {
+        pmoq_bits_t* items = (pmoq_bits_t*)pmoq_arena_alloc(arena, (size_t)tuple->nb_items * sizeof(pmoq_bits_t), sizeof(uint64_t));
+
+        if (items == NULL) {
+            return -1;
+        }
+        if (tuple->nb_items > 0) {
+            memcpy(items, tuple->items, (size_t)tuple->nb_items * sizeof(pmoq_bits_t));
+        }
+        tuple->items = items;
+        tuple->items_max = (size_t)tuple->nb_items;
+    }
+    for (uint64_t i = 0; ret == 0 && i < tuple->nb_items; i++) {
+        ret = pmoq_arena_copy_bits(arena, &tuple->items[i]);
+    }
+    return ret;
+}
+
+/* Copy the side data of a parsed message in the arena */
+static int pmoq_msg_arena_copy(pmoq_arena_t* arena, const pmoq_msg_def_t* def, pmoq_msg_t* msg, int copy_items, int copy_values)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < def->nb_fields; i++) {
+        uint8_t* target = (uint8_t*)&msg->u + def->fields[i].offset;
+
+        switch (def->fields[i].field_type) {
+        case pmoq_field_bits:
+            ret = pmoq_arena_copy_bits(arena, (pmoq_bits_t*)target);
+            break;
+        case pmoq_field_tuple:
+            ret = pmoq_arena_copy_tuple(arena, (pmoq_tuple_t*)target, copy_items);
+            break;
+        case pmoq_field_subscribe_parameters: {
+            pmoq_subscribe_parameters_t* param = (pmoq_subscribe_parameters_t*)target;
+            if ((ret = pmoq_arena_copy(arena, &param->auth_info, param->auth_info_len)) == 0) {
+                ret = pmoq_arena_copy_values(arena, &param->extensions, copy_values);
+            }
+            break;
+        }
+        case pmoq_field_setup_parameters: {
+            pmoq_setup_parameters_t* param = (pmoq_setup_parameters_t*)target;
+            if ((ret = pmoq_arena_copy(arena, &param->path, param->path_length)) == 0) {
+                ret = pmoq_arena_copy_values(arena, &param->extensions, copy_values);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return ret;
+}
+
+static pmoq_tuple_t* pmoq_msg_def_namespace(const pmoq_msg_def_t* def, pmoq_msg_t* msg)
+{
+    return (def == NULL || def->namespace_offset == PMOQ_FIELD_NO_OFFSET) ? NULL :
+        (pmoq_tuple_t*)((uint8_t*)&msg->u + def->namespace_offset);
+}
 
-const uint8_t* pmoq_strm_object_status_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
-    uint64_t payload_length, uint64_t* object_status)
+static pmoq_param_values_t* pmoq_msg_def_param_values(const pmoq_msg_def_t* def, pmoq_msg_t* msg)
 {
-    if (payload_length == 0 &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, object_status)) != NULL) {
-        if (*object_status > PMOQ_OBJECT_STATUS_MAX) {
+    return (def == NULL || def->extensions_offset == PMOQ_FIELD_NO_OFFSET) ? NULL :
+        (pmoq_param_values_t*)((uint8_t*)&msg->u + def->extensions_offset);
+}
+
+static const uint8_t* pmoq_msg_def_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, const pmoq_msg_def_t* def, pmoq_msg_t* msg)
+{
+    pmoq_tuple_t* tuple = pmoq_msg_def_namespace(def, msg);
+    pmoq_param_values_t* values = pmoq_msg_def_param_values(def, msg);
+    pmoq_bits_t arena_items[PMOQ_TUPLE_SIZE_MAX];
+    pmoq_param_value_t arena_values[PMOQ_PARAM_VALUES_MAX];
+    int copy_items = (msg->arena != NULL && msg->namespace_items == NULL);
+    int copy_values = (msg->arena != NULL && msg->param_values == NULL);
+
+    if (def == NULL) {
+        /* Unexpected */
+        *err = -1;
+        return NULL;
+    }
+
+    if (tuple != NULL) {
+        /* The namespace items are stored in the array provided by the caller,
+         * or copied from a local array to the arena after parsing */
+        tuple->items = (copy_items) ? arena_items : msg->namespace_items;
+        tuple->items_max = (copy_items) ? PMOQ_TUPLE_SIZE_MAX : ((msg->namespace_items == NULL) ? 0 : msg->namespace_items_max);
+    }
+    if (values != NULL) {
+        /* Same for the parameter values */
+        values->values = (copy_values) ? arena_values : msg->param_values;
+        values->values_max = (copy_values) ? PMOQ_PARAM_VALUES_MAX : ((msg->param_values == NULL) ? 0 : msg->param_values_max);
+    }
+
+    bytes = def->parse(bytes, bytes_max, err, needed, msg->registry, &msg->u);
+
+    if (bytes != NULL && msg->arena != NULL) {
+        size_t used = msg->arena->used;
+
+        if (pmoq_msg_arena_copy(msg->arena, def, msg, copy_items, copy_values) != 0) {
+            msg->arena->used = used;
             *err = -1;
             bytes = NULL;
         }
     }
+    if (bytes == NULL && copy_items && tuple != NULL) {
+        tuple->items = NULL;
+        tuple->items_max = 0;
+    }
+    if (bytes == NULL && copy_values && values != NULL) {
+        values->values = NULL;
+        values->values_max = 0;
+    }
     return bytes;
 }
 
-uint8_t* pmoq_strm_object_datagram_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* datagram) {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->track_alias)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->group_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->object_id)) != NULL &&
-        (bytes = picoquic_frames_uint8_encode(bytes, bytes_max, datagram->publisher_priority)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->payload_length)) != NULL) {
-        bytes = picoquic_frames_varint_encode(bytes, bytes_max, datagram->object_status);
+const uint8_t * pmoq_msg_keyed_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t msg_type, pmoq_msg_t* msg)
+{
+    return pmoq_msg_def_parse(bytes, bytes_max, err, needed, pmoq_msg_def_get(msg_type), msg);
+}
+
+uint8_t* pmoq_msg_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* msg)
+{
+    return pmoq_codec_msg_format(pmoq_codec_default(), bytes, bytes_max, msg);
+}
+
+size_t pmoq_msg_encoded_size(const pmoq_msg_t* msg)
+{
+    return pmoq_codec_msg_encoded_size(pmoq_codec_default(), msg);
+}
+
+uint8_t* pmoq_codec_msg_format(const pmoq_codec_t* codec, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_t* msg)
+{
+    PMOQ_STATS_START(stats_start);
+    uint8_t* next;
+
+    if ((next = picoquic_frames_varint_encode(bytes, bytes_max, msg->msg_type)) != NULL) {
+        next = pmoq_msg_def_format(next, bytes_max, PMOQ_CODEC_MSG_DEF(codec, msg->msg_type), msg);
     }
-    return bytes;
+    PMOQ_STATS_FORMATTED(0, pmoq_stats_msg_slot(msg->msg_type), bytes, next, stats_start);
+    return next;
 }
 
-const uint8_t* pmoq_strm_object_datagram_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* datagram)
+size_t pmoq_codec_msg_encoded_size(const pmoq_codec_t* codec, const pmoq_msg_t* msg)
+{
+    return pmoq_size_add(pmoq_varint_size(msg->msg_type), pmoq_msg_def_size(PMOQ_CODEC_MSG_DEF(codec, msg->msg_type), msg));
+}
+
+const uint8_t* pmoq_codec_msg_parse(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* msg)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 5, &datagram->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 4, &datagram->track_alias)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &datagram->group_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &datagram->object_id)) != NULL &&
-        (bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed + 1, &datagram->publisher_priority)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &datagram->payload_length)) != NULL){
-        bytes = pmoq_strm_object_status_parse(bytes, bytes_max, err, needed, datagram->payload_length, &datagram->object_status);
+    PMOQ_STATS_START(stats_start);
+    const uint8_t* next;
+    /* Counted in the unknown slot if the type cannot be parsed */
+    uint64_t msg_type = UINT64_MAX;
+
+    if ((next = pmoq_varint_parse(bytes, bytes_max, err, needed, &msg_type)) != NULL) {
+        msg->msg_type = msg_type;
+        next = pmoq_msg_def_parse(next, bytes_max, err, needed, PMOQ_CODEC_MSG_DEF(codec, msg_type), msg);
     }
-    return bytes;
+    PMOQ_STATS_PARSED(0, pmoq_stats_msg_slot(msg_type), bytes, next, (next == NULL) ? *err : 0, stats_start);
+    return next;
+}
+
+pmoq_tuple_t* pmoq_msg_keyed_namespace(uint64_t msg_type, pmoq_msg_t* msg)
+{
+    return pmoq_msg_def_namespace(pmoq_msg_def_get(msg_type), msg);
+}
+
+pmoq_tuple_t* pmoq_msg_namespace(pmoq_msg_t* msg)
+{
+    return pmoq_msg_keyed_namespace(msg->msg_type, msg);
+}
+
+const uint8_t* pmoq_msg_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_t* msg)
+{
+    return pmoq_codec_msg_parse(pmoq_codec_default(), bytes, bytes_max, err, needed, msg);
+}
+
+size_t pmoq_strm_object_datagram_size(const pmoq_strm_t* datagram)
+{
+    return pmoq_layout_object_datagram_size(datagram);
+}
+
+uint8_t* pmoq_strm_object_datagram_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* datagram)
+{
+    return pmoq_layout_object_datagram_format(bytes, bytes_max, datagram);
+}
+
+const uint8_t* pmoq_strm_object_datagram_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* datagram)
+{
+    return pmoq_layout_object_datagram_parse(bytes, bytes_max, err, needed, NULL, datagram);
+}
+
+size_t pmoq_strm_header_track_size(const pmoq_strm_t* header_track)
+{
+    return pmoq_layout_header_track_size(header_track);
 }
 
 uint8_t* pmoq_strm_header_track_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* header_track)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_track->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_track->track_alias)) != NULL)
-    {
-        bytes = picoquic_frames_uint8_encode(bytes, bytes_max, header_track->publisher_priority);
-    }
-    return bytes;
+    return pmoq_layout_header_track_format(bytes, bytes_max, header_track);
 }
 
 const uint8_t* pmoq_strm_header_track_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* header_track)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &header_track->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &header_track->track_alias)) != NULL)
-    {
-        bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, &header_track->publisher_priority);
-    }
-    return bytes;
+    return pmoq_layout_header_track_parse(bytes, bytes_max, err, needed, NULL, header_track);
+}
+
+size_t pmoq_strm_object_track_size(const pmoq_strm_t* object)
+{
+    return pmoq_layout_object_track_size(object);
 }
 
 uint8_t* pmoq_strm_object_track_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->group_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->object_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->payload_length)) != NULL) {
-        bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->object_status);
-    }
-    return bytes;
+    return pmoq_layout_object_track_format(bytes, bytes_max, object);
 }
 
 const uint8_t* pmoq_strm_object_track_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* object)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &object->group_id)) != NULL &&
-        (bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed + 1, &object->publisher_priority)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &object->payload_length)) != NULL) {
-        bytes = pmoq_strm_object_status_parse(bytes, bytes_max, err, needed, object->payload_length, &object->object_status);
-    }
-    return bytes;
+    return pmoq_layout_object_track_parse(bytes, bytes_max, err, needed, NULL, object);
+}
+
+size_t pmoq_strm_header_subgroup_size(const pmoq_strm_t* header_subgroup)
+{
+    return pmoq_layout_header_subgroup_size(header_subgroup);
 }
 
 uint8_t* pmoq_strm_header_subgroup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* header_subgroup)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_subgroup->subscribe_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_subgroup->track_alias)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_subgroup->group_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, header_subgroup->object_id)) != NULL) {
-        bytes = picoquic_frames_uint8_encode(bytes, bytes_max, header_subgroup->publisher_priority);
-    }
-    return bytes;
+    return pmoq_layout_header_subgroup_format(bytes, bytes_max, header_subgroup);
 }
 
 const uint8_t* pmoq_strm_header_subgroup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* header_subgroup)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 3, &header_subgroup->subscribe_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 2, &header_subgroup->track_alias)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed + 1, &header_subgroup->group_id)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &header_subgroup->object_id)) != NULL) {
-        bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed, &header_subgroup->publisher_priority);
-    }
-    return bytes;
+    return pmoq_layout_header_subgroup_parse(bytes, bytes_max, err, needed, NULL, header_subgroup);
+}
+
+size_t pmoq_strm_object_subgroup_size(const pmoq_strm_t* object)
+{
+    return pmoq_layout_object_subgroup_size(object);
 }
 
 uint8_t* pmoq_strm_object_subgroup_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->object_id)) != NULL &&
-        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->payload_length)) != NULL) {
-        bytes = picoquic_frames_varint_encode(bytes, bytes_max, object->object_status);
-    }
-    return bytes;
+    return pmoq_layout_object_subgroup_format(bytes, bytes_max, object);
 }
 
 const uint8_t* pmoq_strm_object_subgroup_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* object)
 {
-    if ((bytes = pmoq_uint8_parse(bytes, bytes_max, err, needed + 1, &object->publisher_priority)) != NULL &&
-        (bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &object->payload_length)) != NULL) {
-        bytes = pmoq_strm_object_status_parse(bytes, bytes_max, err, needed, object->payload_length, &object->object_status);
+    return pmoq_layout_object_subgroup_parse(bytes, bytes_max, err, needed, NULL, object);
+}
+
+static uint8_t* pmoq_strm_header_iov(uint8_t* bytes, uint8_t* bytes_end, uint64_t payload_length,
+    const uint8_t* payload, pmoq_iovec_t iov[2], size_t* nb_iov)
+{
+    *nb_iov = 0;
+    if (bytes_end != NULL) {
+        if (payload_length > SIZE_MAX || (payload_length > 0 && payload == NULL)) {
+            bytes_end = NULL;
+        }
+        else {
+            iov[0].base = bytes;
+            iov[0].len = bytes_end - bytes;
+            *nb_iov = 1;
+            if (payload_length > 0) {
+                iov[1].base = payload;
+                iov[1].len = (size_t)payload_length;
+                *nb_iov = 2;
+            }
+        }
+    }
+    return bytes_end;
+}
+
+uint8_t* pmoq_strm_object_datagram_format_iov(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* datagram,
+    const uint8_t* payload, pmoq_iovec_t iov[2], size_t* nb_iov)
+{
+    return pmoq_strm_header_iov(bytes, pmoq_strm_object_datagram_format(bytes, bytes_max, datagram),
+        datagram->payload_length, payload, iov, nb_iov);
+}
+
+uint8_t* pmoq_strm_object_subgroup_format_iov(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object,
+    const uint8_t* payload, pmoq_iovec_t iov[2], size_t* nb_iov)
+{
+    return pmoq_strm_header_iov(bytes, pmoq_strm_object_subgroup_format(bytes, bytes_max, object),
+        object->payload_length, payload, iov, nb_iov);
+}
+
+size_t pmoq_iovec_gather(uint8_t* bytes, size_t length, const pmoq_iovec_t* iov, size_t nb_iov, size_t offset)
+{
+    size_t copied = 0;
+
+    for (size_t i = 0; i < nb_iov && copied < length; i++) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+        }
+        else {
+            size_t l = iov[i].len - offset;
+            if (l > length - copied) {
+                l = length - copied;
+            }
+            memcpy(bytes + copied, iov[i].base + offset, l);
+            copied += l;
+            offset = 0;
+        }
+    }
+    return copied;
+}
+
+const uint8_t* pmoq_strm_subgroup_parse_batch(const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    pmoq_strm_object_ref_t* objects, size_t objects_max, size_t* nb_objects)
+{
+    return pmoq_codec_subgroup_parse_batch(pmoq_codec_default(), bytes, bytes_max, err, objects, objects_max, nb_objects);
+}
+
+/* Object ID and payload length, the leading fields of the subgroup objects */
+static const uint8_t pmoq_fast_layout_subgroup_object[] = { PMOQ_FAST_FIELD_VARINT, PMOQ_FAST_FIELD_VARINT };
+
+/* Objects of the layout pmoq_layout_object_subgroup_def, decoded directly:
+ * the fields are only tested once per batch, in the caller. */
+static const uint8_t* pmoq_subgroup_object_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    pmoq_strm_object_ref_t* object)
+{
+    uint64_t v[sizeof(pmoq_fast_layout_subgroup_object)];
+    const uint8_t* next_bytes;
+
+    if ((next_bytes = pmoq_varint_fast_decode(bytes, bytes_max, pmoq_fast_layout_subgroup_object,
+        sizeof(pmoq_fast_layout_subgroup_object), v)) == NULL &&
+        (next_bytes = pmoq_varint_parse(bytes, bytes_max, err, 1, &v[0])) != NULL) {
+        next_bytes = pmoq_varint_parse(next_bytes, bytes_max, err, 0, &v[1]);
+    }
+    if (next_bytes != NULL) {
+        object->object_id = v[0];
+        object->payload_length = v[1];
+        object->object_status = 0;
+        /* The status is only present if the payload is empty */
+        if (object->payload_length == 0 &&
+            (next_bytes = pmoq_varint_parse(next_bytes, bytes_max, err, 0, &object->object_status)) != NULL &&
+            object->object_status > PMOQ_OBJECT_STATUS_MAX) {
+            *err = -1;
+            next_bytes = NULL;
+        }
+    }
+    return next_bytes;
+}
+
+/* Objects of another layout, decoded by the function of the layout */
+static const uint8_t* pmoq_subgroup_object_def_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    const pmoq_msg_def_t* def, pmoq_strm_object_ref_t* object)
+{
+    pmoq_strm_t header;
+
+    header.object_status = 0;
+    if ((bytes = def->parse(bytes, bytes_max, err, 0, NULL, &header)) != NULL) {
+        object->object_id = header.object_id;
+        object->payload_length = header.payload_length;
+        object->object_status = header.object_status;
     }
     return bytes;
 }
 
-uint8_t* pmoq_strm_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_strm_t* msg)
+const uint8_t* pmoq_codec_subgroup_parse_batch(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err,
+    pmoq_strm_object_ref_t* objects, size_t objects_max, size_t* nb_objects)
 {
-    switch (msg_type) {
-    case PMOQ_STRM_OBJECT_DATAGRAM:
-        bytes = pmoq_strm_object_datagram_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_STRM_HEADER_TRACK:
-        bytes = pmoq_strm_header_track_format(bytes, bytes_max, msg);
-        break;
-    case PMOQ_STRM_HEADER_SUBGROUP:
-        bytes = pmoq_strm_header_subgroup_format(bytes, bytes_max, msg);
-        break;
-    default:
+    const pmoq_msg_def_t* def = pmoq_codec_object_def(codec, PMOQ_STRM_HEADER_SUBGROUP);
+    const uint8_t* bytes_zero = bytes;
+    int is_direct = (def == &pmoq_layout_object_subgroup_def);
+
+    *err = 0;
+    *nb_objects = 0;
+
+    if (def == NULL) {
+        /* The codec has no subgroup objects */
+        *err = -1;
+        return NULL;
+    }
+
+    while (bytes < bytes_max && *nb_objects < objects_max) {
+        pmoq_strm_object_ref_t* object = &objects[*nb_objects];
+        const uint8_t* next_bytes = (is_direct) ? pmoq_subgroup_object_parse(bytes, bytes_max, err, object) :
+            pmoq_subgroup_object_def_parse(bytes, bytes_max, err, def, object);
+
+        if (next_bytes == NULL) {
+            /* Malformed, or header incomplete */
+            break;
+        }
+        else if (object->payload_length > (uint64_t)(bytes_max - next_bytes)) {
+            uint64_t missing = object->payload_length - (uint64_t)(bytes_max - next_bytes);
+            *err = (missing > INT32_MAX) ? INT32_MAX : (int)missing;
+            break;
+        }
+        else {
+            object->payload_offset = next_bytes - bytes_zero;
+            bytes = next_bytes + object->payload_length;
+            *nb_objects += 1;
+        }
+    }
+
+    return (*err < 0) ? NULL : bytes;
+}
+
+/* Data stream headers and objects, for a layout found in the codec */
+static uint8_t* pmoq_strm_def_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_msg_def_t* def, const pmoq_strm_t* msg)
+{
+    /* Unexpected if the type is unknown */
+    return (def == NULL) ? NULL : def->format(bytes, bytes_max, msg);
+}
+
+static size_t pmoq_strm_def_size(const pmoq_msg_def_t* def, const pmoq_strm_t* msg)
+{
+    return (def == NULL) ? 0 : def->size(msg);
+}
+
+static const uint8_t* pmoq_strm_def_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, const pmoq_msg_def_t* def, pmoq_strm_t* msg)
+{
+    if (def == NULL) {
         /* Unexpected */
-        bytes = NULL;
-        break;
+        *err = -1;
+        return NULL;
     }
-    return bytes;
+    return def->parse(bytes, bytes_max, err, needed, NULL, msg);
+}
+
+uint8_t* pmoq_strm_keyed_format(uint8_t* bytes, const uint8_t* bytes_max, uint64_t msg_type, const pmoq_strm_t* msg)
+{
+    return pmoq_strm_def_format(bytes, bytes_max, pmoq_strm_def_get(msg_type), msg);
+}
+
+size_t pmoq_strm_keyed_encoded_size(uint64_t msg_type, const pmoq_strm_t* msg)
+{
+    return pmoq_strm_def_size(pmoq_strm_def_get(msg_type), msg);
 }
 
 const uint8_t* pmoq_strm_keyed_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t msg_type, pmoq_strm_t* msg)
 {
-    switch (msg_type) {
-    case PMOQ_STRM_OBJECT_DATAGRAM:
-        bytes = pmoq_strm_object_datagram_parse(bytes, bytes_max, err, needed, msg);
-        break;
+    return pmoq_strm_def_parse(bytes, bytes_max, err, needed, pmoq_strm_def_get(msg_type), msg);
+}
+
+uint8_t* pmoq_strm_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* msg)
+{
+    return pmoq_codec_strm_format(pmoq_codec_default(), bytes, bytes_max, msg);
+}
+
+size_t pmoq_strm_encoded_size(const pmoq_strm_t* msg)
+{
+    return pmoq_codec_strm_encoded_size(pmoq_codec_default(), msg);
+}
+
+const uint8_t* pmoq_strm_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* msg)
+{
+    return pmoq_codec_strm_parse(pmoq_codec_default(), bytes, bytes_max, err, needed, msg);
+}
+
+uint8_t* pmoq_codec_strm_format(const pmoq_codec_t* codec, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* msg)
+{
+    PMOQ_STATS_START(stats_start);
+    uint8_t* next;
+
+    if ((next = picoquic_frames_varint_encode(bytes, bytes_max, msg->msg_type)) != NULL) {
+        next = pmoq_strm_def_format(next, bytes_max, PMOQ_CODEC_STRM_DEF(codec, msg->msg_type), msg);
+    }
+    PMOQ_STATS_FORMATTED(1, pmoq_stats_strm_slot(msg->msg_type), bytes, next, stats_start);
+    return next;
+}
+
+size_t pmoq_codec_strm_encoded_size(const pmoq_codec_t* codec, const pmoq_strm_t* msg)
+{
+    return pmoq_size_add(pmoq_varint_size(msg->msg_type), pmoq_strm_def_size(PMOQ_CODEC_STRM_DEF(codec, msg->msg_type), msg));
+}
+
+const uint8_t* pmoq_codec_strm_parse(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* msg)
+{
+    PMOQ_STATS_START(stats_start);
+    const uint8_t* next;
+    /* Counted in the unknown slot if the type cannot be parsed */
+    uint64_t msg_type = UINT64_MAX;
+
+    if ((next = pmoq_varint_parse(bytes, bytes_max, err, needed, &msg_type)) != NULL) {
+        msg->msg_type = msg_type;
+        next = pmoq_strm_def_parse(next, bytes_max, err, needed, PMOQ_CODEC_STRM_DEF(codec, msg_type), msg);
+    }
+    PMOQ_STATS_PARSED(1, pmoq_stats_strm_slot(msg_type), bytes, next, (next == NULL) ? *err : 0, stats_start);
+    return next;
+}
+
+#ifdef PMOQ_STATS
+static pmoq_stats_strm_enum pmoq_stats_object_slot(uint64_t header_type)
+{
+    switch (header_type) {
     case PMOQ_STRM_HEADER_TRACK:
-        bytes = pmoq_strm_header_track_parse(bytes, bytes_max, err, needed, msg);
-        break;
+        return pmoq_stats_strm_object_track;
     case PMOQ_STRM_HEADER_SUBGROUP:
-        bytes = pmoq_strm_header_subgroup_parse(bytes, bytes_max, err, needed, msg);
-        break;
+        return pmoq_stats_strm_object_subgroup;
     default:
-        /* Unexpected */
-        *err = -1;
-        bytes = NULL;
-        break;
+        return pmoq_stats_strm_other;
+    }
+}
+#endif
+
+uint8_t* pmoq_codec_object_format(const pmoq_codec_t* codec, uint64_t header_type, uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* object)
+{
+    PMOQ_STATS_START(stats_start);
+    uint8_t* next = pmoq_strm_def_format(bytes, bytes_max, pmoq_codec_object_def(codec, header_type), object);
+
+    PMOQ_STATS_FORMATTED(1, pmoq_stats_object_slot(header_type), bytes, next, stats_start);
+    return next;
+}
+
+size_t pmoq_codec_object_size(const pmoq_codec_t* codec, uint64_t header_type, const pmoq_strm_t* object)
+{
+    return pmoq_strm_def_size(pmoq_codec_object_def(codec, header_type), object);
+}
+
+const uint8_t* pmoq_codec_object_parse(const pmoq_codec_t* codec, uint64_t header_type, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* object)
+{
+    PMOQ_STATS_START(stats_start);
+    const uint8_t* next = pmoq_strm_def_parse(bytes, bytes_max, err, needed, pmoq_codec_object_def(codec, header_type), object);
+
+    PMOQ_STATS_PARSED(1, pmoq_stats_object_slot(header_type), bytes, next, (next == NULL) ? *err : 0, stats_start);
+    return next;
+}
+
+const uint8_t* pmoq_codec_msg_skip(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type)
+{
+    uint64_t payload_length;
+
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, msg_type)) != NULL) {
+        bytes = pmoq_fields_skip(bytes, bytes_max, err, needed, pmoq_codec_msg_def(codec, *msg_type), &payload_length, NULL);
     }
     return bytes;
 }
 
+const uint8_t* pmoq_codec_strm_skip(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type)
+{
+    uint64_t payload_length;
 
-uint8_t* pmoq_strm_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_strm_t* msg)
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, msg_type)) != NULL) {
+        bytes = pmoq_fields_skip(bytes, bytes_max, err, needed, pmoq_codec_strm_def(codec, *msg_type), &payload_length, NULL);
+    }
+    return bytes;
+}
+
+const uint8_t* pmoq_codec_object_skip(const pmoq_codec_t* codec, uint64_t header_type, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed)
 {
-    if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, msg->msg_type)) != NULL) {
-        bytes = pmoq_strm_keyed_format(bytes, bytes_max, msg->msg_type, msg);
+    uint64_t payload_length;
+
+    if ((bytes = pmoq_fields_skip(bytes, bytes_max, err, needed, pmoq_codec_object_def(codec, header_type), &payload_length, NULL)) != NULL) {
+        bytes = pmoq_bytes_skip(bytes, bytes_max, err, needed, payload_length);
     }
     return bytes;
 }
 
-const uint8_t* pmoq_strm_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_strm_t* msg)
+const uint8_t* pmoq_msg_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type)
+{
+    return pmoq_codec_msg_skip(pmoq_codec_default(), bytes, bytes_max, err, needed, msg_type);
+}
+
+const uint8_t* pmoq_strm_skip(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* msg_type)
 {
-    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &msg->msg_type)) != NULL) {
-        bytes = pmoq_strm_keyed_parse(bytes, bytes_max, err, needed, msg->msg_type, msg);
+    return pmoq_codec_strm_skip(pmoq_codec_default(), bytes, bytes_max, err, needed, msg_type);
+}
+
+/* Lazy view. The scan records where each field starts, and the accessors
+* decode one field from there, with the bounds of the message. The scan
+* already checked the structure, so decoding a field only fails on the
+* values that the skip functions do not check, e.g., the parameters, or
+* on a namespace with more items than the caller provided.
+*/
+const uint8_t* pmoq_codec_msg_view(const pmoq_codec_t* codec, const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_view_t* view)
+{
+    uint64_t payload_length;
+
+    memset(view, 0, sizeof(pmoq_msg_view_t));
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, err, needed, &view->msg_type)) != NULL) {
+        const pmoq_msg_def_t* def = pmoq_codec_msg_def(codec, view->msg_type);
+
+        if (def != NULL && def->nb_fields > PMOQ_MSG_VIEW_FIELDS_MAX) {
+            /* Not expected with the layouts of the schema */
+            *err = -1;
+            bytes = NULL;
+        }
+        else {
+            view->bytes = bytes;
+            if ((bytes = pmoq_fields_skip(bytes, bytes_max, err, needed, def, &payload_length, view->starts)) != NULL) {
+                if ((uint64_t)(bytes - view->bytes) > UINT32_MAX) {
+                    *err = -1;
+                    bytes = NULL;
+                }
+                else {
+                    view->def = def;
+                    view->bytes_end = bytes;
+                }
+            }
+        }
     }
     return bytes;
-}
\ No newline at end of file
+}
+
+const uint8_t* pmoq_msg_view(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_msg_view_t* view)
+{
+    return pmoq_codec_msg_view(pmoq_codec_default(), bytes, bytes_max, err, needed, view);
+}
+
+/* Rank of the designated field, or -1 if the message is not of the
+* designated type, has no such field or the field is not present */
+static int pmoq_msg_view_rank(const pmoq_msg_view_t* view, pmoq_msg_view_field_t designator)
+{
+    const pmoq_msg_def_t* def = view->def;
+
+    if (def != NULL && designator.msg_type == view->msg_type && designator.offset >= offsetof(pmoq_msg_t, u)) {
+        size_t offset = designator.offset - offsetof(pmoq_msg_t, u);
+
+        for (size_t i = 0; i < def->nb_fields; i++) {
+            if (def->fields[i].offset == offset) {
+                return (view->starts[i] == PMOQ_MSG_VIEW_ABSENT) ? -1 : (int)i;
+            }
+        }
+    }
+    return -1;
+}
+
+int pmoq_msg_view_varint(const pmoq_msg_view_t* view, pmoq_msg_view_field_t designator, uint64_t* v)
+{
+    int rank = pmoq_msg_view_rank(view, designator);
+    int err = 0;
+
+    if (rank < 0) {
+        return -1;
+    }
+    switch (view->def->fields[rank].field_type) {
+    case pmoq_field_varint:
+    case pmoq_field_uint8:
+    case pmoq_field_version:
+        return (pmoq_field_skip(view->bytes + view->starts[rank], view->bytes_end, &err, 0,
+            view->def->fields[rank].field_type, v) == NULL) ? -1 : 0;
+    default:
+        return -1;
+    }
+}
+
+int pmoq_msg_view_field(const pmoq_msg_view_t* view, pmoq_msg_view_field_t designator, pmoq_msg_t* msg)
+{
+    int rank = pmoq_msg_view_rank(view, designator);
+    const pmoq_field_def_t* field;
+    pmoq_param_values_t* values;
+    uint8_t* target;
+    uint64_t v = 0;
+    int err = 0;
+
+    if (rank < 0) {
+        return -1;
+    }
+    field = &view->def->fields[rank];
+    target = (uint8_t*)&msg->u + field->offset;
+    msg->msg_type = view->msg_type;
+    if (field->field_type == pmoq_field_tuple) {
+        /* The items are stored in the array provided by the caller */
+        pmoq_tuple_t* tuple = (pmoq_tuple_t*)target;
+
+        tuple->items = msg->namespace_items;
+        tuple->items_max = (msg->namespace_items == NULL) ? 0 : msg->namespace_items_max;
+    }
+    else if ((values = pmoq_field_param_values(field->field_type, target)) != NULL) {
+        /* Same for the parameter values */
+        values->values = msg->param_values;
+        values->values_max = (msg->param_values == NULL) ? 0 : msg->param_values_max;
+    }
+    return (pmoq_field_parse(view->bytes + view->starts[rank], view->bytes_end, &err, 0,
+        msg->registry, field->field_type, target, &v) == NULL) ? -1 : 0;
+}
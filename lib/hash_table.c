@@ -0,0 +1,126 @@
+/* Open addressing hash table.
+*
+* Collisions are resolved by linear probing, and the table doubles when
+* it would become more than half full, so that the probe sequences stay
+* short. Elements are removed by backward shift deletion: the following
+* elements of the probe sequence are moved back into the hole, so that
+* no tombstones are needed and lookups never stop early.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_internal.h"
+
+static int pmoq_hash_table_slot_is_empty(const uint8_t* slot, size_t slot_size)
+{
+    for (size_t i = 0; i < slot_size; i++) {
+        if (slot[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int pmoq_hash_table_init(pmoq_hash_table_t* table, size_t slot_size, size_t size,
+    pmoq_hash_table_hash_fn hash_fn, void* hash_ctx)
+{
+    table->slot_size = slot_size;
+    table->size = size;
+    table->count = 0;
+    table->hash_fn = hash_fn;
+    table->hash_ctx = hash_ctx;
+    table->slots = (uint8_t*)calloc(size, slot_size);
+
+    return (table->slots == NULL) ? -1 : 0;
+}
+
+void pmoq_hash_table_release(pmoq_hash_table_t* table)
+{
+    if (table->slots != NULL) {
+        free(table->slots);
+        table->slots = NULL;
+    }
+    table->count = 0;
+}
+
+int pmoq_hash_table_is_used(const pmoq_hash_table_t* table, size_t slot)
+{
+    return !pmoq_hash_table_slot_is_empty(table->slots + slot * table->slot_size, table->slot_size);
+}
+
+size_t pmoq_hash_table_probe(const pmoq_hash_table_t* table, uint64_t hash,
+    pmoq_hash_table_match_fn match_fn, const void* key)
+{
+    size_t mask = table->size - 1;
+    size_t slot = (size_t)hash & mask;
+
+    while (pmoq_hash_table_is_used(table, slot) && !match_fn(key, PMOQ_HASH_TABLE_SLOT(table, slot))) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+int pmoq_hash_table_reserve(pmoq_hash_table_t* table)
+{
+    int ret = 0;
+
+    if (2 * (table->count + 1) > table->size) {
+        size_t new_size = table->size * 2;
+        size_t mask = new_size - 1;
+        uint8_t* new_slots = (uint8_t*)calloc(new_size, table->slot_size);
+
+        if (new_slots == NULL) {
+            ret = -1;
+        }
+        else {
+            for (size_t i = 0; i < table->size; i++) {
+                const uint8_t* element = table->slots + i * table->slot_size;
+
+                if (!pmoq_hash_table_slot_is_empty(element, table->slot_size)) {
+                    size_t slot = (size_t)table->hash_fn(table->hash_ctx, element) & mask;
+
+                    while (!pmoq_hash_table_slot_is_empty(new_slots + slot * table->slot_size, table->slot_size)) {
+                        slot = (slot + 1) & mask;
+                    }
+                    memcpy(new_slots + slot * table->slot_size, element, table->slot_size);
+                }
+            }
+            free(table->slots);
+            table->slots = new_slots;
+            table->size = new_size;
+        }
+    }
+    return ret;
+}
+
+void pmoq_hash_table_insert(pmoq_hash_table_t* table, size_t slot, const void* element)
+{
+    memcpy(PMOQ_HASH_TABLE_SLOT(table, slot), element, table->slot_size);
+    table->count++;
+}
+
+void pmoq_hash_table_remove(pmoq_hash_table_t* table, size_t slot)
+{
+    size_t mask = table->size - 1;
+    size_t next = slot;
+
+    memset(PMOQ_HASH_TABLE_SLOT(table, slot), 0, table->slot_size);
+    table->count--;
+
+    while (1) {
+        size_t home;
+
+        next = (next + 1) & mask;
+        if (!pmoq_hash_table_is_used(table, next)) {
+            break;
+        }
+        /* The element moves back unless its home lies in (slot, next] */
+        home = (size_t)table->hash_fn(table->hash_ctx, PMOQ_HASH_TABLE_SLOT(table, next)) & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            memcpy(PMOQ_HASH_TABLE_SLOT(table, slot), PMOQ_HASH_TABLE_SLOT(table, next), table->slot_size);
+            memset(PMOQ_HASH_TABLE_SLOT(table, next), 0, table->slot_size);
+            slot = next;
+        }
+    }
+}
@@ -0,0 +1,285 @@
+/* Interned full track names.
+*
+* Each full track name is stored once, in its wire encoding: the
+* namespace tuple followed by the track name. The ID is the rank of the
+* entry in an array, plus 1, and the entries are found by content in a
+* hash table of IDs. Released IDs are chained in a free list and reused.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_internal.h"
+
+#define PMOQ_INTERN_TABLE_SIZE_MIN 64
+
+typedef struct st_pmoq_intern_entry_t {
+    uint64_t hash;
+    uint8_t* key;
+    size_t key_length;
+    uint32_t refcount;
+    uint32_t next_free;
+} pmoq_intern_entry_t;
+
+struct st_pmoq_intern_t {
+    pmoq_intern_entry_t* entries;
+    size_t entries_max;
+    uint32_t first_free;
+    /* Hash table of IDs, 0 if empty */
+    pmoq_hash_table_t table;
+};
+
+typedef struct st_pmoq_intern_key_t {
+    const pmoq_intern_t* intern;
+    uint64_t hash;
+    const pmoq_tuple_t* track_namespace;
+    const pmoq_bits_t* track_name;
+} pmoq_intern_key_t;
+
+static uint64_t pmoq_intern_hash_bits(uint64_t h, const pmoq_bits_t* bits)
+{
+    size_t nb_bytes = (size_t)((bits->nb_bits + 7) >> 3);
+
+    h = (h ^ bits->nb_bits) * 0x100000001b3ull;
+    for (size_t i = 0; i < nb_bytes; i++) {
+        h = (h ^ bits->bits[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t pmoq_intern_hash_name(const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name)
+{
+    uint64_t h = (0xcbf29ce484222325ull ^ track_namespace->nb_items) * 0x100000001b3ull;
+
+    for (uint64_t i = 0; i < track_namespace->nb_items; i++) {
+        h = pmoq_intern_hash_bits(h, &track_namespace->items[i]);
+    }
+    h = pmoq_intern_hash_bits(h, track_name);
+    /* Final mix, so that the low bits used for the table depend on all bytes */
+    h ^= h >> 32;
+    h *= 0x9E3779B97F4A7C15ull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* Compare the stored encoding with the name, item by item */
+static int pmoq_intern_is_equal(const pmoq_intern_entry_t* entry, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name)
+{
+    const uint8_t* bytes = entry->key;
+    const uint8_t* bytes_max = entry->key + entry->key_length;
+    uint64_t nb_items = 0;
+    int err = 0;
+    int is_equal = 0;
+
+    if ((bytes = pmoq_varint_parse(bytes, bytes_max, &err, 0, &nb_items)) != NULL && nb_items == track_namespace->nb_items) {
+        pmoq_bits_t bits;
+        uint64_t i = 0;
+
+        is_equal = 1;
+        while (is_equal && i <= nb_items) {
+            const pmoq_bits_t* expected = (i < nb_items) ? &track_namespace->items[i] : track_name;
+
+            if ((bytes = pmoq_bits_parse(bytes, bytes_max, &err, 0, &bits)) == NULL || bits.nb_bits != expected->nb_bits ||
+                (bits.nb_bits > 0 && memcmp(bits.bits, expected->bits, (size_t)((bits.nb_bits + 7) >> 3)) != 0)) {
+                is_equal = 0;
+            }
+            i++;
+        }
+    }
+    return is_equal;
+}
+
+static uint64_t pmoq_intern_id_hash(void* hash_ctx, const void* element)
+{
+    const pmoq_intern_t* intern = (const pmoq_intern_t*)hash_ctx;
+
+    return intern->entries[*(const uint32_t*)element - 1].hash;
+}
+
+static int pmoq_intern_id_match(const void* key, const void* element)
+{
+    const pmoq_intern_key_t* k = (const pmoq_intern_key_t*)key;
+    const pmoq_intern_entry_t* entry = &k->intern->entries[*(const uint32_t*)element - 1];
+
+    return entry->hash == k->hash && pmoq_intern_is_equal(entry, k->track_namespace, k->track_name);
+}
+
+static int pmoq_intern_id_is_same(const void* key, const void* element)
+{
+    return *(const uint32_t*)element == *(const uint32_t*)key;
+}
+
+/* Slot of the entry for the name, or of the empty slot where it would be inserted */
+static size_t pmoq_intern_slot(const pmoq_intern_t* intern, uint64_t hash, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name)
+{
+    pmoq_intern_key_t key;
+
+    key.intern = intern;
+    key.hash = hash;
+    key.track_namespace = track_namespace;
+    key.track_name = track_name;
+    return pmoq_hash_table_probe(&intern->table, hash, pmoq_intern_id_match, &key);
+}
+
+static uint32_t pmoq_intern_slot_id(const pmoq_intern_t* intern, size_t slot)
+{
+    return *(const uint32_t*)PMOQ_HASH_TABLE_SLOT(&intern->table, slot);
+}
+
+static void pmoq_intern_table_remove(pmoq_intern_t* intern, uint32_t id)
+{
+    pmoq_hash_table_remove(&intern->table,
+        pmoq_hash_table_probe(&intern->table, intern->entries[id - 1].hash, pmoq_intern_id_is_same, &id));
+}
+
+pmoq_intern_t* pmoq_intern_create()
+{
+    pmoq_intern_t* intern = (pmoq_intern_t*)malloc(sizeof(pmoq_intern_t));
+
+    if (intern != NULL) {
+        memset(intern, 0, sizeof(pmoq_intern_t));
+        intern->first_free = UINT32_MAX;
+        if (pmoq_hash_table_init(&intern->table, sizeof(uint32_t), PMOQ_INTERN_TABLE_SIZE_MIN,
+            pmoq_intern_id_hash, intern) != 0) {
+            free(intern);
+            intern = NULL;
+        }
+    }
+    return intern;
+}
+
+void pmoq_intern_delete(pmoq_intern_t* intern)
+{
+    if (intern != NULL) {
+        for (size_t i = 0; i < intern->entries_max; i++) {
+            if (intern->entries[i].key != NULL) {
+                free(intern->entries[i].key);
+            }
+        }
+        if (intern->entries != NULL) {
+            free(intern->entries);
+        }
+        pmoq_hash_table_release(&intern->table);
+        free(intern);
+    }
+}
+
+size_t pmoq_intern_count(const pmoq_intern_t* intern)
+{
+    return intern->table.count;
+}
+
+pmoq_intern_id_t pmoq_intern_find(pmoq_intern_t* intern, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name)
+{
+    uint64_t hash = pmoq_intern_hash_name(track_namespace, track_name);
+
+    return pmoq_intern_slot_id(intern, pmoq_intern_slot(intern, hash, track_namespace, track_name));
+}
+
+pmoq_intern_id_t pmoq_intern_track(pmoq_intern_t* intern, const pmoq_tuple_t* track_namespace, const pmoq_bits_t* track_name)
+{
+    uint64_t hash = pmoq_intern_hash_name(track_namespace, track_name);
+    uint32_t id = pmoq_intern_slot_id(intern, pmoq_intern_slot(intern, hash, track_namespace, track_name));
+    size_t key_length;
+    uint8_t* key;
+    uint8_t* bytes;
+    uint32_t rank;
+
+    if (id != 0) {
+        intern->entries[id - 1].refcount++;
+        return id;
+    }
+
+    if ((key_length = pmoq_size_add(pmoq_tuple_size(track_namespace), pmoq_bits_size(track_name))) == 0 ||
+        (key = (uint8_t*)malloc(key_length)) == NULL) {
+        return PMOQ_INTERN_ID_NONE;
+    }
+    if ((bytes = pmoq_tuple_format(key, key + key_length, track_namespace)) == NULL ||
+        pmoq_bits_format(bytes, key + key_length, track_name) == NULL) {
+        free(key);
+        return PMOQ_INTERN_ID_NONE;
+    }
+    if (intern->first_free == UINT32_MAX) {
+        size_t new_max = (intern->entries_max == 0) ? 64 : 2 * intern->entries_max;
+        pmoq_intern_entry_t* new_entries;
+
+        if (new_max >= UINT32_MAX ||
+            (new_entries = (pmoq_intern_entry_t*)realloc(intern->entries, new_max * sizeof(pmoq_intern_entry_t))) == NULL) {
+            free(key);
+            return PMOQ_INTERN_ID_NONE;
+        }
+        memset(new_entries + intern->entries_max, 0, (new_max - intern->entries_max) * sizeof(pmoq_intern_entry_t));
+        for (size_t i = intern->entries_max; i < new_max; i++) {
+            new_entries[i].next_free = (i + 1 < new_max) ? (uint32_t)(i + 1) : UINT32_MAX;
+        }
+        intern->first_free = (uint32_t)intern->entries_max;
+        intern->entries = new_entries;
+        intern->entries_max = new_max;
+    }
+    if (pmoq_hash_table_reserve(&intern->table) != 0) {
+        free(key);
+        return PMOQ_INTERN_ID_NONE;
+    }
+
+    rank = intern->first_free;
+    intern->first_free = intern->entries[rank].next_free;
+    intern->entries[rank].hash = hash;
+    intern->entries[rank].key = key;
+    intern->entries[rank].key_length = key_length;
+    intern->entries[rank].refcount = 1;
+    id = rank + 1;
+    pmoq_hash_table_insert(&intern->table, pmoq_intern_slot(intern, hash, track_namespace, track_name), &id);
+
+    return id;
+}
+
+static pmoq_intern_entry_t* pmoq_intern_entry(const pmoq_intern_t* intern, pmoq_intern_id_t id)
+{
+    return (id == PMOQ_INTERN_ID_NONE || id > intern->entries_max || intern->entries[id - 1].refcount == 0) ?
+        NULL : &intern->entries[id - 1];
+}
+
+void pmoq_intern_ref(pmoq_intern_t* intern, pmoq_intern_id_t id)
+{
+    pmoq_intern_entry_t* entry = pmoq_intern_entry(intern, id);
+
+    if (entry != NULL) {
+        entry->refcount++;
+    }
+}
+
+void pmoq_intern_release(pmoq_intern_t* intern, pmoq_intern_id_t id)
+{
+    pmoq_intern_entry_t* entry = pmoq_intern_entry(intern, id);
+
+    if (entry != NULL && --entry->refcount == 0) {
+        pmoq_intern_table_remove(intern, id);
+        free(entry->key);
+        entry->key = NULL;
+        entry->next_free = intern->first_free;
+        intern->first_free = id - 1;
+    }
+}
+
+uint64_t pmoq_intern_hash(const pmoq_intern_t* intern, pmoq_intern_id_t id)
+{
+    pmoq_intern_entry_t* entry = pmoq_intern_entry(intern, id);
+
+    return (entry == NULL) ? 0 : entry->hash;
+}
+
+int pmoq_intern_get(const pmoq_intern_t* intern, pmoq_intern_id_t id, pmoq_tuple_t* track_namespace, pmoq_bits_t* track_name)
+{
+    pmoq_intern_entry_t* entry = pmoq_intern_entry(intern, id);
+    const uint8_t* bytes;
+    int err = 0;
+
+    if (entry == NULL) {
+        return -1;
+    }
+    bytes = pmoq_tuple_parse(entry->key, entry->key + entry->key_length, &err, 0, track_namespace);
+    bytes = (bytes == NULL) ? NULL : pmoq_bits_parse(bytes, entry->key + entry->key_length, &err, 0, track_name);
+
+    return (bytes == NULL) ? -1 : 0;
+}
@@ -0,0 +1,518 @@
+/* Resumable parser for control stream messages.
+*
+* Control messages arrive on the control stream in segments that
+* have no relation with message boundaries. The stateless _parse()
+* functions in formats.c handle that by returning a "needed" hint,
+* after which the caller parses again from the first byte of the
+* message. When a SUBSCRIBE or ANNOUNCE with a long namespace is
+* split over many small segments, the same prefix gets decoded
+* again and again.
+*
+* The parser in this file remembers where it is between calls:
+* the current field of the message layout, the bytes of a partially
+* received varint, the rank of the item in a tuple or parameter list.
+* Each byte is examined once. The content of bit strings and of
+* parameters is copied in a storage area owned by the parser, so the
+* caller does not need to keep the segments. The message returned by
+* pmoq_msg_parser_next() is valid until the next call to
+* pmoq_msg_parser_feed().
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq.h"
+#include "picomoq_stats.h"
+#include "picomoq_internal.h"
+
+#define PMOQ_MSG_PARSER_STORE_MIN 256
+
+struct st_pmoq_msg_parser_t {
+    const pmoq_codec_t* codec;
+    const pmoq_param_registry_t* registry;
+    pmoq_msg_t msg;
+    const pmoq_msg_def_t* msg_def;
+    size_t field_rank;
+    int is_started;
+    int is_complete;
+    /* Position within the current field */
+    int step;
+    uint64_t nb_items;
+    uint64_t item_rank;
+    uint64_t param_key;
+    uint64_t data_length;
+    uint64_t data_read;
+    size_t data_offset;
+    /* Value of the last field that governs the presence of the next ones,
+     * e.g., filter type, content exists, or status code */
+    uint64_t selector;
+    /* Partially received varint */
+    uint8_t varint[8];
+    size_t varint_len;
+    /* Items of the track namespace */
+    pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
+    /* Values of the registered parameters */
+    pmoq_param_value_t param_values[PMOQ_PARAM_VALUES_MAX];
+    /* Storage of strings and parameter values */
+    uint8_t* store;
+    size_t store_size;
+    size_t store_used;
+};
+
+pmoq_msg_parser_t* pmoq_msg_parser_create()
+{
+    pmoq_msg_parser_t* parser = (pmoq_msg_parser_t*)malloc(sizeof(pmoq_msg_parser_t));
+
+    if (parser != NULL) {
+        memset(parser, 0, sizeof(pmoq_msg_parser_t));
+        parser->codec = pmoq_codec_default();
+        if ((parser->store = (uint8_t*)malloc(PMOQ_MSG_PARSER_STORE_MIN)) == NULL) {
+            free(parser);
+            parser = NULL;
+        }
+        else {
+            parser->store_size = PMOQ_MSG_PARSER_STORE_MIN;
+        }
+    }
+    return parser;
+}
+
+void pmoq_msg_parser_delete(pmoq_msg_parser_t* parser)
+{
+    if (parser != NULL) {
+        if (parser->store != NULL) {
+            free(parser->store);
+        }
+        free(parser);
+    }
+}
+
+void pmoq_msg_parser_set_codec(pmoq_msg_parser_t* parser, const pmoq_codec_t* codec)
+{
+    parser->codec = codec;
+}
+
+void pmoq_msg_parser_set_registry(pmoq_msg_parser_t* parser, const pmoq_param_registry_t* registry)
+{
+    parser->registry = registry;
+}
+
+static uint8_t* pmoq_msg_parser_rebase_one(uint8_t* p, uintptr_t old_store, uint8_t* new_store)
+{
+    return (p == NULL) ? NULL : new_store + ((uintptr_t)p - old_store);
+}
+
+static void pmoq_msg_parser_rebase_values(pmoq_param_values_t* values, uintptr_t old_store, uint8_t* new_store)
+{
+    for (size_t i = 0; i < values->nb_values; i++) {
+        values->values[i].bytes = pmoq_msg_parser_rebase_one(values->values[i].bytes, old_store, new_store);
+    }
+}
+
+/* After the storage was reallocated, update the pointers
+ * that the message already holds. The fields that are not
+ * parsed yet are still zero. */
+static void pmoq_msg_parser_rebase(pmoq_msg_parser_t* parser, uintptr_t old_store)
+{
+    for (size_t i = 0; i < parser->msg_def->nb_fields; i++) {
+        const pmoq_field_def_t* field = &parser->msg_def->fields[i];
+        uint8_t* target = ((uint8_t*)&parser->msg.u) + field->offset;
+
+        switch (field->field_type) {
+        case pmoq_field_bits: {
+            pmoq_bits_t* bits_string = (pmoq_bits_t*)target;
+            bits_string->bits = pmoq_msg_parser_rebase_one(bits_string->bits, old_store, parser->store);
+            break;
+        }
+        case pmoq_field_tuple: {
+            pmoq_tuple_t* tuple = (pmoq_tuple_t*)target;
+            for (uint64_t j = 0; tuple->items != NULL && j < tuple->nb_items; j++) {
+                tuple->items[j].bits = pmoq_msg_parser_rebase_one(tuple->items[j].bits, old_store, parser->store);
+            }
+            break;
+        }
+        case pmoq_field_subscribe_parameters: {
+            pmoq_subscribe_parameters_t* param = (pmoq_subscribe_parameters_t*)target;
+            param->auth_info = pmoq_msg_parser_rebase_one(param->auth_info, old_store, parser->store);
+            pmoq_msg_parser_rebase_values(&param->extensions, old_store, parser->store);
+            break;
+        }
+        case pmoq_field_setup_parameters: {
+            pmoq_setup_parameters_t* param = (pmoq_setup_parameters_t*)target;
+            param->path = pmoq_msg_parser_rebase_one(param->path, old_store, parser->store);
+            pmoq_msg_parser_rebase_values(&param->extensions, old_store, parser->store);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/* Reserve space in the storage for the next string */
+static int pmoq_msg_parser_reserve(pmoq_msg_parser_t* parser, uint64_t length)
+{
+    int ret = 0;
+
+    if (parser->store_used + length > parser->store_size) {
+        size_t new_size = 2 * parser->store_size;
+        uintptr_t old_store = (uintptr_t)parser->store;
+        uint8_t* new_store;
+
+        if (new_size < parser->store_used + length) {
+            new_size = parser->store_used + (size_t)length;
+        }
+        if ((new_store = (uint8_t*)realloc(parser->store, new_size)) == NULL) {
+            ret = -1;
+        }
+        else {
+            parser->store = new_store;
+            parser->store_size = new_size;
+            if ((uintptr_t)new_store != old_store) {
+                pmoq_msg_parser_rebase(parser, old_store);
+            }
+        }
+    }
+    if (ret == 0) {
+        parser->data_offset = parser->store_used;
+        parser->data_length = length;
+        parser->data_read = 0;
+        parser->store_used += (size_t)length;
+    }
+    return ret;
+}
+
+/* Copy the available bytes of the current string. Returns 1 when the string is complete. */
+static int pmoq_msg_parser_data(pmoq_msg_parser_t* parser, const uint8_t** p_bytes, const uint8_t* bytes_max)
+{
+    size_t available = (size_t)(bytes_max - *p_bytes);
+    uint64_t remaining = parser->data_length - parser->data_read;
+    size_t copied = (remaining < available) ? (size_t)remaining : available;
+
+    if (copied > 0) {
+        memcpy(parser->store + parser->data_offset + parser->data_read, *p_bytes, copied);
+        parser->data_read += copied;
+        *p_bytes += copied;
+    }
+    return parser->data_read == parser->data_length;
+}
+
+/* Decode a varint that may be split between segments. Returns 1 when the value is complete. */
+static int pmoq_msg_parser_varint(pmoq_msg_parser_t* parser, const uint8_t** p_bytes, const uint8_t* bytes_max, uint64_t* v)
+{
+    const uint8_t* bytes = *p_bytes;
+    const uint8_t* next_bytes;
+    int is_complete = 0;
+
+    if (parser->varint_len == 0 && (next_bytes = picoquic_frames_varint_decode(bytes, bytes_max, v)) != NULL) {
+        /* Common case, the whole varint is in the segment */
+        bytes = next_bytes;
+        is_complete = 1;
+    }
+    else {
+        while (bytes < bytes_max) {
+            parser->varint[parser->varint_len++] = *bytes++;
+            if (parser->varint_len == VARINT_LEN_T(parser->varint, size_t)) {
+                (void)picoquic_frames_varint_decode(parser->varint, parser->varint + parser->varint_len, v);
+                parser->varint_len = 0;
+                is_complete = 1;
+                break;
+            }
+        }
+    }
+    *p_bytes = bytes;
+
+    return is_complete;
+}
+
+/* Parse a list of parameters, setup or subscribe.
+ * Step 0: number of parameters, 1: key, 2: length, 3: value. */
+static int pmoq_msg_parser_parameters(pmoq_msg_parser_t* parser, const uint8_t** p_bytes, const uint8_t* bytes_max, int is_setup, void* param)
+{
+    int ret = 0;
+    uint64_t v;
+
+    while (ret == 0) {
+        if (parser->step == 0) {
+            if (!pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &parser->nb_items)) {
+                break;
+            }
+            else if (parser->nb_items > PMOQ_PARAMETERS_NUMBER_MAX ||
+                (is_setup && parser->nb_items == 0)) {
+                /* There must be at least one setup parameter, the role. */
+                ret = -1;
+            }
+            else {
+                pmoq_param_values_t* values = pmoq_field_param_values((is_setup) ? pmoq_field_setup_parameters :
+                    pmoq_field_subscribe_parameters, (uint8_t*)param);
+
+                values->values = parser->param_values;
+                values->values_max = PMOQ_PARAM_VALUES_MAX;
+                parser->item_rank = 0;
+                parser->step = 1;
+            }
+        }
+        else if (parser->step == 1) {
+            if (parser->item_rank >= parser->nb_items) {
+                ret = 1;
+            }
+            else if (!pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &parser->param_key)) {
+                break;
+            }
+            else {
+                parser->step = 2;
+            }
+        }
+        else if (parser->step == 2) {
+            if (!pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &v)) {
+                break;
+            }
+            else if (v > PMOQ_BIT_STRING_SIZE_MAX || pmoq_msg_parser_reserve(parser, v) != 0) {
+                ret = -1;
+            }
+            else {
+                parser->step = 3;
+            }
+        }
+        else if (!pmoq_msg_parser_data(parser, p_bytes, bytes_max)) {
+            break;
+        }
+        else {
+            uint8_t* value = parser->store + parser->data_offset;
+
+            if (is_setup) {
+                ret = pmoq_setup_parameter_set(parser->registry, (pmoq_setup_parameters_t*)param, parser->param_key, parser->data_length, value);
+            }
+            else {
+                ret = pmoq_subscribe_parameter_set(parser->registry, (pmoq_subscribe_parameters_t*)param, parser->param_key, parser->data_length, value);
+            }
+            parser->item_rank++;
+            parser->step = 1;
+        }
+    }
+    return ret;
+}
+
+/* Parse one bit string. Step 0 (or first_step): number of bits, next step: content. */
+static int pmoq_msg_parser_bits(pmoq_msg_parser_t* parser, const uint8_t** p_bytes, const uint8_t* bytes_max, int first_step, pmoq_bits_t* bits_string)
+{
+    int ret = 0;
+
+    if (parser->step == first_step) {
+        if (pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &bits_string->nb_bits)) {
+            if (bits_string->nb_bits > PMOQ_BIT_STRING_SIZE_MAX ||
+                pmoq_msg_parser_reserve(parser, (bits_string->nb_bits + 7) >> 3) != 0) {
+                ret = -1;
+            }
+            else {
+                parser->step = first_step + 1;
+            }
+        }
+    }
+    if (ret == 0 && parser->step == first_step + 1 &&
+        pmoq_msg_parser_data(parser, p_bytes, bytes_max)) {
+        bits_string->bits = parser->store + parser->data_offset;
+        ret = 1;
+    }
+    return ret;
+}
+
+/* Parse one field of the message. Returns 1 if the field is complete,
+ * 0 if more bytes are needed, -1 if the field is malformed. */
+static int pmoq_msg_parser_field(pmoq_msg_parser_t* parser, const pmoq_field_def_t* field, const uint8_t** p_bytes, const uint8_t* bytes_max)
+{
+    int ret = 0;
+    uint8_t* target = ((uint8_t*)&parser->msg.u) + field->offset;
+    uint64_t v = 0;
+
+    if (parser->step == 0 && !pmoq_field_is_present(parser->selector, field->cond)) {
+        return 1;
+    }
+
+    switch (field->field_type) {
+    case pmoq_field_varint:
+        if ((ret = pmoq_msg_parser_varint(parser, p_bytes, bytes_max, (uint64_t*)target)) == 1) {
+            v = *(uint64_t*)target;
+        }
+        break;
+    case pmoq_field_uint8:
+        if (*p_bytes < bytes_max) {
+            *target = **p_bytes;
+            *p_bytes += 1;
+            v = *target;
+            ret = 1;
+        }
+        break;
+    case pmoq_field_version:
+        if ((ret = pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &v)) == 1) {
+            if (v > UINT32_MAX) {
+                ret = -1;
+            }
+            else {
+                *(uint32_t*)target = (uint32_t)v;
+            }
+        }
+        break;
+    case pmoq_field_bits:
+        ret = pmoq_msg_parser_bits(parser, p_bytes, bytes_max, 0, (pmoq_bits_t*)target);
+        break;
+    case pmoq_field_tuple: {
+        pmoq_tuple_t* tuple = (pmoq_tuple_t*)target;
+        if (parser->step == 0 && pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &tuple->nb_items)) {
+            if (tuple->nb_items > PMOQ_TUPLE_SIZE_MAX) {
+                ret = -1;
+            }
+            else {
+                tuple->items = parser->namespace_items;
+                tuple->items_max = PMOQ_TUPLE_SIZE_MAX;
+                memset(tuple->items, 0, (size_t)tuple->nb_items * sizeof(pmoq_bits_t));
+                parser->item_rank = 0;
+                parser->step = 1;
+            }
+        }
+        while (ret == 0 && parser->step > 0) {
+            if (parser->item_rank >= tuple->nb_items) {
+                ret = 1;
+            }
+            else if ((ret = pmoq_msg_parser_bits(parser, p_bytes, bytes_max, 1, &tuple->items[parser->item_rank])) == 1) {
+                parser->item_rank++;
+                parser->step = 1;
+                ret = 0;
+            }
+            else if (ret == 0) {
+                break;
+            }
+        }
+        break;
+    }
+    case pmoq_field_versions: {
+        pmoq_client_setup_t* client_setup = (pmoq_client_setup_t*)target;
+        while (ret == 0) {
+            if (parser->step == 0) {
+                if (!pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &client_setup->supported_versions_nb)) {
+                    break;
+                }
+                else if (client_setup->supported_versions_nb > PMOQ_VERSION_NUMBER_MAX) {
+                    ret = -1;
+                }
+                else {
+                    parser->item_rank = 0;
+                    parser->step = 1;
+                }
+            }
+            else if (parser->item_rank >= client_setup->supported_versions_nb) {
+                ret = 1;
+            }
+            else if (!pmoq_msg_parser_varint(parser, p_bytes, bytes_max, &v)) {
+                break;
+            }
+            else if (v > UINT32_MAX) {
+                ret = -1;
+            }
+            else {
+                client_setup->supported_versions[parser->item_rank++] = (uint32_t)v;
+            }
+        }
+        break;
+    }
+    case pmoq_field_subscribe_parameters:
+        ret = pmoq_msg_parser_parameters(parser, p_bytes, bytes_max, 0, target);
+        break;
+    case pmoq_field_setup_parameters:
+        ret = pmoq_msg_parser_parameters(parser, p_bytes, bytes_max, 1, target);
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+
+    if (ret == 1 && field->check != pmoq_field_check_none) {
+        if (pmoq_field_check(v, field->check) != 0) {
+            ret = -1;
+        }
+        else {
+            parser->selector = v;
+        }
+    }
+
+    return ret;
+}
+
+static const uint8_t* pmoq_msg_parser_consume(pmoq_msg_parser_t* parser, const uint8_t* bytes, const uint8_t* bytes_max, int* err)
+{
+    if (parser->is_complete) {
+        /* The previous message must be retrieved first */
+        return bytes;
+    }
+
+    if (!parser->is_started) {
+        if (parser->field_rank == 0 && parser->varint_len == 0) {
+            /* First byte of a new message */
+            memset(&parser->msg, 0, sizeof(pmoq_msg_t));
+            parser->msg.namespace_items = parser->namespace_items;
+            parser->msg.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
+            parser->msg.param_values = parser->param_values;
+            parser->msg.param_values_max = PMOQ_PARAM_VALUES_MAX;
+            parser->msg.registry = parser->registry;
+            parser->selector = 0;
+            parser->store_used = 0;
+            parser->step = 0;
+        }
+        if (!pmoq_msg_parser_varint(parser, &bytes, bytes_max, &parser->msg.msg_type)) {
+            return bytes;
+        }
+        if ((parser->msg_def = pmoq_codec_msg_def(parser->codec, parser->msg.msg_type)) == NULL) {
+            /* Unexpected */
+            *err = -1;
+            return NULL;
+        }
+        parser->is_started = 1;
+    }
+
+    while (parser->field_rank < parser->msg_def->nb_fields) {
+        int ret = pmoq_msg_parser_field(parser, &parser->msg_def->fields[parser->field_rank], &bytes, bytes_max);
+        if (ret < 0) {
+            *err = -1;
+            bytes = NULL;
+            break;
+        }
+        else if (ret == 0) {
+            break;
+        }
+        else {
+            parser->field_rank++;
+            parser->step = 0;
+        }
+    }
+
+    if (bytes != NULL && parser->field_rank >= parser->msg_def->nb_fields) {
+        parser->is_complete = 1;
+    }
+
+    return bytes;
+}
+
+const uint8_t* pmoq_msg_parser_feed(pmoq_msg_parser_t* parser, const uint8_t* bytes, const uint8_t* bytes_max, int* err)
+{
+    PMOQ_STATS_START(stats_start);
+    const uint8_t* next = pmoq_msg_parser_consume(parser, bytes, bytes_max, err);
+
+    /* A message left complete by the previous call is not counted again */
+    PMOQ_STATS_FED(pmoq_stats_msg_slot(parser->msg.msg_type), bytes, next, parser->is_complete && next != bytes, stats_start);
+    return next;
+}
+
+const pmoq_msg_t* pmoq_msg_parser_next(pmoq_msg_parser_t* parser)
+{
+    const pmoq_msg_t* msg = NULL;
+
+    if (parser->is_complete) {
+        msg = &parser->msg;
+        parser->is_complete = 0;
+        parser->is_started = 0;
+        parser->field_rank = 0;
+    }
+    return msg;
+}
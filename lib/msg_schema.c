@@ -0,0 +1,181 @@
+/* Tables of the message schema.
+*
+* The field lists of msg_schema.h are expanded into one table per layout,
+* and each message type is registered with its layout in the codec of
+* the versions that use it. The data that only depends on the layout,
+* like the offsets of the namespace and of the parameters, is computed
+* here, at compile time.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include "picomoq.h"
+#include "picomoq_internal.h"
+#include "msg_schema.h"
+
+#define PMOQ_FIELD_ENTRY(T, t, c, k, f) { pmoq_field_##t, pmoq_field_cond_##c, pmoq_field_check_##k, offsetof(T, f) },
+
+/* Offset of the first field of a given type, as a chain of conditional
+ * expressions closed after the last field */
+#define PMOQ_NAMESPACE_OFFSET(T, t, c, k, f) (pmoq_field_##t == pmoq_field_tuple) ? offsetof(T, f) : (
+#define PMOQ_EXTENSIONS_OFFSET(T, t, c, k, f) \
+    (pmoq_field_##t == pmoq_field_subscribe_parameters) ? offsetof(T, f) + offsetof(pmoq_subscribe_parameters_t, extensions) : \
+    (pmoq_field_##t == pmoq_field_setup_parameters) ? offsetof(T, f) + offsetof(pmoq_setup_parameters_t, extensions) : (
+#define PMOQ_OFFSET_END(T, t, c, k, f) )
+
+#define PMOQ_LAYOUT_DEF(name, T, list) \
+static const pmoq_field_def_t pmoq_layout_##name##_fields[] = { list(PMOQ_FIELD_ENTRY, T) }; \
+const pmoq_msg_def_t pmoq_layout_##name##_def = { \
+    pmoq_layout_##name##_fields, sizeof(pmoq_layout_##name##_fields) / sizeof(pmoq_field_def_t), \
+    pmoq_layout_##name##_parse, pmoq_layout_##name##_format, pmoq_layout_##name##_size, \
+    list(PMOQ_NAMESPACE_OFFSET, T) PMOQ_FIELD_NO_OFFSET list(PMOQ_OFFSET_END, T), \
+    list(PMOQ_EXTENSIONS_OFFSET, T) PMOQ_FIELD_NO_OFFSET list(PMOQ_OFFSET_END, T) };
+
+PMOQ_MSG_LAYOUTS(PMOQ_LAYOUT_DEF)
+PMOQ_STRM_LAYOUTS(PMOQ_LAYOUT_DEF)
+
+/* The layouts of a codec are indexed by message type */
+static const pmoq_msg_def_t* const pmoq_msg_defs[] = {
+    [PMOQ_MSG_SUBSCRIBE_UPDATE] = &pmoq_layout_subscribe_update_def,
+    [PMOQ_MSG_SUBSCRIBE] = &pmoq_layout_subscribe_def,
+    [PMOQ_MSG_SUBSCRIBE_OK] = &pmoq_layout_subscribe_ok_def,
+    [PMOQ_MSG_SUBSCRIBE_ERROR] = &pmoq_layout_subscribe_error_def,
+    [PMOQ_MSG_ANNOUNCE] = &pmoq_layout_namespace_parameters_def,
+    [PMOQ_MSG_ANNOUNCE_OK] = &pmoq_layout_namespace_def,
+    [PMOQ_MSG_ANNOUNCE_ERROR] = &pmoq_layout_namespace_error_def,
+    [PMOQ_MSG_UNANNOUNCE] = &pmoq_layout_namespace_def,
+    [PMOQ_MSG_UNSUBSCRIBE] = &pmoq_layout_subscribe_id_def,
+    [PMOQ_MSG_SUBSCRIBE_DONE] = &pmoq_layout_subscribe_done_def,
+    [PMOQ_MSG_ANNOUNCE_CANCEL] = &pmoq_layout_namespace_error_def,
+    [PMOQ_MSG_TRACK_STATUS_REQUEST] = &pmoq_layout_track_status_request_def,
+    [PMOQ_MSG_TRACK_STATUS] = &pmoq_layout_track_status_def,
+    [PMOQ_MSG_GOAWAY] = &pmoq_layout_goaway_def,
+    [PMOQ_MSG_SUBSCRIBE_NAMESPACE] = &pmoq_layout_namespace_parameters_def,
+    [PMOQ_MSG_SUBSCRIBE_NAMESPACE_OK] = &pmoq_layout_namespace_def,
+    [PMOQ_MSG_SUBSCRIBE_NAMESPACE_ERROR] = &pmoq_layout_namespace_error_def,
+    [PMOQ_MSG_UNSUBSCRIBE_NAMESPACE] = &pmoq_layout_namespace_def,
+    [PMOQ_MSG_MAX_SUBSCRIBE_ID] = &pmoq_layout_subscribe_id_def,
+    [PMOQ_MSG_CLIENT_SETUP] = &pmoq_layout_client_setup_def,
+    [PMOQ_MSG_SERVER_SETUP] = &pmoq_layout_server_setup_def
+};
+
+static const pmoq_msg_def_t* const pmoq_strm_defs[] = {
+    [PMOQ_STRM_OBJECT_DATAGRAM] = &pmoq_layout_object_datagram_def,
+    [PMOQ_STRM_HEADER_TRACK] = &pmoq_layout_header_track_def,
+    [PMOQ_STRM_HEADER_SUBGROUP] = &pmoq_layout_header_subgroup_def
+};
+
+/* Codecs of the supported versions. A new version of the wire format is
+ * added by listing the layouts of the messages that changed in
+ * msg_schema.h, and registering them here with the layouts that did not
+ * change. */
+static const pmoq_codec_t pmoq_codecs[] = {
+    {
+        PMOQ_VERSION_DRAFT_07,
+        pmoq_msg_defs, sizeof(pmoq_msg_defs) / sizeof(pmoq_msg_def_t*),
+        pmoq_strm_defs, sizeof(pmoq_strm_defs) / sizeof(pmoq_msg_def_t*),
+        &pmoq_layout_object_track_def,
+        &pmoq_layout_object_subgroup_def
+    }
+};
+
+const pmoq_codec_t* pmoq_codec_get(uint32_t version)
+{
+    for (size_t i = 0; i < sizeof(pmoq_codecs) / sizeof(pmoq_codec_t); i++) {
+        if (pmoq_codecs[i].version == version) {
+            return &pmoq_codecs[i];
+        }
+    }
+    return NULL;
+}
+
+const pmoq_codec_t* pmoq_codec_default()
+{
+    return &pmoq_codecs[0];
+}
+
+uint32_t pmoq_codec_version(const pmoq_codec_t* codec)
+{
+    return codec->version;
+}
+
+const pmoq_msg_def_t* pmoq_codec_msg_def(const pmoq_codec_t* codec, uint64_t msg_type)
+{
+    return PMOQ_CODEC_MSG_DEF(codec, msg_type);
+}
+
+const pmoq_msg_def_t* pmoq_codec_strm_def(const pmoq_codec_t* codec, uint64_t msg_type)
+{
+    return PMOQ_CODEC_STRM_DEF(codec, msg_type);
+}
+
+const pmoq_msg_def_t* pmoq_codec_object_def(const pmoq_codec_t* codec, uint64_t header_type)
+{
+    const pmoq_msg_def_t* def = NULL;
+
+    if (header_type == PMOQ_STRM_HEADER_TRACK) {
+        def = codec->object_track_def;
+    }
+    else if (header_type == PMOQ_STRM_HEADER_SUBGROUP) {
+        def = codec->object_subgroup_def;
+    }
+    return def;
+}
+
+const pmoq_msg_def_t* pmoq_msg_def_get(uint64_t msg_type)
+{
+    return pmoq_codec_msg_def(pmoq_codec_default(), msg_type);
+}
+
+const pmoq_msg_def_t* pmoq_strm_def_get(uint64_t msg_type)
+{
+    return pmoq_codec_strm_def(pmoq_codec_default(), msg_type);
+}
+
+int pmoq_field_is_present(uint64_t selector, pmoq_field_cond_enum cond)
+{
+    int is_present = 1;
+
+    switch (cond) {
+    case pmoq_field_cond_filter_start:
+        is_present = PMOQ_FIELD_COND_filter_start(selector);
+        break;
+    case pmoq_field_cond_filter_range:
+        is_present = PMOQ_FIELD_COND_filter_range(selector);
+        break;
+    case pmoq_field_cond_content_exists:
+        is_present = PMOQ_FIELD_COND_content_exists(selector);
+        break;
+    case pmoq_field_cond_status_in_progress:
+        is_present = PMOQ_FIELD_COND_status_in_progress(selector);
+        break;
+    case pmoq_field_cond_payload_empty:
+        is_present = PMOQ_FIELD_COND_payload_empty(selector);
+        break;
+    default:
+        break;
+    }
+    return is_present;
+}
+
+int pmoq_field_check(uint64_t value, pmoq_field_check_enum check)
+{
+    int is_invalid = 0;
+
+    switch (check) {
+    case pmoq_field_check_filter_type:
+        is_invalid = PMOQ_FIELD_INVALID_filter_type(value);
+        break;
+    case pmoq_field_check_content_exists:
+        is_invalid = PMOQ_FIELD_INVALID_content_exists(value);
+        break;
+    case pmoq_field_check_track_status:
+        is_invalid = PMOQ_FIELD_INVALID_track_status(value);
+        break;
+    case pmoq_field_check_object_status:
+        is_invalid = PMOQ_FIELD_INVALID_object_status(value);
+        break;
+    default:
+        break;
+    }
+    return (is_invalid) ? -1 : 0;
+}
@@ -0,0 +1,193 @@
+#ifndef PMOQ_MSG_SCHEMA_H
+#define PMOQ_MSG_SCHEMA_H
+/* Message schema.
+*
+* The layout of every control message and data stream header is
+* described once, by the field lists below. msg_schema.c expands them
+* into the tables walked by the resumable parser, the skip and the view
+* functions; formats.c expands them into a parse, a format and a size
+* function per layout, with the conditions, checks and offsets known at
+* compile time. Adding a message or changing a field for a new draft
+* only requires editing this file and registering the layout in the
+* codec, in msg_schema.c.
+*
+* Each field is listed in wire order as F(T, type, condition, check,
+* member), where T is the type of the message body. Optional fields
+* carry a condition, evaluated against the "selector", i.e., the value
+* of the last field that has a check: filter type, content exists,
+* status code, or payload length.
+*/
+
+/* Conditions under which an optional field is present */
+#define PMOQ_FIELD_COND_none(s) 1
+#define PMOQ_FIELD_COND_filter_start(s) ((s) == pmoq_msg_filter_absolute_start || (s) == pmoq_msg_filter_absolute_range)
+#define PMOQ_FIELD_COND_filter_range(s) ((s) == pmoq_msg_filter_absolute_range)
+#define PMOQ_FIELD_COND_content_exists(s) ((s) == 1)
+#define PMOQ_FIELD_COND_status_in_progress(s) ((s) == PMOQ_TRACK_STATUS_IN_PROGRESS)
+#define PMOQ_FIELD_COND_payload_empty(s) ((s) == 0)
+
+/* Values rejected by the checks */
+#define PMOQ_FIELD_INVALID_none(v) 0
+#define PMOQ_FIELD_INVALID_filter_type(v) ((v) == 0 || (v) > pmoq_msg_filter_max)
+#define PMOQ_FIELD_INVALID_content_exists(v) ((v) > 1)
+#define PMOQ_FIELD_INVALID_track_status(v) ((v) > PMOQ_TRACK_STATUS_MAX)
+#define PMOQ_FIELD_INVALID_payload_length(v) 0
+#define PMOQ_FIELD_INVALID_object_status(v) ((v) > PMOQ_OBJECT_STATUS_MAX)
+
+/* Control messages */
+
+#define PMOQ_LAYOUT_SUBSCRIBE_UPDATE(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, start_group) \
+    F(T, varint, none, none, start_object) \
+    F(T, varint, none, none, end_group) \
+    F(T, varint, none, none, end_object) \
+    F(T, subscribe_parameters, none, none, subscribe_parameters)
+
+#define PMOQ_LAYOUT_SUBSCRIBE(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, track_alias) \
+    F(T, tuple, none, none, track_namespace) \
+    F(T, bits, none, none, track_name) \
+    F(T, varint, none, filter_type, filter_type) \
+    F(T, varint, filter_start, none, start_group) \
+    F(T, varint, filter_start, none, start_object) \
+    F(T, varint, filter_range, none, end_group) \
+    F(T, varint, filter_range, none, end_object) \
+    F(T, subscribe_parameters, none, none, subscribe_parameters)
+
+#define PMOQ_LAYOUT_SUBSCRIBE_OK(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, expires) \
+    F(T, uint8, none, content_exists, content_exists) \
+    F(T, varint, content_exists, none, largest_group_id) \
+    F(T, varint, content_exists, none, largest_object_id) \
+    F(T, subscribe_parameters, none, none, subscribe_parameters)
+
+#define PMOQ_LAYOUT_SUBSCRIBE_ERROR(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, error_code) \
+    F(T, bits, none, none, reason_phrase) \
+    F(T, varint, none, none, track_alias)
+
+#define PMOQ_LAYOUT_NAMESPACE_PARAMETERS(F, T) \
+    F(T, tuple, none, none, track_namespace) \
+    F(T, subscribe_parameters, none, none, subscribe_parameters)
+
+#define PMOQ_LAYOUT_NAMESPACE(F, T) \
+    F(T, tuple, none, none, track_namespace)
+
+#define PMOQ_LAYOUT_NAMESPACE_ERROR(F, T) \
+    F(T, tuple, none, none, track_namespace) \
+    F(T, varint, none, none, error_code) \
+    F(T, bits, none, none, reason_phrase)
+
+#define PMOQ_LAYOUT_SUBSCRIBE_ID(F, T) \
+    F(T, varint, none, none, subscribe_id)
+
+#define PMOQ_LAYOUT_SUBSCRIBE_DONE(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, status_code) \
+    F(T, bits, none, none, reason_phrase) \
+    F(T, uint8, none, content_exists, content_exists) \
+    F(T, varint, content_exists, none, final_group_id) \
+    F(T, varint, content_exists, none, final_object_id)
+
+#define PMOQ_LAYOUT_TRACK_STATUS_REQUEST(F, T) \
+    F(T, tuple, none, none, track_namespace) \
+    F(T, bits, none, none, track_name)
+
+#define PMOQ_LAYOUT_TRACK_STATUS(F, T) \
+    F(T, tuple, none, none, track_namespace) \
+    F(T, bits, none, none, track_name) \
+    F(T, varint, none, track_status, status_code) \
+    F(T, varint, status_in_progress, none, last_group_id) \
+    F(T, varint, status_in_progress, none, last_object_id)
+
+#define PMOQ_LAYOUT_GOAWAY(F, T) \
+    F(T, bits, none, none, uri)
+
+#define PMOQ_LAYOUT_CLIENT_SETUP(F, T) \
+    F(T, versions, none, none, supported_versions_nb) \
+    F(T, setup_parameters, none, none, setup_parameters)
+
+#define PMOQ_LAYOUT_SERVER_SETUP(F, T) \
+    F(T, version, none, none, selected_version) \
+    F(T, setup_parameters, none, none, setup_parameters)
+
+/* Data streams and datagrams. The object status is only present if the
+ * payload is empty. The fields are varints or bytes, and the leading
+ * fields that are always present are decoded in one pass by the fast
+ * decoder, see varint_fast.c. */
+
+#define PMOQ_LAYOUT_OBJECT_DATAGRAM(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, track_alias) \
+    F(T, varint, none, none, group_id) \
+    F(T, varint, none, none, object_id) \
+    F(T, uint8, none, none, publisher_priority) \
+    F(T, varint, none, payload_length, payload_length) \
+    F(T, varint, payload_empty, object_status, object_status)
+
+#define PMOQ_LAYOUT_HEADER_TRACK(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, track_alias) \
+    F(T, uint8, none, none, publisher_priority)
+
+#define PMOQ_LAYOUT_OBJECT_TRACK(F, T) \
+    F(T, varint, none, none, group_id) \
+    F(T, varint, none, none, object_id) \
+    F(T, varint, none, payload_length, payload_length) \
+    F(T, varint, payload_empty, object_status, object_status)
+
+#define PMOQ_LAYOUT_HEADER_SUBGROUP(F, T) \
+    F(T, varint, none, none, subscribe_id) \
+    F(T, varint, none, none, track_alias) \
+    F(T, varint, none, none, group_id) \
+    F(T, varint, none, none, object_id) \
+    F(T, uint8, none, none, publisher_priority)
+
+#define PMOQ_LAYOUT_OBJECT_SUBGROUP(F, T) \
+    F(T, varint, none, none, object_id) \
+    F(T, varint, none, payload_length, payload_length) \
+    F(T, varint, payload_empty, object_status, object_status)
+
+/* All the layouts, as L(name, body type, field list). Message types that
+ * share a structure share the layout. */
+#define PMOQ_MSG_LAYOUTS(L) \
+    L(subscribe_update, pmoq_subscribe_update_t, PMOQ_LAYOUT_SUBSCRIBE_UPDATE) \
+    L(subscribe, pmoq_subscribe_t, PMOQ_LAYOUT_SUBSCRIBE) \
+    L(subscribe_ok, pmoq_subscribe_ok_t, PMOQ_LAYOUT_SUBSCRIBE_OK) \
+    L(subscribe_error, pmoq_subscribe_error_t, PMOQ_LAYOUT_SUBSCRIBE_ERROR) \
+    L(namespace_parameters, pmoq_announce_t, PMOQ_LAYOUT_NAMESPACE_PARAMETERS) \
+    L(namespace, pmoq_announce_ok_t, PMOQ_LAYOUT_NAMESPACE) \
+    L(namespace_error, pmoq_announce_error_t, PMOQ_LAYOUT_NAMESPACE_ERROR) \
+    L(subscribe_id, pmoq_unsubscribe_t, PMOQ_LAYOUT_SUBSCRIBE_ID) \
+    L(subscribe_done, pmoq_subscribe_done_t, PMOQ_LAYOUT_SUBSCRIBE_DONE) \
+    L(track_status_request, pmoq_track_status_request_t, PMOQ_LAYOUT_TRACK_STATUS_REQUEST) \
+    L(track_status, pmoq_track_status_t, PMOQ_LAYOUT_TRACK_STATUS) \
+    L(goaway, pmoq_goaway_t, PMOQ_LAYOUT_GOAWAY) \
+    L(client_setup, pmoq_client_setup_t, PMOQ_LAYOUT_CLIENT_SETUP) \
+    L(server_setup, pmoq_server_setup_t, PMOQ_LAYOUT_SERVER_SETUP)
+
+#define PMOQ_STRM_LAYOUTS(L) \
+    L(object_datagram, pmoq_strm_t, PMOQ_LAYOUT_OBJECT_DATAGRAM) \
+    L(header_track, pmoq_strm_t, PMOQ_LAYOUT_HEADER_TRACK) \
+    L(object_track, pmoq_strm_t, PMOQ_LAYOUT_OBJECT_TRACK) \
+    L(header_subgroup, pmoq_strm_t, PMOQ_LAYOUT_HEADER_SUBGROUP) \
+    L(object_subgroup, pmoq_strm_t, PMOQ_LAYOUT_OBJECT_SUBGROUP)
+
+/* Layouts, in msg_schema.c, and their specialized functions, in
+ * formats.c. The parse functions decode the parameters with the
+ * registry, or with the keys known to the library if it is NULL. */
+#define PMOQ_LAYOUT_DECLARE(name, T, list) \
+    extern const pmoq_msg_def_t pmoq_layout_##name##_def; \
+    const uint8_t* pmoq_layout_##name##_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, \
+        const pmoq_param_registry_t* registry, void* body); \
+    uint8_t* pmoq_layout_##name##_format(uint8_t* bytes, const uint8_t* bytes_max, const void* body); \
+    size_t pmoq_layout_##name##_size(const void* body);
+
+PMOQ_MSG_LAYOUTS(PMOQ_LAYOUT_DECLARE)
+PMOQ_STRM_LAYOUTS(PMOQ_LAYOUT_DECLARE)
+
+#endif /* PMOQ_MSG_SCHEMA_H */
@@ -0,0 +1,366 @@
+/* Track namespace trie.
+*
+* Each node of the trie is one item of a namespace tuple; the path from
+* the root to a node spells the namespace. The children of all nodes are
+* found through a single hash table, keyed by the parent node and the
+* hash of the item, so descending one level is one lookup whatever the
+* number of siblings. The children of a node are also chained, for
+* walking the subtree below a prefix.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_internal.h"
+
+typedef struct st_pmoq_ns_node_t pmoq_ns_node_t;
+
+struct st_pmoq_ns_node_t {
+    pmoq_ns_node_t* parent;
+    pmoq_ns_node_t* first_child;
+    pmoq_ns_node_t* next_sibling;
+    pmoq_ns_node_t* previous_sibling;
+    uint64_t hash;
+    size_t depth;
+    pmoq_ns_entry_t* entries;
+    size_t nb_entries;
+    size_t entries_max;
+    uint64_t nb_bits;
+    uint8_t* bits;
+};
+
+struct st_pmoq_ns_trie_t {
+    pmoq_ns_node_t root;
+    /* Hash table of pointers to all the nodes except the root */
+    pmoq_hash_table_t nodes;
+    size_t nb_entries;
+};
+
+#define PMOQ_NS_TABLE_SIZE_MIN 64
+
+static uint64_t pmoq_ns_item_hash(const pmoq_bits_t* item)
+{
+    uint64_t h = 0xcbf29ce484222325ull ^ item->nb_bits;
+    size_t nb_bytes = (size_t)((item->nb_bits + 7) >> 3);
+
+    for (size_t i = 0; i < nb_bytes; i++) {
+        h = (h ^ item->bits[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+typedef struct st_pmoq_ns_key_t {
+    const pmoq_ns_node_t* parent;
+    uint64_t hash;
+    const pmoq_bits_t* item;
+} pmoq_ns_key_t;
+
+static uint64_t pmoq_ns_slot_hash(const pmoq_ns_node_t* parent, uint64_t hash)
+{
+    return ((hash + (uint64_t)(uintptr_t)parent) * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+static uint64_t pmoq_ns_node_hash(void* hash_ctx, const void* element)
+{
+    const pmoq_ns_node_t* node = *(pmoq_ns_node_t* const*)element;
+
+    (void)hash_ctx;
+    return pmoq_ns_slot_hash(node->parent, node->hash);
+}
+
+static int pmoq_ns_node_match(const void* key, const void* element)
+{
+    const pmoq_ns_key_t* k = (const pmoq_ns_key_t*)key;
+    const pmoq_ns_node_t* node = *(pmoq_ns_node_t* const*)element;
+    size_t nb_bytes = (size_t)((k->item->nb_bits + 7) >> 3);
+
+    return node->parent == k->parent && node->hash == k->hash && node->nb_bits == k->item->nb_bits &&
+        (nb_bytes == 0 || memcmp(node->bits, k->item->bits, nb_bytes) == 0);
+}
+
+static int pmoq_ns_node_is_same(const void* key, const void* element)
+{
+    return *(pmoq_ns_node_t* const*)element == (const pmoq_ns_node_t*)key;
+}
+
+/* Slot of the child of parent holding the item, or of the empty slot
+ * where it would be inserted. */
+static size_t pmoq_ns_slot_find(const pmoq_ns_trie_t* trie, const pmoq_ns_node_t* parent, uint64_t hash, const pmoq_bits_t* item)
+{
+    pmoq_ns_key_t key;
+
+    key.parent = parent;
+    key.hash = hash;
+    key.item = item;
+    return pmoq_hash_table_probe(&trie->nodes, pmoq_ns_slot_hash(parent, hash), pmoq_ns_node_match, &key);
+}
+
+static pmoq_ns_node_t* pmoq_ns_slot_node(const pmoq_ns_trie_t* trie, size_t slot)
+{
+    return *(pmoq_ns_node_t**)PMOQ_HASH_TABLE_SLOT(&trie->nodes, slot);
+}
+
+static void pmoq_ns_table_remove(pmoq_ns_trie_t* trie, const pmoq_ns_node_t* node)
+{
+    pmoq_hash_table_remove(&trie->nodes,
+        pmoq_hash_table_probe(&trie->nodes, pmoq_ns_slot_hash(node->parent, node->hash), pmoq_ns_node_is_same, node));
+}
+
+/* Deepest node along the namespace. Returns the node of the whole
+ * namespace, or NULL if it is not in the trie. */
+static pmoq_ns_node_t* pmoq_ns_node_find(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns)
+{
+    pmoq_ns_node_t* node = &trie->root;
+
+    for (uint64_t i = 0; node != NULL && i < ns->nb_items; i++) {
+        uint64_t hash = pmoq_ns_item_hash(&ns->items[i]);
+        node = pmoq_ns_slot_node(trie, pmoq_ns_slot_find(trie, node, hash, &ns->items[i]));
+    }
+    return node;
+}
+
+static pmoq_ns_node_t* pmoq_ns_node_create(pmoq_ns_node_t* parent, uint64_t hash, const pmoq_bits_t* item)
+{
+    size_t nb_bytes = (size_t)((item->nb_bits + 7) >> 3);
+    pmoq_ns_node_t* node = (pmoq_ns_node_t*)malloc(sizeof(pmoq_ns_node_t) + nb_bytes);
+
+    if (node != NULL) {
+        memset(node, 0, sizeof(pmoq_ns_node_t));
+        node->parent = parent;
+        node->hash = hash;
+        node->depth = parent->depth + 1;
+        node->nb_bits = item->nb_bits;
+        node->bits = (uint8_t*)(node + 1);
+        if (nb_bytes > 0) {
+            memcpy(node->bits, item->bits, nb_bytes);
+        }
+        node->next_sibling = parent->first_child;
+        if (parent->first_child != NULL) {
+            parent->first_child->previous_sibling = node;
+        }
+        parent->first_child = node;
+    }
+    return node;
+}
+
+static void pmoq_ns_node_free(pmoq_ns_trie_t* trie, pmoq_ns_node_t* node)
+{
+    pmoq_ns_table_remove(trie, node);
+    if (node->previous_sibling != NULL) {
+        node->previous_sibling->next_sibling = node->next_sibling;
+    }
+    else {
+        node->parent->first_child = node->next_sibling;
+    }
+    if (node->next_sibling != NULL) {
+        node->next_sibling->previous_sibling = node->previous_sibling;
+    }
+    if (node->entries != NULL) {
+        free(node->entries);
+    }
+    free(node);
+}
+
+/* Remove the node if it has no entries and no children, then its
+ * ancestors in the same condition. */
+static void pmoq_ns_node_prune(pmoq_ns_trie_t* trie, pmoq_ns_node_t* node)
+{
+    while (node != &trie->root && node->nb_entries == 0 && node->first_child == NULL) {
+        pmoq_ns_node_t* parent = node->parent;
+
+        pmoq_ns_node_free(trie, node);
+        node = parent;
+    }
+}
+
+pmoq_ns_trie_t* pmoq_ns_trie_create()
+{
+    pmoq_ns_trie_t* trie = (pmoq_ns_trie_t*)malloc(sizeof(pmoq_ns_trie_t));
+
+    if (trie != NULL) {
+        memset(trie, 0, sizeof(pmoq_ns_trie_t));
+        if (pmoq_hash_table_init(&trie->nodes, sizeof(pmoq_ns_node_t*), PMOQ_NS_TABLE_SIZE_MIN,
+            pmoq_ns_node_hash, NULL) != 0) {
+            free(trie);
+            trie = NULL;
+        }
+    }
+    return trie;
+}
+
+void pmoq_ns_trie_delete(pmoq_ns_trie_t* trie)
+{
+    if (trie != NULL) {
+        for (size_t i = 0; i < trie->nodes.size; i++) {
+            pmoq_ns_node_t* node = pmoq_ns_slot_node(trie, i);
+
+            if (node != NULL) {
+                if (node->entries != NULL) {
+                    free(node->entries);
+                }
+                free(node);
+            }
+        }
+        if (trie->root.entries != NULL) {
+            free(trie->root.entries);
+        }
+        pmoq_hash_table_release(&trie->nodes);
+        free(trie);
+    }
+}
+
+size_t pmoq_ns_trie_count(const pmoq_ns_trie_t* trie)
+{
+    return trie->nb_entries;
+}
+
+int pmoq_ns_trie_add(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, uint64_t owner_id, void* app_ctx)
+{
+    pmoq_ns_node_t* node = &trie->root;
+
+    for (uint64_t i = 0; i < ns->nb_items; i++) {
+        uint64_t hash = pmoq_ns_item_hash(&ns->items[i]);
+        pmoq_ns_node_t* child = pmoq_ns_slot_node(trie, pmoq_ns_slot_find(trie, node, hash, &ns->items[i]));
+
+        if (child == NULL) {
+            if (pmoq_hash_table_reserve(&trie->nodes) != 0 ||
+                (child = pmoq_ns_node_create(node, hash, &ns->items[i])) == NULL) {
+                pmoq_ns_node_prune(trie, node);
+                return -1;
+            }
+            pmoq_hash_table_insert(&trie->nodes, pmoq_ns_slot_find(trie, node, hash, &ns->items[i]), &child);
+        }
+        node = child;
+    }
+
+    for (size_t i = 0; i < node->nb_entries; i++) {
+        if (node->entries[i].owner_id == owner_id) {
+            return -1;
+        }
+    }
+    if (node->nb_entries >= node->entries_max) {
+        size_t new_max = (node->entries_max == 0) ? 2 : 2 * node->entries_max;
+        pmoq_ns_entry_t* new_entries = (pmoq_ns_entry_t*)realloc(node->entries, new_max * sizeof(pmoq_ns_entry_t));
+
+        if (new_entries == NULL) {
+            pmoq_ns_node_prune(trie, node);
+            return -1;
+        }
+        node->entries = new_entries;
+        node->entries_max = new_max;
+    }
+    node->entries[node->nb_entries].owner_id = owner_id;
+    node->entries[node->nb_entries].app_ctx = app_ctx;
+    node->nb_entries++;
+    trie->nb_entries++;
+
+    return 0;
+}
+
+/* Remove the entries of the owner from the node, keeping the order of
+ * the others. Returns the number removed. */
+static size_t pmoq_ns_node_remove_owner(pmoq_ns_node_t* node, uint64_t owner_id)
+{
+    size_t j = 0;
+    size_t nb_removed;
+
+    for (size_t i = 0; i < node->nb_entries; i++) {
+        if (node->entries[i].owner_id != owner_id) {
+            node->entries[j++] = node->entries[i];
+        }
+    }
+    nb_removed = node->nb_entries - j;
+    node->nb_entries = j;
+    return nb_removed;
+}
+
+int pmoq_ns_trie_remove(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, uint64_t owner_id)
+{
+    pmoq_ns_node_t* node = pmoq_ns_node_find(trie, ns);
+    size_t nb_removed;
+
+    if (node == NULL || (nb_removed = pmoq_ns_node_remove_owner(node, owner_id)) == 0) {
+        return -1;
+    }
+    trie->nb_entries -= nb_removed;
+    pmoq_ns_node_prune(trie, node);
+
+    return 0;
+}
+
+static pmoq_ns_node_t* pmoq_ns_first_leaf(pmoq_ns_node_t* node)
+{
+    while (node->first_child != NULL) {
+        node = node->first_child;
+    }
+    return node;
+}
+
+void pmoq_ns_trie_remove_owner(pmoq_ns_trie_t* trie, uint64_t owner_id)
+{
+    /* Post order walk, so that a node is pruned after its children */
+    pmoq_ns_node_t* node = pmoq_ns_first_leaf(&trie->root);
+
+    while (node != NULL) {
+        pmoq_ns_node_t* next = NULL;
+
+        if (node != &trie->root) {
+            next = (node->next_sibling != NULL) ? pmoq_ns_first_leaf(node->next_sibling) : node->parent;
+        }
+        trie->nb_entries -= pmoq_ns_node_remove_owner(node, owner_id);
+        /* The parent is visited after all its children, and freed then if empty */
+        if (node->nb_entries == 0 && node->first_child == NULL && node != &trie->root) {
+            pmoq_ns_node_free(trie, node);
+        }
+        node = next;
+    }
+}
+
+static int pmoq_ns_node_call(const pmoq_ns_node_t* node, pmoq_ns_trie_fn fn, void* callback_ctx)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < node->nb_entries; i++) {
+        ret = fn(callback_ctx, &node->entries[i], node->depth);
+    }
+    return ret;
+}
+
+int pmoq_ns_trie_prefixes(pmoq_ns_trie_t* trie, const pmoq_tuple_t* ns, pmoq_ns_trie_fn fn, void* callback_ctx)
+{
+    pmoq_ns_node_t* node = &trie->root;
+    int ret = pmoq_ns_node_call(node, fn, callback_ctx);
+
+    for (uint64_t i = 0; ret == 0 && i < ns->nb_items; i++) {
+        uint64_t hash = pmoq_ns_item_hash(&ns->items[i]);
+
+        if ((node = pmoq_ns_slot_node(trie, pmoq_ns_slot_find(trie, node, hash, &ns->items[i]))) == NULL) {
+            break;
+        }
+        ret = pmoq_ns_node_call(node, fn, callback_ctx);
+    }
+    return ret;
+}
+
+int pmoq_ns_trie_subtree(pmoq_ns_trie_t* trie, const pmoq_tuple_t* prefix, pmoq_ns_trie_fn fn, void* callback_ctx)
+{
+    pmoq_ns_node_t* top = pmoq_ns_node_find(trie, prefix);
+    pmoq_ns_node_t* node = top;
+    int ret = 0;
+
+    /* Pre order walk of the nodes below top */
+    while (ret == 0 && node != NULL) {
+        ret = pmoq_ns_node_call(node, fn, callback_ctx);
+        if (node->first_child != NULL) {
+            node = node->first_child;
+        }
+        else {
+            while (node != top && node->next_sibling == NULL) {
+                node = node->parent;
+            }
+            node = (node == top) ? NULL : node->next_sibling;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,307 @@
+/* Parameter registry.
+*
+* Each key that is decoded has an entry in the registry, with the
+* decoder of its value. The keys known to the library have a setter
+* that writes the members of the parameter structure; the keys of the
+* application are decoded as varint, bytes, or by the decoder of the
+* application, into the extensions of the structure.
+*
+* The setup parameters and the other parameters have separate key
+* spaces, so the lookup key is the parameter key followed by one bit
+* telling the space. The entries are found with a perfect hash: the
+* slot of a key is ((key * multiplier) >> shift) modulo the number of
+* slots, and the multiplier is searched at each registration until no
+* two keys share a slot. The registry of the keys known to the library
+* uses the identity, which has no collision for these keys, so that it
+* can be a constant.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_internal.h"
+
+#define PMOQ_PARAM_REGISTRY_MAX 24
+#define PMOQ_PARAM_HASH_BITS 6
+#define PMOQ_PARAM_HASH_SLOTS (1 << PMOQ_PARAM_HASH_BITS)
+#define PMOQ_PARAM_HASH_TRIES 4096
+#define PMOQ_PARAM_KEY_MAX 0x3fffffffffffffffull
+#define PMOQ_PARAM_LOOKUP_KEY(key, is_setup) ((((uint64_t)(key)) << 1) | ((is_setup) != 0))
+
+typedef struct st_pmoq_param_entry_t {
+    uint64_t lookup_key;
+    pmoq_param_type_enum param_type;
+    /* Keys known to the library, NULL for the application keys */
+    int (*set_fn)(void* param, uint64_t l, uint8_t* v);
+    pmoq_param_decode_fn decode_fn;
+    void* decode_ctx;
+} pmoq_param_entry_t;
+
+struct st_pmoq_param_registry_t {
+    uint64_t multiplier;
+    unsigned int shift;
+    size_t nb_entries;
+    /* Application keys of the other parameters, and of the setup parameters */
+    size_t nb_app[2];
+    pmoq_param_entry_t entries[PMOQ_PARAM_REGISTRY_MAX];
+    /* Rank of the entry plus 1, 0 if the slot is empty */
+    uint8_t slots[PMOQ_PARAM_HASH_SLOTS];
+};
+
+static size_t pmoq_param_slot(uint64_t multiplier, unsigned int shift, uint64_t lookup_key)
+{
+    return (size_t)(((lookup_key * multiplier) >> shift) & (PMOQ_PARAM_HASH_SLOTS - 1));
+}
+
+/* Integer parameters are coded as a varint filling the whole value */
+static int pmoq_varint_parameter_value(uint64_t l, const uint8_t* v, uint64_t* value)
+{
+    int err = 0;
+    const uint8_t* bytes = (l == 0) ? NULL : pmoq_varint_parse(v, v + l, &err, 0, value);
+
+    return (bytes == v + l) ? 0 : -1;
+}
+
+static int pmoq_setup_role_set(void* param, uint64_t l, uint8_t* v)
+{
+    pmoq_setup_parameters_t* setup = (pmoq_setup_parameters_t*)param;
+
+    if (l != 1 || *v == pmoq_setup_role_undef || *v > pmoq_setup_role_max) {
+        /* malformed! */
+        return -1;
+    }
+    else if (setup->role != pmoq_setup_role_undef) {
+        /* Double definition! */
+        return -1;
+    }
+    setup->role = *v;
+    return 0;
+}
+
+static int pmoq_setup_path_set(void* param, uint64_t l, uint8_t* v)
+{
+    pmoq_setup_parameters_t* setup = (pmoq_setup_parameters_t*)param;
+
+    if (setup->path != NULL) {
+        /* Double definition! */
+        return -1;
+    }
+    setup->path = v;
+    setup->path_length = (size_t)l;
+    return 0;
+}
+
+static int pmoq_auth_info_set(void* param, uint64_t l, uint8_t* v)
+{
+    pmoq_subscribe_parameters_t* subscribe = (pmoq_subscribe_parameters_t*)param;
+
+    if (subscribe->auth_info != NULL) {
+        /* Double definition! */
+        return -1;
+    }
+    subscribe->auth_info = v;
+    subscribe->auth_info_len = (size_t)l;
+    return 0;
+}
+
+static int pmoq_delivery_timeout_set(void* param, uint64_t l, uint8_t* v)
+{
+    pmoq_subscribe_parameters_t* subscribe = (pmoq_subscribe_parameters_t*)param;
+
+    if (subscribe->has_delivery_timeout || pmoq_varint_parameter_value(l, v, &subscribe->delivery_timeout) != 0) {
+        return -1;
+    }
+    subscribe->has_delivery_timeout = 1;
+    return 0;
+}
+
+static int pmoq_max_cache_duration_set(void* param, uint64_t l, uint8_t* v)
+{
+    pmoq_subscribe_parameters_t* subscribe = (pmoq_subscribe_parameters_t*)param;
+
+    if (subscribe->has_max_cache_duration || pmoq_varint_parameter_value(l, v, &subscribe->max_cache_duration) != 0) {
+        return -1;
+    }
+    subscribe->has_max_cache_duration = 1;
+    return 0;
+}
+
+#define PMOQ_PARAM_BUILTIN(key, is_setup, set_fn) { PMOQ_PARAM_LOOKUP_KEY(key, is_setup), pmoq_param_type_bytes, set_fn, NULL, NULL }
+#define PMOQ_PARAM_BUILTIN_SLOT(key, is_setup) [PMOQ_PARAM_LOOKUP_KEY(key, is_setup) & (PMOQ_PARAM_HASH_SLOTS - 1)]
+
+static const pmoq_param_registry_t pmoq_param_registry_builtin = {
+    1, 0, 5, { 0, 0 },
+    {
+        PMOQ_PARAM_BUILTIN(PMOQ_SETUP_PARAMETER_ROLE, 1, pmoq_setup_role_set),
+        PMOQ_PARAM_BUILTIN(PMOQ_SETUP_PARAMETER_PATH, 1, pmoq_setup_path_set),
+        PMOQ_PARAM_BUILTIN(PMOQ_PARAMETER_AUTHORIZATION_INFO, 0, pmoq_auth_info_set),
+        PMOQ_PARAM_BUILTIN(PMOQ_PARAMETER_DELIVERY_TIMEOUT, 0, pmoq_delivery_timeout_set),
+        PMOQ_PARAM_BUILTIN(PMOQ_PARAMETER_MAX_CACHE_DURATION, 0, pmoq_max_cache_duration_set)
+    },
+    {
+        PMOQ_PARAM_BUILTIN_SLOT(PMOQ_SETUP_PARAMETER_ROLE, 1) = 1,
+        PMOQ_PARAM_BUILTIN_SLOT(PMOQ_SETUP_PARAMETER_PATH, 1) = 2,
+        PMOQ_PARAM_BUILTIN_SLOT(PMOQ_PARAMETER_AUTHORIZATION_INFO, 0) = 3,
+        PMOQ_PARAM_BUILTIN_SLOT(PMOQ_PARAMETER_DELIVERY_TIMEOUT, 0) = 4,
+        PMOQ_PARAM_BUILTIN_SLOT(PMOQ_PARAMETER_MAX_CACHE_DURATION, 0) = 5
+    }
+};
+
+static const pmoq_param_entry_t* pmoq_param_registry_find(const pmoq_param_registry_t* registry, uint64_t key, int is_setup)
+{
+    uint64_t lookup_key;
+    uint8_t rank;
+
+    if (key > PMOQ_PARAM_KEY_MAX) {
+        return NULL;
+    }
+    lookup_key = PMOQ_PARAM_LOOKUP_KEY(key, is_setup);
+    rank = registry->slots[pmoq_param_slot(registry->multiplier, registry->shift, lookup_key)];
+
+    return (rank > 0 && registry->entries[rank - 1].lookup_key == lookup_key) ? &registry->entries[rank - 1] : NULL;
+}
+
+/* Fill the slots, or return -1 if two keys collide */
+static int pmoq_param_registry_fill(pmoq_param_registry_t* registry, uint64_t multiplier, unsigned int shift)
+{
+    uint8_t slots[PMOQ_PARAM_HASH_SLOTS];
+
+    memset(slots, 0, sizeof(slots));
+    for (size_t i = 0; i < registry->nb_entries; i++) {
+        size_t slot = pmoq_param_slot(multiplier, shift, registry->entries[i].lookup_key);
+
+        if (slots[slot] != 0) {
+            return -1;
+        }
+        slots[slot] = (uint8_t)(i + 1);
+    }
+    memcpy(registry->slots, slots, sizeof(slots));
+    registry->multiplier = multiplier;
+    registry->shift = shift;
+    return 0;
+}
+
+static int pmoq_param_registry_hash(pmoq_param_registry_t* registry)
+{
+    if (pmoq_param_registry_fill(registry, 1, 0) == 0) {
+        return 0;
+    }
+    for (uint64_t i = 1; i <= PMOQ_PARAM_HASH_TRIES; i++) {
+        if (pmoq_param_registry_fill(registry, (0x9E3779B97F4A7C15ull * i) | 1, 64 - PMOQ_PARAM_HASH_BITS) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+pmoq_param_registry_t* pmoq_param_registry_create()
+{
+    pmoq_param_registry_t* registry = (pmoq_param_registry_t*)malloc(sizeof(pmoq_param_registry_t));
+
+    if (registry != NULL) {
+        memcpy(registry, &pmoq_param_registry_builtin, sizeof(pmoq_param_registry_t));
+    }
+    return registry;
+}
+
+void pmoq_param_registry_delete(pmoq_param_registry_t* registry)
+{
+    free(registry);
+}
+
+int pmoq_param_registry_add(pmoq_param_registry_t* registry, uint64_t key, int is_setup,
+    pmoq_param_type_enum param_type, pmoq_param_decode_fn decode_fn, void* decode_ctx)
+{
+    pmoq_param_entry_t* entry;
+
+    is_setup = (is_setup != 0);
+    if (key > PMOQ_PARAM_KEY_MAX || pmoq_param_registry_find(registry, key, is_setup) != NULL ||
+        registry->nb_entries >= PMOQ_PARAM_REGISTRY_MAX || registry->nb_app[is_setup] >= PMOQ_PARAM_VALUES_MAX ||
+        param_type > pmoq_param_type_custom || (param_type == pmoq_param_type_custom && decode_fn == NULL)) {
+        return -1;
+    }
+    entry = &registry->entries[registry->nb_entries++];
+    memset(entry, 0, sizeof(pmoq_param_entry_t));
+    entry->lookup_key = PMOQ_PARAM_LOOKUP_KEY(key, is_setup);
+    entry->param_type = param_type;
+    entry->decode_fn = decode_fn;
+    entry->decode_ctx = decode_ctx;
+    if (pmoq_param_registry_hash(registry) != 0) {
+        /* The slots were not changed */
+        registry->nb_entries--;
+        return -1;
+    }
+    registry->nb_app[is_setup]++;
+    return 0;
+}
+
+const pmoq_param_value_t* pmoq_param_values_find(const pmoq_param_values_t* values, uint64_t key)
+{
+    for (size_t i = 0; i < values->nb_values; i++) {
+        if (values->values[i].key == key) {
+            return &values->values[i];
+        }
+    }
+    return NULL;
+}
+
+static int pmoq_param_value_set(const pmoq_param_entry_t* entry, pmoq_param_values_t* values, uint64_t key, uint64_t l, uint8_t* v)
+{
+    pmoq_param_value_t* value;
+
+    if (pmoq_param_values_find(values, key) != NULL) {
+        /* Double definition! */
+        return -1;
+    }
+    if (values->nb_values >= values->values_max) {
+        /* No space left in the array provided by the caller */
+        return -1;
+    }
+    value = &values->values[values->nb_values];
+    memset(value, 0, sizeof(pmoq_param_value_t));
+    value->key = key;
+    value->length = (size_t)l;
+    value->bytes = v;
+    switch (entry->param_type) {
+    case pmoq_param_type_varint:
+        if (pmoq_varint_parameter_value(l, v, &value->varint) != 0) {
+            return -1;
+        }
+        value->is_varint = 1;
+        break;
+    case pmoq_param_type_custom:
+        if (entry->decode_fn(entry->decode_ctx, value) != 0) {
+            return -1;
+        }
+        break;
+    default:
+        break;
+    }
+    values->nb_values++;
+    return 0;
+}
+
+static int pmoq_parameter_set(const pmoq_param_registry_t* registry, int is_setup, void* param,
+    pmoq_param_values_t* values, uint64_t key, uint64_t l, uint8_t* v)
+{
+    const pmoq_param_entry_t* entry = pmoq_param_registry_find((registry == NULL) ? &pmoq_param_registry_builtin : registry, key, is_setup);
+
+    if (entry == NULL) {
+        /* By default, ignore unused parameters */
+        return 0;
+    }
+    else if (entry->set_fn != NULL) {
+        return entry->set_fn(param, l, v);
+    }
+    return pmoq_param_value_set(entry, values, key, l, v);
+}
+
+int pmoq_setup_parameter_set(const pmoq_param_registry_t* registry, pmoq_setup_parameters_t* param, uint64_t key, uint64_t l, uint8_t* v)
+{
+    return pmoq_parameter_set(registry, 1, param, &param->extensions, key, l, v);
+}
+
+int pmoq_subscribe_parameter_set(const pmoq_param_registry_t* registry, pmoq_subscribe_parameters_t* param, uint64_t key, uint64_t l, uint8_t* v)
+{
+    return pmoq_parameter_set(registry, 0, param, &param->extensions, key, l, v);
+}
@@ -0,0 +1,210 @@
+#ifndef PICOMOQ_INTERNAL_H
+#define PICOMOQ_INTERNAL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations shared between the source files of the library,
+ * but not exposed in the API.
+ */
+
+const uint8_t* pmoq_varint_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint64_t* v);
+const uint8_t* pmoq_uint8_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, uint8_t* v);
+
+/* Fast decoding of object headers, see varint_fast.c */
+#define PMOQ_FAST_FIELD_VARINT 0
+#define PMOQ_FAST_FIELD_UINT8 1
+
+const uint8_t* pmoq_varint_fast_decode(const uint8_t* bytes, const uint8_t* bytes_max,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v);
+
+size_t pmoq_varint_size(uint64_t v);
+size_t pmoq_size_add(size_t l, size_t x);
+size_t pmoq_bits_size(const pmoq_bits_t* bits_string);
+size_t pmoq_tuple_size(const pmoq_tuple_t* tuple);
+
+uint8_t* pmoq_bits_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_bits_t* bits_string);
+const uint8_t* pmoq_bits_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_bits_t* bits_string);
+
+uint8_t* pmoq_tuple_format(uint8_t* bytes, const uint8_t* bytes_max, const pmoq_tuple_t* tuple);
+const uint8_t* pmoq_tuple_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed, pmoq_tuple_t* tuple);
+
+/* Apply a decoded parameter to the parameter set, with the decoder of
+ * its key in the registry, or in the registry of the keys known to the
+ * library if "registry" is NULL. Returns 0 if OK, -1 if the parameter
+ * is malformed or defined twice. Keys that are not registered are
+ * ignored. See params.c. */
+int pmoq_setup_parameter_set(const pmoq_param_registry_t* registry, pmoq_setup_parameters_t* param, uint64_t key, uint64_t l, uint8_t* v);
+int pmoq_subscribe_parameter_set(const pmoq_param_registry_t* registry, pmoq_subscribe_parameters_t* param, uint64_t key, uint64_t l, uint8_t* v);
+const uint8_t* pmoq_msg_setup_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, pmoq_setup_parameters_t* param);
+const uint8_t* pmoq_subscribe_parameters_parse(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, pmoq_subscribe_parameters_t* param);
+
+/* Message schema, see msg_schema.h.
+ * Each message is described by the list of its fields, in wire order.
+ * The resumable parser in msg_parser.c walks the tables of the fields;
+ * the stateless codec in formats.c calls the functions specialized for
+ * each layout. */
+typedef enum {
+    pmoq_field_varint = 0,
+    pmoq_field_uint8,
+    pmoq_field_version,
+    pmoq_field_bits,
+    pmoq_field_tuple,
+    pmoq_field_versions,
+    pmoq_field_subscribe_parameters,
+    pmoq_field_setup_parameters
+} pmoq_field_type_enum;
+
+/* Extensions of a parameter field, in which the parsers set the array of
+ * values before decoding; NULL for the other fields. */
+pmoq_param_values_t* pmoq_field_param_values(pmoq_field_type_enum field_type, uint8_t* target);
+
+/* Conditions under which an optional field is present */
+typedef enum {
+    pmoq_field_cond_none = 0,
+    pmoq_field_cond_filter_start,
+    pmoq_field_cond_filter_range,
+    pmoq_field_cond_content_exists,
+    pmoq_field_cond_status_in_progress,
+    pmoq_field_cond_payload_empty
+} pmoq_field_cond_enum;
+
+/* Verifications applied once the field is decoded. A field with a check
+ * sets the selector that governs the presence of the next fields. */
+typedef enum {
+    pmoq_field_check_none = 0,
+    pmoq_field_check_filter_type,
+    pmoq_field_check_content_exists,
+    pmoq_field_check_track_status,
+    pmoq_field_check_payload_length,
+    pmoq_field_check_object_status
+} pmoq_field_check_enum;
+
+/* The offset is relative to the start of the message body: the union "u"
+ * of pmoq_msg_t for control messages, the pmoq_strm_t for data headers. */
+typedef struct st_pmoq_field_def_t {
+    pmoq_field_type_enum field_type;
+    pmoq_field_cond_enum cond;
+    pmoq_field_check_enum check;
+    size_t offset;
+} pmoq_field_def_t;
+
+typedef const uint8_t* (*pmoq_layout_parse_fn)(const uint8_t* bytes, const uint8_t* bytes_max, int* err, int needed,
+    const pmoq_param_registry_t* registry, void* body);
+typedef uint8_t* (*pmoq_layout_format_fn)(uint8_t* bytes, const uint8_t* bytes_max, const void* body);
+typedef size_t (*pmoq_layout_size_fn)(const void* body);
+
+/* Offset of a field that the layout does not have */
+#define PMOQ_FIELD_NO_OFFSET SIZE_MAX
+
+/* Layout of a message. The offsets of the namespace and of the extensions
+ * of the parameters, in which the parsers set the storage provided by the
+ * caller, are computed when the tables are built. */
+typedef struct st_pmoq_msg_def_t {
+    const pmoq_field_def_t* fields;
+    size_t nb_fields;
+    pmoq_layout_parse_fn parse;
+    pmoq_layout_format_fn format;
+    pmoq_layout_size_fn size;
+    size_t namespace_offset;
+    size_t extensions_offset;
+} pmoq_msg_def_t;
+
+/* Codec of a protocol version: the layouts of its messages, indexed by
+ * message type, with NULL for the types that are not defined. Sessions
+ * hold a pointer to the codec of the negotiated version, so encoding and
+ * decoding do not test the version for each message. */
+struct st_pmoq_codec_t {
+    uint32_t version;
+    const pmoq_msg_def_t* const* msg_defs;
+    size_t nb_msg_defs;
+    const pmoq_msg_def_t* const* strm_defs;
+    size_t nb_strm_defs;
+    const pmoq_msg_def_t* object_track_def;
+    const pmoq_msg_def_t* object_subgroup_def;
+};
+
+/* Codec used before the version is negotiated, and by the functions
+ * that do not take a codec argument */
+const pmoq_codec_t* pmoq_codec_default();
+
+/* Return the layout of a control message, of a data stream header, or of
+ * the objects that follow a stream header, or NULL if the type is not known. */
+const pmoq_msg_def_t* pmoq_codec_msg_def(const pmoq_codec_t* codec, uint64_t msg_type);
+const pmoq_msg_def_t* pmoq_codec_strm_def(const pmoq_codec_t* codec, uint64_t msg_type);
+
+/* Same lookups, expanded in place by the codec in formats.c */
+#define PMOQ_CODEC_MSG_DEF(codec, msg_type) \
+    (((msg_type) < (codec)->nb_msg_defs) ? (codec)->msg_defs[msg_type] : NULL)
+#define PMOQ_CODEC_STRM_DEF(codec, msg_type) \
+    (((msg_type) < (codec)->nb_strm_defs) ? (codec)->strm_defs[msg_type] : NULL)
+const pmoq_msg_def_t* pmoq_codec_object_def(const pmoq_codec_t* codec, uint64_t header_type);
+
+/* Same, with the default codec */
+const pmoq_msg_def_t* pmoq_msg_def_get(uint64_t msg_type);
+const pmoq_msg_def_t* pmoq_strm_def_get(uint64_t msg_type);
+
+int pmoq_field_is_present(uint64_t selector, pmoq_field_cond_enum cond);
+int pmoq_field_check(uint64_t value, pmoq_field_check_enum check);
+
+/* Open addressing hash table of the relay: cache tracks, subscriptions,
+ * namespace trie and interned names, see hash_table.c. The slots hold
+ * elements of "slot_size" bytes, e.g., a pointer, an ID or a key and a
+ * value; a slot is empty if all its bytes are zero. The owner provides
+ * the hash of the element held in a slot, which is masked to the size of
+ * the table, and compares the keys when probing. */
+typedef uint64_t (*pmoq_hash_table_hash_fn)(void* hash_ctx, const void* element);
+typedef int (*pmoq_hash_table_match_fn)(const void* key, const void* element);
+
+typedef struct st_pmoq_hash_table_t {
+    uint8_t* slots;
+    size_t slot_size;
+    size_t size; /* Power of 2 */
+    size_t count;
+    pmoq_hash_table_hash_fn hash_fn;
+    void* hash_ctx;
+} pmoq_hash_table_t;
+
+#define PMOQ_HASH_TABLE_SLOT(table, slot) ((void*)((table)->slots + (slot) * (table)->slot_size))
+
+int pmoq_hash_table_init(pmoq_hash_table_t* table, size_t slot_size, size_t size,
+    pmoq_hash_table_hash_fn hash_fn, void* hash_ctx);
+void pmoq_hash_table_release(pmoq_hash_table_t* table);
+int pmoq_hash_table_is_used(const pmoq_hash_table_t* table, size_t slot);
+/* Return the slot that holds the element matching the key, or else the
+ * empty slot at which it would be inserted */
+size_t pmoq_hash_table_probe(const pmoq_hash_table_t* table, uint64_t hash,
+    pmoq_hash_table_match_fn match_fn, const void* key);
+/* Make room for one more element, doubling the table if needed. This
+ * moves the elements: probe for the insertion slot afterwards. */
+int pmoq_hash_table_reserve(pmoq_hash_table_t* table);
+void pmoq_hash_table_insert(pmoq_hash_table_t* table, size_t slot, const void* element);
+void pmoq_hash_table_remove(pmoq_hash_table_t* table, size_t slot);
+
+/* Codec statistics, see stats.c. The hooks compile to nothing unless
+ * PMOQ_STATS is defined. PMOQ_STATS_START declares the start time of the
+ * call; the other macros count its outcome, from the returned pointer
+ * and the error. */
+#ifdef PMOQ_STATS
+uint64_t pmoq_stats_clock();
+void pmoq_stats_parsed(int is_strm, size_t slot, const uint8_t* bytes, const uint8_t* next, int err, uint64_t start);
+void pmoq_stats_fed(size_t slot, const uint8_t* bytes, const uint8_t* next, int is_complete, uint64_t start);
+void pmoq_stats_formatted(int is_strm, size_t slot, const uint8_t* bytes, const uint8_t* next, uint64_t start);
+
+#define PMOQ_STATS_START(start) uint64_t start = pmoq_stats_clock()
+#define PMOQ_STATS_PARSED(is_strm, slot, bytes, next, err, start) pmoq_stats_parsed(is_strm, slot, bytes, next, err, start)
+#define PMOQ_STATS_FED(slot, bytes, next, is_complete, start) pmoq_stats_fed(slot, bytes, next, is_complete, start)
+#define PMOQ_STATS_FORMATTED(is_strm, slot, bytes, next, start) pmoq_stats_formatted(is_strm, slot, bytes, next, start)
+#else
+#define PMOQ_STATS_START(start)
+#define PMOQ_STATS_PARSED(is_strm, slot, bytes, next, err, start) ((void)0)
+#define PMOQ_STATS_FED(slot, bytes, next, is_complete, start) ((void)0)
+#define PMOQ_STATS_FORMATTED(is_strm, slot, bytes, next, start) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PICOMOQ_INTERNAL_H */
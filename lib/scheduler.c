@@ -0,0 +1,258 @@
+/* Send scheduler.
+*
+* A binary heap of pointers to the entries, smallest first according to
+* pmoq_sched_compare(). Each entry holds its index in the heap, so that
+* it can be updated or removed without searching.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_scheduler.h"
+#include "picomoq_timer.h"
+
+#define PMOQ_SCHED_NOT_QUEUED SIZE_MAX
+#define PMOQ_SCHED_HEAP_SIZE_MIN 64
+
+struct st_pmoq_sched_t {
+    pmoq_sched_entry_t** heap;
+    size_t nb_entries;
+    size_t heap_max;
+    pmoq_timer_wheel_t* wheel;
+};
+
+int pmoq_sched_compare(const pmoq_sched_entry_t* a, const pmoq_sched_entry_t* b)
+{
+    int ret;
+
+    if (a->subscriber_priority != b->subscriber_priority) {
+        ret = (a->subscriber_priority < b->subscriber_priority) ? -1 : 1;
+    }
+    else if (a->publisher_priority != b->publisher_priority) {
+        ret = (a->publisher_priority < b->publisher_priority) ? -1 : 1;
+    }
+    else if (a->group_order != b->group_order) {
+        /* Entries of subscriptions with different group orders only need
+         * a consistent order between them */
+        ret = (a->group_order < b->group_order) ? -1 : 1;
+    }
+    else if (a->group_id != b->group_id) {
+        ret = (a->group_id < b->group_id) ? -1 : 1;
+        if (a->group_order == PMOQ_GROUP_ORDER_DESCENDING) {
+            ret = -ret;
+        }
+    }
+    else if (a->object_id != b->object_id) {
+        ret = (a->object_id < b->object_id) ? -1 : 1;
+    }
+    else {
+        ret = 0;
+    }
+    return ret;
+}
+
+static void pmoq_sched_set(pmoq_sched_t* sched, size_t index, pmoq_sched_entry_t* entry)
+{
+    sched->heap[index] = entry;
+    entry->heap_index = index;
+}
+
+static void pmoq_sched_sift_up(pmoq_sched_t* sched, size_t index)
+{
+    pmoq_sched_entry_t* entry = sched->heap[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+
+        if (pmoq_sched_compare(entry, sched->heap[parent]) >= 0) {
+            break;
+        }
+        pmoq_sched_set(sched, index, sched->heap[parent]);
+        index = parent;
+    }
+    pmoq_sched_set(sched, index, entry);
+}
+
+static void pmoq_sched_sift_down(pmoq_sched_t* sched, size_t index)
+{
+    pmoq_sched_entry_t* entry = sched->heap[index];
+
+    while (2 * index + 1 < sched->nb_entries) {
+        size_t child = 2 * index + 1;
+
+        if (child + 1 < sched->nb_entries && pmoq_sched_compare(sched->heap[child + 1], sched->heap[child]) < 0) {
+            child++;
+        }
+        if (pmoq_sched_compare(sched->heap[child], entry) >= 0) {
+            break;
+        }
+        pmoq_sched_set(sched, index, sched->heap[child]);
+        index = child;
+    }
+    pmoq_sched_set(sched, index, entry);
+}
+
+pmoq_sched_t* pmoq_sched_create()
+{
+    pmoq_sched_t* sched = (pmoq_sched_t*)malloc(sizeof(pmoq_sched_t));
+
+    if (sched != NULL) {
+        memset(sched, 0, sizeof(pmoq_sched_t));
+        if ((sched->wheel = pmoq_timer_wheel_create(0, 0, 0)) == NULL) {
+            free(sched);
+            sched = NULL;
+        }
+    }
+    return sched;
+}
+
+void pmoq_sched_delete(pmoq_sched_t* sched)
+{
+    if (sched != NULL) {
+        if (sched->heap != NULL) {
+            free(sched->heap);
+        }
+        pmoq_timer_wheel_delete(sched->wheel);
+        free(sched);
+    }
+}
+
+size_t pmoq_sched_count(const pmoq_sched_t* sched)
+{
+    return sched->nb_entries;
+}
+
+int pmoq_sched_is_queued(const pmoq_sched_t* sched, const pmoq_sched_entry_t* entry)
+{
+    return entry->heap_index < sched->nb_entries && sched->heap[entry->heap_index] == entry;
+}
+
+int pmoq_sched_push(pmoq_sched_t* sched, pmoq_sched_entry_t* entry)
+{
+    if (pmoq_sched_is_queued(sched, entry)) {
+        return -1;
+    }
+    if (sched->nb_entries >= sched->heap_max) {
+        size_t new_max = (sched->heap_max == 0) ? PMOQ_SCHED_HEAP_SIZE_MIN : 2 * sched->heap_max;
+        pmoq_sched_entry_t** new_heap = (pmoq_sched_entry_t**)realloc(sched->heap, new_max * sizeof(pmoq_sched_entry_t*));
+
+        if (new_heap == NULL) {
+            return -1;
+        }
+        sched->heap = new_heap;
+        sched->heap_max = new_max;
+    }
+    sched->heap[sched->nb_entries] = entry;
+    pmoq_sched_sift_up(sched, sched->nb_entries++);
+
+    return 0;
+}
+
+void pmoq_sched_update(pmoq_sched_t* sched, pmoq_sched_entry_t* entry)
+{
+    size_t index = entry->heap_index;
+
+    if (pmoq_sched_is_queued(sched, entry)) {
+        pmoq_sched_sift_up(sched, index);
+        if (entry->heap_index == index) {
+            pmoq_sched_sift_down(sched, index);
+        }
+    }
+}
+
+void pmoq_sched_remove(pmoq_sched_t* sched, pmoq_sched_entry_t* entry)
+{
+    size_t index = entry->heap_index;
+
+    if (pmoq_sched_is_queued(sched, entry)) {
+        entry->heap_index = PMOQ_SCHED_NOT_QUEUED;
+        sched->nb_entries--;
+        if (index < sched->nb_entries) {
+            /* Move the last entry in the hole, it may go up or down */
+            sched->heap[index] = sched->heap[sched->nb_entries];
+            sched->heap[index]->heap_index = index;
+            pmoq_sched_update(sched, sched->heap[index]);
+        }
+    }
+}
+
+pmoq_sched_entry_t* pmoq_sched_peek(pmoq_sched_t* sched)
+{
+    return (sched->nb_entries == 0) ? NULL : sched->heap[0];
+}
+
+pmoq_sched_entry_t* pmoq_sched_pop(pmoq_sched_t* sched)
+{
+    pmoq_sched_entry_t* entry = pmoq_sched_peek(sched);
+
+    if (entry != NULL) {
+        pmoq_sched_remove(sched, entry);
+    }
+    return entry;
+}
+
+uint8_t pmoq_sched_stream_priority(const pmoq_sched_entry_t* entry)
+{
+    return (uint8_t)((entry->subscriber_priority & 0xf0) | ((entry->publisher_priority >> 4) & 0x0e) | 1);
+}
+
+int pmoq_sched_picoquic_activate(picoquic_cnx_t* cnx, pmoq_sched_entry_t* entry)
+{
+    int ret;
+
+    if (entry->stream_id == PMOQ_SCHED_DATAGRAM) {
+        ret = picoquic_mark_datagram_ready(cnx, 1);
+    }
+    else if ((ret = picoquic_set_stream_priority(cnx, entry->stream_id, pmoq_sched_stream_priority(entry))) == 0) {
+        ret = picoquic_mark_active_stream(cnx, entry->stream_id, 1, entry->app_ctx);
+    }
+    return ret;
+}
+
+void pmoq_sched_set_deadline(pmoq_sched_t* sched, pmoq_sched_entry_t* entry, uint64_t deadline)
+{
+    entry->deadline.app_ctx = entry;
+    pmoq_timer_set(sched->wheel, &entry->deadline, deadline);
+}
+
+void pmoq_sched_clear_deadline(pmoq_sched_t* sched, pmoq_sched_entry_t* entry)
+{
+    pmoq_timer_cancel(sched->wheel, &entry->deadline);
+}
+
+typedef struct st_pmoq_sched_expire_ctx_t {
+    pmoq_sched_t* sched;
+    pmoq_sched_expired_fn fn;
+    void* callback_ctx;
+} pmoq_sched_expire_ctx_t;
+
+static void pmoq_sched_expire_fn(void* callback_ctx, pmoq_timer_t* timer)
+{
+    pmoq_sched_expire_ctx_t* ctx = (pmoq_sched_expire_ctx_t*)callback_ctx;
+    pmoq_sched_entry_t* entry = (pmoq_sched_entry_t*)timer->app_ctx;
+
+    pmoq_sched_remove(ctx->sched, entry);
+    ctx->fn(ctx->callback_ctx, entry);
+}
+
+size_t pmoq_sched_expire(pmoq_sched_t* sched, uint64_t current_time, pmoq_sched_expired_fn fn, void* callback_ctx)
+{
+    pmoq_sched_expire_ctx_t ctx;
+
+    ctx.sched = sched;
+    ctx.fn = fn;
+    ctx.callback_ctx = callback_ctx;
+
+    return pmoq_timer_wheel_advance(sched->wheel, current_time, pmoq_sched_expire_fn, &ctx);
+}
+
+uint64_t pmoq_sched_next_deadline(const pmoq_sched_t* sched)
+{
+    return pmoq_timer_wheel_next_expiry(sched->wheel);
+}
+
+int pmoq_sched_picoquic_drop(picoquic_cnx_t* cnx, const pmoq_sched_entry_t* entry, uint64_t error_code)
+{
+    return (entry->stream_id == PMOQ_SCHED_DATAGRAM) ? 0 : picoquic_reset_stream(cnx, entry->stream_id, error_code);
+}
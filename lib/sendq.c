@@ -0,0 +1,220 @@
+/* Stream send queues.
+*
+* The queue is a ring of entries, each holding a formatted header and a
+* reference to the payload that follows it. The ring doubles when full,
+* since the stream data cannot be dropped. The first entry may be
+* partially sent; offset counts its bytes already sent, header first.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_sendq.h"
+
+#define PMOQ_SENDQ_CAPACITY_MIN 8
+
+typedef struct st_pmoq_sendq_entry_t {
+    uint8_t header[PMOQ_STRM_HEADER_SIZE_MAX];
+    size_t header_length;
+    pmoq_cache_payload_t* payload;
+    size_t payload_length;
+} pmoq_sendq_entry_t;
+
+struct st_pmoq_sendq_t {
+    picoquic_cnx_t* cnx;
+    uint64_t stream_id;
+    const pmoq_codec_t* codec;
+    uint64_t header_type;
+    pmoq_sendq_entry_t* entries;
+    size_t capacity;
+    size_t first;
+    size_t count;
+    size_t offset;
+    size_t pending;
+    int is_finishing;
+    int is_fin_sent;
+};
+
+pmoq_sendq_t* pmoq_sendq_create(picoquic_cnx_t* cnx, uint64_t stream_id)
+{
+    pmoq_sendq_t* sendq = (pmoq_sendq_t*)malloc(sizeof(pmoq_sendq_t));
+
+    if (sendq != NULL) {
+        memset(sendq, 0, sizeof(pmoq_sendq_t));
+        sendq->cnx = cnx;
+        sendq->stream_id = stream_id;
+        sendq->codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+    }
+    return sendq;
+}
+
+static void pmoq_sendq_release_first(pmoq_sendq_t* sendq)
+{
+    pmoq_cache_payload_unref(sendq->entries[sendq->first].payload);
+    sendq->first = (sendq->first + 1) & (sendq->capacity - 1);
+    sendq->count--;
+    sendq->offset = 0;
+}
+
+void pmoq_sendq_delete(pmoq_sendq_t* sendq)
+{
+    if (sendq != NULL) {
+        while (sendq->count > 0) {
+            pmoq_sendq_release_first(sendq);
+        }
+        free(sendq->entries);
+        free(sendq);
+    }
+}
+
+void pmoq_sendq_set_codec(pmoq_sendq_t* sendq, const pmoq_codec_t* codec)
+{
+    sendq->codec = codec;
+}
+
+/* Next free entry, after growing the ring if needed */
+static pmoq_sendq_entry_t* pmoq_sendq_next_entry(pmoq_sendq_t* sendq)
+{
+    if (sendq->count == sendq->capacity) {
+        size_t capacity = (sendq->capacity == 0) ? PMOQ_SENDQ_CAPACITY_MIN : 2 * sendq->capacity;
+        pmoq_sendq_entry_t* entries = (pmoq_sendq_entry_t*)malloc(capacity * sizeof(pmoq_sendq_entry_t));
+
+        if (entries == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i < sendq->count; i++) {
+            entries[i] = sendq->entries[(sendq->first + i) & (sendq->capacity - 1)];
+        }
+        free(sendq->entries);
+        sendq->entries = entries;
+        sendq->capacity = capacity;
+        sendq->first = 0;
+    }
+    return &sendq->entries[(sendq->first + sendq->count) & (sendq->capacity - 1)];
+}
+
+static int pmoq_sendq_push(pmoq_sendq_t* sendq, pmoq_sendq_entry_t* entry, pmoq_cache_payload_t* payload)
+{
+    int ret = 0;
+
+    entry->payload = (entry->payload_length > 0) ? payload : NULL;
+    pmoq_cache_payload_ref(entry->payload);
+    sendq->count++;
+    sendq->pending += entry->header_length + entry->payload_length;
+
+    if (sendq->count == 1 && sendq->cnx != NULL) {
+        ret = picoquic_mark_active_stream(sendq->cnx, sendq->stream_id, 1, sendq);
+    }
+    return ret;
+}
+
+int pmoq_sendq_push_header(pmoq_sendq_t* sendq, const pmoq_strm_t* header)
+{
+    pmoq_sendq_entry_t* entry;
+    uint8_t* bytes;
+
+    if (sendq->header_type != 0 || sendq->is_finishing ||
+        (header->msg_type != PMOQ_STRM_HEADER_TRACK && header->msg_type != PMOQ_STRM_HEADER_SUBGROUP) ||
+        (entry = pmoq_sendq_next_entry(sendq)) == NULL ||
+        (bytes = pmoq_codec_strm_format(sendq->codec, entry->header, entry->header + PMOQ_STRM_HEADER_SIZE_MAX, header)) == NULL) {
+        return -1;
+    }
+    sendq->header_type = header->msg_type;
+    entry->header_length = bytes - entry->header;
+    entry->payload_length = 0;
+
+    return pmoq_sendq_push(sendq, entry, NULL);
+}
+
+int pmoq_sendq_push_object(pmoq_sendq_t* sendq, const pmoq_strm_t* object, pmoq_cache_payload_t* payload)
+{
+    pmoq_sendq_entry_t* entry;
+    uint8_t* bytes;
+
+    if (sendq->header_type == 0 || sendq->is_finishing || object->payload_length > SIZE_MAX ||
+        (object->payload_length > 0 && (payload == NULL || payload->length < object->payload_length)) ||
+        (entry = pmoq_sendq_next_entry(sendq)) == NULL ||
+        (bytes = pmoq_codec_object_format(sendq->codec, sendq->header_type, entry->header,
+            entry->header + PMOQ_STRM_HEADER_SIZE_MAX, object)) == NULL) {
+        return -1;
+    }
+    entry->header_length = bytes - entry->header;
+    entry->payload_length = (size_t)object->payload_length;
+
+    return pmoq_sendq_push(sendq, entry, payload);
+}
+
+int pmoq_sendq_finish(pmoq_sendq_t* sendq)
+{
+    int ret = 0;
+
+    if (sendq->is_finishing) {
+        return -1;
+    }
+    sendq->is_finishing = 1;
+    if (sendq->count == 0 && sendq->cnx != NULL) {
+        ret = picoquic_mark_active_stream(sendq->cnx, sendq->stream_id, 1, sendq);
+    }
+    return ret;
+}
+
+size_t pmoq_sendq_count(const pmoq_sendq_t* sendq)
+{
+    return sendq->count;
+}
+
+size_t pmoq_sendq_pending(const pmoq_sendq_t* sendq)
+{
+    return sendq->pending;
+}
+
+int pmoq_sendq_is_done(const pmoq_sendq_t* sendq)
+{
+    return sendq->is_fin_sent;
+}
+
+size_t pmoq_sendq_output(pmoq_sendq_t* sendq, uint8_t* bytes, size_t length, int* is_fin)
+{
+    size_t copied = 0;
+
+    while (sendq->count > 0 && copied < length) {
+        const pmoq_sendq_entry_t* entry = &sendq->entries[sendq->first];
+        pmoq_iovec_t iov[2];
+        size_t l;
+
+        iov[0].base = entry->header;
+        iov[0].len = entry->header_length;
+        iov[1].base = (entry->payload == NULL) ? NULL : entry->payload->data;
+        iov[1].len = entry->payload_length;
+        l = pmoq_iovec_gather(bytes + copied, length - copied, iov, 2, sendq->offset);
+        copied += l;
+        sendq->offset += l;
+        if (sendq->offset == entry->header_length + entry->payload_length) {
+            pmoq_sendq_release_first(sendq);
+        }
+    }
+    sendq->pending -= copied;
+    *is_fin = sendq->is_finishing && sendq->count == 0 && !sendq->is_fin_sent;
+    if (*is_fin) {
+        sendq->is_fin_sent = 1;
+    }
+    return copied;
+}
+
+int pmoq_sendq_picoquic_prepare(pmoq_sendq_t* sendq, void* context, size_t length)
+{
+    int ret = 0;
+    size_t l = (length < sendq->pending) ? length : sendq->pending;
+    int is_fin = sendq->is_finishing && l == sendq->pending && !sendq->is_fin_sent;
+    uint8_t* buffer = picoquic_provide_stream_data_buffer(context, l, is_fin, l < sendq->pending);
+
+    if (buffer == NULL) {
+        ret = (l > 0 || is_fin) ? -1 : 0;
+    }
+    else {
+        (void)pmoq_sendq_output(sendq, buffer, l, &is_fin);
+    }
+    return ret;
+}
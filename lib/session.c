@@ -0,0 +1,549 @@
+/* MoQ session: control stream management on top of picoquic.
+*
+* The session holds the state of the setup negotiation, a resumable
+* parser for the control messages received, and a send buffer for the
+* messages waiting to be sent. Messages are encoded directly in the send
+* buffer, at their exact size, and copied from there in the packets
+* when picoquic asks for stream data.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq.h"
+#include "picomoq_session.h"
+#include "picomoq_internal.h"
+
+struct st_pmoq_session_t {
+    picoquic_cnx_t* cnx;
+    int is_client;
+    pmoq_session_state_enum state;
+    pmoq_session_cb_fn callback_fn;
+    void* callback_ctx;
+    picoquic_stream_data_cb_fn app_callback_fn;
+    void* app_callback_ctx;
+    /* Control stream */
+    uint64_t control_stream_id;
+    int has_control_stream;
+    int is_stream_active;
+    /* Setup */
+    uint32_t versions[PMOQ_VERSION_NUMBER_MAX];
+    size_t nb_versions;
+    uint32_t version;
+    /* Codec of the negotiated version, the default one until then */
+    const pmoq_codec_t* codec;
+    uint8_t role;
+    uint8_t peer_role;
+    uint8_t* path;
+    size_t path_length;
+    uint64_t error_code;
+    pmoq_msg_parser_t* parser;
+    /* Messages waiting to be sent are in send_buffer[send_start..send_end] */
+    uint8_t* send_buffer;
+    size_t send_buffer_size;
+    size_t send_start;
+    size_t send_end;
+};
+
+pmoq_session_t* pmoq_session_create(picoquic_cnx_t* cnx, int is_client,
+    pmoq_session_cb_fn callback_fn, void* callback_ctx)
+{
+    pmoq_session_t* session = (pmoq_session_t*)malloc(sizeof(pmoq_session_t));
+
+    if (session != NULL) {
+        memset(session, 0, sizeof(pmoq_session_t));
+        session->cnx = cnx;
+        session->is_client = is_client;
+        session->callback_fn = callback_fn;
+        session->callback_ctx = callback_ctx;
+        session->versions[0] = PMOQ_VERSION_DRAFT_07;
+        session->nb_versions = 1;
+        session->codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+        session->role = pmoq_setup_role_pubsub;
+        if ((session->parser = pmoq_msg_parser_create()) == NULL ||
+            (session->send_buffer = (uint8_t*)malloc(PMOQ_SESSION_SEND_BUFFER_MIN)) == NULL) {
+            pmoq_session_delete(session);
+            session = NULL;
+        }
+        else {
+            session->send_buffer_size = PMOQ_SESSION_SEND_BUFFER_MIN;
+            if (cnx != NULL) {
+                picoquic_set_callback(cnx, pmoq_session_picoquic_callback, session);
+            }
+        }
+    }
+    return session;
+}
+
+void pmoq_session_delete(pmoq_session_t* session)
+{
+    if (session != NULL) {
+        if (session->cnx != NULL) {
+            /* Events of the connection now go to the application only */
+            picoquic_set_callback(session->cnx, session->app_callback_fn, session->app_callback_ctx);
+            if (session->is_stream_active) {
+                (void)picoquic_mark_active_stream(session->cnx, session->control_stream_id, 0, NULL);
+            }
+        }
+        if (session->parser != NULL) {
+            pmoq_msg_parser_delete(session->parser);
+        }
+        if (session->send_buffer != NULL) {
+            free(session->send_buffer);
+        }
+        if (session->path != NULL) {
+            free(session->path);
+        }
+        free(session);
+    }
+}
+
+int pmoq_session_set_versions(pmoq_session_t* session, const uint32_t* versions, size_t nb_versions)
+{
+    int ret = 0;
+
+    if (nb_versions == 0 || nb_versions > PMOQ_VERSION_NUMBER_MAX || session->state != pmoq_session_state_init) {
+        ret = -1;
+    }
+    else {
+        memcpy(session->versions, versions, nb_versions * sizeof(uint32_t));
+        session->nb_versions = nb_versions;
+    }
+    return ret;
+}
+
+int pmoq_session_set_setup_parameters(pmoq_session_t* session, uint8_t role, const uint8_t* path, size_t path_length)
+{
+    int ret = 0;
+    uint8_t* path_copy = NULL;
+
+    if (role > pmoq_setup_role_max || session->state != pmoq_session_state_init) {
+        ret = -1;
+    }
+    else if (path != NULL && (path_copy = (uint8_t*)malloc((path_length > 0) ? path_length : 1)) == NULL) {
+        ret = -1;
+    }
+    else {
+        if (path_copy != NULL && path_length > 0) {
+            memcpy(path_copy, path, path_length);
+        }
+        if (session->path != NULL) {
+            free(session->path);
+        }
+        session->role = role;
+        session->path = path_copy;
+        session->path_length = (path_copy == NULL) ? 0 : path_length;
+    }
+    return ret;
+}
+
+void pmoq_session_set_param_registry(pmoq_session_t* session, const pmoq_param_registry_t* registry)
+{
+    pmoq_msg_parser_set_registry(session->parser, registry);
+}
+
+void pmoq_session_set_app_callback(pmoq_session_t* session, picoquic_stream_data_cb_fn app_callback_fn, void* app_callback_ctx)
+{
+    session->app_callback_fn = app_callback_fn;
+    session->app_callback_ctx = app_callback_ctx;
+}
+
+pmoq_session_state_enum pmoq_session_state(const pmoq_session_t* session)
+{
+    return session->state;
+}
+
+uint32_t pmoq_session_version(const pmoq_session_t* session)
+{
+    return session->version;
+}
+
+const pmoq_codec_t* pmoq_session_codec(const pmoq_session_t* session)
+{
+    return session->codec;
+}
+
+uint8_t pmoq_session_peer_role(const pmoq_session_t* session)
+{
+    return session->peer_role;
+}
+
+uint64_t pmoq_session_error(const pmoq_session_t* session)
+{
+    return session->error_code;
+}
+
+picoquic_cnx_t* pmoq_session_cnx(const pmoq_session_t* session)
+{
+    return session->cnx;
+}
+
+uint64_t pmoq_session_control_stream_id(const pmoq_session_t* session)
+{
+    return session->control_stream_id;
+}
+
+/* Make room for length more bytes at the end of the send buffer.
+* The pending bytes are moved to the start of the buffer first, and the
+* buffer is only reallocated if that is not enough.
+*/
+static int pmoq_session_reserve(pmoq_session_t* session, size_t length)
+{
+    int ret = 0;
+
+    if (session->send_buffer_size - session->send_end < length) {
+        size_t pending = session->send_end - session->send_start;
+
+        if (session->send_start > 0) {
+            memmove(session->send_buffer, session->send_buffer + session->send_start, pending);
+            session->send_start = 0;
+            session->send_end = pending;
+        }
+        if (session->send_buffer_size - pending < length) {
+            size_t new_size = session->send_buffer_size;
+            uint8_t* new_buffer;
+
+            while (new_size - pending < length) {
+                new_size *= 2;
+            }
+            if ((new_buffer = (uint8_t*)realloc(session->send_buffer, new_size)) == NULL) {
+                ret = -1;
+            }
+            else {
+                session->send_buffer = new_buffer;
+                session->send_buffer_size = new_size;
+            }
+        }
+    }
+    return ret;
+}
+
+static int pmoq_session_queue(pmoq_session_t* session, const pmoq_msg_t* msg)
+{
+    int ret = 0;
+    size_t l = pmoq_codec_msg_encoded_size(session->codec, msg);
+
+    if (l == 0 || pmoq_session_reserve(session, l) != 0 ||
+        pmoq_codec_msg_format(session->codec, session->send_buffer + session->send_end,
+            session->send_buffer + session->send_end + l, msg) == NULL) {
+        ret = -1;
+    }
+    else {
+        session->send_end += l;
+        if (session->cnx != NULL && session->has_control_stream && !session->is_stream_active) {
+            session->is_stream_active = 1;
+            ret = picoquic_mark_active_stream(session->cnx, session->control_stream_id, 1, session);
+        }
+    }
+    return ret;
+}
+
+void pmoq_session_close(pmoq_session_t* session, uint64_t error_code)
+{
+    if (session->state != pmoq_session_state_closed) {
+        session->state = pmoq_session_state_closed;
+        session->error_code = error_code;
+        if (session->cnx != NULL) {
+            (void)picoquic_close(session->cnx, error_code);
+        }
+        if (session->callback_fn != NULL) {
+            (void)session->callback_fn(session, pmoq_session_event_closed, NULL, session->callback_ctx);
+        }
+    }
+}
+
+int pmoq_session_start(pmoq_session_t* session)
+{
+    int ret = 0;
+
+    if (!session->is_client || session->state != pmoq_session_state_init) {
+        ret = -1;
+    }
+    else {
+        pmoq_msg_t msg = { 0 };
+
+        session->control_stream_id = (session->cnx == NULL) ? 0 : picoquic_get_next_local_stream_id(session->cnx, 0);
+        session->has_control_stream = 1;
+        msg.msg_type = PMOQ_MSG_CLIENT_SETUP;
+        msg.u.client_setup.supported_versions_nb = session->nb_versions;
+        memcpy(msg.u.client_setup.supported_versions, session->versions, session->nb_versions * sizeof(uint32_t));
+        msg.u.client_setup.setup_parameters.role = session->role;
+        msg.u.client_setup.setup_parameters.path = session->path;
+        msg.u.client_setup.setup_parameters.path_length = session->path_length;
+        if ((ret = pmoq_session_queue(session, &msg)) == 0) {
+            session->state = pmoq_session_state_setup_sent;
+        }
+    }
+    return ret;
+}
+
+int pmoq_session_send(pmoq_session_t* session, const pmoq_msg_t* msg)
+{
+    int ret = 0;
+
+    if (session->state != pmoq_session_state_ready ||
+        msg->msg_type == PMOQ_MSG_CLIENT_SETUP || msg->msg_type == PMOQ_MSG_SERVER_SETUP) {
+        ret = -1;
+    }
+    else {
+        ret = pmoq_session_queue(session, msg);
+    }
+    return ret;
+}
+
+/* Switch the encoding and decoding of the next messages to the negotiated
+ * version, which has a codec */
+static void pmoq_session_set_version(pmoq_session_t* session, uint32_t version)
+{
+    session->version = version;
+    session->codec = pmoq_codec_get(version);
+    pmoq_msg_parser_set_codec(session->parser, session->codec);
+}
+
+/* Server side: select the first of our versions that the client supports
+* and that has a codec, and answer with SERVER_SETUP */
+static int pmoq_session_client_setup(pmoq_session_t* session, const pmoq_msg_t* msg)
+{
+    int ret = -1;
+    uint32_t version = 0;
+    const pmoq_client_setup_t* client_setup = &msg->u.client_setup;
+
+    for (size_t i = 0; ret != 0 && i < session->nb_versions; i++) {
+        for (uint64_t j = 0; j < client_setup->supported_versions_nb; j++) {
+            if (client_setup->supported_versions[j] == session->versions[i] &&
+                pmoq_codec_get(session->versions[i]) != NULL) {
+                version = session->versions[i];
+                ret = 0;
+                break;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        pmoq_msg_t server_setup = { 0 };
+
+        /* SERVER_SETUP is encoded before switching, since the client
+         * decodes it before knowing the version */
+        server_setup.msg_type = PMOQ_MSG_SERVER_SETUP;
+        server_setup.u.server_setup.selected_version = version;
+        server_setup.u.server_setup.setup_parameters.role = session->role;
+        session->peer_role = client_setup->setup_parameters.role;
+        if (pmoq_session_queue(session, &server_setup) != 0) {
+            pmoq_session_close(session, PMOQ_ERROR_INTERNAL_ERROR);
+            ret = -1;
+        }
+        else {
+            pmoq_session_set_version(session, version);
+        }
+    }
+    else {
+        pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+    }
+    return ret;
+}
+
+/* Client side: the selected version must be one of those we offered,
+ * and have a codec */
+static int pmoq_session_server_setup(pmoq_session_t* session, const pmoq_msg_t* msg)
+{
+    int ret = -1;
+
+    for (size_t i = 0; i < session->nb_versions; i++) {
+        if (session->versions[i] == msg->u.server_setup.selected_version &&
+            pmoq_codec_get(session->versions[i]) != NULL) {
+            pmoq_session_set_version(session, session->versions[i]);
+            session->peer_role = msg->u.server_setup.setup_parameters.role;
+            ret = 0;
+            break;
+        }
+    }
+    if (ret != 0) {
+        pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+    }
+    return ret;
+}
+
+static int pmoq_session_dispatch(pmoq_session_t* session, const pmoq_msg_t* msg)
+{
+    int ret = 0;
+    pmoq_session_event_enum event = pmoq_session_event_msg;
+
+    switch (session->state) {
+    case pmoq_session_state_init:
+        if (session->is_client || msg->msg_type != PMOQ_MSG_CLIENT_SETUP) {
+            ret = -1;
+        }
+        else if ((ret = pmoq_session_client_setup(session, msg)) == 0) {
+            event = pmoq_session_event_ready;
+        }
+        break;
+    case pmoq_session_state_setup_sent:
+        if (msg->msg_type != PMOQ_MSG_SERVER_SETUP) {
+            ret = -1;
+        }
+        else if ((ret = pmoq_session_server_setup(session, msg)) == 0) {
+            event = pmoq_session_event_ready;
+        }
+        break;
+    case pmoq_session_state_ready:
+        if (msg->msg_type == PMOQ_MSG_CLIENT_SETUP || msg->msg_type == PMOQ_MSG_SERVER_SETUP) {
+            ret = -1;
+        }
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+
+    if (ret != 0) {
+        /* No effect if the setup functions already closed the session */
+        pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+    }
+    else {
+        if (event == pmoq_session_event_ready) {
+            session->state = pmoq_session_state_ready;
+        }
+        if (session->callback_fn != NULL &&
+            session->callback_fn(session, event, msg, session->callback_ctx) != 0) {
+            pmoq_session_close(session, PMOQ_ERROR_INTERNAL_ERROR);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int pmoq_session_input(pmoq_session_t* session, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+    const uint8_t* bytes_max = bytes + length;
+
+    if (session->state == pmoq_session_state_closed) {
+        ret = -1;
+    }
+
+    while (ret == 0 && bytes < bytes_max) {
+        int err = 0;
+        const pmoq_msg_t* msg;
+        const uint8_t* next_bytes = pmoq_msg_parser_feed(session->parser, bytes, bytes_max, &err);
+
+        if (next_bytes == NULL) {
+            pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+            ret = -1;
+        }
+        else if ((msg = pmoq_msg_parser_next(session->parser)) != NULL) {
+            ret = pmoq_session_dispatch(session, msg);
+        }
+        else if (next_bytes == bytes) {
+            /* Cannot happen: the parser consumes all bytes of incomplete messages */
+            pmoq_session_close(session, PMOQ_ERROR_INTERNAL_ERROR);
+            ret = -1;
+        }
+        bytes = next_bytes;
+    }
+    return ret;
+}
+
+size_t pmoq_session_output_pending(const pmoq_session_t* session)
+{
+    return session->send_end - session->send_start;
+}
+
+size_t pmoq_session_output(pmoq_session_t* session, uint8_t* bytes, size_t length)
+{
+    size_t pending = session->send_end - session->send_start;
+
+    if (length > pending) {
+        length = pending;
+    }
+    memcpy(bytes, session->send_buffer + session->send_start, length);
+    session->send_start += length;
+    if (session->send_start == session->send_end) {
+        session->send_start = 0;
+        session->send_end = 0;
+    }
+    return length;
+}
+
+static int pmoq_session_prepare_to_send(pmoq_session_t* session, void* context, size_t length)
+{
+    int ret = 0;
+    size_t pending = pmoq_session_output_pending(session);
+    size_t l = (length < pending) ? length : pending;
+    uint8_t* buffer = picoquic_provide_stream_data_buffer(context, l, 0, pending > l);
+
+    if (buffer == NULL) {
+        ret = -1;
+    }
+    else {
+        (void)pmoq_session_output(session, buffer, l);
+        session->is_stream_active = (pending > l);
+    }
+    return ret;
+}
+
+int pmoq_session_picoquic_callback(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t* bytes, size_t length,
+    picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx)
+{
+    int ret = 0;
+    pmoq_session_t* session = (pmoq_session_t*)callback_ctx;
+    int is_control_stream;
+
+    if (session == NULL) {
+        return -1;
+    }
+
+    if (!session->has_control_stream && !session->is_client &&
+        (fin_or_event == picoquic_callback_stream_data || fin_or_event == picoquic_callback_stream_fin) &&
+        (stream_id & 3) == 0) {
+        /* First bidirectional stream opened by the client */
+        session->control_stream_id = stream_id;
+        session->has_control_stream = 1;
+    }
+    is_control_stream = session->has_control_stream && stream_id == session->control_stream_id;
+
+    switch (fin_or_event) {
+    case picoquic_callback_stream_data:
+    case picoquic_callback_stream_fin:
+        if (is_control_stream) {
+            if (length > 0) {
+                (void)pmoq_session_input(session, bytes, length);
+            }
+            if (fin_or_event == picoquic_callback_stream_fin) {
+                /* The control stream must stay open for the whole session */
+                pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+            }
+            return 0;
+        }
+        break;
+    case picoquic_callback_stream_reset:
+    case picoquic_callback_stop_sending:
+        if (is_control_stream) {
+            pmoq_session_close(session, PMOQ_ERROR_PROTOCOL_VIOLATION);
+            return 0;
+        }
+        break;
+    case picoquic_callback_prepare_to_send:
+        if (is_control_stream && v_stream_ctx == session) {
+            return pmoq_session_prepare_to_send(session, bytes, length);
+        }
+        break;
+    case picoquic_callback_stateless_reset:
+    case picoquic_callback_close:
+    case picoquic_callback_application_close:
+        if (session->state != pmoq_session_state_closed) {
+            session->state = pmoq_session_state_closed;
+            if (session->callback_fn != NULL) {
+                (void)session->callback_fn(session, pmoq_session_event_closed, NULL, session->callback_ctx);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (session->app_callback_fn != NULL) {
+        ret = session->app_callback_fn(cnx, stream_id, bytes, length, fin_or_event, session->app_callback_ctx, v_stream_ctx);
+    }
+    return ret;
+}
@@ -0,0 +1,553 @@
+/* Sharded relay.
+*
+* The rings are the classic Lamport queue: the producer only writes the
+* head and the consumer only writes the tail, each published with release
+* semantics and read with acquire semantics by the other side. Each side
+* keeps a copy of the other index and only reloads it when the ring looks
+* full or empty, so that the cache line of the other side is rarely
+* touched. The indices of the two sides are on separate cache lines.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include <picosocks.h>
+#include "picomoq.h"
+#include "picomoq_shard.h"
+
+#define PMOQ_CACHE_LINE_SIZE 64
+
+#ifdef _WINDOWS
+/* On x86 and x64, MSVC gives volatile accesses acquire and release
+ * semantics; the barrier prevents the compiler from reordering. */
+static size_t pmoq_load_acquire(volatile size_t* p)
+{
+    size_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static void pmoq_store_release(volatile size_t* p, size_t v)
+{
+    _ReadWriteBarrier();
+    *p = v;
+}
+#define PMOQ_LOAD_ACQUIRE(p) pmoq_load_acquire(p)
+#define PMOQ_STORE_RELEASE(p, v) pmoq_store_release(p, v)
+#else
+#define PMOQ_LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define PMOQ_STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+struct st_pmoq_spsc_ring_t {
+    size_t mask;
+    void** slots;
+    uint8_t shared_pad[PMOQ_CACHE_LINE_SIZE];
+    /* Written by the producer */
+    size_t head;
+    size_t tail_cache;
+    uint8_t producer_pad[PMOQ_CACHE_LINE_SIZE];
+    /* Written by the consumer */
+    size_t tail;
+    size_t head_cache;
+    uint8_t consumer_pad[PMOQ_CACHE_LINE_SIZE];
+};
+
+pmoq_spsc_ring_t* pmoq_spsc_ring_create(size_t capacity)
+{
+    pmoq_spsc_ring_t* ring = (pmoq_spsc_ring_t*)malloc(sizeof(pmoq_spsc_ring_t));
+    size_t nb_slots = 1;
+
+    while (nb_slots < capacity) {
+        nb_slots <<= 1;
+    }
+    if (ring != NULL) {
+        memset(ring, 0, sizeof(pmoq_spsc_ring_t));
+        ring->mask = nb_slots - 1;
+        if ((ring->slots = (void**)malloc(nb_slots * sizeof(void*))) == NULL) {
+            free(ring);
+            ring = NULL;
+        }
+    }
+    return ring;
+}
+
+void pmoq_spsc_ring_delete(pmoq_spsc_ring_t* ring)
+{
+    if (ring != NULL) {
+        free(ring->slots);
+        free(ring);
+    }
+}
+
+int pmoq_spsc_ring_push(pmoq_spsc_ring_t* ring, void* item)
+{
+    size_t head = ring->head;
+
+    if (head - ring->tail_cache > ring->mask) {
+        ring->tail_cache = PMOQ_LOAD_ACQUIRE(&ring->tail);
+        if (head - ring->tail_cache > ring->mask) {
+            return -1;
+        }
+    }
+    ring->slots[head & ring->mask] = item;
+    PMOQ_STORE_RELEASE(&ring->head, head + 1);
+
+    return 0;
+}
+
+void* pmoq_spsc_ring_pop(pmoq_spsc_ring_t* ring)
+{
+    size_t tail = ring->tail;
+    void* item;
+
+    if (tail == ring->head_cache) {
+        ring->head_cache = PMOQ_LOAD_ACQUIRE(&ring->head);
+        if (tail == ring->head_cache) {
+            return NULL;
+        }
+    }
+    item = ring->slots[tail & ring->mask];
+    PMOQ_STORE_RELEASE(&ring->tail, tail + 1);
+
+    return item;
+}
+
+size_t pmoq_spsc_ring_count(const pmoq_spsc_ring_t* ring)
+{
+    size_t tail = PMOQ_LOAD_ACQUIRE((size_t*)&ring->tail);
+
+    return PMOQ_LOAD_ACQUIRE((size_t*)&ring->head) - tail;
+}
+
+/* Shards */
+#ifdef _WINDOWS
+typedef HANDLE pmoq_thread_t;
+#else
+typedef pthread_t pmoq_thread_t;
+#endif
+
+struct st_pmoq_shard_t {
+    pmoq_shards_t* shards;
+    size_t index;
+    pmoq_shard_stats_t stats;
+    pmoq_thread_t thread;
+    int is_started;
+    int worker_ret;
+    /* The statistics of the shards are not on the same cache line */
+    uint8_t pad[PMOQ_CACHE_LINE_SIZE];
+};
+
+struct st_pmoq_shards_t {
+    size_t nb_shards;
+    pmoq_shard_t** shard;
+    /* Ring from shard i to shard j at [i * nb_shards + j] */
+    pmoq_spsc_ring_t** items;
+    pmoq_spsc_ring_t** packets;
+    size_t is_stopping;
+    pmoq_shard_worker_fn worker_fn;
+    void* app_ctx;
+};
+
+typedef struct st_pmoq_shard_packet_t {
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_to;
+    int if_index;
+    unsigned char received_ecn;
+    size_t length;
+    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+} pmoq_shard_packet_t;
+
+pmoq_shards_t* pmoq_shards_create(size_t nb_shards, size_t ring_size)
+{
+    pmoq_shards_t* shards = NULL;
+    size_t nb_rings = nb_shards * nb_shards;
+    int ret = 0;
+
+    if (nb_shards == 0 || nb_shards > PMOQ_SHARD_MAX ||
+        (shards = (pmoq_shards_t*)malloc(sizeof(pmoq_shards_t))) == NULL) {
+        return NULL;
+    }
+    memset(shards, 0, sizeof(pmoq_shards_t));
+    shards->nb_shards = nb_shards;
+    if (ring_size == 0) {
+        ring_size = PMOQ_SHARD_RING_SIZE_DEFAULT;
+    }
+
+    if ((shards->shard = (pmoq_shard_t**)calloc(nb_shards, sizeof(pmoq_shard_t*))) == NULL ||
+        (shards->items = (pmoq_spsc_ring_t**)calloc(nb_rings, sizeof(pmoq_spsc_ring_t*))) == NULL ||
+        (shards->packets = (pmoq_spsc_ring_t**)calloc(nb_rings, sizeof(pmoq_spsc_ring_t*))) == NULL) {
+        ret = -1;
+    }
+    for (size_t i = 0; ret == 0 && i < nb_shards; i++) {
+        if ((shards->shard[i] = (pmoq_shard_t*)malloc(sizeof(pmoq_shard_t))) == NULL) {
+            ret = -1;
+        }
+        else {
+            memset(shards->shard[i], 0, sizeof(pmoq_shard_t));
+            shards->shard[i]->shards = shards;
+            shards->shard[i]->index = i;
+        }
+    }
+    for (size_t i = 0; ret == 0 && i < nb_rings; i++) {
+        if (i / nb_shards != i % nb_shards &&
+            ((shards->items[i] = pmoq_spsc_ring_create(ring_size)) == NULL ||
+            (shards->packets[i] = pmoq_spsc_ring_create(ring_size)) == NULL)) {
+            ret = -1;
+        }
+    }
+    if (ret != 0) {
+        pmoq_shards_delete(shards);
+        shards = NULL;
+    }
+    return shards;
+}
+
+void pmoq_shards_delete(pmoq_shards_t* shards)
+{
+    if (shards != NULL) {
+        size_t nb_rings = shards->nb_shards * shards->nb_shards;
+
+        for (size_t i = 0; shards->packets != NULL && i < nb_rings; i++) {
+            if (shards->packets[i] != NULL) {
+                void* packet;
+
+                while ((packet = pmoq_spsc_ring_pop(shards->packets[i])) != NULL) {
+                    free(packet);
+                }
+                pmoq_spsc_ring_delete(shards->packets[i]);
+            }
+        }
+        for (size_t i = 0; shards->items != NULL && i < nb_rings; i++) {
+            pmoq_spsc_ring_delete(shards->items[i]);
+        }
+        for (size_t i = 0; shards->shard != NULL && i < shards->nb_shards; i++) {
+            free(shards->shard[i]);
+        }
+        free(shards->packets);
+        free(shards->items);
+        free(shards->shard);
+        free(shards);
+    }
+}
+
+size_t pmoq_shards_count(const pmoq_shards_t* shards)
+{
+    return shards->nb_shards;
+}
+
+pmoq_shard_t* pmoq_shards_get(pmoq_shards_t* shards, size_t index)
+{
+    return (index < shards->nb_shards) ? shards->shard[index] : NULL;
+}
+
+size_t pmoq_shard_index(const pmoq_shard_t* shard)
+{
+    return shard->index;
+}
+
+void pmoq_shard_stats(const pmoq_shard_t* shard, pmoq_shard_stats_t* stats)
+{
+    *stats = shard->stats;
+}
+
+int pmoq_shard_post(pmoq_shard_t* shard, size_t to, void* item)
+{
+    pmoq_shards_t* shards = shard->shards;
+    int ret = -1;
+
+    if (to < shards->nb_shards && to != shard->index) {
+        if ((ret = pmoq_spsc_ring_push(shards->items[shard->index * shards->nb_shards + to], item)) == 0) {
+            shard->stats.nb_items_posted++;
+        }
+        else {
+            shard->stats.drops_ring_full++;
+        }
+    }
+    return ret;
+}
+
+size_t pmoq_shard_drain(pmoq_shard_t* shard, pmoq_shard_item_fn item_fn, void* app_ctx, size_t max_items)
+{
+    pmoq_shards_t* shards = shard->shards;
+    size_t nb_items = 0;
+
+    for (size_t from = 0; from < shards->nb_shards && nb_items < max_items; from++) {
+        pmoq_spsc_ring_t* ring = shards->items[from * shards->nb_shards + shard->index];
+        void* item;
+
+        while (ring != NULL && nb_items < max_items && (item = pmoq_spsc_ring_pop(ring)) != NULL) {
+            item_fn(shard, from, item, app_ctx);
+            nb_items++;
+        }
+    }
+    shard->stats.nb_items_delivered += nb_items;
+
+    return nb_items;
+}
+
+void pmoq_shard_cnx_id_callback(picoquic_quic_t* quic, picoquic_connection_id_t cnx_id_local,
+    picoquic_connection_id_t cnx_id_remote, void* cnx_id_cb_data, picoquic_connection_id_t* cnx_id_returned)
+{
+    pmoq_shard_t* shard = (pmoq_shard_t*)cnx_id_cb_data;
+
+    (void)quic;
+    (void)cnx_id_remote;
+    *cnx_id_returned = cnx_id_local;
+    if (cnx_id_returned->id_len > 0) {
+        cnx_id_returned->id[0] = (uint8_t)shard->index;
+    }
+}
+
+#define PMOQ_QUIC_VERSION_1 0x00000001
+#define PMOQ_QUIC_VERSION_2 0x6b3343cf
+
+size_t pmoq_shard_route_packet(const uint8_t* bytes, size_t length, size_t nb_shards, size_t self)
+{
+    const uint8_t* cid = NULL;
+
+    if (length > 1 && (bytes[0] & 0x80) == 0) {
+        /* Short header, the connection ID follows the first byte */
+        cid = bytes + 1;
+    }
+    else if (length > 6 && bytes[5] > 0) {
+        /* Long header: only the Handshake packets carry a connection
+         * ID chosen by the server */
+        uint32_t version = ((uint32_t)bytes[1] << 24) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 8) | bytes[4];
+        int packet_type = (bytes[0] >> 4) & 3;
+
+        if ((version == PMOQ_QUIC_VERSION_1 && packet_type == 2) ||
+            (version == PMOQ_QUIC_VERSION_2 && packet_type == 3)) {
+            cid = bytes + 6;
+        }
+    }
+    return (cid != NULL && *cid < nb_shards) ? *cid : self;
+}
+
+#ifdef _WINDOWS
+static DWORD WINAPI pmoq_shard_thread(LPVOID arg)
+#else
+static void* pmoq_shard_thread(void* arg)
+#endif
+{
+    pmoq_shard_t* shard = (pmoq_shard_t*)arg;
+
+    shard->worker_ret = shard->shards->worker_fn(shard, shard->shards->app_ctx);
+#ifdef _WINDOWS
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int pmoq_shards_start(pmoq_shards_t* shards, pmoq_shard_worker_fn worker_fn, void* app_ctx)
+{
+    int ret = 0;
+
+    shards->worker_fn = worker_fn;
+    shards->app_ctx = app_ctx;
+    PMOQ_STORE_RELEASE(&shards->is_stopping, 0);
+
+    for (size_t i = 0; ret == 0 && i < shards->nb_shards; i++) {
+        pmoq_shard_t* shard = shards->shard[i];
+#ifdef _WINDOWS
+        if ((shard->thread = CreateThread(NULL, 0, pmoq_shard_thread, shard, 0, NULL)) == NULL) {
+            ret = -1;
+        }
+#else
+        if (pthread_create(&shard->thread, NULL, pmoq_shard_thread, shard) != 0) {
+            ret = -1;
+        }
+#endif
+        else {
+            shard->is_started = 1;
+        }
+    }
+    if (ret != 0) {
+        /* The workers already started are stopped */
+        pmoq_shards_stop(shards);
+        (void)pmoq_shards_join(shards);
+    }
+    return ret;
+}
+
+void pmoq_shards_stop(pmoq_shards_t* shards)
+{
+    PMOQ_STORE_RELEASE(&shards->is_stopping, 1);
+}
+
+int pmoq_shard_is_stopping(const pmoq_shard_t* shard)
+{
+    return PMOQ_LOAD_ACQUIRE(&shard->shards->is_stopping) != 0;
+}
+
+int pmoq_shards_join(pmoq_shards_t* shards)
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < shards->nb_shards; i++) {
+        pmoq_shard_t* shard = shards->shard[i];
+
+        if (shard->is_started) {
+#ifdef _WINDOWS
+            (void)WaitForSingleObject(shard->thread, INFINITE);
+            (void)CloseHandle(shard->thread);
+#else
+            (void)pthread_join(shard->thread, NULL);
+#endif
+            shard->is_started = 0;
+            if (ret == 0) {
+                ret = shard->worker_ret;
+            }
+        }
+    }
+    return ret;
+}
+
+SOCKET_TYPE pmoq_shard_socket_open(int af, uint16_t port)
+{
+#ifdef SO_REUSEPORT
+    SOCKET_TYPE fd = socket(af, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (fd != INVALID_SOCKET) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+        int one = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        if (af == AF_INET6) {
+            struct sockaddr_in6* addr6 = (struct sockaddr_in6*)&addr;
+            addr6->sin6_family = AF_INET6;
+            addr6->sin6_port = htons(port);
+            addr_len = sizeof(struct sockaddr_in6);
+        }
+        else {
+            struct sockaddr_in* addr4 = (struct sockaddr_in*)&addr;
+            addr4->sin_family = AF_INET;
+            addr4->sin_port = htons(port);
+            addr_len = sizeof(struct sockaddr_in);
+        }
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) != 0 ||
+            picoquic_socket_set_pkt_info(fd, af) != 0 ||
+            bind(fd, (struct sockaddr*)&addr, addr_len) != 0) {
+            SOCKET_CLOSE(fd);
+            fd = INVALID_SOCKET;
+        }
+    }
+    return fd;
+#else
+    (void)af;
+    (void)port;
+    return INVALID_SOCKET;
+#endif
+}
+
+static void pmoq_shard_forward_packet(pmoq_shard_t* shard, size_t owner, const uint8_t* bytes, size_t length,
+    const struct sockaddr_storage* addr_from, const struct sockaddr_storage* addr_to, int if_index, unsigned char received_ecn)
+{
+    pmoq_shards_t* shards = shard->shards;
+    pmoq_shard_packet_t* packet = (pmoq_shard_packet_t*)malloc(sizeof(pmoq_shard_packet_t));
+
+    if (packet != NULL) {
+        packet->addr_from = *addr_from;
+        packet->addr_to = *addr_to;
+        packet->if_index = if_index;
+        packet->received_ecn = received_ecn;
+        packet->length = length;
+        memcpy(packet->bytes, bytes, length);
+        if (pmoq_spsc_ring_push(shards->packets[shard->index * shards->nb_shards + owner], packet) == 0) {
+            shard->stats.nb_packets_forwarded++;
+            packet = NULL;
+        }
+    }
+    if (packet != NULL) {
+        /* Ring full, QUIC recovers the loss */
+        shard->stats.drops_ring_full++;
+        free(packet);
+    }
+}
+
+int pmoq_shard_run(pmoq_shard_t* shard, picoquic_quic_t* quic, SOCKET_TYPE fd,
+    pmoq_shard_item_fn item_fn, void* app_ctx)
+{
+    int ret = 0;
+    pmoq_shards_t* shards = shard->shards;
+    uint8_t buffer[PICOQUIC_MAX_PACKET_SIZE];
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_to;
+    int if_index = 0;
+    unsigned char received_ecn = 0;
+    uint64_t current_time = picoquic_current_time();
+
+    while (ret == 0 && !pmoq_shard_is_stopping(shard)) {
+        int64_t delay_max = picoquic_get_next_wake_delay(quic, current_time, PMOQ_SHARD_POLL_DELAY);
+        int bytes_recv = picoquic_select(&fd, 1, &addr_from, &addr_to, &if_index, &received_ecn,
+            buffer, sizeof(buffer), delay_max, &current_time);
+
+        if (bytes_recv < 0) {
+            ret = -1;
+            break;
+        }
+        if (bytes_recv > 0) {
+            size_t owner = pmoq_shard_route_packet(buffer, (size_t)bytes_recv, shards->nb_shards, shard->index);
+
+            shard->stats.nb_packets_received++;
+            if (owner == shard->index) {
+                /* Errors only concern the packet, which is dropped */
+                (void)picoquic_incoming_packet(quic, buffer, (size_t)bytes_recv, (struct sockaddr*)&addr_from,
+                    (struct sockaddr*)&addr_to, if_index, received_ecn, current_time);
+            }
+            else {
+                pmoq_shard_forward_packet(shard, owner, buffer, (size_t)bytes_recv, &addr_from, &addr_to, if_index, received_ecn);
+            }
+        }
+
+        /* Packets and items from the other shards */
+        for (size_t from = 0; from < shards->nb_shards; from++) {
+            pmoq_spsc_ring_t* ring = shards->packets[from * shards->nb_shards + shard->index];
+            pmoq_shard_packet_t* packet;
+
+            while (ring != NULL && (packet = (pmoq_shard_packet_t*)pmoq_spsc_ring_pop(ring)) != NULL) {
+                (void)picoquic_incoming_packet(quic, packet->bytes, packet->length, (struct sockaddr*)&packet->addr_from,
+                    (struct sockaddr*)&packet->addr_to, packet->if_index, packet->received_ecn, current_time);
+                free(packet);
+            }
+        }
+        (void)pmoq_shard_drain(shard, item_fn, app_ctx, SIZE_MAX);
+
+        /* Everything that picoquic has to send */
+        while (ret == 0) {
+            uint8_t send_buffer[PICOQUIC_MAX_PACKET_SIZE];
+            size_t send_length = 0;
+            struct sockaddr_storage peer_addr;
+            struct sockaddr_storage local_addr;
+            int send_if_index = 0;
+            picoquic_connection_id_t log_cid;
+            picoquic_cnx_t* last_cnx = NULL;
+            int sock_err = 0;
+
+            current_time = picoquic_current_time();
+            ret = picoquic_prepare_next_packet(quic, current_time, send_buffer, sizeof(send_buffer), &send_length,
+                &peer_addr, &local_addr, &send_if_index, &log_cid, &last_cnx);
+            if (ret != 0 || send_length == 0) {
+                break;
+            }
+            (void)picoquic_sendmsg(fd, (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, send_if_index,
+                (const char*)send_buffer, (int)send_length, &sock_err);
+            shard->stats.nb_packets_sent++;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,354 @@
+/* Codec statistics.
+*
+* Each thread gets a block on its first count, found through a thread
+* local pointer. The blocks are chained in a list whose head is updated
+* with compare and swap; a block is never removed, so the aggregation can
+* walk the list without locking. Only the owner thread writes a block:
+* the counters are updated with relaxed atomic loads and stores, which
+* compile to plain instructions, so that the aggregation reads whole
+* values without slowing down the counting.
+*/
+#if !defined(_WINDOWS) && !defined(_POSIX_C_SOURCE)
+/* clock_gettime() */
+#define _POSIX_C_SOURCE 200112L
+#endif
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "picomoq.h"
+#include "picomoq_stats.h"
+#include "picomoq_internal.h"
+
+#define PMOQ_CACHE_LINE_SIZE 64
+
+size_t pmoq_stats_msg_slot(uint64_t msg_type)
+{
+    if (msg_type <= PMOQ_MSG_MAX_SUBSCRIBE_ID) {
+        return (size_t)msg_type;
+    }
+    else if (msg_type == PMOQ_MSG_CLIENT_SETUP || msg_type == PMOQ_MSG_SERVER_SETUP) {
+        return (size_t)(PMOQ_MSG_MAX_SUBSCRIBE_ID + 1 + msg_type - PMOQ_MSG_CLIENT_SETUP);
+    }
+    return PMOQ_STATS_MSG_SLOTS - 1;
+}
+
+pmoq_stats_strm_enum pmoq_stats_strm_slot(uint64_t msg_type)
+{
+    switch (msg_type) {
+    case PMOQ_STRM_OBJECT_DATAGRAM:
+        return pmoq_stats_strm_object_datagram;
+    case PMOQ_STRM_HEADER_TRACK:
+        return pmoq_stats_strm_header_track;
+    case PMOQ_STRM_HEADER_SUBGROUP:
+        return pmoq_stats_strm_header_subgroup;
+    default:
+        return pmoq_stats_strm_other;
+    }
+}
+
+size_t pmoq_stats_histo_bucket(uint64_t value)
+{
+    size_t e = 0;
+
+    if (value < (1 << PMOQ_STATS_HISTO_SUB_BITS)) {
+        return (size_t)value;
+    }
+    if (value >> 32 != 0) {
+        return PMOQ_STATS_HISTO_BUCKETS - 1;
+    }
+    while ((value >> (e + 1)) != 0) {
+        e++;
+    }
+    return (1 << PMOQ_STATS_HISTO_SUB_BITS) + ((e - PMOQ_STATS_HISTO_SUB_BITS) << PMOQ_STATS_HISTO_SUB_BITS) +
+        (size_t)((value >> (e - PMOQ_STATS_HISTO_SUB_BITS)) & ((1 << PMOQ_STATS_HISTO_SUB_BITS) - 1));
+}
+
+uint64_t pmoq_stats_histo_bucket_min(size_t bucket)
+{
+    size_t e;
+    uint64_t sub;
+
+    if (bucket < (1 << PMOQ_STATS_HISTO_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+    bucket -= (1 << PMOQ_STATS_HISTO_SUB_BITS);
+    e = bucket >> PMOQ_STATS_HISTO_SUB_BITS;
+    sub = bucket & ((1 << PMOQ_STATS_HISTO_SUB_BITS) - 1);
+    return ((1 << PMOQ_STATS_HISTO_SUB_BITS) + sub) << e;
+}
+
+uint64_t pmoq_stats_histo_count(const pmoq_stats_histo_t* histo)
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < PMOQ_STATS_HISTO_BUCKETS; i++) {
+        count += histo->counts[i];
+    }
+    return count;
+}
+
+uint64_t pmoq_stats_histo_percentile(const pmoq_stats_histo_t* histo, double percentile)
+{
+    uint64_t count = pmoq_stats_histo_count(histo);
+    uint64_t rank = (uint64_t)((percentile * (double)count) / 100.0);
+    uint64_t seen = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    for (size_t i = 0; i < PMOQ_STATS_HISTO_BUCKETS; i++) {
+        seen += histo->counts[i];
+        if (seen > rank) {
+            return pmoq_stats_histo_bucket_min(i);
+        }
+    }
+    return 0;
+}
+
+static const char* pmoq_stats_msg_names[PMOQ_STATS_MSG_SLOTS] = {
+    "0x00", "0x01", "subscribe_update", "subscribe", "subscribe_ok", "subscribe_error",
+    "announce", "announce_ok", "announce_error", "unannounce", "unsubscribe",
+    "subscribe_done", "announce_cancel", "track_status_request", "track_status", "0x0f",
+    "goaway", "subscribe_namespace", "subscribe_namespace_ok", "subscribe_namespace_error",
+    "unsubscribe_namespace", "max_subscribe_id", "client_setup", "server_setup", "other"
+};
+
+static const char* pmoq_stats_strm_names[pmoq_stats_strm_max] = {
+    "object_datagram", "header_track", "header_subgroup", "object_track", "object_subgroup", "other"
+};
+
+static int pmoq_stats_dump_entry(FILE* F, const char* kind, const char* name, const pmoq_stats_entry_t* entry)
+{
+    int ret = 0;
+
+    if (entry->nb_parsed != 0 || entry->nb_formatted != 0 || entry->nb_parse_failed != 0 ||
+        entry->nb_format_failed != 0 || entry->nb_needs_more_bytes != 0) {
+        const pmoq_stats_histo_t* parse = &entry->latency[pmoq_stats_op_parse];
+        const pmoq_stats_histo_t* format = &entry->latency[pmoq_stats_op_format];
+
+        if (fprintf(F, "{ \"kind\": \"%s\", \"type\": \"%s\", \"parsed\": %" PRIu64 ", \"formatted\": %" PRIu64
+            ", \"parse_failed\": %" PRIu64 ", \"format_failed\": %" PRIu64 ", \"needs_more_bytes\": %" PRIu64
+            ", \"bytes_parsed\": %" PRIu64 ", \"bytes_formatted\": %" PRIu64, kind, name,
+            entry->nb_parsed, entry->nb_formatted, entry->nb_parse_failed, entry->nb_format_failed,
+            entry->nb_needs_more_bytes, entry->bytes_parsed, entry->bytes_formatted) < 0 ||
+            fprintf(F, ", \"parse_ns\": { \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 " }"
+                ", \"format_ns\": { \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64 " } }\n",
+                pmoq_stats_histo_percentile(parse, 50.0), pmoq_stats_histo_percentile(parse, 99.0),
+                pmoq_stats_histo_percentile(parse, 100.0), pmoq_stats_histo_percentile(format, 50.0),
+                pmoq_stats_histo_percentile(format, 99.0), pmoq_stats_histo_percentile(format, 100.0)) < 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int pmoq_stats_dump(FILE* F, const pmoq_stats_t* stats)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < PMOQ_STATS_MSG_SLOTS; i++) {
+        ret = pmoq_stats_dump_entry(F, "msg", pmoq_stats_msg_names[i], &stats->msg[i]);
+    }
+    for (size_t i = 0; ret == 0 && i < pmoq_stats_strm_max; i++) {
+        ret = pmoq_stats_dump_entry(F, "strm", pmoq_stats_strm_names[i], &stats->strm[i]);
+    }
+    return ret;
+}
+
+#ifdef PMOQ_STATS
+
+#ifdef _WINDOWS
+#define PMOQ_STATS_THREAD_LOCAL __declspec(thread)
+/* On x86 and x64, MSVC reads and writes aligned 64 bit values at once */
+#define PMOQ_STATS_LOAD(p) (*(volatile uint64_t*)(p))
+#define PMOQ_STATS_ADD(p, v) (*(volatile uint64_t*)(p) = *(volatile uint64_t*)(p) + (v))
+#else
+#define PMOQ_STATS_THREAD_LOCAL __thread
+#define PMOQ_STATS_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+/* p is evaluated twice */
+#define PMOQ_STATS_ADD(p, v) __atomic_store_n((p), __atomic_load_n((p), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+#endif
+
+typedef struct st_pmoq_stats_block_t {
+    pmoq_stats_t stats;
+    struct st_pmoq_stats_block_t* next;
+} pmoq_stats_block_t;
+
+static pmoq_stats_block_t* pmoq_stats_blocks = NULL;
+static PMOQ_STATS_THREAD_LOCAL pmoq_stats_block_t* pmoq_stats_local = NULL;
+
+static pmoq_stats_block_t* pmoq_stats_blocks_first()
+{
+#ifdef _WINDOWS
+    return (pmoq_stats_block_t*)InterlockedCompareExchangePointer((PVOID volatile*)&pmoq_stats_blocks, NULL, NULL);
+#else
+    return __atomic_load_n(&pmoq_stats_blocks, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* The block is aligned on a cache line, and its size rounded up to a
+ * multiple of the line, so that no other block shares its lines. The
+ * memory is never released. */
+static pmoq_stats_block_t* pmoq_stats_block_create()
+{
+    size_t size = (sizeof(pmoq_stats_block_t) + PMOQ_CACHE_LINE_SIZE - 1) & ~((size_t)PMOQ_CACHE_LINE_SIZE - 1);
+    uint8_t* allocated = (uint8_t*)malloc(size + PMOQ_CACHE_LINE_SIZE);
+    pmoq_stats_block_t* block = NULL;
+
+    if (allocated != NULL) {
+        block = (pmoq_stats_block_t*)(allocated + PMOQ_CACHE_LINE_SIZE - ((uintptr_t)allocated & (PMOQ_CACHE_LINE_SIZE - 1)));
+        memset(block, 0, sizeof(pmoq_stats_block_t));
+#ifdef _WINDOWS
+        {
+            PVOID first;
+            do {
+                first = InterlockedCompareExchangePointer((PVOID volatile*)&pmoq_stats_blocks, NULL, NULL);
+                block->next = (pmoq_stats_block_t*)first;
+            } while (InterlockedCompareExchangePointer((PVOID volatile*)&pmoq_stats_blocks, block, first) != first);
+        }
+#else
+        block->next = __atomic_load_n(&pmoq_stats_blocks, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&pmoq_stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+    }
+    return block;
+}
+
+uint64_t pmoq_stats_clock()
+{
+#ifdef _WINDOWS
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((((double)counter.QuadPart) * 1000000000.0) / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec) * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static pmoq_stats_entry_t* pmoq_stats_entry(int is_strm, size_t slot)
+{
+    if (pmoq_stats_local == NULL && (pmoq_stats_local = pmoq_stats_block_create()) == NULL) {
+        return NULL;
+    }
+    return (is_strm) ? &pmoq_stats_local->stats.strm[slot] : &pmoq_stats_local->stats.msg[slot];
+}
+
+void pmoq_stats_parsed(int is_strm, size_t slot, const uint8_t* bytes, const uint8_t* next, int err, uint64_t start)
+{
+    pmoq_stats_entry_t* entry = pmoq_stats_entry(is_strm, slot);
+    size_t bucket = pmoq_stats_histo_bucket(pmoq_stats_clock() - start);
+
+    if (entry != NULL) {
+        if (next != NULL) {
+            PMOQ_STATS_ADD(&entry->nb_parsed, 1);
+            PMOQ_STATS_ADD(&entry->bytes_parsed, (uint64_t)(next - bytes));
+        }
+        else if (err > 0) {
+            PMOQ_STATS_ADD(&entry->nb_needs_more_bytes, 1);
+        }
+        else {
+            PMOQ_STATS_ADD(&entry->nb_parse_failed, 1);
+        }
+        PMOQ_STATS_ADD(&entry->latency[pmoq_stats_op_parse].counts[bucket], 1);
+    }
+}
+
+void pmoq_stats_fed(size_t slot, const uint8_t* bytes, const uint8_t* next, int is_complete, uint64_t start)
+{
+    pmoq_stats_entry_t* entry = pmoq_stats_entry(0, slot);
+    size_t bucket = pmoq_stats_histo_bucket(pmoq_stats_clock() - start);
+
+    if (entry != NULL) {
+        if (next == NULL) {
+            PMOQ_STATS_ADD(&entry->nb_parse_failed, 1);
+        }
+        else {
+            PMOQ_STATS_ADD(&entry->bytes_parsed, (uint64_t)(next - bytes));
+            PMOQ_STATS_ADD((is_complete) ? &entry->nb_parsed : &entry->nb_needs_more_bytes, 1);
+        }
+        PMOQ_STATS_ADD(&entry->latency[pmoq_stats_op_parse].counts[bucket], 1);
+    }
+}
+
+void pmoq_stats_formatted(int is_strm, size_t slot, const uint8_t* bytes, const uint8_t* next, uint64_t start)
+{
+    pmoq_stats_entry_t* entry = pmoq_stats_entry(is_strm, slot);
+    size_t bucket = pmoq_stats_histo_bucket(pmoq_stats_clock() - start);
+
+    if (entry != NULL) {
+        if (next != NULL) {
+            PMOQ_STATS_ADD(&entry->nb_formatted, 1);
+            PMOQ_STATS_ADD(&entry->bytes_formatted, (uint64_t)(next - bytes));
+        }
+        else {
+            PMOQ_STATS_ADD(&entry->nb_format_failed, 1);
+        }
+        PMOQ_STATS_ADD(&entry->latency[pmoq_stats_op_format].counts[bucket], 1);
+    }
+}
+
+static void pmoq_stats_entry_add(pmoq_stats_entry_t* total, pmoq_stats_entry_t* entry)
+{
+    total->nb_parsed += PMOQ_STATS_LOAD(&entry->nb_parsed);
+    total->nb_formatted += PMOQ_STATS_LOAD(&entry->nb_formatted);
+    total->nb_parse_failed += PMOQ_STATS_LOAD(&entry->nb_parse_failed);
+    total->nb_format_failed += PMOQ_STATS_LOAD(&entry->nb_format_failed);
+    total->nb_needs_more_bytes += PMOQ_STATS_LOAD(&entry->nb_needs_more_bytes);
+    total->bytes_parsed += PMOQ_STATS_LOAD(&entry->bytes_parsed);
+    total->bytes_formatted += PMOQ_STATS_LOAD(&entry->bytes_formatted);
+    for (size_t op = 0; op < pmoq_stats_op_max; op++) {
+        for (size_t i = 0; i < PMOQ_STATS_HISTO_BUCKETS; i++) {
+            total->latency[op].counts[i] += PMOQ_STATS_LOAD(&entry->latency[op].counts[i]);
+        }
+    }
+}
+
+int pmoq_stats_enabled()
+{
+    return 1;
+}
+
+void pmoq_stats_aggregate(pmoq_stats_t* stats)
+{
+    memset(stats, 0, sizeof(pmoq_stats_t));
+    for (pmoq_stats_block_t* block = pmoq_stats_blocks_first(); block != NULL; block = block->next) {
+        for (size_t i = 0; i < PMOQ_STATS_MSG_SLOTS; i++) {
+            pmoq_stats_entry_add(&stats->msg[i], &block->stats.msg[i]);
+        }
+        for (size_t i = 0; i < pmoq_stats_strm_max; i++) {
+            pmoq_stats_entry_add(&stats->strm[i], &block->stats.strm[i]);
+        }
+    }
+}
+
+#else
+
+int pmoq_stats_enabled()
+{
+    return 0;
+}
+
+void pmoq_stats_aggregate(pmoq_stats_t* stats)
+{
+    memset(stats, 0, sizeof(pmoq_stats_t));
+}
+
+#endif
@@ -0,0 +1,407 @@
+/* Subscription table.
+*
+* The subscriptions are stored in an array of records, reused through a
+* free list. Two hash tables map (connection ID, subscribe ID) to a
+* record, and the track key to a track. Each track has a fan-out array
+* with one entry per subscription, holding the filter, so that objects
+* are matched without following pointers to the records. Removals swap
+* the last fan-out entry in place of the removed one.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_internal.h"
+
+#define PMOQ_SUBS_TABLE_SIZE_MIN 64
+#define PMOQ_SUBS_NONE UINT32_MAX
+
+typedef struct st_pmoq_subs_map_entry_t {
+    uint64_t k1;
+    uint64_t k2;
+    uint32_t value;
+    uint32_t is_used;
+} pmoq_subs_map_entry_t;
+
+typedef struct st_pmoq_subs_fanout_t {
+    uint64_t start_group;
+    uint64_t start_object;
+    uint64_t end_group; /* UINT64_MAX if open ended */
+    uint64_t end_object; /* Object ID plus 1, 0 for the whole end group */
+    uint32_t record;
+    uint32_t is_start_pending;
+} pmoq_subs_fanout_t;
+
+typedef struct st_pmoq_subs_track_t {
+    uint64_t track_key;
+    pmoq_subs_fanout_t* fanout;
+    size_t nb_fanout;
+    size_t fanout_max;
+    uint32_t next_free;
+} pmoq_subs_track_t;
+
+typedef struct st_pmoq_subs_record_t {
+    pmoq_subscription_t sub;
+    uint32_t track;
+    uint32_t fanout_rank;
+    uint32_t next_free;
+    uint32_t is_used;
+} pmoq_subs_record_t;
+
+struct st_pmoq_subs_t {
+    pmoq_subs_record_t* records;
+    size_t records_max;
+    uint32_t first_free_record;
+    size_t nb_records;
+    pmoq_subs_track_t* tracks;
+    size_t tracks_max;
+    uint32_t first_free_track;
+    pmoq_hash_table_t by_id;
+    pmoq_hash_table_t by_track;
+};
+
+static uint64_t pmoq_subs_hash(uint64_t k1, uint64_t k2)
+{
+    uint64_t h = (k1 * 0x9E3779B97F4A7C15ull) ^ ((k2 + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full);
+    h ^= h >> 29;
+    return h;
+}
+
+static uint64_t pmoq_subs_map_hash(void* hash_ctx, const void* element)
+{
+    const pmoq_subs_map_entry_t* entry = (const pmoq_subs_map_entry_t*)element;
+
+    (void)hash_ctx;
+    return pmoq_subs_hash(entry->k1, entry->k2);
+}
+
+static int pmoq_subs_map_match(const void* key, const void* element)
+{
+    const pmoq_subs_map_entry_t* k = (const pmoq_subs_map_entry_t*)key;
+    const pmoq_subs_map_entry_t* entry = (const pmoq_subs_map_entry_t*)element;
+
+    return entry->k1 == k->k1 && entry->k2 == k->k2;
+}
+
+static int pmoq_subs_map_init(pmoq_hash_table_t* map)
+{
+    return pmoq_hash_table_init(map, sizeof(pmoq_subs_map_entry_t), PMOQ_SUBS_TABLE_SIZE_MIN, pmoq_subs_map_hash, NULL);
+}
+
+static size_t pmoq_subs_map_slot(const pmoq_hash_table_t* map, uint64_t k1, uint64_t k2)
+{
+    pmoq_subs_map_entry_t key;
+
+    key.k1 = k1;
+    key.k2 = k2;
+    return pmoq_hash_table_probe(map, pmoq_subs_hash(k1, k2), pmoq_subs_map_match, &key);
+}
+
+static uint32_t pmoq_subs_map_find(const pmoq_hash_table_t* map, uint64_t k1, uint64_t k2)
+{
+    const pmoq_subs_map_entry_t* entry = (const pmoq_subs_map_entry_t*)PMOQ_HASH_TABLE_SLOT(map, pmoq_subs_map_slot(map, k1, k2));
+
+    return (entry->is_used) ? entry->value : PMOQ_SUBS_NONE;
+}
+
+static int pmoq_subs_map_insert(pmoq_hash_table_t* map, uint64_t k1, uint64_t k2, uint32_t value)
+{
+    pmoq_subs_map_entry_t entry;
+
+    if (pmoq_hash_table_reserve(map) != 0) {
+        return -1;
+    }
+    entry.k1 = k1;
+    entry.k2 = k2;
+    entry.value = value;
+    entry.is_used = 1;
+    pmoq_hash_table_insert(map, pmoq_subs_map_slot(map, k1, k2), &entry);
+    return 0;
+}
+
+static void pmoq_subs_map_remove(pmoq_hash_table_t* map, uint64_t k1, uint64_t k2)
+{
+    size_t slot = pmoq_subs_map_slot(map, k1, k2);
+
+    if (pmoq_hash_table_is_used(map, slot)) {
+        pmoq_hash_table_remove(map, slot);
+    }
+}
+
+pmoq_subs_t* pmoq_subs_create()
+{
+    pmoq_subs_t* subs = (pmoq_subs_t*)malloc(sizeof(pmoq_subs_t));
+
+    if (subs != NULL) {
+        memset(subs, 0, sizeof(pmoq_subs_t));
+        subs->first_free_record = PMOQ_SUBS_NONE;
+        subs->first_free_track = PMOQ_SUBS_NONE;
+        if (pmoq_subs_map_init(&subs->by_id) != 0 ||
+            pmoq_subs_map_init(&subs->by_track) != 0) {
+            pmoq_subs_delete(subs);
+            subs = NULL;
+        }
+    }
+    return subs;
+}
+
+void pmoq_subs_delete(pmoq_subs_t* subs)
+{
+    if (subs != NULL) {
+        for (size_t i = 0; i < subs->tracks_max; i++) {
+            if (subs->tracks[i].fanout != NULL) {
+                free(subs->tracks[i].fanout);
+            }
+        }
+        if (subs->tracks != NULL) {
+            free(subs->tracks);
+        }
+        if (subs->records != NULL) {
+            free(subs->records);
+        }
+        pmoq_hash_table_release(&subs->by_id);
+        pmoq_hash_table_release(&subs->by_track);
+        free(subs);
+    }
+}
+
+size_t pmoq_subs_count(const pmoq_subs_t* subs)
+{
+    return subs->nb_records;
+}
+
+/* Arrays of records and tracks grow by doubling, and the free entries
+* are chained through next_free. */
+static uint32_t pmoq_subs_new_record(pmoq_subs_t* subs)
+{
+    uint32_t rank = subs->first_free_record;
+
+    if (rank == PMOQ_SUBS_NONE) {
+        size_t new_max = (subs->records_max == 0) ? 64 : 2 * subs->records_max;
+        pmoq_subs_record_t* new_records;
+
+        if (new_max >= PMOQ_SUBS_NONE ||
+            (new_records = (pmoq_subs_record_t*)realloc(subs->records, new_max * sizeof(pmoq_subs_record_t))) == NULL) {
+            return PMOQ_SUBS_NONE;
+        }
+        for (size_t i = subs->records_max; i < new_max; i++) {
+            new_records[i].is_used = 0;
+            new_records[i].next_free = (i + 1 < new_max) ? (uint32_t)(i + 1) : PMOQ_SUBS_NONE;
+        }
+        subs->first_free_record = (uint32_t)subs->records_max;
+        subs->records = new_records;
+        subs->records_max = new_max;
+        rank = subs->first_free_record;
+    }
+    subs->first_free_record = subs->records[rank].next_free;
+    return rank;
+}
+
+static uint32_t pmoq_subs_get_track(pmoq_subs_t* subs, uint64_t track_key)
+{
+    uint32_t rank = pmoq_subs_map_find(&subs->by_track, track_key, 0);
+
+    if (rank == PMOQ_SUBS_NONE) {
+        if ((rank = subs->first_free_track) == PMOQ_SUBS_NONE) {
+            size_t new_max = (subs->tracks_max == 0) ? 16 : 2 * subs->tracks_max;
+            pmoq_subs_track_t* new_tracks;
+
+            if (new_max >= PMOQ_SUBS_NONE ||
+                (new_tracks = (pmoq_subs_track_t*)realloc(subs->tracks, new_max * sizeof(pmoq_subs_track_t))) == NULL) {
+                return PMOQ_SUBS_NONE;
+            }
+            memset(new_tracks + subs->tracks_max, 0, (new_max - subs->tracks_max) * sizeof(pmoq_subs_track_t));
+            for (size_t i = subs->tracks_max; i < new_max; i++) {
+                new_tracks[i].next_free = (i + 1 < new_max) ? (uint32_t)(i + 1) : PMOQ_SUBS_NONE;
+            }
+            subs->first_free_track = (uint32_t)subs->tracks_max;
+            subs->tracks = new_tracks;
+            subs->tracks_max = new_max;
+            rank = subs->first_free_track;
+        }
+        if (pmoq_subs_map_insert(&subs->by_track, track_key, 0, rank) != 0) {
+            return PMOQ_SUBS_NONE;
+        }
+        subs->first_free_track = subs->tracks[rank].next_free;
+        subs->tracks[rank].track_key = track_key;
+        subs->tracks[rank].nb_fanout = 0;
+    }
+    return rank;
+}
+
+static void pmoq_subs_set_filter(pmoq_subs_fanout_t* fanout, uint64_t start_group, uint64_t start_object,
+    uint64_t end_group, uint64_t end_object)
+{
+    fanout->start_group = start_group;
+    fanout->start_object = start_object;
+    fanout->end_group = end_group;
+    fanout->end_object = end_object;
+}
+
+int pmoq_subs_add(pmoq_subs_t* subs, uint64_t connection_id, uint64_t track_key,
+    const pmoq_subscribe_t* subscribe, void* app_ctx)
+{
+    uint32_t rank;
+    uint32_t track_rank;
+    pmoq_subs_track_t* track;
+    pmoq_subs_fanout_t fanout = { 0 };
+
+    switch (subscribe->filter_type) {
+    case pmoq_msg_filter_latest_group:
+    case pmoq_msg_filter_latest_object:
+        pmoq_subs_set_filter(&fanout, 0, 0, UINT64_MAX, 0);
+        fanout.is_start_pending = 1;
+        break;
+    case pmoq_msg_filter_absolute_start:
+        pmoq_subs_set_filter(&fanout, subscribe->start_group, subscribe->start_object, UINT64_MAX, 0);
+        break;
+    case pmoq_msg_filter_absolute_range:
+        if (subscribe->end_group < subscribe->start_group) {
+            return -1;
+        }
+        pmoq_subs_set_filter(&fanout, subscribe->start_group, subscribe->start_object,
+            subscribe->end_group, subscribe->end_object);
+        break;
+    default:
+        return -1;
+    }
+
+    if (pmoq_subs_map_find(&subs->by_id, connection_id, subscribe->subscribe_id) != PMOQ_SUBS_NONE ||
+        (track_rank = pmoq_subs_get_track(subs, track_key)) == PMOQ_SUBS_NONE) {
+        return -1;
+    }
+    track = &subs->tracks[track_rank];
+    if (track->nb_fanout >= track->fanout_max) {
+        size_t new_max = (track->fanout_max == 0) ? 4 : 2 * track->fanout_max;
+        pmoq_subs_fanout_t* new_fanout = (pmoq_subs_fanout_t*)realloc(track->fanout, new_max * sizeof(pmoq_subs_fanout_t));
+
+        if (new_fanout == NULL) {
+            return -1;
+        }
+        track->fanout = new_fanout;
+        track->fanout_max = new_max;
+    }
+    if ((rank = pmoq_subs_new_record(subs)) == PMOQ_SUBS_NONE) {
+        return -1;
+    }
+    if (pmoq_subs_map_insert(&subs->by_id, connection_id, subscribe->subscribe_id, rank) != 0) {
+        subs->records[rank].next_free = subs->first_free_record;
+        subs->first_free_record = rank;
+        return -1;
+    }
+
+    subs->records[rank].sub.connection_id = connection_id;
+    subs->records[rank].sub.subscribe_id = subscribe->subscribe_id;
+    subs->records[rank].sub.track_alias = subscribe->track_alias;
+    subs->records[rank].sub.track_key = track_key;
+    subs->records[rank].sub.filter_type = subscribe->filter_type;
+    subs->records[rank].sub.app_ctx = app_ctx;
+    subs->records[rank].track = track_rank;
+    subs->records[rank].fanout_rank = (uint32_t)track->nb_fanout;
+    subs->records[rank].is_used = 1;
+    fanout.record = rank;
+    track->fanout[track->nb_fanout++] = fanout;
+    subs->nb_records++;
+
+    return 0;
+}
+
+pmoq_subscription_t* pmoq_subs_find(pmoq_subs_t* subs, uint64_t connection_id, uint64_t subscribe_id)
+{
+    uint32_t rank = pmoq_subs_map_find(&subs->by_id, connection_id, subscribe_id);
+
+    return (rank == PMOQ_SUBS_NONE) ? NULL : &subs->records[rank].sub;
+}
+
+int pmoq_subs_update(pmoq_subs_t* subs, uint64_t connection_id, const pmoq_subscribe_update_t* update)
+{
+    uint32_t rank = pmoq_subs_map_find(&subs->by_id, connection_id, update->subscribe_id);
+    pmoq_subs_record_t* record;
+    uint64_t end_group;
+
+    if (rank == PMOQ_SUBS_NONE) {
+        return -1;
+    }
+    /* In SUBSCRIBE_UPDATE, the end group is coded plus 1, 0 if open ended */
+    end_group = (update->end_group == 0) ? UINT64_MAX : update->end_group - 1;
+    if (end_group < update->start_group) {
+        return -1;
+    }
+    record = &subs->records[rank];
+    pmoq_subs_set_filter(&subs->tracks[record->track].fanout[record->fanout_rank],
+        update->start_group, update->start_object, end_group, update->end_object);
+    subs->tracks[record->track].fanout[record->fanout_rank].is_start_pending = 0;
+
+    return 0;
+}
+
+int pmoq_subs_remove(pmoq_subs_t* subs, uint64_t connection_id, uint64_t subscribe_id)
+{
+    uint32_t rank = pmoq_subs_map_find(&subs->by_id, connection_id, subscribe_id);
+    pmoq_subs_record_t* record;
+    pmoq_subs_track_t* track;
+
+    if (rank == PMOQ_SUBS_NONE) {
+        return -1;
+    }
+    record = &subs->records[rank];
+    track = &subs->tracks[record->track];
+
+    /* Move the last fan-out entry in the place of the removed one */
+    track->nb_fanout--;
+    if (record->fanout_rank < track->nb_fanout) {
+        track->fanout[record->fanout_rank] = track->fanout[track->nb_fanout];
+        subs->records[track->fanout[record->fanout_rank].record].fanout_rank = record->fanout_rank;
+    }
+    if (track->nb_fanout == 0) {
+        pmoq_subs_map_remove(&subs->by_track, track->track_key, 0);
+        track->next_free = subs->first_free_track;
+        subs->first_free_track = record->track;
+    }
+
+    pmoq_subs_map_remove(&subs->by_id, connection_id, subscribe_id);
+    record->is_used = 0;
+    record->next_free = subs->first_free_record;
+    subs->first_free_record = rank;
+    subs->nb_records--;
+
+    return 0;
+}
+
+void pmoq_subs_remove_connection(pmoq_subs_t* subs, uint64_t connection_id)
+{
+    for (size_t i = 0; i < subs->records_max; i++) {
+        if (subs->records[i].is_used && subs->records[i].sub.connection_id == connection_id) {
+            (void)pmoq_subs_remove(subs, connection_id, subs->records[i].sub.subscribe_id);
+        }
+    }
+}
+
+size_t pmoq_subs_match(pmoq_subs_t* subs, uint64_t track_key, uint64_t group_id, uint64_t object_id,
+    size_t* cursor, pmoq_subscription_t** matches, size_t matches_max)
+{
+    size_t nb_matches = 0;
+    uint32_t track_rank = pmoq_subs_map_find(&subs->by_track, track_key, 0);
+
+    if (track_rank != PMOQ_SUBS_NONE) {
+        pmoq_subs_track_t* track = &subs->tracks[track_rank];
+        size_t i = *cursor;
+
+        for (; i < track->nb_fanout && nb_matches < matches_max; i++) {
+            pmoq_subs_fanout_t* fanout = &track->fanout[i];
+
+            if (fanout->is_start_pending) {
+                fanout->start_group = group_id;
+                fanout->start_object = (subs->records[fanout->record].sub.filter_type == pmoq_msg_filter_latest_object) ? object_id : 0;
+                fanout->is_start_pending = 0;
+            }
+            if ((group_id > fanout->start_group || (group_id == fanout->start_group && object_id >= fanout->start_object)) &&
+                (group_id < fanout->end_group || (group_id == fanout->end_group && (fanout->end_object == 0 || object_id < fanout->end_object)))) {
+                matches[nb_matches++] = &subs->records[fanout->record].sub;
+            }
+        }
+        *cursor = i;
+    }
+    return nb_matches;
+}
@@ -0,0 +1,179 @@
+/* Timer wheel.
+*
+* Each slot is a circular doubly linked list with a sentinel, so a timer
+* can be removed without knowing its slot. A timer is set when its next
+* pointer is not NULL. Expired timers are first moved to a local list,
+* then fired one at a time, so that the callback may change any timer.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picomoq_timer.h"
+
+struct st_pmoq_timer_wheel_t {
+    uint64_t tick;
+    size_t nb_slots;
+    uint64_t current_tick;
+    size_t nb_timers;
+    pmoq_timer_t* slots;
+};
+
+static void pmoq_timer_list_init(pmoq_timer_t* sentinel)
+{
+    sentinel->next = sentinel;
+    sentinel->previous = sentinel;
+}
+
+static void pmoq_timer_list_insert(pmoq_timer_t* sentinel, pmoq_timer_t* timer)
+{
+    timer->previous = sentinel->previous;
+    timer->next = sentinel;
+    sentinel->previous->next = timer;
+    sentinel->previous = timer;
+}
+
+static void pmoq_timer_list_remove(pmoq_timer_t* timer)
+{
+    timer->previous->next = timer->next;
+    timer->next->previous = timer->previous;
+    timer->next = NULL;
+    timer->previous = NULL;
+}
+
+pmoq_timer_wheel_t* pmoq_timer_wheel_create(uint64_t tick, size_t nb_slots, uint64_t current_time)
+{
+    pmoq_timer_wheel_t* wheel = (pmoq_timer_wheel_t*)malloc(sizeof(pmoq_timer_wheel_t));
+
+    if (wheel != NULL) {
+        memset(wheel, 0, sizeof(pmoq_timer_wheel_t));
+        wheel->tick = (tick == 0) ? PMOQ_TIMER_TICK_DEFAULT : tick;
+        wheel->nb_slots = 1;
+        while (wheel->nb_slots < ((nb_slots == 0) ? PMOQ_TIMER_SLOTS_DEFAULT : nb_slots)) {
+            wheel->nb_slots *= 2;
+        }
+        wheel->current_tick = current_time / wheel->tick;
+        if ((wheel->slots = (pmoq_timer_t*)malloc(wheel->nb_slots * sizeof(pmoq_timer_t))) == NULL) {
+            free(wheel);
+            wheel = NULL;
+        }
+        else {
+            for (size_t i = 0; i < wheel->nb_slots; i++) {
+                pmoq_timer_list_init(&wheel->slots[i]);
+            }
+        }
+    }
+    return wheel;
+}
+
+void pmoq_timer_wheel_delete(pmoq_timer_wheel_t* wheel)
+{
+    if (wheel != NULL) {
+        for (size_t i = 0; i < wheel->nb_slots; i++) {
+            while (wheel->slots[i].next != &wheel->slots[i]) {
+                pmoq_timer_list_remove(wheel->slots[i].next);
+            }
+        }
+        free(wheel->slots);
+        free(wheel);
+    }
+}
+
+size_t pmoq_timer_wheel_count(const pmoq_timer_wheel_t* wheel)
+{
+    return wheel->nb_timers;
+}
+
+int pmoq_timer_is_set(const pmoq_timer_t* timer)
+{
+    return timer->next != NULL;
+}
+
+void pmoq_timer_cancel(pmoq_timer_wheel_t* wheel, pmoq_timer_t* timer)
+{
+    if (timer->next != NULL) {
+        pmoq_timer_list_remove(timer);
+        wheel->nb_timers--;
+    }
+}
+
+void pmoq_timer_set(pmoq_timer_wheel_t* wheel, pmoq_timer_t* timer, uint64_t expiry)
+{
+    uint64_t expiry_tick = expiry / wheel->tick;
+
+    pmoq_timer_cancel(wheel, timer);
+    /* Timers already expired go in the current slot, visited by the next advance */
+    if (expiry_tick < wheel->current_tick) {
+        expiry_tick = wheel->current_tick;
+    }
+    timer->expiry = expiry;
+    pmoq_timer_list_insert(&wheel->slots[expiry_tick & (wheel->nb_slots - 1)], timer);
+    wheel->nb_timers++;
+}
+
+size_t pmoq_timer_wheel_advance(pmoq_timer_wheel_t* wheel, uint64_t current_time, pmoq_timer_fn fn, void* callback_ctx)
+{
+    uint64_t target_tick = current_time / wheel->tick;
+    uint64_t nb_ticks;
+    pmoq_timer_t expired;
+    size_t nb_fired = 0;
+
+    if (target_tick < wheel->current_tick) {
+        return 0;
+    }
+    nb_ticks = target_tick - wheel->current_tick + 1;
+    if (nb_ticks > wheel->nb_slots) {
+        nb_ticks = wheel->nb_slots;
+    }
+    pmoq_timer_list_init(&expired);
+    for (uint64_t i = 0; i < nb_ticks; i++) {
+        pmoq_timer_t* slot = &wheel->slots[(wheel->current_tick + i) & (wheel->nb_slots - 1)];
+        pmoq_timer_t* timer = slot->next;
+
+        while (timer != slot) {
+            pmoq_timer_t* next = timer->next;
+
+            if (timer->expiry <= current_time) {
+                pmoq_timer_list_remove(timer);
+                pmoq_timer_list_insert(&expired, timer);
+            }
+            timer = next;
+        }
+    }
+    wheel->current_tick = target_tick;
+
+    while (expired.next != &expired) {
+        pmoq_timer_t* timer = expired.next;
+
+        pmoq_timer_list_remove(timer);
+        wheel->nb_timers--;
+        nb_fired++;
+        fn(callback_ctx, timer);
+    }
+    return nb_fired;
+}
+
+uint64_t pmoq_timer_wheel_next_expiry(const pmoq_timer_wheel_t* wheel)
+{
+    uint64_t next_expiry = UINT64_MAX;
+
+    /* The first slot that holds a timer of the current turn has the next
+     * expiry. Timers of later turns are only used if there are none. */
+    for (size_t i = 0; wheel->nb_timers > 0 && i < wheel->nb_slots; i++) {
+        const pmoq_timer_t* slot = &wheel->slots[(wheel->current_tick + i) & (wheel->nb_slots - 1)];
+        uint64_t slot_expiry = UINT64_MAX;
+
+        for (const pmoq_timer_t* timer = slot->next; timer != slot; timer = timer->next) {
+            if (timer->expiry / wheel->tick <= wheel->current_tick + i && timer->expiry < slot_expiry) {
+                slot_expiry = timer->expiry;
+            }
+            else if (timer->expiry < next_expiry) {
+                next_expiry = timer->expiry;
+            }
+        }
+        if (slot_expiry != UINT64_MAX) {
+            next_expiry = slot_expiry;
+            break;
+        }
+    }
+    return next_expiry;
+}
@@ -0,0 +1,161 @@
+/* Fast decoding of the fixed sequences of varints found in object headers.
+* The object datagram, subgroup header and subgroup object parsers are
+* on the data path of relays, and called once per object. When the buffer
+* holds enough bytes for the largest possible encoding of the header, the
+* fields are decoded without per field bounds checks.
+*
+* Two decoders are available. The scalar decoder reads each varint byte
+* by byte, like picoquic_frames_varint_decode. The SWAR decoder loads
+* 8 bytes at once, converts them to host order, and extracts the value
+* with a shift and a mask, without branching on the length prefix.
+* The decoder is selected at compile time, based on the host: the SWAR
+* decoder is only worth it if 64 bit loads and byte swaps are cheap. Since
+* it is never changed outside of tests, the shard threads can read it
+* without synchronization.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq.h"
+#include "picomoq_internal.h"
+
+#if defined(_MSC_VER)
+#define PMOQ_BSWAP64(x) _byteswap_uint64(x)
+#elif defined(__GNUC__) || defined(__clang__)
+#define PMOQ_BSWAP64(x) __builtin_bswap64(x)
+#else
+static uint64_t pmoq_bswap64(uint64_t x)
+{
+    x = ((x & 0x00000000ffffffffull) << 32) | ((x & 0xffffffff00000000ull) >> 32);
+    x = ((x & 0x0000ffff0000ffffull) << 16) | ((x & 0xffff0000ffff0000ull) >> 16);
+    x = ((x & 0x00ff00ff00ff00ffull) << 8) | ((x & 0xff00ff00ff00ff00ull) >> 8);
+    return x;
+}
+#define PMOQ_BSWAP64(x) pmoq_bswap64(x)
+#endif
+
+typedef const uint8_t* (*pmoq_varint_fast_decode_fn)(const uint8_t* bytes,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v);
+
+static const uint8_t* pmoq_varint_fast_decode_scalar(const uint8_t* bytes,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v)
+{
+    for (size_t i = 0; i < nb_fields; i++) {
+        if (layout[i] == PMOQ_FAST_FIELD_UINT8) {
+            v[i] = *bytes++;
+        }
+        else {
+            size_t l = VARINT_LEN_T(bytes, size_t);
+            uint64_t x = bytes[0] & 0x3f;
+
+            for (size_t j = 1; j < l; j++) {
+                x = (x << 8) | bytes[j];
+            }
+            v[i] = x;
+            bytes += l;
+        }
+    }
+    return bytes;
+}
+
+static const uint8_t* pmoq_varint_fast_decode_swar_le(const uint8_t* bytes,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v)
+{
+    for (size_t i = 0; i < nb_fields; i++) {
+        if (layout[i] == PMOQ_FAST_FIELD_UINT8) {
+            v[i] = *bytes++;
+        }
+        else {
+            uint64_t x;
+            unsigned int l_log = bytes[0] >> 6;
+
+            memcpy(&x, bytes, sizeof(x));
+            x = PMOQ_BSWAP64(x) & 0x3fffffffffffffffull;
+            /* 1, 2, 4 or 8 bytes, i.e., shift by 56, 48, 32 or 0 bits */
+            v[i] = x >> (64 - (8u << l_log));
+            bytes += ((size_t)1) << l_log;
+        }
+    }
+    return bytes;
+}
+
+static const uint8_t* pmoq_varint_fast_decode_swar_be(const uint8_t* bytes,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v)
+{
+    for (size_t i = 0; i < nb_fields; i++) {
+        if (layout[i] == PMOQ_FAST_FIELD_UINT8) {
+            v[i] = *bytes++;
+        }
+        else {
+            uint64_t x;
+            unsigned int l_log = bytes[0] >> 6;
+
+            memcpy(&x, bytes, sizeof(x));
+            x &= 0x3fffffffffffffffull;
+            v[i] = x >> (64 - (8u << l_log));
+            bytes += ((size_t)1) << l_log;
+        }
+    }
+    return bytes;
+}
+
+/* On 32 bit hosts, 64 bit shifts and byte swaps are emulated and the byte
+ * per byte decoder is faster. The SWAR decoder also needs the byte order
+ * of the host. */
+#if SIZE_MAX > 0xffffffffu && ((defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_MSC_VER))
+#define PMOQ_VARINT_FAST_DEFAULT pmoq_varint_fast_decode_swar_le
+#define PMOQ_VARINT_FAST_DEFAULT_MODE pmoq_varint_decoder_swar
+#elif SIZE_MAX > 0xffffffffu && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PMOQ_VARINT_FAST_DEFAULT pmoq_varint_fast_decode_swar_be
+#define PMOQ_VARINT_FAST_DEFAULT_MODE pmoq_varint_decoder_swar
+#else
+#define PMOQ_VARINT_FAST_DEFAULT pmoq_varint_fast_decode_scalar
+#define PMOQ_VARINT_FAST_DEFAULT_MODE pmoq_varint_decoder_scalar
+#endif
+
+static pmoq_varint_fast_decode_fn pmoq_varint_fast_decoder = PMOQ_VARINT_FAST_DEFAULT;
+
+static int pmoq_varint_host_is_little_endian()
+{
+    uint32_t x = 1;
+    uint8_t b;
+
+    memcpy(&b, &x, 1);
+    return b == 1;
+}
+
+pmoq_varint_decoder_enum pmoq_varint_decoder_select(pmoq_varint_decoder_enum mode)
+{
+    switch (mode) {
+    case pmoq_varint_decoder_auto:
+        mode = PMOQ_VARINT_FAST_DEFAULT_MODE;
+        pmoq_varint_fast_decoder = PMOQ_VARINT_FAST_DEFAULT;
+        break;
+    case pmoq_varint_decoder_swar:
+        pmoq_varint_fast_decoder = (pmoq_varint_host_is_little_endian()) ?
+            pmoq_varint_fast_decode_swar_le : pmoq_varint_fast_decode_swar_be;
+        break;
+    default:
+        mode = pmoq_varint_decoder_scalar;
+        pmoq_varint_fast_decoder = pmoq_varint_fast_decode_scalar;
+        break;
+    }
+
+    return mode;
+}
+
+/* Decode the fields described in layout, if the buffer is long enough to
+* hold the largest possible encoding of all of them. Returns a pointer to
+* the first byte after the fields, or NULL if the buffer is too short, in
+* which case the caller uses the bounded parse functions.
+*/
+const uint8_t* pmoq_varint_fast_decode(const uint8_t* bytes, const uint8_t* bytes_max,
+    const uint8_t* layout, size_t nb_fields, uint64_t* v)
+{
+    if ((size_t)(bytes_max - bytes) < nb_fields * 8) {
+        return NULL;
+    }
+    return pmoq_varint_fast_decoder(bytes, layout, nb_fields, v);
+}
@@ -0,0 +1,296 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq/picomoq_test.h"
+#include "cache_test.h"
+
+/* Relay cache tests
+*/
+
+void pmoq_cache_test_header(pmoq_strm_t* header, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length)
+{
+    memset(header, 0, sizeof(pmoq_strm_t));
+    header->msg_type = PMOQ_STRM_HEADER_SUBGROUP;
+    header->track_alias = track_alias;
+    header->group_id = group_id;
+    header->object_id = object_id;
+    header->payload_length = payload_length;
+    header->publisher_priority = (uint8_t)(object_id + 1);
+    header->object_status = (payload_length == 0) ? PMOQ_OBJECT_STATUS_END_OF_GROUP : PMOQ_OBJECT_STATUS_NORMAL;
+}
+
+int pmoq_cache_test_check_object(const pmoq_cache_object_t* object, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length)
+{
+    int ret = 0;
+
+    if (object == NULL || object->object_id != object_id || object->payload_length != payload_length ||
+        object->publisher_priority != (uint8_t)(object_id + 1) || !pmoq_cache_object_is_complete(object) ||
+        (payload_length == 0 && object->object_status != PMOQ_OBJECT_STATUS_END_OF_GROUP)) {
+        ret = -1;
+    }
+    for (uint64_t i = 0; ret == 0 && i < payload_length; i++) {
+        if (object->payload->data[i] != (uint8_t)(track_alias + group_id + object_id + i)) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+pmoq_cache_object_t* pmoq_cache_test_add(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length)
+{
+    pmoq_strm_t header;
+    uint8_t payload[1024];
+
+    for (uint64_t i = 0; i < payload_length && i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(track_alias + group_id + object_id + i);
+    }
+    pmoq_cache_test_header(&header, track_alias, group_id, object_id, payload_length);
+    return pmoq_cache_add_object(cache, &header, payload);
+}
+
+static int pmoq_cache_test_check(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length)
+{
+    return pmoq_cache_test_check_object(pmoq_cache_get_object(cache, track_alias, group_id, object_id),
+        track_alias, group_id, object_id, payload_length);
+}
+
+int pmoq_cache_test_basic()
+{
+    int ret = 0;
+    pmoq_cache_t* cache = pmoq_cache_create(1000000, 4);
+    pmoq_strm_t header;
+    uint64_t latest = 0;
+
+    if (cache == NULL) {
+        return -1;
+    }
+
+    /* Objects out of order, in two groups of two tracks */
+    for (uint64_t track_alias = 1; ret == 0 && track_alias <= 2; track_alias++) {
+        for (uint64_t group_id = 10; ret == 0 && group_id <= 11; group_id++) {
+            const uint64_t object_ids[] = { 5, 3, 7, 4, 0 };
+            for (size_t i = 0; ret == 0 && i < sizeof(object_ids) / sizeof(uint64_t); i++) {
+                if (pmoq_cache_test_add(cache, track_alias, group_id, object_ids[i], 100 + object_ids[i]) == NULL) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+    for (uint64_t track_alias = 1; ret == 0 && track_alias <= 2; track_alias++) {
+        pmoq_cache_group_t* group = pmoq_cache_get_group(cache, track_alias, 11);
+        size_t nb_present = 0;
+
+        if (pmoq_cache_test_check(cache, track_alias, 10, 3, 103) != 0 ||
+            pmoq_cache_test_check(cache, track_alias, 11, 0, 100) != 0 ||
+            pmoq_cache_test_check(cache, track_alias, 11, 7, 107) != 0 ||
+            pmoq_cache_get_object(cache, track_alias, 11, 1) != NULL ||
+            pmoq_cache_get_object(cache, track_alias, 11, 8) != NULL ||
+            pmoq_cache_get_object(cache, track_alias, 12, 0) != NULL ||
+            pmoq_cache_latest_group(cache, track_alias, &latest) != 0 || latest != 11 ||
+            group == NULL || pmoq_cache_group_id(group) != 11 || pmoq_cache_group_span(group) != 8) {
+            ret = -1;
+        }
+        for (size_t rank = 0; ret == 0 && rank < pmoq_cache_group_span(group); rank++) {
+            pmoq_cache_object_t* object = pmoq_cache_group_object(group, rank);
+            if (object != NULL) {
+                if (object->object_id != rank) {
+                    ret = -1;
+                }
+                nb_present++;
+            }
+        }
+        if (nb_present != 5) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && (pmoq_cache_get_object(cache, 3, 10, 3) != NULL || pmoq_cache_latest_group(cache, 3, &latest) == 0)) {
+        ret = -1;
+    }
+
+    /* Adding the same object again returns the cached copy */
+    if (ret == 0) {
+        size_t used = pmoq_cache_memory_used(cache);
+        if (pmoq_cache_test_add(cache, 1, 10, 3, 103) != pmoq_cache_get_object(cache, 1, 10, 3) ||
+            pmoq_cache_memory_used(cache) != used) {
+            ret = -1;
+        }
+    }
+
+    /* Payload received in pieces */
+    if (ret == 0) {
+        pmoq_cache_object_t* object;
+        uint8_t payload[300];
+
+        for (size_t i = 0; i < sizeof(payload); i++) {
+            payload[i] = (uint8_t)(1 + 11 + 9 + i);
+        }
+        pmoq_cache_test_header(&header, 1, 11, 9, sizeof(payload));
+        if ((object = pmoq_cache_start_object(cache, &header)) == NULL ||
+            pmoq_cache_object_is_complete(object) ||
+            pmoq_cache_append_object(object, payload, 100) != 0 ||
+            pmoq_cache_append_object(object, payload + 100, 200) != 0 ||
+            pmoq_cache_append_object(object, payload, 1) == 0 ||
+            pmoq_cache_test_check(cache, 1, 11, 9, sizeof(payload)) != 0) {
+            ret = -1;
+        }
+    }
+
+    /* A newer group replaces the group in the same ring slot; the
+     * payload remains valid while referenced */
+    if (ret == 0) {
+        pmoq_cache_object_t* object = pmoq_cache_get_object(cache, 2, 10, 5);
+        pmoq_cache_payload_t* payload = (object == NULL) ? NULL : object->payload;
+
+        pmoq_cache_payload_ref(payload);
+        if (payload == NULL || pmoq_cache_test_add(cache, 2, 14, 0, 10) == NULL ||
+            pmoq_cache_get_object(cache, 2, 10, 5) != NULL ||
+            pmoq_cache_test_check(cache, 2, 11, 5, 105) != 0 ||
+            pmoq_cache_test_check(cache, 2, 14, 0, 10) != 0 ||
+            payload->length != 105 || payload->data[0] != (uint8_t)(2 + 10 + 5)) {
+            ret = -1;
+        }
+        pmoq_cache_payload_unref(payload);
+        /* Groups older than the ring are not cached */
+        if (ret == 0 && pmoq_cache_test_add(cache, 2, 10, 1, 10) != NULL) {
+            ret = -1;
+        }
+    }
+
+    /* Object IDs too far apart */
+    if (ret == 0 && pmoq_cache_test_add(cache, 1, 10, PMOQ_CACHE_GROUP_OBJECTS_MAX + 10, 1) != NULL) {
+        ret = -1;
+    }
+
+    /* Many tracks, then removal of every other track */
+    for (uint64_t track_alias = 100; ret == 0 && track_alias < 1100; track_alias++) {
+        if (pmoq_cache_test_add(cache, track_alias, 1, 0, 1) == NULL) {
+            ret = -1;
+        }
+    }
+    for (uint64_t track_alias = 100; ret == 0 && track_alias < 1100; track_alias += 2) {
+        pmoq_cache_remove_track(cache, track_alias);
+    }
+    for (uint64_t track_alias = 100; ret == 0 && track_alias < 1100; track_alias++) {
+        if ((pmoq_cache_get_object(cache, track_alias, 1, 0) == NULL) != ((track_alias & 1) == 0)) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && pmoq_cache_test_check(cache, 1, 11, 9, 300) != 0) {
+        ret = -1;
+    }
+
+    pmoq_cache_delete(cache);
+
+    return ret;
+}
+
+int pmoq_cache_test_eviction()
+{
+    int ret = 0;
+    const size_t object_size = 1000;
+    const size_t budget = 20 * (object_size + PMOQ_CACHE_OBJECT_OVERHEAD);
+    pmoq_cache_t* cache = pmoq_cache_create(budget, 8);
+    pmoq_strm_t header;
+
+    if (cache == NULL) {
+        return -1;
+    }
+
+    /* Groups of 4 objects, alternating between 2 tracks. The budget holds
+     * 5 groups, so adding group N evicts the oldest. */
+    for (uint64_t group_id = 0; ret == 0 && group_id < 20; group_id++) {
+        uint64_t track_alias = 1 + (group_id & 1);
+
+        for (uint64_t object_id = 0; ret == 0 && object_id < 4; object_id++) {
+            if (pmoq_cache_test_add(cache, track_alias, group_id, object_id, object_size) == NULL ||
+                pmoq_cache_memory_used(cache) > budget) {
+                ret = -1;
+            }
+        }
+        for (uint64_t old_id = 0; ret == 0 && old_id <= group_id; old_id++) {
+            int is_cached = pmoq_cache_get_group(cache, 1 + (old_id & 1), old_id) != NULL;
+            if (is_cached != (old_id + 5 > group_id)) {
+                ret = -1;
+            }
+        }
+        if (ret != 0) {
+            printf("Cache eviction test fails, group %d\n", (int)group_id);
+        }
+    }
+
+    /* Too large for the budget */
+    if (ret == 0) {
+        pmoq_cache_test_header(&header, 3, 0, 0, budget);
+        if (pmoq_cache_start_object(cache, &header) != NULL ||
+            pmoq_cache_get_group(cache, 3, 0) != NULL) {
+            ret = -1;
+        }
+    }
+
+    pmoq_cache_delete(cache);
+
+    return ret;
+}
+
+int pmoq_cache_test_expiry()
+{
+    int ret = 0;
+    const uint64_t start_time = 1000000;
+    const uint64_t max_duration = 2000000;
+    pmoq_cache_t* cache = pmoq_cache_create(1000000, 8);
+
+    if (cache == NULL) {
+        return -1;
+    }
+
+    /* Track 1 keeps its groups for 2 seconds, track 2 without limit. One
+     * group of each track is added every 500 ms. */
+    if (pmoq_cache_set_max_duration(cache, 1, max_duration) != 0 ||
+        pmoq_cache_expire(cache, start_time) != 0 || pmoq_cache_next_expiry(cache) != UINT64_MAX) {
+        ret = -1;
+    }
+    for (uint64_t group_id = 0; ret == 0 && group_id < 6; group_id++) {
+        uint64_t current_time = start_time + group_id * 500000;
+        size_t expected = (current_time >= start_time + max_duration) ? 1 : 0;
+
+        if (pmoq_cache_expire(cache, current_time) != expected ||
+            pmoq_cache_test_add(cache, 1, group_id, 0, 10) == NULL ||
+            pmoq_cache_test_add(cache, 1, group_id, 1, 10) == NULL ||
+            pmoq_cache_test_add(cache, 2, group_id, 0, 10) == NULL) {
+            ret = -1;
+        }
+    }
+    /* At 3.5 s, groups 2 to 5 remain, the next to expire is group 2 */
+    if (ret == 0 && (pmoq_cache_get_group(cache, 1, 1) != NULL || pmoq_cache_get_group(cache, 1, 2) == NULL ||
+        pmoq_cache_get_group(cache, 2, 0) == NULL ||
+        pmoq_cache_next_expiry(cache) != start_time + 2 * 500000 + max_duration)) {
+        ret = -1;
+    }
+    /* Time going backwards does not expire anything */
+    if (ret == 0 && (pmoq_cache_expire(cache, start_time) != 0 || pmoq_cache_get_group(cache, 1, 2) == NULL)) {
+        ret = -1;
+    }
+    /* Objects added to a group later expire with the group */
+    if (ret == 0 && (pmoq_cache_test_add(cache, 1, 5, 2, 10) == NULL ||
+        pmoq_cache_expire(cache, start_time + 5 * 500000 + max_duration - 1) != 3 ||
+        pmoq_cache_get_object(cache, 1, 5, 2) == NULL ||
+        pmoq_cache_expire(cache, start_time + 5 * 500000 + max_duration) != 1 ||
+        pmoq_cache_get_group(cache, 1, 5) != NULL || pmoq_cache_next_expiry(cache) != UINT64_MAX ||
+        pmoq_cache_get_group(cache, 2, 5) == NULL)) {
+        ret = -1;
+    }
+    /* The duration only applies to the groups created after it is changed */
+    if (ret == 0 && (pmoq_cache_set_max_duration(cache, 2, 100) != 0 ||
+        pmoq_cache_test_add(cache, 2, 6, 0, 10) == NULL ||
+        pmoq_cache_expire(cache, start_time + 5 * 500000 + max_duration + 100) != 1 ||
+        pmoq_cache_get_group(cache, 2, 6) != NULL || pmoq_cache_get_group(cache, 2, 5) == NULL)) {
+        ret = -1;
+    }
+
+    pmoq_cache_delete(cache);
+
+    return ret;
+}
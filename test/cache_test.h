@@ -0,0 +1,20 @@
+#ifndef CACHE_TEST_H
+#define CACHE_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Objects shared by the cache and datagram tests, see cache_test.c.
+* The payload of each object is derived from its track alias, group id
+* and object id, and its publisher priority from its object id, so that
+* the checks only need the identifiers and the payload length.
+*/
+void pmoq_cache_test_header(pmoq_strm_t* header, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length);
+pmoq_cache_object_t* pmoq_cache_test_add(pmoq_cache_t* cache, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length);
+int pmoq_cache_test_check_object(const pmoq_cache_object_t* object, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHE_TEST_H */
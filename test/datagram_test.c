@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_datagram.h"
+#include "picomoq/picomoq_test.h"
+#include "cache_test.h"
+
+/* Object datagram tests
+*/
+
+/* Same objects as the cache tests, sent as datagrams */
+static void pmoq_dgram_test_header(pmoq_strm_t* header, uint64_t track_alias, uint64_t group_id, uint64_t object_id, uint64_t payload_length)
+{
+    pmoq_cache_test_header(header, track_alias, group_id, object_id, payload_length);
+    header->msg_type = PMOQ_STRM_OBJECT_DATAGRAM;
+    header->subscribe_id = 3;
+}
+
+/* Queue a cached object for sending. The object pointers are only valid
+ * until the next object is added to the cache. */
+static int pmoq_dgram_test_send(pmoq_dgram_t* dgram, pmoq_cache_object_t* object, uint64_t track_alias, uint64_t group_id)
+{
+    pmoq_strm_t header;
+
+    pmoq_dgram_test_header(&header, track_alias, group_id, object->object_id, object->payload_length);
+    return pmoq_dgram_send(dgram, &header, object->payload);
+}
+
+/* Objects go from the cache of a relay, through the datagram queue, to
+ * the cache of the next relay. The payloads stay valid in the queue after
+ * the source objects are evicted. */
+int pmoq_dgram_test_relay()
+{
+    int ret = 0;
+    const uint64_t lengths[] = { 1, 0, 100, 1000, 37 };
+    const size_t nb_objects = sizeof(lengths) / sizeof(uint64_t);
+    pmoq_cache_t* source = pmoq_cache_create(1000000, 4);
+    pmoq_cache_t* target = pmoq_cache_create(1000000, 4);
+    pmoq_dgram_t* sender = pmoq_dgram_create(NULL, 0, 1200);
+    pmoq_dgram_t* receiver = pmoq_dgram_create(NULL, 0, 1200);
+    pmoq_dgram_stats_t stats;
+    uint8_t packet[1500];
+
+    if (source == NULL || target == NULL || sender == NULL || receiver == NULL) {
+        ret = -1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < nb_objects; i++) {
+        pmoq_cache_object_t* object = pmoq_cache_test_add(source, 7, 2, i, lengths[i]);
+
+        if (object == NULL || pmoq_dgram_test_send(sender, object, 7, 2) != 0) {
+            ret = -1;
+        }
+    }
+    pmoq_cache_remove_track(source, 7);
+    if (ret == 0 && pmoq_dgram_count(sender) != nb_objects) {
+        ret = -1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < nb_objects; i++) {
+        size_t l = pmoq_dgram_next_size(sender);
+        uint8_t* bytes;
+
+        if (l == 0 || l > sizeof(packet) ||
+            pmoq_dgram_write_next(sender, packet, packet + l - 1) != NULL ||
+            (bytes = pmoq_dgram_write_next(sender, packet, packet + sizeof(packet))) != packet + l ||
+            pmoq_cache_test_check_object(pmoq_dgram_receive(receiver, target, packet, l), 7, 2, i, lengths[i]) != 0 ||
+            pmoq_cache_test_check_object(pmoq_cache_get_object(target, 7, 2, i), 7, 2, i, lengths[i]) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        pmoq_dgram_stats(sender, &stats);
+        if (pmoq_dgram_count(sender) != 0 || pmoq_dgram_next_size(sender) != 0 ||
+            pmoq_dgram_write_next(sender, packet, packet + sizeof(packet)) != NULL ||
+            stats.nb_queued != nb_objects || stats.nb_sent != nb_objects ||
+            stats.drops_too_large != 0 || stats.drops_congestion != 0) {
+            ret = -1;
+        }
+        pmoq_dgram_stats(receiver, &stats);
+        if (stats.nb_received != nb_objects || stats.drops_malformed != 0 || stats.drops_not_cached != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Datagram relay test fails\n");
+    }
+    pmoq_dgram_delete(sender);
+    pmoq_dgram_delete(receiver);
+    pmoq_cache_delete(source);
+    pmoq_cache_delete(target);
+
+    return ret;
+}
+
+int pmoq_dgram_test_drops()
+{
+    int ret = 0;
+    pmoq_cache_t* cache = pmoq_cache_create(1000000, 4);
+    pmoq_dgram_t* dgram = pmoq_dgram_create(NULL, 4, 500);
+    pmoq_dgram_stats_t stats;
+    uint8_t packet[1500];
+    size_t l = 0;
+
+    if (cache == NULL || dgram == NULL) {
+        ret = -1;
+    }
+    for (size_t i = 0; ret == 0 && i < 8; i++) {
+        if (pmoq_cache_test_add(cache, 1, 10, i, 100) == NULL) {
+            ret = -1;
+        }
+    }
+
+    /* Larger than the max datagram size */
+    if (ret == 0) {
+        pmoq_cache_object_t* large = pmoq_cache_test_add(cache, 1, 10, 8, 495);
+
+        if (large == NULL || pmoq_dgram_test_send(dgram, large, 1, 10) == 0 || pmoq_dgram_count(dgram) != 0) {
+            ret = -1;
+        }
+        pmoq_dgram_set_max_size(dgram, 1200);
+        if (ret == 0 && (pmoq_dgram_test_send(dgram, large, 1, 10) != 0 ||
+            (l = pmoq_dgram_next_size(dgram)) == 0 ||
+            pmoq_dgram_write_next(dgram, packet, packet + sizeof(packet)) != packet + l)) {
+            ret = -1;
+        }
+    }
+
+    /* The queue holds 4 datagrams, the oldest are dropped */
+    for (size_t i = 0; ret == 0 && i < 8; i++) {
+        if (pmoq_dgram_test_send(dgram, pmoq_cache_get_object(cache, 1, 10, i), 1, 10) != 0) {
+            ret = -1;
+        }
+    }
+    for (size_t i = 4; ret == 0 && i < 8; i++) {
+        pmoq_strm_t header;
+        int err = 0;
+
+        if ((l = pmoq_dgram_next_size(dgram)) == 0 ||
+            pmoq_dgram_write_next(dgram, packet, packet + sizeof(packet)) != packet + l ||
+            pmoq_strm_parse(packet, packet + l, &err, 0, &header) != packet + l - 100 ||
+            header.object_id != i) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        pmoq_dgram_stats(dgram, &stats);
+        if (stats.drops_too_large != 1 || stats.drops_congestion != 4 ||
+            stats.nb_queued != 9 || stats.nb_sent != 5 || pmoq_dgram_count(dgram) != 0) {
+            ret = -1;
+        }
+    }
+
+    /* Malformed: truncated, trailing bytes, other type */
+    if (ret == 0) {
+        pmoq_strm_t header;
+        uint8_t* bytes;
+
+        pmoq_dgram_test_header(&header, 2, 5, 0, 3);
+        if ((bytes = pmoq_strm_format(packet, packet + sizeof(packet), &header)) == NULL) {
+            ret = -1;
+        }
+        else {
+            l = bytes - packet + 3;
+            memset(bytes, 0x55, 4);
+            if (pmoq_dgram_receive(dgram, cache, packet, l - 1) != NULL ||
+                pmoq_dgram_receive(dgram, cache, packet, l + 1) != NULL ||
+                pmoq_dgram_receive(dgram, cache, packet, 2) != NULL ||
+                pmoq_dgram_receive(dgram, cache, packet, l) == NULL) {
+                ret = -1;
+            }
+        }
+        header.msg_type = PMOQ_STRM_HEADER_TRACK;
+        if (ret == 0 && ((bytes = pmoq_strm_format(packet, packet + sizeof(packet), &header)) == NULL ||
+            pmoq_dgram_receive(dgram, cache, packet, bytes - packet) != NULL)) {
+            ret = -1;
+        }
+    }
+
+    /* Not cached: group older than the ring */
+    if (ret == 0) {
+        pmoq_strm_t header;
+        uint8_t* bytes;
+
+        pmoq_dgram_test_header(&header, 1, 2, 0, 0);
+        if ((bytes = pmoq_strm_format(packet, packet + sizeof(packet), &header)) == NULL ||
+            pmoq_dgram_receive(dgram, cache, packet, bytes - packet) != NULL) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        pmoq_dgram_stats(dgram, &stats);
+        if (stats.drops_malformed != 4 || stats.drops_not_cached != 1 || stats.nb_received != 1) {
+            ret = -1;
+        }
+    }
+
+    /* Datagrams still queued release their payloads on delete */
+    for (size_t i = 0; ret == 0 && i < 3; i++) {
+        if (pmoq_dgram_test_send(dgram, pmoq_cache_get_object(cache, 1, 10, i), 1, 10) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Datagram drops test fails\n");
+    }
+    pmoq_dgram_delete(dgram);
+    pmoq_cache_delete(cache);
+
+    return ret;
+}
@@ -0,0 +1,363 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq.h"
+#include "picomoq/picomoq_test.h"
+#include "format_test.h"
+
+/* Micro benchmarks of the codec.
+* Each valid message of the test corpus and each stream header is
+* formatted and parsed a large number of times. The results are
+* reported per message, as a JSON document or as CSV lines, so they
+* can be compared between builds.
+*/
+
+typedef struct st_pmoq_bench_type_name_t {
+    uint64_t msg_type;
+    char const* name;
+} pmoq_bench_type_name_t;
+
+static const pmoq_bench_type_name_t pmoq_bench_msg_names[] = {
+    { PMOQ_MSG_SUBSCRIBE_UPDATE, "SUBSCRIBE_UPDATE" },
+    { PMOQ_MSG_SUBSCRIBE, "SUBSCRIBE" },
+    { PMOQ_MSG_SUBSCRIBE_OK, "SUBSCRIBE_OK" },
+    { PMOQ_MSG_SUBSCRIBE_ERROR, "SUBSCRIBE_ERROR" },
+    { PMOQ_MSG_ANNOUNCE, "ANNOUNCE" },
+    { PMOQ_MSG_ANNOUNCE_OK, "ANNOUNCE_OK" },
+    { PMOQ_MSG_ANNOUNCE_ERROR, "ANNOUNCE_ERROR" },
+    { PMOQ_MSG_UNANNOUNCE, "UNANNOUNCE" },
+    { PMOQ_MSG_UNSUBSCRIBE, "UNSUBSCRIBE" },
+    { PMOQ_MSG_SUBSCRIBE_DONE, "SUBSCRIBE_DONE" },
+    { PMOQ_MSG_ANNOUNCE_CANCEL, "ANNOUNCE_CANCEL" },
+    { PMOQ_MSG_TRACK_STATUS_REQUEST, "TRACK_STATUS_REQUEST" },
+    { PMOQ_MSG_TRACK_STATUS, "TRACK_STATUS" },
+    { PMOQ_MSG_GOAWAY, "GOAWAY" },
+    { PMOQ_MSG_SUBSCRIBE_NAMESPACE, "SUBSCRIBE_NAMESPACE" },
+    { PMOQ_MSG_SUBSCRIBE_NAMESPACE_OK, "SUBSCRIBE_NAMESPACE_OK" },
+    { PMOQ_MSG_SUBSCRIBE_NAMESPACE_ERROR, "SUBSCRIBE_NAMESPACE_ERROR" },
+    { PMOQ_MSG_UNSUBSCRIBE_NAMESPACE, "UNSUBSCRIBE_NAMESPACE" },
+    { PMOQ_MSG_MAX_SUBSCRIBE_ID, "MAX_SUBSCRIBE_ID" },
+    { PMOQ_MSG_CLIENT_SETUP, "CLIENT_SETUP" },
+    { PMOQ_MSG_SERVER_SETUP, "SERVER_SETUP" }
+};
+
+static const pmoq_bench_type_name_t pmoq_bench_strm_names[] = {
+    { PMOQ_STRM_OBJECT_DATAGRAM, "OBJECT_DATAGRAM" },
+    { PMOQ_STRM_HEADER_TRACK, "STREAM_HEADER_TRACK" },
+    { PMOQ_STRM_HEADER_SUBGROUP, "STREAM_HEADER_SUBGROUP" }
+};
+
+static char const* pmoq_bench_type_name(const pmoq_bench_type_name_t* names, size_t nb_names, uint64_t msg_type)
+{
+    char const* name = "UNKNOWN";
+
+    for (size_t i = 0; i < nb_names; i++) {
+        if (names[i].msg_type == msg_type) {
+            name = names[i].name;
+            break;
+        }
+    }
+    return name;
+}
+
+typedef struct st_pmoq_bench_ctx_t {
+    FILE* F;
+    int is_csv;
+    int nb_reported;
+    uint64_t nb_iterations;
+    /* Accumulated from the results, so the compiler cannot skip the calls */
+    uint64_t checksum;
+} pmoq_bench_ctx_t;
+
+static void pmoq_bench_report(pmoq_bench_ctx_t* ctx, char const* kind, char const* type_name, size_t case_rank,
+    char const* op, size_t msg_len, uint64_t elapsed_us)
+{
+    double elapsed_s = (elapsed_us == 0) ? 1e-6 : ((double)elapsed_us) / 1000000.0;
+    double ns_per_op = (elapsed_s * 1e9) / (double)ctx->nb_iterations;
+    double msgs_per_s = ((double)ctx->nb_iterations) / elapsed_s;
+    double bytes_per_s = msgs_per_s * (double)msg_len;
+
+    if (ctx->is_csv) {
+        fprintf(ctx->F, "%s,%s,%zu,%s,%zu,%.2f,%.0f,%.0f\n", kind, type_name, case_rank, op, msg_len,
+            ns_per_op, msgs_per_s, bytes_per_s);
+    }
+    else {
+        fprintf(ctx->F, "%s    { \"kind\": \"%s\", \"type\": \"%s\", \"case\": %zu, \"op\": \"%s\", \"bytes\": %zu, ",
+            (ctx->nb_reported > 0) ? ",\n" : "", kind, type_name, case_rank, op, msg_len);
+        fprintf(ctx->F, "\"ns_per_op\": %.2f, \"msgs_per_s\": %.0f, \"bytes_per_s\": %.0f }",
+            ns_per_op, msgs_per_s, bytes_per_s);
+    }
+    ctx->nb_reported++;
+}
+
+static int pmoq_bench_msg_one(pmoq_bench_ctx_t* ctx, size_t case_rank)
+{
+    int ret = 0;
+    pmoq_msg_format_test_case_t* test = &format_test_cases[case_rank];
+    char const* type_name = pmoq_bench_type_name(pmoq_bench_msg_names,
+        sizeof(pmoq_bench_msg_names) / sizeof(pmoq_bench_type_name_t), test->msg_type);
+    pmoq_msg_t msg = { 0 };
+    pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
+    uint8_t buf[2048];
+    size_t format_len = 0;
+    uint64_t start_time;
+    pmoq_msg_parser_t* parser = NULL;
+
+    if (pmoq_test_set_msg_from_test(&msg, test) != 0 ||
+        (parser = pmoq_msg_parser_create()) == NULL) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+            uint8_t* bytes = pmoq_msg_format(buf, buf + sizeof(buf), &msg);
+            if (bytes == NULL) {
+                ret = -1;
+                break;
+            }
+            format_len = bytes - buf;
+            ctx->checksum += format_len;
+        }
+        /* Alternate encodings are formatted to the target encoding, which may be shorter */
+        pmoq_bench_report(ctx, "msg", type_name, case_rank, "format", format_len, picoquic_current_time() - start_time);
+    }
+
+    if (ret == 0) {
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+            int err = 0;
+            pmoq_msg_t parsed = { 0 };
+            const uint8_t* bytes;
+
+            parsed.namespace_items = namespace_items;
+            parsed.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
+            bytes = pmoq_msg_parse(test->msg, test->msg + test->msg_len, &err, 0, &parsed);
+            if (bytes == NULL) {
+                ret = -1;
+                break;
+            }
+            ctx->checksum += parsed.msg_type;
+        }
+        pmoq_bench_report(ctx, "msg", type_name, case_rank, "parse", test->msg_len, picoquic_current_time() - start_time);
+    }
+
+    if (ret == 0) {
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+            int err = 0;
+            const pmoq_msg_t* parsed;
+            if (pmoq_msg_parser_feed(parser, test->msg, test->msg + test->msg_len, &err) == NULL ||
+                (parsed = pmoq_msg_parser_next(parser)) == NULL) {
+                ret = -1;
+                break;
+            }
+            ctx->checksum += parsed->msg_type;
+        }
+        pmoq_bench_report(ctx, "msg", type_name, case_rank, "stream_parse", test->msg_len, picoquic_current_time() - start_time);
+    }
+
+    if (parser != NULL) {
+        pmoq_msg_parser_delete(parser);
+    }
+
+    return ret;
+}
+
+static int pmoq_bench_strm_one(pmoq_bench_ctx_t* ctx, size_t case_rank)
+{
+    int ret = 0;
+    pmoq_strm_t* strm = &format_test_strm[case_rank];
+    char const* type_name = pmoq_bench_type_name(pmoq_bench_strm_names,
+        sizeof(pmoq_bench_strm_names) / sizeof(pmoq_bench_type_name_t), strm->msg_type);
+    static const pmoq_varint_decoder_enum decoders[] = { pmoq_varint_decoder_scalar, pmoq_varint_decoder_swar };
+    static char const* decoder_ops[] = { "parse_scalar", "parse_swar" };
+    uint8_t buf[256] = { 0 };
+    uint8_t* bytes_max = pmoq_strm_format(buf, buf + sizeof(buf), strm);
+    size_t msg_len;
+    uint64_t start_time;
+
+    if (bytes_max == NULL) {
+        return -1;
+    }
+    msg_len = bytes_max - buf;
+
+    start_time = picoquic_current_time();
+    for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+        uint8_t* bytes = pmoq_strm_format(buf, buf + sizeof(buf), strm);
+        if (bytes == NULL) {
+            ret = -1;
+            break;
+        }
+        ctx->checksum += bytes - buf;
+    }
+    pmoq_bench_report(ctx, "strm", type_name, case_rank, "format", msg_len, picoquic_current_time() - start_time);
+
+    /* Object headers are parsed with each of the fast path decoders */
+    for (size_t d = 0; ret == 0 && d < sizeof(decoders) / sizeof(decoders[0]); d++) {
+        (void)pmoq_varint_decoder_select(decoders[d]);
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+            int err = 0;
+            pmoq_strm_t parsed = { 0 };
+            if (pmoq_strm_parse(buf, buf + sizeof(buf), &err, 0, &parsed) == NULL) {
+                ret = -1;
+                break;
+            }
+            ctx->checksum += parsed.group_id;
+        }
+        pmoq_bench_report(ctx, "strm", type_name, case_rank, decoder_ops[d], msg_len, picoquic_current_time() - start_time);
+    }
+    (void)pmoq_varint_decoder_select(pmoq_varint_decoder_auto);
+
+    return ret;
+}
+
+/* A subgroup stream chunk holding many small objects, as for audio
+* frames, parsed in a single batch call per iteration.
+*/
+#define PMOQ_BENCH_BATCH_OBJECTS 32
+#define PMOQ_BENCH_BATCH_PAYLOAD 40
+
+static int pmoq_bench_subgroup_batch(pmoq_bench_ctx_t* ctx)
+{
+    int ret = 0;
+    uint8_t buf[PMOQ_BENCH_BATCH_OBJECTS * (PMOQ_BENCH_BATCH_PAYLOAD + 16)];
+    uint8_t* bytes = buf;
+    pmoq_strm_object_ref_t objects[PMOQ_BENCH_BATCH_OBJECTS];
+    uint64_t start_time;
+
+    for (uint64_t i = 0; bytes != NULL && i < PMOQ_BENCH_BATCH_OBJECTS; i++) {
+        if ((bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), 1000 + i)) != NULL &&
+            (bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), PMOQ_BENCH_BATCH_PAYLOAD)) != NULL) {
+            memset(bytes, (uint8_t)i, PMOQ_BENCH_BATCH_PAYLOAD);
+            bytes += PMOQ_BENCH_BATCH_PAYLOAD;
+        }
+    }
+    if (bytes == NULL) {
+        return -1;
+    }
+
+    start_time = picoquic_current_time();
+    for (uint64_t i = 0; i < ctx->nb_iterations; i++) {
+        int err = 0;
+        size_t nb_objects = 0;
+        if (pmoq_strm_subgroup_parse_batch(buf, bytes, &err, objects, PMOQ_BENCH_BATCH_OBJECTS, &nb_objects) != bytes ||
+            nb_objects != PMOQ_BENCH_BATCH_OBJECTS) {
+            ret = -1;
+            break;
+        }
+        ctx->checksum += objects[nb_objects - 1].payload_offset;
+    }
+    pmoq_bench_report(ctx, "strm", "SUBGROUP_OBJECTS_X32", 0, "parse_batch", bytes - buf, picoquic_current_time() - start_time);
+
+    return ret;
+}
+
+/* A large video object sent on a subgroup stream, formatted either by
+* copying the payload behind the header, or as a header and a payload
+* reference.
+*/
+#define PMOQ_BENCH_VIDEO_OBJECT 262144
+
+static int pmoq_bench_object_iov(pmoq_bench_ctx_t* ctx)
+{
+    int ret = 0;
+    uint8_t* payload = (uint8_t*)malloc(PMOQ_BENCH_VIDEO_OBJECT);
+    uint8_t* buf = (uint8_t*)malloc(PMOQ_STRM_HEADER_SIZE_MAX + PMOQ_BENCH_VIDEO_OBJECT);
+    pmoq_strm_t object = { 0 };
+    uint64_t start_time;
+    uint64_t nb_iterations = (ctx->nb_iterations + 999) / 1000;
+    uint64_t saved_iterations = ctx->nb_iterations;
+
+    if (payload == NULL || buf == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(payload, 0x5a, PMOQ_BENCH_VIDEO_OBJECT);
+        object.object_id = 1234;
+        object.payload_length = PMOQ_BENCH_VIDEO_OBJECT;
+        /* Large copies are slow, run a thousand times fewer iterations */
+        ctx->nb_iterations = nb_iterations;
+
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; i < nb_iterations; i++) {
+            uint8_t* bytes = pmoq_strm_object_subgroup_format(buf, buf + PMOQ_STRM_HEADER_SIZE_MAX, &object);
+            if (bytes == NULL) {
+                ret = -1;
+                break;
+            }
+            memcpy(bytes, payload, PMOQ_BENCH_VIDEO_OBJECT);
+            ctx->checksum += bytes[i % PMOQ_BENCH_VIDEO_OBJECT];
+        }
+        pmoq_bench_report(ctx, "strm", "SUBGROUP_OBJECT_256K", 0, "format_copy", PMOQ_BENCH_VIDEO_OBJECT,
+            picoquic_current_time() - start_time);
+
+        start_time = picoquic_current_time();
+        for (uint64_t i = 0; ret == 0 && i < nb_iterations; i++) {
+            pmoq_iovec_t iov[2];
+            size_t nb_iov;
+            if (pmoq_strm_object_subgroup_format_iov(buf, buf + PMOQ_STRM_HEADER_SIZE_MAX, &object, payload, iov, &nb_iov) == NULL) {
+                ret = -1;
+                break;
+            }
+            ctx->checksum += iov[nb_iov - 1].len;
+        }
+        pmoq_bench_report(ctx, "strm", "SUBGROUP_OBJECT_256K", 0, "format_iov", PMOQ_BENCH_VIDEO_OBJECT,
+            picoquic_current_time() - start_time);
+        ctx->nb_iterations = saved_iterations;
+    }
+
+    if (payload != NULL) {
+        free(payload);
+    }
+    if (buf != NULL) {
+        free(buf);
+    }
+    return ret;
+}
+
+int pmoq_format_bench(FILE* F, uint64_t nb_iterations, int is_csv)
+{
+    int ret = 0;
+    pmoq_bench_ctx_t ctx = { 0 };
+
+    ctx.F = F;
+    ctx.is_csv = is_csv;
+    ctx.nb_iterations = (nb_iterations == 0) ? 1 : nb_iterations;
+
+    if (is_csv) {
+        fprintf(F, "kind,type,case,op,bytes,ns_per_op,msgs_per_s,bytes_per_s\n");
+    }
+    else {
+        fprintf(F, "{\n  \"iterations\": %" PRIu64 ",\n  \"results\": [\n", ctx.nb_iterations);
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_cases_nb; i++) {
+        if (format_test_cases[i].mode != pmoq_msg_test_mode_error) {
+            ret = pmoq_bench_msg_one(&ctx, i);
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_strm_nb; i++) {
+        ret = pmoq_bench_strm_one(&ctx, i);
+    }
+
+    if (ret == 0) {
+        ret = pmoq_bench_subgroup_batch(&ctx);
+    }
+
+    if (ret == 0) {
+        ret = pmoq_bench_object_iov(&ctx);
+    }
+
+    if (!is_csv) {
+        fprintf(F, "\n  ],\n  \"checksum\": %" PRIu64 ",\n  \"status\": %d\n}\n", ctx.checksum, ret);
+    }
+
+    return ret;
+}
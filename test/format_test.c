@@ -1,43 +1,12 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <picoquic.h>
 #include <picoquic_utils.h>
 #include "picomoq.h"
-
-/* Testing the formats
-* Each test case includes:
-* - A message type.
-* - A message encoding in binary.
-* - The value of the key specific type, cast as (void *)
-* - Whether the binary is the target encoding (0) , an alternate (1), or an error (2).
-*/
-
-typedef struct st_format_test_val_t {
-    char* t_name;
-    char* t_val;
-} format_test_val_t;
-
-#define FVAL(x, y) { #x, #y }
-
-typedef struct st_pmoq_msg_format_test_case_t {
-    uint64_t msg_type;
-    size_t msg_len;
-    uint8_t *msg;
-    format_test_val_t* ref_val;
-    size_t ref_val_size;
-#define pmoq_msg_test_mode_target 0
-#define pmoq_msg_test_mode_alternate 1
-#define pmoq_msg_test_mode_error 2
-    unsigned int mode;
-} pmoq_msg_format_test_case_t;
-
-#define FORMAT_TEST_CASE_OK(msg_type, msg, ref) \
-    { msg_type, sizeof(msg), msg, ref, sizeof(ref), pmoq_msg_test_mode_target }
-#define FORMAT_TEST_CASE_ALT(msg_type, msg, ref) \
-    { msg_type, sizeof(msg), msg, ref, sizeof(ref), pmoq_msg_test_mode_alternate }
-#define FORMAT_TEST_CASE_ERR(msg_type, msg) \
-    { msg_type, sizeof(msg), msg, NULL, 0, pmoq_msg_test_mode_error }
+#include "picomoq/picomoq_test.h"
+#include "format_test.h"
 
 /* Defining a set of message values used for testing */
 
@@ -67,6 +36,9 @@ static uint8_t test_auth[] = { TEST_AUTH };
 #define test_param_grease1 0x60, 0x01, TEST_PATH_LEN, TEST_PATH
 #define test_param_grease2 0x60, 0x02, 1, 1
 #define test_param_auth PMOQ_PARAMETER_AUTHORIZATION_INFO, TEST_AUTH_LEN, TEST_AUTH
+#define test_param_delivery_500 PMOQ_PARAMETER_DELIVERY_TIMEOUT, 2, 0x41, 0xf4
+#define test_param_delivery_bad PMOQ_PARAMETER_DELIVERY_TIMEOUT, 3, 0x41, 0xf4, 0
+#define test_param_cache_60000 PMOQ_PARAMETER_MAX_CACHE_DURATION, 4, 0x80, 0, 0xea, 0x60
 
 format_test_val_t subscribe[] = {
     FVAL(subscribe_id, 31),
@@ -147,6 +119,62 @@ uint8_t test_msg_subscribe_range[] = {
     test_param_auth
 };
 
+format_test_val_t subscribe_timeouts[] = {
+    FVAL(subscribe_id, 31),
+    FVAL(track_alias, 17),
+    FVAL(track_namespace, path),
+    FVAL(track_name, track),
+    FVAL(filter_type, pmoq_msg_filter_latest_object),
+    FVAL(auth_info, auth),
+    FVAL(delivery_timeout, 500),
+    FVAL(max_cache_duration, 60000)
+};
+
+uint8_t test_msg_subscribe_timeouts[] = {
+    PMOQ_MSG_SUBSCRIBE,
+    31,
+    17,
+    1,
+    TEST_PATH_LEN*8,
+    TEST_PATH,
+    TEST_TRACK_NAME_LEN*8,
+    TEST_TRACK_NAME,
+    pmoq_msg_filter_latest_object,
+    3,
+    test_param_auth,
+    test_param_delivery_500,
+    test_param_cache_60000
+};
+
+uint8_t test_msg_subscribe_timeout_twice[] = {
+    PMOQ_MSG_SUBSCRIBE,
+    31,
+    17,
+    1,
+    TEST_PATH_LEN*8,
+    TEST_PATH,
+    TEST_TRACK_NAME_LEN*8,
+    TEST_TRACK_NAME,
+    pmoq_msg_filter_latest_object,
+    2,
+    test_param_delivery_500,
+    test_param_delivery_500
+};
+
+uint8_t test_msg_subscribe_timeout_bad[] = {
+    PMOQ_MSG_SUBSCRIBE,
+    31,
+    17,
+    1,
+    TEST_PATH_LEN*8,
+    TEST_PATH,
+    TEST_TRACK_NAME_LEN*8,
+    TEST_TRACK_NAME,
+    pmoq_msg_filter_latest_object,
+    1,
+    test_param_delivery_bad
+};
+
 #if 0
 /* TODO: parser and test cases for subscribe update. */
 
@@ -601,6 +629,9 @@ pmoq_msg_format_test_case_t format_test_cases[] = {
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe, subscribe),
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe_start, subscribe_start),
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe_range, subscribe_range),
+    FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe_timeouts, subscribe_timeouts),
+    FORMAT_TEST_CASE_ERR(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe_timeout_twice),
+    FORMAT_TEST_CASE_ERR(PMOQ_MSG_SUBSCRIBE, test_msg_subscribe_timeout_bad),
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE_UPDATE, test_msg_subscribe_update, subscribe_update),
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE_OK, test_msg_subscribe_ok, subscribe_ok),
     FORMAT_TEST_CASE_OK(PMOQ_MSG_SUBSCRIBE_OK, test_msg_subscribe_ok_empty, subscribe_ok_empty),
@@ -718,46 +749,150 @@ int pmoq_subscribe_parameters_cmp(const pmoq_subscribe_parameters_t* param, cons
     else if (param->auth_info != NULL || param_ref->auth_info != NULL) {
         ret = -1;
     }
+    if (ret == 0 && (param->has_delivery_timeout != param_ref->has_delivery_timeout ||
+        param->delivery_timeout != param_ref->delivery_timeout ||
+        param->has_max_cache_duration != param_ref->has_max_cache_duration ||
+        param->max_cache_duration != param_ref->max_cache_duration)) {
+        ret = -1;
+    }
     return ret;
 }
 
-int mpoq_test_msg_compare(const pmoq_msg_t* msg, const pmoq_msg_t* msg2)
+/* Location of the named test values in the message structures.
+ * Message types that share a structure are listed once, see
+ * pmoq_test_msg_layout_type().
+ */
+typedef enum {
+    pmoq_test_field_u64 = 0,
+    pmoq_test_field_u32,
+    pmoq_test_field_u8,
+    pmoq_test_field_bits,
+    pmoq_test_field_tuple,
+    pmoq_test_field_versions,
+    pmoq_test_field_auth_info,
+    pmoq_test_field_delivery_timeout,
+    pmoq_test_field_max_cache_duration,
+    pmoq_test_field_path
+} pmoq_test_field_kind_t;
+
+typedef struct st_pmoq_test_field_t {
+    uint64_t msg_type;
+    char const* name;
+    pmoq_test_field_kind_t kind;
+    size_t offset;
+} pmoq_test_field_t;
+
+#define TFIELD(t, k, m, f) { t, #f, pmoq_test_field_##k, offsetof(pmoq_msg_t, u.m.f) }
+#define TFIELD_N(t, n, k, m, f) { t, #n, pmoq_test_field_##k, offsetof(pmoq_msg_t, u.m.f) }
+
+static const pmoq_test_field_t test_fields[] = {
+    TFIELD(PMOQ_MSG_SUBSCRIBE_UPDATE, u64, subscribe_update, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_UPDATE, u64, subscribe_update, start_group),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_UPDATE, u64, subscribe_update, start_object),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_UPDATE, u64, subscribe_update, end_group),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_UPDATE, u64, subscribe_update, end_object),
+    TFIELD_N(PMOQ_MSG_SUBSCRIBE_UPDATE, auth_info, auth_info, subscribe_update, subscribe_parameters),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, track_alias),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, tuple, subscribe, track_namespace),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, bits, subscribe, track_name),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, filter_type),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, start_group),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, start_object),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, end_group),
+    TFIELD(PMOQ_MSG_SUBSCRIBE, u64, subscribe, end_object),
+    TFIELD_N(PMOQ_MSG_SUBSCRIBE, auth_info, auth_info, subscribe, subscribe_parameters),
+    TFIELD_N(PMOQ_MSG_SUBSCRIBE, delivery_timeout, delivery_timeout, subscribe, subscribe_parameters),
+    TFIELD_N(PMOQ_MSG_SUBSCRIBE, max_cache_duration, max_cache_duration, subscribe, subscribe_parameters),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_OK, u64, subscribe_ok, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_OK, u64, subscribe_ok, expires),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_OK, u8, subscribe_ok, content_exists),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_OK, u64, subscribe_ok, largest_group_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_OK, u64, subscribe_ok, largest_object_id),
+    TFIELD_N(PMOQ_MSG_SUBSCRIBE_OK, auth_info, auth_info, subscribe_ok, subscribe_parameters),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_ERROR, u64, subscribe_error, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_ERROR, u64, subscribe_error, error_code),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_ERROR, bits, subscribe_error, reason_phrase),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_ERROR, u64, subscribe_error, track_alias),
+    TFIELD(PMOQ_MSG_ANNOUNCE, tuple, announce, track_namespace),
+    TFIELD_N(PMOQ_MSG_ANNOUNCE, auth_info, auth_info, announce, subscribe_parameters),
+    TFIELD(PMOQ_MSG_ANNOUNCE_OK, tuple, announce_ok, track_namespace),
+    TFIELD(PMOQ_MSG_ANNOUNCE_ERROR, tuple, announce_error, track_namespace),
+    TFIELD(PMOQ_MSG_ANNOUNCE_ERROR, u64, announce_error, error_code),
+    TFIELD(PMOQ_MSG_ANNOUNCE_ERROR, bits, announce_error, reason_phrase),
+    TFIELD(PMOQ_MSG_UNSUBSCRIBE, u64, unsubscribe, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, u64, subscribe_done, subscribe_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, u64, subscribe_done, status_code),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, bits, subscribe_done, reason_phrase),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, u8, subscribe_done, content_exists),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, u64, subscribe_done, final_group_id),
+    TFIELD(PMOQ_MSG_SUBSCRIBE_DONE, u64, subscribe_done, final_object_id),
+    TFIELD(PMOQ_MSG_TRACK_STATUS_REQUEST, tuple, track_status_request, track_namespace),
+    TFIELD(PMOQ_MSG_TRACK_STATUS_REQUEST, bits, track_status_request, track_name),
+    TFIELD(PMOQ_MSG_TRACK_STATUS, tuple, track_status, track_namespace),
+    TFIELD(PMOQ_MSG_TRACK_STATUS, bits, track_status, track_name),
+    TFIELD(PMOQ_MSG_TRACK_STATUS, u64, track_status, status_code),
+    TFIELD(PMOQ_MSG_TRACK_STATUS, u64, track_status, last_group_id),
+    TFIELD(PMOQ_MSG_TRACK_STATUS, u64, track_status, last_object_id),
+    TFIELD(PMOQ_MSG_GOAWAY, bits, goaway, uri),
+    TFIELD_N(PMOQ_MSG_CLIENT_SETUP, versions, versions, client_setup, supported_versions_nb),
+    TFIELD_N(PMOQ_MSG_CLIENT_SETUP, role, u8, client_setup, setup_parameters.role),
+    TFIELD_N(PMOQ_MSG_CLIENT_SETUP, path, path, client_setup, setup_parameters),
+    TFIELD(PMOQ_MSG_SERVER_SETUP, u32, server_setup, selected_version),
+    TFIELD_N(PMOQ_MSG_SERVER_SETUP, role, u8, server_setup, setup_parameters.role),
+    TFIELD_N(PMOQ_MSG_SERVER_SETUP, path, path, server_setup, setup_parameters)
+};
+
+static const size_t test_fields_nb = sizeof(test_fields) / sizeof(pmoq_test_field_t);
+
+uint64_t pmoq_test_msg_layout_type(uint64_t msg_type)
+{
+    switch (msg_type) {
+    case PMOQ_MSG_SUBSCRIBE_NAMESPACE:
+        msg_type = PMOQ_MSG_ANNOUNCE;
+        break;
+    case PMOQ_MSG_UNANNOUNCE:
+    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_OK:
+    case PMOQ_MSG_UNSUBSCRIBE_NAMESPACE:
+        msg_type = PMOQ_MSG_ANNOUNCE_OK;
+        break;
+    case PMOQ_MSG_ANNOUNCE_CANCEL:
+    case PMOQ_MSG_SUBSCRIBE_NAMESPACE_ERROR:
+        msg_type = PMOQ_MSG_ANNOUNCE_ERROR;
+        break;
+    case PMOQ_MSG_MAX_SUBSCRIBE_ID:
+        msg_type = PMOQ_MSG_UNSUBSCRIBE;
+        break;
+    default:
+        break;
+    }
+    return msg_type;
+}
+
+const pmoq_test_field_t* pmoq_test_find_field(uint64_t msg_type, char const* name)
+{
+    const pmoq_test_field_t* field = NULL;
+
+    msg_type = pmoq_test_msg_layout_type(msg_type);
+    for (size_t i = 0; i < test_fields_nb; i++) {
+        if (test_fields[i].msg_type == msg_type && strcmp(test_fields[i].name, name) == 0) {
+            field = &test_fields[i];
+            break;
+        }
+    }
+    return field;
+}
+
+int pmoq_test_versions_cmp(const pmoq_client_setup_t* client_setup, const pmoq_client_setup_t* client_setup_ref)
 {
     int ret = 0;
-    if (msg->msg_type != msg2->msg_type ||
-        pmoq_tuple_cmp(&msg->track_namespace, &msg2->track_namespace) != 0 ||
-        pmoq_bits_cmp(&msg->track_name, &msg2->track_name) != 0 ||
-        msg->subscribe_id != msg2->subscribe_id ||
-        msg->track_alias != msg2->track_alias ||
-#if 0
-        msg->group_id != msg2->group_id ||
-        msg->object_send_order != msg2->object_send_order ||
-        msg->object_status != msg2->object_status ||
-#endif
-        msg->filter_type != msg2->filter_type ||
-        msg->expires != msg2->expires ||
-        msg->content_exists != msg2->content_exists ||
-        msg->error_code != msg2->error_code ||
-        msg->status_code != msg2->status_code ||
-        msg->start_group != msg2->start_group ||
-        msg->start_object != msg2->start_object ||
-        msg->end_group != msg2->end_group ||
-        msg->largest_group_id != msg2->largest_group_id ||
-        msg->largest_object_id != msg2->largest_object_id ||
-        msg->last_group_id != msg2->last_group_id ||
-        msg->last_object_id != msg2->last_object_id ||
-        msg->final_group_id != msg2->final_group_id ||
-        msg->final_object_id != msg2->final_object_id ||
-        pmoq_bits_cmp(&msg->reason_phrase, &msg2->reason_phrase) != 0 ||
-        pmoq_bits_cmp(&msg->uri, &msg2->uri) != 0 ||
-        pmoq_subscribe_parameters_cmp(&msg->subscribe_parameters, &msg2->subscribe_parameters) != 0 ||
-        pmoq_msg_setup_parameters_cmp(&msg->setup_parameters, &msg2->setup_parameters) != 0 ||
-        msg->selected_version != msg2->selected_version ||
-        msg->supported_versions_nb != msg2->supported_versions_nb) {
+
+    if (client_setup->supported_versions_nb != client_setup_ref->supported_versions_nb) {
         ret = -1;
-    } else {
-        for (uint64_t i = 0; i < msg->supported_versions_nb; i++) {
-            if (msg->supported_versions[i] != msg2->supported_versions[i]) {
+    }
+    else {
+        for (uint64_t i = 0; i < client_setup->supported_versions_nb; i++) {
+            if (client_setup->supported_versions[i] != client_setup_ref->supported_versions[i]) {
                 ret = -1;
                 break;
             }
@@ -766,6 +901,57 @@ int mpoq_test_msg_compare(const pmoq_msg_t* msg, const pmoq_msg_t* msg2)
     return ret;
 }
 
+int mpoq_test_msg_compare(const pmoq_msg_t* msg, const pmoq_msg_t* msg2)
+{
+    int ret = 0;
+    uint64_t layout_type = pmoq_test_msg_layout_type(msg->msg_type);
+
+    if (msg->msg_type != msg2->msg_type) {
+        ret = -1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < test_fields_nb; i++) {
+        const uint8_t* v = ((const uint8_t*)msg) + test_fields[i].offset;
+        const uint8_t* v2 = ((const uint8_t*)msg2) + test_fields[i].offset;
+
+        if (test_fields[i].msg_type != layout_type) {
+            continue;
+        }
+        switch (test_fields[i].kind) {
+        case pmoq_test_field_u64:
+            ret = (*(const uint64_t*)v == *(const uint64_t*)v2) ? 0 : -1;
+            break;
+        case pmoq_test_field_u32:
+            ret = (*(const uint32_t*)v == *(const uint32_t*)v2) ? 0 : -1;
+            break;
+        case pmoq_test_field_u8:
+            ret = (*v == *v2) ? 0 : -1;
+            break;
+        case pmoq_test_field_bits:
+            ret = pmoq_bits_cmp((const pmoq_bits_t*)v, (const pmoq_bits_t*)v2);
+            break;
+        case pmoq_test_field_tuple:
+            ret = pmoq_tuple_cmp((const pmoq_tuple_t*)v, (const pmoq_tuple_t*)v2);
+            break;
+        case pmoq_test_field_versions:
+            ret = pmoq_test_versions_cmp((const pmoq_client_setup_t*)v, (const pmoq_client_setup_t*)v2);
+            break;
+        case pmoq_test_field_auth_info:
+        case pmoq_test_field_delivery_timeout:
+        case pmoq_test_field_max_cache_duration:
+            ret = pmoq_subscribe_parameters_cmp((const pmoq_subscribe_parameters_t*)v, (const pmoq_subscribe_parameters_t*)v2);
+            break;
+        case pmoq_test_field_path:
+            ret = pmoq_msg_setup_parameters_cmp((const pmoq_setup_parameters_t*)v, (const pmoq_setup_parameters_t*)v2);
+            break;
+        default:
+            ret = -1;
+            break;
+        }
+    }
+    return ret;
+}
+
 
 int mpoq_test_strm_compare(const pmoq_strm_t* msg, const pmoq_strm_t* msg2)
 {
@@ -804,12 +990,25 @@ int pmoq_test_set_bits(pmoq_bits_t* v, char* val)
     return ret;
 }
 
+/* Tuple items are kept in a separate array, one per test value */
+static pmoq_bits_t test_tuple_path[] = { { TEST_PATH_LEN * 8, test_path } };
+static pmoq_bits_t test_tuple_track[] = { { TEST_TRACK_NAME_LEN * 8, test_track_name } };
+
 int pmoq_test_set_tuple(pmoq_tuple_t* v, char* val)
 {
     int ret = 0;
 
     v->nb_items = 1;
-    ret = pmoq_test_set_bits(&v->items[0], val);
+    v->items_max = 1;
+    if (strcmp(val, "path") == 0) {
+        v->items = test_tuple_path;
+    }
+    else if (strcmp(val, "track") == 0) {
+        v->items = test_tuple_track;
+    }
+    else {
+        ret = -1;
+    }
     return ret;
 }
 
@@ -915,11 +1114,11 @@ int pmoq_test_set_u8(uint8_t * role, char* val)
     return ret;
 }
 
-int pmoq_test_set_versions(pmoq_msg_t *msg)
+int pmoq_test_set_versions(pmoq_client_setup_t* client_setup)
 {
-    msg->supported_versions_nb = 2;
-    msg->supported_versions[0] = 1;
-    msg->supported_versions[1] = 2;
+    client_setup->supported_versions_nb = 2;
+    client_setup->supported_versions[0] = 1;
+    client_setup->supported_versions[1] = 2;
     return 0;
 }
 
@@ -948,90 +1147,58 @@ int pmoq_test_set_msg_from_test(pmoq_msg_t *msg, pmoq_msg_format_test_case_t* te
     msg->msg_type = test->msg_type;
 
     for (size_t i = 0; ret == 0 &&  i < nb_vals; i++) {
-        if (strcmp(test->ref_val[i].t_name, "track_namespace") == 0) {
-            ret = pmoq_test_set_tuple(&msg->track_namespace, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "track_name") == 0) {
-            ret = pmoq_test_set_bits(&msg->track_name, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "subscribe_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->subscribe_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "track_alias") == 0) {
-            ret = pmoq_test_set_u64(&msg->track_alias, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "filter_type") == 0) {
-            ret = pmoq_test_set_u64(&msg->filter_type, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "expires") == 0) {
-            ret = pmoq_test_set_u64(&msg->expires, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "content_exists") == 0) {
-            ret = pmoq_test_set_u8(&msg->content_exists, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "error_code") == 0) {
-            ret = pmoq_test_set_u64(&msg->error_code, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "status_code") == 0) {
-            ret = pmoq_test_set_u64(&msg->status_code, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "start_group") == 0) {
-            ret = pmoq_test_set_u64(&msg->start_group, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "start_object") == 0) {
-            ret = pmoq_test_set_u64(&msg->start_object, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "end_group") == 0) {
-            ret = pmoq_test_set_u64(&msg->end_group, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "end_object") == 0) {
-            ret = pmoq_test_set_u64(&msg->end_object, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "largest_group_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->largest_group_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "largest_object_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->largest_object_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "last_group_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->last_group_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "last_object_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->last_object_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "final_group_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->final_group_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "final_object_id") == 0) {
-            ret = pmoq_test_set_u64(&msg->final_object_id, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "reason_phrase") == 0) {
-            ret = pmoq_test_set_bits(&msg->reason_phrase, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "uri") == 0) {
-            ret = pmoq_test_set_bits(&msg->uri, test->ref_val[i].t_val);
-        }
-        else if (strcmp(test->ref_val[i].t_name, "auth_info") == 0) {
-            ret = pmoq_test_set_string(&msg->subscribe_parameters.auth_info,
-                &msg->subscribe_parameters.auth_info_len,
-                test->ref_val[i].t_val);
+        const pmoq_test_field_t* field = pmoq_test_find_field(msg->msg_type, test->ref_val[i].t_name);
+        uint8_t* v = ((uint8_t*)msg) + ((field == NULL) ? 0 : field->offset);
+
+        if (field == NULL) {
+            ret = -1;
+            break;
         }
-        else if (strcmp(test->ref_val[i].t_name, "selected_version") == 0) {
-            ret = pmoq_test_set_u32(&msg->selected_version, test->ref_val[i].t_val);
+
+        switch (field->kind) {
+        case pmoq_test_field_u64:
+            ret = pmoq_test_set_u64((uint64_t*)v, test->ref_val[i].t_val);
+            break;
+        case pmoq_test_field_u32:
+            ret = pmoq_test_set_u32((uint32_t*)v, test->ref_val[i].t_val);
+            break;
+        case pmoq_test_field_u8:
+            ret = pmoq_test_set_u8(v, test->ref_val[i].t_val);
+            break;
+        case pmoq_test_field_bits:
+            ret = pmoq_test_set_bits((pmoq_bits_t*)v, test->ref_val[i].t_val);
+            break;
+        case pmoq_test_field_tuple:
+            ret = pmoq_test_set_tuple((pmoq_tuple_t*)v, test->ref_val[i].t_val);
+            break;
+        case pmoq_test_field_versions:
+            ret = pmoq_test_set_versions((pmoq_client_setup_t*)v);
+            break;
+        case pmoq_test_field_auth_info: {
+            pmoq_subscribe_parameters_t* param = (pmoq_subscribe_parameters_t*)v;
+            ret = pmoq_test_set_string(&param->auth_info, &param->auth_info_len, test->ref_val[i].t_val);
+            break;
         }
-        else if (strcmp(test->ref_val[i].t_name, "versions") == 0) {
-            pmoq_test_set_versions(msg);
+        case pmoq_test_field_delivery_timeout: {
+            pmoq_subscribe_parameters_t* param = (pmoq_subscribe_parameters_t*)v;
+            param->has_delivery_timeout = 1;
+            ret = pmoq_test_set_u64(&param->delivery_timeout, test->ref_val[i].t_val);
+            break;
         }
-        else if (strcmp(test->ref_val[i].t_name, "role") == 0) {
-            ret = pmoq_test_set_u8(&msg->setup_parameters.role, test->ref_val[i].t_val);
+        case pmoq_test_field_max_cache_duration: {
+            pmoq_subscribe_parameters_t* param = (pmoq_subscribe_parameters_t*)v;
+            param->has_max_cache_duration = 1;
+            ret = pmoq_test_set_u64(&param->max_cache_duration, test->ref_val[i].t_val);
+            break;
         }
-        else if (strcmp(test->ref_val[i].t_name, "path") == 0) {
-            ret = pmoq_test_set_string(&msg->setup_parameters.path,
-                &msg->setup_parameters.path_length,
-                test->ref_val[i].t_val);
+        case pmoq_test_field_path: {
+            pmoq_setup_parameters_t* param = (pmoq_setup_parameters_t*)v;
+            ret = pmoq_test_set_string(&param->path, &param->path_length, test->ref_val[i].t_val);
+            break;
         }
-        else {
+        default:
             ret = -1;
+            break;
         }
     }
 
@@ -1080,7 +1247,10 @@ int pmoq_msg_format_test_parse_one(pmoq_msg_format_test_case_t* test)
     const uint8_t* bytes = test->msg;
     const uint8_t* bytes_max = bytes + test->msg_len;
     pmoq_msg_t msg = { 0 };
+    pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
 
+    msg.namespace_items = namespace_items;
+    msg.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
     bytes = pmoq_msg_parse(bytes, bytes_max, &err, 0, &msg);
 
     if (test->mode == pmoq_msg_test_mode_error) {
@@ -1116,6 +1286,119 @@ int pmoq_msg_format_test_parse()
         }
     }
 
+    if (ret == 0) {
+        /* The namespace items must fit in the array provided by the caller */
+        pmoq_msg_t msg = { 0 };
+        pmoq_bits_t namespace_items[1];
+        int err = 0;
+
+        if (pmoq_msg_parse(test_msg_announce_ok, test_msg_announce_ok + sizeof(test_msg_announce_ok), &err, 0, &msg) != NULL ||
+            err != -1) {
+            ret = -1;
+        }
+        else {
+            msg.namespace_items = namespace_items;
+            msg.namespace_items_max = 1;
+            if (pmoq_msg_parse(test_msg_announce_ok, test_msg_announce_ok + sizeof(test_msg_announce_ok), &err, 0, &msg) == NULL ||
+                pmoq_msg_namespace(&msg) == NULL ||
+                pmoq_msg_namespace(&msg)->items != namespace_items) {
+                ret = -1;
+            }
+        }
+        if (ret != 0) {
+            printf("Parse test fails: namespace items\n");
+        }
+    }
+
+    return ret;
+}
+
+/* Parse each message with an arena, then release the buffer before
+ * comparing, so that no field may still point into it.
+ */
+int pmoq_msg_format_test_arena_one(pmoq_msg_format_test_case_t* test, pmoq_arena_t* arena)
+{
+    int ret = 0;
+    int err = 0;
+    uint8_t* buf = (uint8_t*)malloc(test->msg_len);
+    pmoq_msg_t msg = { 0 };
+    pmoq_msg_t ref = { 0 };
+
+    if (buf == NULL) {
+        return -1;
+    }
+    memcpy(buf, test->msg, test->msg_len);
+    msg.arena = arena;
+    if (pmoq_msg_parse(buf, buf + test->msg_len, &err, 0, &msg) == NULL) {
+        ret = -1;
+    }
+    memset(buf, 0xa5, test->msg_len);
+    free(buf);
+
+    if (ret == 0 && (pmoq_test_set_msg_from_test(&ref, test) != 0 || mpoq_test_msg_compare(&msg, &ref) != 0)) {
+        ret = -1;
+    }
+    if (ret == 0 && pmoq_msg_namespace(&msg) != NULL) {
+        pmoq_tuple_t* tuple = pmoq_msg_namespace(&msg);
+
+        if ((uint8_t*)tuple->items < arena->base || (uint8_t*)tuple->items >= arena->base + arena->size) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_arena()
+{
+    int ret = 0;
+    uint8_t storage[4096];
+    pmoq_arena_t arena;
+
+    pmoq_arena_init(&arena, storage, sizeof(storage));
+    for (size_t i = 0; i < format_test_cases_nb; i++) {
+        if (format_test_cases[i].mode != pmoq_msg_test_mode_error) {
+            if ((ret = pmoq_msg_format_test_arena_one(&format_test_cases[i], &arena)) != 0) {
+                printf("Arena test fails: format_test_cases[%zu]\n", i);
+                break;
+            }
+            /* Release the side data after every other message */
+            if ((i & 1) != 0) {
+                pmoq_arena_reset(&arena);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        /* Alignment, and allocations past the end of the region */
+        pmoq_arena_init(&arena, storage, 16);
+        if (pmoq_arena_alloc(&arena, 3, 1) != storage || pmoq_arena_alloc(&arena, 8, 8) != storage + 8 ||
+            pmoq_arena_alloc(&arena, 1, 1) != NULL || arena.used != 16 || pmoq_arena_alloc(&arena, 0, 1) != storage + 16) {
+            ret = -1;
+        }
+        pmoq_arena_reset(&arena);
+        if (ret == 0 && (arena.used != 0 || pmoq_arena_alloc(&arena, 17, 1) != NULL || arena.used != 0)) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* A message whose side data does not fit leaves the arena unchanged */
+        pmoq_msg_t msg = { 0 };
+        int err = 0;
+
+        pmoq_arena_init(&arena, storage, 8);
+        (void)pmoq_arena_alloc(&arena, 1, 1);
+        msg.arena = &arena;
+        if (pmoq_msg_parse(test_msg_announce_ok, test_msg_announce_ok + sizeof(test_msg_announce_ok), &err, 0, &msg) != NULL ||
+            err != -1 || arena.used != 1 || msg.u.announce_ok.track_namespace.items != NULL) {
+            ret = -1;
+        }
+        if (ret != 0) {
+            printf("Arena test fails: arena too small\n");
+        }
+    }
+
     return ret;
 }
 
@@ -1129,7 +1412,7 @@ int pmoq_msg_format_test_format_one(pmoq_msg_format_test_case_t* test)
     } else {
         uint8_t buf[2048];
         uint8_t* bytes = buf;
-        const uint8_t* bytes_max = bytes + sizeof(msg);
+        const uint8_t* bytes_max = bytes + sizeof(buf);
 
         memset(buf, 0xff, sizeof(buf));
 
@@ -1183,8 +1466,11 @@ int pmoq_msg_format_test_varlen_one(pmoq_msg_format_test_case_t* test)
 
         while (ret == 0) {
             pmoq_msg_t msg = { 0 };
+            pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
             int err = 0;
 
+            msg.namespace_items = namespace_items;
+            msg.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
             if (test_len < 64) {
                 mask |= (1ull << test_len);
             }
@@ -1235,4 +1521,1000 @@ int pmoq_msg_format_test_varlen()
     }
 
     return ret;
-}
\ No newline at end of file
+}
+/* Feed the test messages to the resumable parser in segments of
+ * size "segment_len". The parser must produce the same message
+ * as the stateless parse, or detect the same errors.
+ */
+int pmoq_msg_format_test_stream_one(pmoq_msg_parser_t* parser, pmoq_msg_format_test_case_t* test, size_t segment_len)
+{
+    int ret = 0;
+    int err = 0;
+    const uint8_t* bytes = test->msg;
+    const uint8_t* msg_end = bytes + test->msg_len;
+    const pmoq_msg_t* msg = NULL;
+
+    while (bytes != NULL && bytes < msg_end && msg == NULL) {
+        const uint8_t* bytes_max = (bytes + segment_len < msg_end) ? bytes + segment_len : msg_end;
+        const uint8_t* next_bytes = pmoq_msg_parser_feed(parser, bytes, bytes_max, &err);
+
+        msg = pmoq_msg_parser_next(parser);
+        if (next_bytes != NULL && next_bytes != bytes_max && msg == NULL) {
+            /* Stopping before the end of the segment is only expected at the end of a message */
+            ret = -1;
+            break;
+        }
+        bytes = next_bytes;
+    }
+
+    if (ret == 0) {
+        if (test->mode == pmoq_msg_test_mode_error) {
+            if (bytes != NULL) {
+                ret = -1;
+            }
+        }
+        else if (bytes != msg_end || msg == NULL) {
+            ret = -1;
+        }
+        else {
+            pmoq_msg_t ref = { 0 };
+
+            if (pmoq_test_set_msg_from_test(&ref, test) != 0 ||
+                mpoq_test_msg_compare(msg, &ref) != 0) {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_stream_sequence(size_t segment_len)
+{
+    int ret = 0;
+    uint8_t buf[4096];
+    size_t buf_len = 0;
+    size_t nb_target = 0;
+    size_t nb_parsed = 0;
+    pmoq_msg_parser_t* parser = pmoq_msg_parser_create();
+
+    if (parser == NULL) {
+        return -1;
+    }
+
+    /* Concatenate all the valid test messages on a single stream */
+    for (size_t i = 0; i < format_test_cases_nb; i++) {
+        if (format_test_cases[i].mode != pmoq_msg_test_mode_error &&
+            buf_len + format_test_cases[i].msg_len <= sizeof(buf)) {
+            memcpy(buf + buf_len, format_test_cases[i].msg, format_test_cases[i].msg_len);
+            buf_len += format_test_cases[i].msg_len;
+            nb_target++;
+        }
+    }
+
+    for (size_t offset = 0; ret == 0 && offset < buf_len; offset += segment_len) {
+        const uint8_t* bytes = buf + offset;
+        const uint8_t* bytes_max = (offset + segment_len < buf_len) ? bytes + segment_len : buf + buf_len;
+
+        while (ret == 0 && bytes < bytes_max) {
+            int err = 0;
+
+            if ((bytes = pmoq_msg_parser_feed(parser, bytes, bytes_max, &err)) == NULL) {
+                ret = -1;
+            }
+            else {
+                const pmoq_msg_t* msg;
+                while (ret == 0 && (msg = pmoq_msg_parser_next(parser)) != NULL) {
+                    /* Skip the error cases to find the reference */
+                    while (nb_parsed < format_test_cases_nb &&
+                        format_test_cases[nb_parsed].mode == pmoq_msg_test_mode_error) {
+                        nb_parsed++;
+                    }
+                    if (nb_parsed >= format_test_cases_nb) {
+                        ret = -1;
+                    }
+                    else {
+                        pmoq_msg_t ref = { 0 };
+                        if (pmoq_test_set_msg_from_test(&ref, &format_test_cases[nb_parsed]) != 0 ||
+                            mpoq_test_msg_compare(msg, &ref) != 0) {
+                            printf("Stream sequence fails: format_test_cases[%zu]\n", nb_parsed);
+                            ret = -1;
+                        }
+                        nb_parsed++;
+                    }
+                }
+            }
+        }
+    }
+
+    pmoq_msg_parser_delete(parser);
+
+    return ret;
+}
+
+int pmoq_msg_format_test_stream()
+{
+    int ret = 0;
+    size_t segment_lengths[] = { 1, 2, 3, 7, 4096 };
+    size_t nb_segment_lengths = sizeof(segment_lengths) / sizeof(size_t);
+
+    for (size_t s = 0; ret == 0 && s < nb_segment_lengths; s++) {
+        for (size_t i = 0; i < format_test_cases_nb; i++) {
+            pmoq_msg_parser_t* parser = pmoq_msg_parser_create();
+
+            if (parser == NULL) {
+                ret = -1;
+            }
+            else {
+                ret = pmoq_msg_format_test_stream_one(parser, &format_test_cases[i], segment_lengths[s]);
+                pmoq_msg_parser_delete(parser);
+            }
+            if (ret != 0) {
+                printf("Format stream test fails: format_test_cases[%zu], segments of %zu bytes\n", i, segment_lengths[s]);
+                break;
+            }
+        }
+        if (ret == 0) {
+            ret = pmoq_msg_format_test_stream_sequence(segment_lengths[s]);
+        }
+    }
+
+    return ret;
+}
+
+/* Verify that the size computation matches the length of the
+ * formatted messages, and that a buffer of exactly that size is
+ * sufficient.
+ */
+int pmoq_msg_format_test_size_one(pmoq_msg_format_test_case_t* test)
+{
+    int ret = 0;
+    pmoq_msg_t msg = { 0 };
+
+    if (pmoq_test_set_msg_from_test(&msg, test) != 0) {
+        ret = -1;
+    }
+    else {
+        uint8_t buf[2048];
+        size_t l = pmoq_msg_encoded_size(&msg);
+
+        if (l != test->msg_len || l > sizeof(buf)) {
+            ret = -1;
+        }
+        else if (pmoq_msg_format(buf, buf + l, &msg) != buf + l ||
+            memcmp(buf, test->msg, l) != 0) {
+            ret = -1;
+        }
+        else if (pmoq_msg_format(buf, buf + l - 1, &msg) != NULL) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+pmoq_strm_t format_test_strm[] = {
+    { PMOQ_STRM_OBJECT_DATAGRAM, 17, 31, 1234, 0x4567, 0, PMOQ_OBJECT_STATUS_END_OF_GROUP, 0x80 },
+    { PMOQ_STRM_OBJECT_DATAGRAM, 0x4000, 0x40000000, 0x3fffffffffffffffull, 0, 1500, PMOQ_OBJECT_STATUS_NORMAL, 1 },
+    { PMOQ_STRM_HEADER_TRACK, 63, 64, 0, 0, 0, 0, 0xff },
+    { PMOQ_STRM_HEADER_SUBGROUP, 1, 2, 16383, 16384, 0, 0, 7 }
+};
+
+size_t format_test_strm_nb = sizeof(format_test_strm) / sizeof(pmoq_strm_t);
+
+int pmoq_strm_format_test_size_one(const pmoq_strm_t* strm)
+{
+    int ret = 0;
+    uint8_t buf[256];
+    size_t l = pmoq_strm_encoded_size(strm);
+    uint8_t* bytes;
+
+    if (l == 0 || l > sizeof(buf) ||
+        (bytes = pmoq_strm_format(buf, buf + sizeof(buf), strm)) == NULL ||
+        (size_t)(bytes - buf) != l ||
+        pmoq_strm_format(buf, buf + l - 1, strm) != NULL) {
+        ret = -1;
+    }
+    else if ((l = pmoq_strm_object_subgroup_size(strm)) == 0 ||
+        (bytes = pmoq_strm_object_subgroup_format(buf, buf + sizeof(buf), strm)) == NULL ||
+        (size_t)(bytes - buf) != l) {
+        ret = -1;
+    }
+    else if ((l = pmoq_strm_object_track_size(strm)) == 0 ||
+        (bytes = pmoq_strm_object_track_format(buf, buf + sizeof(buf), strm)) == NULL ||
+        (size_t)(bytes - buf) != l) {
+        ret = -1;
+    }
+    else {
+        /* The objects parse back to the values that were formatted */
+        pmoq_strm_t parsed = { 0 };
+        int err = 0;
+
+        if (pmoq_strm_object_track_parse(buf, buf + l, &err, 0, &parsed) != buf + l ||
+            parsed.group_id != strm->group_id || parsed.object_id != strm->object_id ||
+            parsed.payload_length != strm->payload_length ||
+            (strm->payload_length == 0 && parsed.object_status != strm->object_status)) {
+            ret = -1;
+        }
+        else if ((l = pmoq_strm_object_subgroup_size(strm)) == 0 ||
+            pmoq_strm_object_subgroup_format(buf, buf + sizeof(buf), strm) != buf + l ||
+            pmoq_strm_object_subgroup_parse(buf, buf + l, &err, 0, &parsed) != buf + l ||
+            parsed.object_id != strm->object_id || parsed.payload_length != strm->payload_length) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_size()
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < format_test_cases_nb; i++) {
+        if (format_test_cases[i].mode == pmoq_msg_test_mode_target) {
+            if ((ret = pmoq_msg_format_test_size_one(&format_test_cases[i])) != 0) {
+                printf("Format size test fails: format_test_cases[%zu]\n", i);
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_strm_nb; i++) {
+        if ((ret = pmoq_strm_format_test_size_one(&format_test_strm[i])) != 0) {
+            printf("Format size test fails: format_test_strm[%zu]\n", i);
+        }
+    }
+
+    if (ret == 0) {
+        /* Values that cannot be encoded */
+        pmoq_msg_t msg = { 0 };
+        pmoq_strm_t strm = format_test_strm[0];
+
+        msg.msg_type = PMOQ_MSG_UNSUBSCRIBE;
+        msg.u.unsubscribe.subscribe_id = 0x4000000000000000ull;
+        strm.msg_type = 0x3f;
+
+        if (pmoq_msg_encoded_size(&msg) != 0 ||
+            pmoq_strm_encoded_size(&strm) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* Namespaces longer than PMOQ_TUPLE_SIZE_MAX are neither sized nor formatted */
+        pmoq_bits_t items[PMOQ_TUPLE_SIZE_MAX + 1];
+        pmoq_msg_t msg = { 0 };
+        uint8_t item = 0x5a;
+        uint8_t buf[512];
+        uint8_t* bytes;
+        size_t l;
+
+        for (size_t i = 0; i < PMOQ_TUPLE_SIZE_MAX + 1; i++) {
+            items[i].nb_bits = 8;
+            items[i].bits = &item;
+        }
+        msg.msg_type = PMOQ_MSG_SUBSCRIBE;
+        msg.u.subscribe.track_namespace.items = items;
+        msg.u.subscribe.track_namespace.items_max = PMOQ_TUPLE_SIZE_MAX + 1;
+        msg.u.subscribe.track_namespace.nb_items = PMOQ_TUPLE_SIZE_MAX;
+        msg.u.subscribe.track_name.nb_bits = 8;
+        msg.u.subscribe.track_name.bits = &item;
+        msg.u.subscribe.filter_type = pmoq_msg_filter_latest_group;
+
+        if ((l = pmoq_msg_encoded_size(&msg)) == 0 ||
+            (bytes = pmoq_msg_format(buf, buf + sizeof(buf), &msg)) == NULL ||
+            (size_t)(bytes - buf) != l) {
+            ret = -1;
+        }
+        else {
+            msg.u.subscribe.track_namespace.nb_items = PMOQ_TUPLE_SIZE_MAX + 1;
+            if (pmoq_msg_encoded_size(&msg) != 0 ||
+                pmoq_msg_format(buf, buf + sizeof(buf), &msg) != NULL) {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/* The object headers are decoded by a fast path when the buffer is long
+ * enough, and by the bounded parsers otherwise. Check that both decoders
+ * of the fast path find the values that were formatted, on random headers
+ * with varints of all lengths, and that truncated headers still require
+ * more bytes.
+ */
+static uint64_t pmoq_fast_test_random(uint64_t* state)
+{
+    /* xorshift64, so the test is reproducible */
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static uint64_t pmoq_fast_test_varint(uint64_t* state)
+{
+    static const uint64_t masks[4] = { 0x3f, 0x3fff, 0x3fffffff, 0x3fffffffffffffffull };
+    uint64_t r = pmoq_fast_test_random(state);
+
+    return (r >> 2) & masks[r & 3];
+}
+
+int pmoq_strm_fast_test_one(const uint8_t* buf, size_t l, size_t buf_len, const pmoq_strm_t* expected, int expected_err)
+{
+    int ret = 0;
+
+    for (int is_padded = 0; ret == 0 && is_padded < 2; is_padded++) {
+        pmoq_strm_t parsed = { 0 };
+        int err = 0;
+        const uint8_t* bytes;
+
+        if (expected->msg_type == 0) {
+            bytes = pmoq_strm_object_subgroup_parse(buf, buf + ((is_padded) ? buf_len : l), &err, 0, &parsed);
+        }
+        else {
+            bytes = pmoq_strm_parse(buf, buf + ((is_padded) ? buf_len : l), &err, 0, &parsed);
+        }
+        if (expected_err != 0) {
+            if (bytes != NULL || err != expected_err) {
+                ret = -1;
+            }
+        }
+        else if (bytes != buf + l || mpoq_test_strm_compare(&parsed, expected) != 0) {
+            ret = -1;
+        }
+    }
+
+    for (size_t t = 0; ret == 0 && expected_err == 0 && t < l; t++) {
+        pmoq_strm_t parsed = { 0 };
+        int err = 0;
+        const uint8_t* bytes;
+
+        if (expected->msg_type == 0) {
+            bytes = pmoq_strm_object_subgroup_parse(buf, buf + t, &err, 0, &parsed);
+        }
+        else {
+            bytes = pmoq_strm_parse(buf, buf + t, &err, 0, &parsed);
+        }
+        if (bytes != NULL || err <= 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_strm_fast_test_mode(pmoq_varint_decoder_enum mode)
+{
+    int ret = 0;
+    uint64_t state = 0x123456789abcdefull;
+    uint8_t buf[128];
+
+    if (pmoq_varint_decoder_select(mode) != mode) {
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < 1000; i++) {
+        pmoq_strm_t strm = { 0 };
+        uint8_t* bytes;
+
+        for (size_t j = 0; j < sizeof(buf); j++) {
+            buf[j] = (uint8_t)pmoq_fast_test_random(&state);
+        }
+        strm.msg_type = (i & 1) ? PMOQ_STRM_HEADER_SUBGROUP : PMOQ_STRM_OBJECT_DATAGRAM;
+        strm.subscribe_id = pmoq_fast_test_varint(&state);
+        strm.track_alias = pmoq_fast_test_varint(&state);
+        strm.group_id = pmoq_fast_test_varint(&state);
+        strm.object_id = pmoq_fast_test_varint(&state);
+        strm.publisher_priority = (uint8_t)pmoq_fast_test_random(&state);
+        if (strm.msg_type == PMOQ_STRM_OBJECT_DATAGRAM) {
+            strm.payload_length = ((i & 6) == 0) ? 0 : pmoq_fast_test_varint(&state);
+            if (strm.payload_length == 0) {
+                strm.object_status = pmoq_fast_test_random(&state) % (PMOQ_OBJECT_STATUS_MAX + 1);
+            }
+        }
+        bytes = pmoq_strm_format(buf, buf + sizeof(buf), &strm);
+        if (bytes == NULL ||
+            pmoq_strm_fast_test_one(buf, bytes - buf, sizeof(buf), &strm, 0) != 0) {
+            printf("Fast decode test fails, mode %d, header %d\n", (int)mode, i);
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; ret == 0 && i < 1000; i++) {
+        /* Objects on subgroup streams: object ID, length, and status if the payload is empty */
+        pmoq_strm_t strm = { 0 };
+        uint8_t* bytes = buf;
+        int expected_err = 0;
+
+        for (size_t j = 0; j < sizeof(buf); j++) {
+            buf[j] = (uint8_t)pmoq_fast_test_random(&state);
+        }
+        strm.object_id = pmoq_fast_test_varint(&state);
+        strm.payload_length = ((i & 3) == 0) ? 0 : pmoq_fast_test_varint(&state);
+        if ((bytes = picoquic_frames_varint_encode(buf, buf + sizeof(buf), strm.object_id)) != NULL) {
+            bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), strm.payload_length);
+        }
+        if (bytes != NULL && strm.payload_length == 0) {
+            strm.object_status = pmoq_fast_test_random(&state) % (PMOQ_OBJECT_STATUS_MAX + 3);
+            bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), strm.object_status);
+            expected_err = (strm.object_status > PMOQ_OBJECT_STATUS_MAX) ? -1 : 0;
+        }
+        if (bytes == NULL ||
+            pmoq_strm_fast_test_one(buf, bytes - buf, sizeof(buf), &strm, expected_err) != 0) {
+            printf("Fast decode test fails, mode %d, object %d\n", (int)mode, i);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_fast_decode()
+{
+    int ret = pmoq_strm_fast_test_mode(pmoq_varint_decoder_scalar);
+
+    if (ret == 0) {
+        ret = pmoq_strm_fast_test_mode(pmoq_varint_decoder_swar);
+    }
+    (void)pmoq_varint_decoder_select(pmoq_varint_decoder_auto);
+
+    return ret;
+}
+
+/* Batch parsing of the objects of a subgroup stream. The stream is
+ * cut at every possible length, and parsed in batches of varying size,
+ * resuming at the tail returned by the previous call.
+ */
+typedef struct st_pmoq_batch_test_object_t {
+    uint64_t object_id;
+    uint64_t payload_length;
+    uint64_t object_status;
+} pmoq_batch_test_object_t;
+
+static const pmoq_batch_test_object_t batch_test_objects[] = {
+    { 0, 5, 0 },
+    { 1, 0, PMOQ_OBJECT_STATUS_NORMAL },
+    { 2, 1, 0 },
+    { 63, 64, 0 },
+    { 16384, 0, PMOQ_OBJECT_STATUS_END_OF_GROUP },
+    { 16385, 300, 0 },
+    { 0x3fffffffffffffffull, 17, 0 }
+};
+
+static const size_t batch_test_objects_nb = sizeof(batch_test_objects) / sizeof(pmoq_batch_test_object_t);
+
+int pmoq_strm_batch_test_parse(const uint8_t* buf, size_t buf_len, const size_t* object_ends, size_t objects_max)
+{
+    int ret = 0;
+    pmoq_strm_object_ref_t objects[8];
+    const uint8_t* bytes = buf;
+    size_t nb_parsed = 0;
+
+    while (ret == 0) {
+        size_t nb_objects = 0;
+        int err = 0;
+        const uint8_t* next_bytes = pmoq_strm_subgroup_parse_batch(bytes, buf + buf_len, &err, objects, objects_max, &nb_objects);
+
+        if (next_bytes == NULL || nb_objects > objects_max || nb_parsed + nb_objects > batch_test_objects_nb) {
+            ret = -1;
+            break;
+        }
+        for (size_t i = 0; i < nb_objects; i++) {
+            const pmoq_batch_test_object_t* expected = &batch_test_objects[nb_parsed + i];
+            size_t payload_start = (bytes - buf) + objects[i].payload_offset;
+
+            if (objects[i].object_id != expected->object_id ||
+                objects[i].payload_length != expected->payload_length ||
+                objects[i].object_status != expected->object_status ||
+                payload_start + expected->payload_length != object_ends[nb_parsed + i] ||
+                (expected->payload_length > 0 && buf[payload_start] != (uint8_t)expected->object_id)) {
+                ret = -1;
+            }
+        }
+        nb_parsed += nb_objects;
+        if (ret == 0 && (size_t)(next_bytes - buf) != ((nb_parsed == 0) ? 0 : object_ends[nb_parsed - 1])) {
+            ret = -1;
+        }
+        else if (nb_objects < objects_max) {
+            /* Stopped before the end of the batch: tail is incomplete or empty */
+            if ((err == 0) != (next_bytes == buf + buf_len)) {
+                ret = -1;
+            }
+            break;
+        }
+        bytes = next_bytes;
+    }
+
+    /* All the objects that end before the end of the buffer are found */
+    if (ret == 0 && nb_parsed < batch_test_objects_nb && object_ends[nb_parsed] <= buf_len) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_subgroup_batch()
+{
+    int ret = 0;
+    uint8_t buf[1024];
+    uint8_t* bytes = buf;
+    size_t object_ends[sizeof(batch_test_objects) / sizeof(pmoq_batch_test_object_t)];
+
+    for (size_t i = 0; bytes != NULL && i < batch_test_objects_nb; i++) {
+        const pmoq_batch_test_object_t* object = &batch_test_objects[i];
+
+        if ((bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), object->object_id)) != NULL &&
+            (bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), object->payload_length)) != NULL &&
+            object->payload_length == 0) {
+            bytes = picoquic_frames_varint_encode(bytes, buf + sizeof(buf), object->object_status);
+        }
+        if (bytes != NULL && (size_t)(buf + sizeof(buf) - bytes) >= object->payload_length) {
+            memset(bytes, (uint8_t)object->object_id, (size_t)object->payload_length);
+            bytes += object->payload_length;
+            object_ends[i] = bytes - buf;
+        }
+        else {
+            bytes = NULL;
+        }
+    }
+
+    if (bytes == NULL) {
+        ret = -1;
+    }
+
+    for (size_t l = 0; ret == 0 && l <= (size_t)(bytes - buf); l++) {
+        for (size_t objects_max = 1; ret == 0 && objects_max <= 8; objects_max++) {
+            if ((ret = pmoq_strm_batch_test_parse(buf, l, object_ends, objects_max)) != 0) {
+                printf("Subgroup batch test fails, length %zu, batch %zu\n", l, objects_max);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        /* Invalid status on an empty object */
+        uint8_t bad[] = { 0x01, 0x00, PMOQ_OBJECT_STATUS_MAX + 1, 0x02, 0x00, 0x00 };
+        pmoq_strm_object_ref_t objects[2];
+        size_t nb_objects = 0;
+        int err = 0;
+
+        if (pmoq_strm_subgroup_parse_batch(bad, bad + sizeof(bad), &err, objects, 2, &nb_objects) != NULL ||
+            err != -1 || nb_objects != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* The objects follow the layout of the codec of the version */
+        const pmoq_codec_t* codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+        pmoq_strm_object_ref_t objects[8];
+        size_t nb_objects = 0;
+        int err = 0;
+
+        if (codec == NULL ||
+            pmoq_codec_subgroup_parse_batch(codec, buf, bytes, &err, objects, 8, &nb_objects) != bytes ||
+            err != 0 || nb_objects != batch_test_objects_nb ||
+            objects[batch_test_objects_nb - 1].object_id != batch_test_objects[batch_test_objects_nb - 1].object_id) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/* Scatter-gather formatting: the header and the payload reference must
+ * gather into the same bytes as the header formatted in line followed
+ * by a copy of the payload, whatever the size of the gathered chunks.
+ */
+int pmoq_strm_iov_test_one(const pmoq_strm_t* strm, const uint8_t* payload, int is_datagram)
+{
+    int ret = 0;
+    uint8_t header[PMOQ_STRM_HEADER_SIZE_MAX];
+    uint8_t ref[PMOQ_STRM_HEADER_SIZE_MAX + 512];
+    uint8_t gathered[PMOQ_STRM_HEADER_SIZE_MAX + 512];
+    pmoq_iovec_t iov[2];
+    size_t nb_iov = 0;
+    uint8_t* header_end;
+    uint8_t* ref_end;
+
+    if (is_datagram) {
+        header_end = pmoq_strm_object_datagram_format_iov(header, header + sizeof(header), strm, payload, iov, &nb_iov);
+        ref_end = pmoq_strm_object_datagram_format(ref, ref + sizeof(ref), strm);
+    }
+    else {
+        header_end = pmoq_strm_object_subgroup_format_iov(header, header + sizeof(header), strm, payload, iov, &nb_iov);
+        ref_end = pmoq_strm_object_subgroup_format(ref, ref + sizeof(ref), strm);
+    }
+
+    if (header_end == NULL || ref_end == NULL || nb_iov != ((strm->payload_length > 0) ? 2 : 1) ||
+        iov[0].base != header || iov[0].len != (size_t)(header_end - header) ||
+        (nb_iov == 2 && (iov[1].base != payload || iov[1].len != strm->payload_length))) {
+        ret = -1;
+    }
+    else {
+        size_t total = (ref_end - ref) + (size_t)strm->payload_length;
+
+        memcpy(ref_end, payload, (size_t)strm->payload_length);
+        for (size_t chunk = 1; ret == 0 && chunk <= total + 1; chunk += (chunk < 16) ? 1 : 37) {
+            size_t offset = 0;
+            size_t copied;
+
+            memset(gathered, 0, sizeof(gathered));
+            while ((copied = pmoq_iovec_gather(gathered + offset, chunk, iov, nb_iov, offset)) > 0) {
+                offset += copied;
+            }
+            if (offset != total || memcmp(gathered, ref, total) != 0) {
+                ret = -1;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        /* Header buffer too small */
+        if (is_datagram) {
+            header_end = pmoq_strm_object_datagram_format_iov(header, header + iov[0].len - 1, strm, payload, iov, &nb_iov);
+        }
+        else {
+            header_end = pmoq_strm_object_subgroup_format_iov(header, header + iov[0].len - 1, strm, payload, iov, &nb_iov);
+        }
+        if (header_end != NULL || nb_iov != 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_iov()
+{
+    int ret = 0;
+    uint8_t payload[512];
+    const uint64_t payload_lengths[] = { 0, 1, 63, 64, 300, sizeof(payload) };
+
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_strm_nb; i++) {
+        for (size_t j = 0; ret == 0 && j < sizeof(payload_lengths) / sizeof(uint64_t); j++) {
+            pmoq_strm_t strm = format_test_strm[i];
+
+            strm.payload_length = payload_lengths[j];
+            for (int is_datagram = 0; ret == 0 && is_datagram < 2; is_datagram++) {
+                if ((ret = pmoq_strm_iov_test_one(&strm, payload, is_datagram)) != 0) {
+                    printf("Format iov test fails, strm %zu, length %zu, datagram %d\n", i, (size_t)payload_lengths[j], is_datagram);
+                }
+            }
+        }
+    }
+
+    if (ret == 0) {
+        /* A payload is required if the length is not zero */
+        pmoq_strm_t strm = format_test_strm[1];
+        uint8_t header[PMOQ_STRM_HEADER_SIZE_MAX];
+        pmoq_iovec_t iov[2];
+        size_t nb_iov = 0;
+
+        if (pmoq_strm_object_datagram_format_iov(header, header + sizeof(header), &strm, NULL, iov, &nb_iov) != NULL) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/* The codec of each supported version is found by its version number,
+ * and the session uses it to encode and decode the messages. Check that
+ * the codec of draft 07 produces the encodings of the corpus, and that
+ * the unsupported versions have no codec.
+ */
+int pmoq_codec_test_msg_one(const pmoq_codec_t* codec, pmoq_msg_format_test_case_t* test)
+{
+    int ret = 0;
+    int err = 0;
+    pmoq_msg_t ref = { 0 };
+    pmoq_msg_t msg = { 0 };
+    pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
+    uint8_t buf[2048];
+    uint8_t* bytes;
+
+    msg.namespace_items = namespace_items;
+    msg.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
+
+    if (pmoq_test_set_msg_from_test(&ref, test) != 0 ||
+        (bytes = pmoq_codec_msg_format(codec, buf, buf + sizeof(buf), &ref)) == NULL ||
+        (size_t)(bytes - buf) != test->msg_len || memcmp(buf, test->msg, test->msg_len) != 0 ||
+        pmoq_codec_msg_encoded_size(codec, &ref) != test->msg_len ||
+        pmoq_codec_msg_parse(codec, test->msg, test->msg + test->msg_len, &err, 0, &msg) != test->msg + test->msg_len ||
+        mpoq_test_msg_compare(&msg, &ref) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int pmoq_codec_test_strm_one(const pmoq_codec_t* codec, const pmoq_strm_t* strm)
+{
+    int ret = 0;
+    int err = 0;
+    uint8_t buf[256];
+    uint8_t ref[256];
+    size_t l = pmoq_codec_strm_encoded_size(codec, strm);
+    pmoq_strm_t parsed = { 0 };
+
+    if (l == 0 || pmoq_codec_strm_format(codec, buf, buf + sizeof(buf), strm) != buf + l ||
+        pmoq_strm_format(ref, ref + sizeof(ref), strm) != ref + l || memcmp(buf, ref, l) != 0 ||
+        pmoq_codec_strm_parse(codec, buf, buf + l, &err, 0, &parsed) != buf + l ||
+        mpoq_test_strm_compare(&parsed, strm) != 0) {
+        ret = -1;
+    }
+    else if ((l = pmoq_codec_object_size(codec, PMOQ_STRM_HEADER_SUBGROUP, strm)) == 0 ||
+        pmoq_codec_object_format(codec, PMOQ_STRM_HEADER_SUBGROUP, buf, buf + sizeof(buf), strm) != buf + l ||
+        pmoq_strm_object_subgroup_format(ref, ref + sizeof(ref), strm) != ref + l || memcmp(buf, ref, l) != 0 ||
+        pmoq_codec_object_parse(codec, PMOQ_STRM_HEADER_SUBGROUP, buf, buf + l, &err, 0, &parsed) != buf + l ||
+        parsed.object_id != strm->object_id || parsed.payload_length != strm->payload_length) {
+        ret = -1;
+    }
+    else if ((l = pmoq_codec_object_size(codec, PMOQ_STRM_HEADER_TRACK, strm)) == 0 ||
+        pmoq_codec_object_format(codec, PMOQ_STRM_HEADER_TRACK, buf, buf + sizeof(buf), strm) != buf + l ||
+        pmoq_strm_object_track_format(ref, ref + sizeof(ref), strm) != ref + l || memcmp(buf, ref, l) != 0 ||
+        pmoq_codec_object_parse(codec, PMOQ_STRM_HEADER_TRACK, buf, buf + l, &err, 0, &parsed) != buf + l ||
+        parsed.group_id != strm->group_id || parsed.object_id != strm->object_id) {
+        ret = -1;
+    }
+    else if (pmoq_codec_object_size(codec, PMOQ_STRM_OBJECT_DATAGRAM, strm) != 0 ||
+        pmoq_codec_object_format(codec, PMOQ_STRM_OBJECT_DATAGRAM, buf, buf + sizeof(buf), strm) != NULL ||
+        pmoq_codec_object_parse(codec, PMOQ_STRM_OBJECT_DATAGRAM, buf, buf + l, &err, 0, &parsed) != NULL ||
+        err != -1) {
+        /* Datagrams are not followed by objects */
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_codec()
+{
+    int ret = 0;
+    const pmoq_codec_t* codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+
+    if (codec == NULL || pmoq_codec_version(codec) != PMOQ_VERSION_DRAFT_07 ||
+        pmoq_codec_get(PMOQ_VERSION_DRAFT_07 + 1) != NULL || pmoq_codec_get(0) != NULL) {
+        printf("Codec test fails: codec lookup\n");
+        ret = -1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_cases_nb; i++) {
+        if (format_test_cases[i].mode == pmoq_msg_test_mode_target &&
+            (ret = pmoq_codec_test_msg_one(codec, &format_test_cases[i])) != 0) {
+            printf("Codec test fails: format_test_cases[%zu]\n", i);
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_strm_nb; i++) {
+        if ((ret = pmoq_codec_test_strm_one(codec, &format_test_strm[i])) != 0) {
+            printf("Codec test fails: format_test_strm[%zu]\n", i);
+        }
+    }
+
+    return ret;
+}
+
+/* The skip functions find the same end as the parse functions, and ask
+ * for more bytes while the message is truncated. The malformed messages
+ * of the corpus may pass if the error is in the value of a parameter,
+ * which the skip functions do not check.
+ */
+int pmoq_msg_format_test_skip_one(pmoq_msg_format_test_case_t* test)
+{
+    int ret = 0;
+    int err = 0;
+    uint64_t msg_type = 0;
+    const uint8_t* bytes = pmoq_msg_skip(test->msg, test->msg + test->msg_len, &err, 0, &msg_type);
+
+    if (test->mode == pmoq_msg_test_mode_error) {
+        if (bytes == NULL && err != -1) {
+            ret = -1;
+        }
+    }
+    else if (bytes != test->msg + test->msg_len || msg_type != test->msg_type) {
+        ret = -1;
+    }
+    else {
+        for (size_t l = 0; ret == 0 && l < test->msg_len; l++) {
+            if (pmoq_msg_skip(test->msg, test->msg + l, &err, 0, &msg_type) != NULL ||
+                err <= 0 || l + err > test->msg_len) {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_strm_format_test_skip_one(const pmoq_codec_t* codec, const pmoq_strm_t* strm)
+{
+    int ret = 0;
+    int err = 0;
+    uint64_t msg_type = 0;
+    uint8_t buf[256];
+    uint8_t* bytes = pmoq_strm_format(buf, buf + sizeof(buf), strm);
+    size_t l;
+
+    if (bytes == NULL || pmoq_strm_skip(buf, bytes, &err, 0, &msg_type) != bytes || msg_type != strm->msg_type ||
+        pmoq_strm_skip(buf, bytes - 1, &err, 0, &msg_type) != NULL || err <= 0) {
+        ret = -1;
+    }
+    else if ((l = pmoq_strm_object_subgroup_size(strm)) == 0 ||
+        pmoq_strm_object_subgroup_format(buf, buf + sizeof(buf), strm) != buf + l) {
+        ret = -1;
+    }
+    else if (l + strm->payload_length <= sizeof(buf)) {
+        /* The object is skipped with its payload */
+        memset(buf + l, 0x5a, (size_t)strm->payload_length);
+        l += (size_t)strm->payload_length;
+        if (pmoq_codec_object_skip(codec, PMOQ_STRM_HEADER_SUBGROUP, buf, buf + l, &err, 0) != buf + l ||
+            pmoq_codec_object_skip(codec, PMOQ_STRM_HEADER_SUBGROUP, buf, buf + l - 1, &err, 0) != NULL || err != 1 ||
+            pmoq_codec_object_skip(codec, PMOQ_STRM_OBJECT_DATAGRAM, buf, buf + l, &err, 0) != NULL || err != -1) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_skip()
+{
+    int ret = 0;
+    const pmoq_codec_t* codec = pmoq_codec_get(PMOQ_VERSION_DRAFT_07);
+    uint8_t unknown[] = { 0x3f, 0 };
+    uint64_t msg_type = 0;
+    int err = 0;
+
+    for (size_t i = 0; ret == 0 && i < format_test_cases_nb; i++) {
+        if ((ret = pmoq_msg_format_test_skip_one(&format_test_cases[i])) != 0) {
+            printf("Skip test fails: format_test_cases[%zu]\n", i);
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < format_test_strm_nb; i++) {
+        if ((ret = pmoq_strm_format_test_skip_one(codec, &format_test_strm[i])) != 0) {
+            printf("Skip test fails: format_test_strm[%zu]\n", i);
+        }
+    }
+
+    if (ret == 0 && (pmoq_msg_skip(unknown, unknown + sizeof(unknown), &err, 0, &msg_type) != NULL || err != -1 ||
+        pmoq_strm_skip(unknown, unknown + sizeof(unknown), &err, 0, &msg_type) != NULL || err != -1)) {
+        printf("Skip test fails: unknown type\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* The view of a message decodes each field to the value that the parser
+ * finds, and reports the fields that are absent.
+ */
+int pmoq_msg_format_test_view_subscribe(pmoq_msg_format_test_case_t* test)
+{
+    int ret = 0;
+    int err = 0;
+    pmoq_msg_view_t view;
+    pmoq_msg_t ref = { 0 };
+    pmoq_msg_t msg = { 0 };
+    pmoq_bits_t namespace_items[PMOQ_TUPLE_SIZE_MAX];
+    uint64_t v;
+    pmoq_msg_view_field_t fields[] = {
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, subscribe_id),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_alias),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_namespace),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_name),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, filter_type),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, start_group),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, start_object),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, end_group),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, end_object),
+        PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, subscribe_parameters)
+    };
+
+    msg.namespace_items = namespace_items;
+    msg.namespace_items_max = PMOQ_TUPLE_SIZE_MAX;
+    if (pmoq_test_set_msg_from_test(&ref, test) != 0 ||
+        pmoq_msg_view(test->msg, test->msg + test->msg_len, &err, 0, &view) != test->msg + test->msg_len ||
+        view.msg_type != PMOQ_MSG_SUBSCRIBE) {
+        ret = -1;
+    }
+    else if (pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, subscribe_id), &v) != 0 ||
+        v != ref.u.subscribe.subscribe_id ||
+        pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_alias), &v) != 0 ||
+        v != ref.u.subscribe.track_alias ||
+        pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_name), &v) == 0 ||
+        pmoq_msg_view_varint(&view, (pmoq_msg_view_field_t){ PMOQ_MSG_SUBSCRIBE, offsetof(pmoq_msg_t, msg_type) }, &v) == 0) {
+        ret = -1;
+    }
+    else {
+        /* The fields that are present give back the parsed message */
+        for (size_t i = 0; ret == 0 && i < sizeof(fields) / sizeof(pmoq_msg_view_field_t); i++) {
+            int is_absent = 0;
+
+            if (i == 5 || i == 6) {
+                is_absent = ref.u.subscribe.filter_type < pmoq_msg_filter_absolute_start;
+            }
+            else if (i == 7 || i == 8) {
+                is_absent = ref.u.subscribe.filter_type != pmoq_msg_filter_absolute_range;
+            }
+            if ((pmoq_msg_view_field(&view, fields[i], &msg) != 0) != is_absent) {
+                ret = -1;
+            }
+        }
+        if (ret == 0 && mpoq_test_msg_compare(&msg, &ref) != 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int pmoq_msg_format_test_view()
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < format_test_cases_nb; i++) {
+        pmoq_msg_format_test_case_t* test = &format_test_cases[i];
+        pmoq_msg_view_t view;
+        int err = 0;
+
+        if (test->mode == pmoq_msg_test_mode_error) {
+            continue;
+        }
+        if (pmoq_msg_view(test->msg, test->msg + test->msg_len, &err, 0, &view) != test->msg + test->msg_len ||
+            view.msg_type != test->msg_type ||
+            pmoq_msg_view(test->msg, test->msg + test->msg_len - 1, &err, 0, &view) != NULL || err <= 0) {
+            ret = -1;
+        }
+        else if (test->msg_type == PMOQ_MSG_SUBSCRIBE) {
+            ret = pmoq_msg_format_test_view_subscribe(test);
+        }
+        if (ret != 0) {
+            printf("View test fails: format_test_cases[%zu]\n", i);
+        }
+    }
+
+    if (ret == 0) {
+        /* The namespace items must fit in the array provided by the caller */
+        pmoq_msg_view_t view;
+        pmoq_msg_t msg = { 0 };
+        int err = 0;
+
+        if (pmoq_msg_view(test_msg_announce_ok, test_msg_announce_ok + sizeof(test_msg_announce_ok), &err, 0, &view) == NULL ||
+            pmoq_msg_view_field(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_ANNOUNCE_OK, announce_ok, track_namespace), &msg) == 0) {
+            printf("View test fails: namespace items\n");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* The fields of a message of another type share their offsets in
+         * the union, e.g., status_code of SUBSCRIBE_DONE and track_alias
+         * of SUBSCRIBE, but are not fields of the view */
+        pmoq_msg_view_t view;
+        pmoq_msg_t msg = { 0 };
+        uint64_t v;
+        int err = 0;
+
+        if (pmoq_msg_view(test_msg_subscribe_done, test_msg_subscribe_done + sizeof(test_msg_subscribe_done), &err, 0, &view) == NULL ||
+            pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE_DONE, subscribe_done, status_code), &v) != 0 ||
+            pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, track_alias), &v) == 0 ||
+            pmoq_msg_view_varint(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_UNSUBSCRIBE, unsubscribe, subscribe_id), &v) == 0 ||
+            pmoq_msg_view_field(&view, PMOQ_MSG_VIEW_FIELD(PMOQ_MSG_SUBSCRIBE, subscribe, subscribe_id), &msg) == 0) {
+            printf("View test fails: field of another message type\n");
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,54 @@
+#ifndef FORMAT_TEST_H
+#define FORMAT_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Testing the formats
+* Each test case includes:
+* - A message type.
+* - A message encoding in binary.
+* - The value of the key specific type, cast as (void *)
+* - Whether the binary is the target encoding (0) , an alternate (1), or an error (2).
+*/
+
+typedef struct st_format_test_val_t {
+    char* t_name;
+    char* t_val;
+} format_test_val_t;
+
+#define FVAL(x, y) { #x, #y }
+
+typedef struct st_pmoq_msg_format_test_case_t {
+    uint64_t msg_type;
+    size_t msg_len;
+    uint8_t *msg;
+    format_test_val_t* ref_val;
+    size_t ref_val_size;
+#define pmoq_msg_test_mode_target 0
+#define pmoq_msg_test_mode_alternate 1
+#define pmoq_msg_test_mode_error 2
+    unsigned int mode;
+} pmoq_msg_format_test_case_t;
+
+#define FORMAT_TEST_CASE_OK(msg_type, msg, ref) \
+    { msg_type, sizeof(msg), msg, ref, sizeof(ref), pmoq_msg_test_mode_target }
+#define FORMAT_TEST_CASE_ALT(msg_type, msg, ref) \
+    { msg_type, sizeof(msg), msg, ref, sizeof(ref), pmoq_msg_test_mode_alternate }
+#define FORMAT_TEST_CASE_ERR(msg_type, msg) \
+    { msg_type, sizeof(msg), msg, NULL, 0, pmoq_msg_test_mode_error }
+
+/* Test corpus, shared by the tests and the benchmarks */
+extern pmoq_msg_format_test_case_t format_test_cases[];
+extern const size_t format_test_cases_nb;
+extern pmoq_strm_t format_test_strm[];
+extern size_t format_test_strm_nb;
+
+int pmoq_test_set_msg_from_test(pmoq_msg_t* msg, pmoq_msg_format_test_case_t* test);
+int mpoq_test_msg_compare(const pmoq_msg_t* msg, const pmoq_msg_t* msg2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FORMAT_TEST_H */
@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq/picomoq_test.h"
+
+/* Interned track name tests
+*/
+
+typedef struct st_pmoq_intern_test_name_t {
+    pmoq_tuple_t track_namespace;
+    pmoq_bits_t items[3];
+    pmoq_bits_t track_name;
+} pmoq_intern_test_name_t;
+
+static void pmoq_intern_test_name(pmoq_intern_test_name_t* name, const char* i0, const char* i1, const char* i2, const char* track_name)
+{
+    const char* texts[3] = { i0, i1, i2 };
+
+    name->track_namespace.nb_items = 0;
+    name->track_namespace.items_max = 3;
+    name->track_namespace.items = name->items;
+    for (size_t i = 0; i < 3 && texts[i] != NULL; i++) {
+        name->items[i].nb_bits = 8 * strlen(texts[i]);
+        name->items[i].bits = (uint8_t*)texts[i];
+        name->track_namespace.nb_items++;
+    }
+    name->track_name.nb_bits = 8 * strlen(track_name);
+    name->track_name.bits = (uint8_t*)track_name;
+}
+
+static int pmoq_intern_test_check(pmoq_intern_t* intern, pmoq_intern_id_t id, const pmoq_intern_test_name_t* expected)
+{
+    pmoq_intern_test_name_t name;
+    int ret = 0;
+
+    memset(&name, 0, sizeof(name));
+    name.track_namespace.items_max = 3;
+    name.track_namespace.items = name.items;
+    if (pmoq_intern_get(intern, id, &name.track_namespace, &name.track_name) != 0 ||
+        name.track_namespace.nb_items != expected->track_namespace.nb_items ||
+        name.track_name.nb_bits != expected->track_name.nb_bits ||
+        memcmp(name.track_name.bits, expected->track_name.bits, (size_t)(name.track_name.nb_bits >> 3)) != 0) {
+        ret = -1;
+    }
+    for (uint64_t i = 0; ret == 0 && i < name.track_namespace.nb_items; i++) {
+        if (name.items[i].nb_bits != expected->items[i].nb_bits ||
+            memcmp(name.items[i].bits, expected->items[i].bits, (size_t)(name.items[i].nb_bits >> 3)) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int pmoq_intern_test_basic()
+{
+    int ret = 0;
+    pmoq_intern_t* intern = pmoq_intern_create();
+    pmoq_intern_test_name_t names[4];
+    pmoq_intern_id_t ids[4];
+    pmoq_intern_id_t id;
+
+    if (intern == NULL) {
+        return -1;
+    }
+    /* Same bytes, split differently, and empty items */
+    pmoq_intern_test_name(&names[0], "ab", "c", NULL, "video");
+    pmoq_intern_test_name(&names[1], "a", "bc", NULL, "video");
+    pmoq_intern_test_name(&names[2], "ab", "c", "video", "");
+    pmoq_intern_test_name(&names[3], "", NULL, NULL, "");
+
+    for (int i = 0; ret == 0 && i < 4; i++) {
+        ids[i] = pmoq_intern_track(intern, &names[i].track_namespace, &names[i].track_name);
+        if (ids[i] == PMOQ_INTERN_ID_NONE || pmoq_intern_test_check(intern, ids[i], &names[i]) != 0) {
+            ret = -1;
+        }
+        for (int j = 0; ret == 0 && j < i; j++) {
+            if (ids[j] == ids[i] || pmoq_intern_hash(intern, ids[j]) == pmoq_intern_hash(intern, ids[i])) {
+                ret = -1;
+            }
+        }
+    }
+
+    /* Interning again returns the same ID, and takes a reference */
+    if (ret == 0) {
+        pmoq_intern_test_name_t copy;
+        char text[3] = { 'a', 'b', 0 };
+
+        pmoq_intern_test_name(&copy, text, "c", NULL, "video");
+        if (pmoq_intern_track(intern, &copy.track_namespace, &copy.track_name) != ids[0] ||
+            pmoq_intern_find(intern, &copy.track_namespace, &copy.track_name) != ids[0] ||
+            pmoq_intern_count(intern) != 4) {
+            ret = -1;
+        }
+        pmoq_intern_release(intern, ids[0]);
+        if (ret == 0 && pmoq_intern_find(intern, &copy.track_namespace, &copy.track_name) != ids[0]) {
+            ret = -1;
+        }
+        pmoq_intern_ref(intern, ids[1]);
+        pmoq_intern_release(intern, ids[0]);
+        pmoq_intern_release(intern, ids[1]);
+        if (ret == 0 && (pmoq_intern_find(intern, &copy.track_namespace, &copy.track_name) != PMOQ_INTERN_ID_NONE ||
+            pmoq_intern_get(intern, ids[0], &copy.track_namespace, &copy.track_name) == 0 ||
+            pmoq_intern_hash(intern, ids[0]) != 0 ||
+            pmoq_intern_test_check(intern, ids[1], &names[1]) != 0 || pmoq_intern_count(intern) != 3)) {
+            ret = -1;
+        }
+    }
+
+    /* Released IDs are reused */
+    if (ret == 0) {
+        pmoq_intern_test_name_t other;
+
+        pmoq_intern_test_name(&other, "other", NULL, NULL, "audio");
+        if ((id = pmoq_intern_track(intern, &other.track_namespace, &other.track_name)) != ids[0] ||
+            pmoq_intern_test_check(intern, id, &other) != 0) {
+            ret = -1;
+        }
+    }
+
+    /* Many names, then release of every other */
+    if (ret == 0) {
+        char texts[2000][8];
+        pmoq_intern_id_t many_ids[2000];
+
+        for (int i = 0; ret == 0 && i < 2000; i++) {
+            pmoq_intern_test_name_t name;
+
+            (void)sprintf(texts[i], "t%d", i);
+            pmoq_intern_test_name(&name, "many", texts[i], NULL, texts[i]);
+            if ((many_ids[i] = pmoq_intern_track(intern, &name.track_namespace, &name.track_name)) == PMOQ_INTERN_ID_NONE) {
+                ret = -1;
+            }
+        }
+        for (int i = 0; ret == 0 && i < 2000; i += 2) {
+            pmoq_intern_release(intern, many_ids[i]);
+        }
+        for (int i = 0; ret == 0 && i < 2000; i++) {
+            pmoq_intern_test_name_t name;
+
+            pmoq_intern_test_name(&name, "many", texts[i], NULL, texts[i]);
+            id = pmoq_intern_find(intern, &name.track_namespace, &name.track_name);
+            if ((i & 1) ? (id != many_ids[i] || pmoq_intern_test_check(intern, id, &name) != 0) : id != PMOQ_INTERN_ID_NONE) {
+                ret = -1;
+            }
+        }
+        if (ret == 0 && (pmoq_intern_count(intern) != 1004 || pmoq_intern_test_check(intern, ids[3], &names[3]) != 0)) {
+            ret = -1;
+        }
+    }
+
+    pmoq_intern_delete(intern);
+
+    return ret;
+}
@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq/picomoq_test.h"
+
+/* Namespace trie tests
+*/
+
+typedef struct st_pmoq_ns_test_ctx_t {
+    size_t nb_calls;
+    size_t depth_sum;
+    uint64_t owner_sum;
+    size_t stop_after;
+} pmoq_ns_test_ctx_t;
+
+static int pmoq_ns_test_fn(void* callback_ctx, const pmoq_ns_entry_t* entry, size_t depth)
+{
+    pmoq_ns_test_ctx_t* ctx = (pmoq_ns_test_ctx_t*)callback_ctx;
+
+    ctx->nb_calls++;
+    ctx->depth_sum += depth;
+    ctx->owner_sum += entry->owner_id;
+    if (entry->app_ctx != (void*)(uintptr_t)(entry->owner_id + 1)) {
+        return -1;
+    }
+    return (ctx->stop_after != 0 && ctx->nb_calls >= ctx->stop_after) ? 1 : 0;
+}
+
+/* Tuple of up to 4 text items */
+static void pmoq_ns_test_tuple(pmoq_tuple_t* tuple, pmoq_bits_t items[4], const char* i0, const char* i1, const char* i2, const char* i3)
+{
+    const char* texts[4] = { i0, i1, i2, i3 };
+
+    tuple->nb_items = 0;
+    tuple->items_max = 4;
+    tuple->items = items;
+    for (size_t i = 0; i < 4 && texts[i] != NULL; i++) {
+        items[i].nb_bits = 8 * strlen(texts[i]);
+        items[i].bits = (uint8_t*)texts[i];
+        tuple->nb_items++;
+    }
+}
+
+static int pmoq_ns_test_add(pmoq_ns_trie_t* trie, uint64_t owner_id, const char* i0, const char* i1, const char* i2, const char* i3)
+{
+    pmoq_tuple_t tuple;
+    pmoq_bits_t items[4];
+
+    pmoq_ns_test_tuple(&tuple, items, i0, i1, i2, i3);
+    return pmoq_ns_trie_add(trie, &tuple, owner_id, (void*)(uintptr_t)(owner_id + 1));
+}
+
+static int pmoq_ns_test_remove(pmoq_ns_trie_t* trie, uint64_t owner_id, const char* i0, const char* i1, const char* i2, const char* i3)
+{
+    pmoq_tuple_t tuple;
+    pmoq_bits_t items[4];
+
+    pmoq_ns_test_tuple(&tuple, items, i0, i1, i2, i3);
+    return pmoq_ns_trie_remove(trie, &tuple, owner_id);
+}
+
+static int pmoq_ns_test_walk(pmoq_ns_trie_t* trie, int is_subtree, pmoq_ns_test_ctx_t* ctx,
+    const char* i0, const char* i1, const char* i2, const char* i3)
+{
+    pmoq_tuple_t tuple;
+    pmoq_bits_t items[4];
+    size_t stop_after = ctx->stop_after;
+
+    memset(ctx, 0, sizeof(pmoq_ns_test_ctx_t));
+    ctx->stop_after = stop_after;
+    pmoq_ns_test_tuple(&tuple, items, i0, i1, i2, i3);
+    return (is_subtree) ? pmoq_ns_trie_subtree(trie, &tuple, pmoq_ns_test_fn, ctx) :
+        pmoq_ns_trie_prefixes(trie, &tuple, pmoq_ns_test_fn, ctx);
+}
+
+int pmoq_ns_test_basic()
+{
+    int ret = 0;
+    pmoq_ns_trie_t* trie = pmoq_ns_trie_create();
+    pmoq_ns_test_ctx_t ctx = { 0 };
+
+    if (trie == NULL) {
+        return -1;
+    }
+
+    if (pmoq_ns_test_add(trie, 1, "a", NULL, NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 1, "a", "b", NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 1, "a", "b", "c", NULL) != 0 ||
+        pmoq_ns_test_add(trie, 2, "a", "b", NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 1, "x", NULL, NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 1, "ab", "c", NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 3, NULL, NULL, NULL, NULL) != 0 ||
+        pmoq_ns_test_add(trie, 2, "a", "b", NULL, NULL) == 0 ||
+        pmoq_ns_trie_count(trie) != 7) {
+        ret = -1;
+    }
+
+    /* Items that only differ by their length in bits are distinct */
+    if (ret == 0) {
+        pmoq_tuple_t tuple;
+        pmoq_bits_t items[4];
+
+        pmoq_ns_test_tuple(&tuple, items, "a", NULL, NULL, NULL);
+        items[0].nb_bits = 4;
+        if (pmoq_ns_trie_add(trie, &tuple, 4, (void*)(uintptr_t)5) != 0 ||
+            pmoq_ns_trie_prefixes(trie, &tuple, pmoq_ns_test_fn, &ctx) != 0 ||
+            ctx.nb_calls != 2 || ctx.owner_sum != 7 ||
+            pmoq_ns_trie_remove(trie, &tuple, 4) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && (pmoq_ns_test_walk(trie, 0, &ctx, "a", "b", "c", "d") != 0 ||
+        ctx.nb_calls != 5 || ctx.depth_sum != 8 || ctx.owner_sum != 8)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_ns_test_walk(trie, 0, &ctx, "a", "c", NULL, NULL) != 0 ||
+        ctx.nb_calls != 2 || ctx.depth_sum != 1)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_ns_test_walk(trie, 1, &ctx, "a", NULL, NULL, NULL) != 0 ||
+        ctx.nb_calls != 4 || ctx.depth_sum != 8 || ctx.owner_sum != 5)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_ns_test_walk(trie, 1, &ctx, NULL, NULL, NULL, NULL) != 0 ||
+        ctx.nb_calls != 7 || ctx.depth_sum != 11)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_ns_test_walk(trie, 1, &ctx, "q", NULL, NULL, NULL) != 0 || ctx.nb_calls != 0 ||
+        pmoq_ns_test_walk(trie, 1, &ctx, "a", "b", "c", "d") != 0 || ctx.nb_calls != 0)) {
+        ret = -1;
+    }
+
+    /* The walks stop when the callback returns non zero */
+    if (ret == 0) {
+        ctx.stop_after = 2;
+        if (pmoq_ns_test_walk(trie, 1, &ctx, NULL, NULL, NULL, NULL) != 1 || ctx.nb_calls != 2 ||
+            pmoq_ns_test_walk(trie, 0, &ctx, "a", "b", NULL, NULL) != 1 || ctx.nb_calls != 2) {
+            ret = -1;
+        }
+        ctx.stop_after = 0;
+    }
+
+    /* Removals */
+    if (ret == 0 && (pmoq_ns_test_remove(trie, 2, "a", "b", NULL, NULL) != 0 ||
+        pmoq_ns_test_remove(trie, 2, "a", "b", NULL, NULL) == 0 ||
+        pmoq_ns_test_remove(trie, 1, "a", "b", "c", NULL) != 0 ||
+        pmoq_ns_test_remove(trie, 1, "a", "b", "c", "d") == 0 ||
+        pmoq_ns_test_walk(trie, 0, &ctx, "a", "b", "c", "d") != 0 || ctx.nb_calls != 3 ||
+        pmoq_ns_trie_count(trie) != 5)) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        pmoq_ns_trie_remove_owner(trie, 1);
+        if (pmoq_ns_trie_count(trie) != 1 ||
+            pmoq_ns_test_walk(trie, 1, &ctx, NULL, NULL, NULL, NULL) != 0 || ctx.nb_calls != 1 || ctx.owner_sum != 3 ||
+            pmoq_ns_test_remove(trie, 3, NULL, NULL, NULL, NULL) != 0 || pmoq_ns_trie_count(trie) != 0 ||
+            pmoq_ns_test_add(trie, 1, "a", "b", NULL, NULL) != 0 ||
+            pmoq_ns_test_walk(trie, 0, &ctx, "a", "b", "c", "d") != 0 || ctx.nb_calls != 1 || ctx.depth_sum != 2) {
+            ret = -1;
+        }
+    }
+
+    pmoq_ns_trie_delete(trie);
+
+    return ret;
+}
+
+int pmoq_ns_test_scale()
+{
+    int ret = 0;
+    pmoq_ns_trie_t* trie = pmoq_ns_trie_create();
+    pmoq_ns_test_ctx_t ctx = { 0 };
+    char names[16][4];
+
+    if (trie == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < 16; i++) {
+        (void)sprintf(names[i], "n%d", i);
+    }
+
+    /* Owner 1 has all the (i, j), owner 2 all the (i, j, k) */
+    for (int i = 0; ret == 0 && i < 16; i++) {
+        for (int j = 0; ret == 0 && j < 16; j++) {
+            if (pmoq_ns_test_add(trie, 1, names[i], names[j], NULL, NULL) != 0) {
+                ret = -1;
+            }
+            for (int k = 0; ret == 0 && k < 16; k++) {
+                if (pmoq_ns_test_add(trie, 2, names[i], names[j], names[k], NULL) != 0) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+    for (int i = 0; ret == 0 && i < 16; i++) {
+        if (pmoq_ns_test_walk(trie, 1, &ctx, names[i], NULL, NULL, NULL) != 0 || ctx.nb_calls != 16 + 256 ||
+            pmoq_ns_test_walk(trie, 0, &ctx, names[i], names[15 - i], names[i], "z") != 0 || ctx.nb_calls != 2 ||
+            ctx.owner_sum != 3) {
+            ret = -1;
+        }
+    }
+
+    /* Remove owner 1, then the odd k of owner 2 */
+    if (ret == 0) {
+        pmoq_ns_trie_remove_owner(trie, 1);
+        if (pmoq_ns_trie_count(trie) != 16 * 16 * 16) {
+            ret = -1;
+        }
+    }
+    for (int i = 0; ret == 0 && i < 16; i++) {
+        for (int j = 0; ret == 0 && j < 16; j++) {
+            for (int k = 1; ret == 0 && k < 16; k += 2) {
+                if (pmoq_ns_test_remove(trie, 2, names[i], names[j], names[k], NULL) != 0) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+    for (int i = 0; ret == 0 && i < 16; i++) {
+        if (pmoq_ns_test_walk(trie, 1, &ctx, names[i], NULL, NULL, NULL) != 0 || ctx.nb_calls != 128 ||
+            pmoq_ns_test_walk(trie, 0, &ctx, names[i], names[i], names[(2 * i) & 15], NULL) != 0 || ctx.nb_calls != 1 ||
+            pmoq_ns_test_walk(trie, 0, &ctx, names[i], names[i], names[1], NULL) != 0 || ctx.nb_calls != 0) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        pmoq_ns_trie_remove_owner(trie, 2);
+        if (pmoq_ns_trie_count(trie) != 0 || pmoq_ns_test_walk(trie, 1, &ctx, NULL, NULL, NULL, NULL) != 0 || ctx.nb_calls != 0) {
+            ret = -1;
+        }
+    }
+
+    pmoq_ns_trie_delete(trie);
+
+    return ret;
+}
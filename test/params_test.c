@@ -0,0 +1,337 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq/picomoq_test.h"
+
+/* Parameter registry tests
+*/
+
+#define PARAMS_TEST_BITRATE 0x20
+#define PARAMS_TEST_TENANT 0x21
+#define PARAMS_TEST_TRACE 0x22
+#define PARAMS_TEST_UNKNOWN 0x23
+#define PARAMS_TEST_REGION 0x30
+#define PARAMS_TEST_TRACE_LENGTH 4
+
+static uint8_t params_test_tenant[] = { 't', 'e', 'n', 'a', 'n', 't' };
+static uint8_t params_test_trace[PARAMS_TEST_TRACE_LENGTH] = { 1, 2, 3, 4 };
+static uint8_t params_test_bad_trace[PARAMS_TEST_TRACE_LENGTH + 1] = { 1, 2, 3, 4, 5 };
+
+/* The trace context has a fixed length, its first byte is the version */
+static int params_test_trace_decode(void* decode_ctx, pmoq_param_value_t* value)
+{
+    int* nb_calls = (int*)decode_ctx;
+
+    (*nb_calls)++;
+    if (value->length != PARAMS_TEST_TRACE_LENGTH) {
+        return -1;
+    }
+    value->varint = value->bytes[0];
+    return 0;
+}
+
+static pmoq_param_registry_t* params_test_registry(int* nb_calls)
+{
+    pmoq_param_registry_t* registry = pmoq_param_registry_create();
+
+    if (registry != NULL &&
+        (pmoq_param_registry_add(registry, PARAMS_TEST_BITRATE, 0, pmoq_param_type_varint, NULL, NULL) != 0 ||
+        pmoq_param_registry_add(registry, PARAMS_TEST_TENANT, 0, pmoq_param_type_bytes, NULL, NULL) != 0 ||
+        pmoq_param_registry_add(registry, PARAMS_TEST_TRACE, 0, pmoq_param_type_custom, params_test_trace_decode, nb_calls) != 0 ||
+        pmoq_param_registry_add(registry, PARAMS_TEST_REGION, 1, pmoq_param_type_varint, NULL, NULL) != 0)) {
+        pmoq_param_registry_delete(registry);
+        registry = NULL;
+    }
+    return registry;
+}
+
+static int params_test_set_value(pmoq_param_values_t* values, uint64_t key, int is_varint, uint64_t v, uint8_t* bytes, size_t length)
+{
+    pmoq_param_value_t* value;
+
+    if (values->nb_values >= values->values_max) {
+        return -1;
+    }
+    value = &values->values[values->nb_values++];
+
+    value->key = key;
+    value->is_varint = (uint8_t)is_varint;
+    value->varint = v;
+    value->bytes = bytes;
+    value->length = length;
+    return 0;
+}
+
+static size_t params_test_subscribe(uint8_t* buf, size_t buf_size, uint8_t* trace, size_t trace_length, int twice)
+{
+    pmoq_msg_t msg = { 0 };
+    pmoq_subscribe_parameters_t* param = &msg.u.subscribe.subscribe_parameters;
+    pmoq_param_value_t values[PMOQ_PARAM_VALUES_MAX];
+    uint8_t* bytes;
+
+    msg.msg_type = PMOQ_MSG_SUBSCRIBE;
+    msg.u.subscribe.subscribe_id = 1;
+    msg.u.subscribe.track_alias = 2;
+    msg.u.subscribe.track_name.nb_bits = 8 * sizeof(params_test_tenant);
+    msg.u.subscribe.track_name.bits = params_test_tenant;
+    msg.u.subscribe.filter_type = pmoq_msg_filter_latest_group;
+    param->has_delivery_timeout = 1;
+    param->delivery_timeout = 1000;
+    param->extensions.values = values;
+    param->extensions.values_max = PMOQ_PARAM_VALUES_MAX;
+    if (params_test_set_value(&param->extensions, PARAMS_TEST_BITRATE, 1, 2500000, NULL, 0) != 0 ||
+        params_test_set_value(&param->extensions, PARAMS_TEST_TENANT, 0, 0, params_test_tenant, sizeof(params_test_tenant)) != 0 ||
+        params_test_set_value(&param->extensions, PARAMS_TEST_UNKNOWN, 1, 17, NULL, 0) != 0 ||
+        params_test_set_value(&param->extensions, PARAMS_TEST_TRACE, 0, 0, trace, trace_length) != 0 ||
+        (twice && params_test_set_value(&param->extensions, PARAMS_TEST_BITRATE, 1, 1, NULL, 0) != 0)) {
+        return 0;
+    }
+    bytes = pmoq_msg_format(buf, buf + buf_size, &msg);
+
+    return (bytes == NULL || (size_t)(bytes - buf) != pmoq_msg_encoded_size(&msg)) ? 0 : (size_t)(bytes - buf);
+}
+
+static int params_test_check_subscribe(const pmoq_msg_t* msg)
+{
+    const pmoq_subscribe_parameters_t* param = &msg->u.subscribe.subscribe_parameters;
+    const pmoq_param_value_t* value;
+
+    if (msg->msg_type != PMOQ_MSG_SUBSCRIBE || !param->has_delivery_timeout || param->delivery_timeout != 1000 ||
+        param->extensions.nb_values != 3 || pmoq_param_values_find(&param->extensions, PARAMS_TEST_UNKNOWN) != NULL) {
+        return -1;
+    }
+    if ((value = pmoq_param_values_find(&param->extensions, PARAMS_TEST_BITRATE)) == NULL ||
+        !value->is_varint || value->varint != 2500000) {
+        return -1;
+    }
+    if ((value = pmoq_param_values_find(&param->extensions, PARAMS_TEST_TENANT)) == NULL ||
+        value->is_varint || value->length != sizeof(params_test_tenant) ||
+        memcmp(value->bytes, params_test_tenant, sizeof(params_test_tenant)) != 0) {
+        return -1;
+    }
+    if ((value = pmoq_param_values_find(&param->extensions, PARAMS_TEST_TRACE)) == NULL ||
+        value->length != PARAMS_TEST_TRACE_LENGTH || value->varint != params_test_trace[0] ||
+        memcmp(value->bytes, params_test_trace, PARAMS_TEST_TRACE_LENGTH) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int pmoq_params_test_registry()
+{
+    int ret = 0;
+    int nb_calls = 0;
+    pmoq_param_registry_t* registry = params_test_registry(&nb_calls);
+
+    if (registry == NULL) {
+        ret = -1;
+    }
+    /* Keys already registered, by the library or the application, or not valid */
+    else if (pmoq_param_registry_add(registry, PMOQ_PARAMETER_AUTHORIZATION_INFO, 0, pmoq_param_type_bytes, NULL, NULL) == 0 ||
+        pmoq_param_registry_add(registry, PMOQ_SETUP_PARAMETER_ROLE, 1, pmoq_param_type_varint, NULL, NULL) == 0 ||
+        pmoq_param_registry_add(registry, PARAMS_TEST_TENANT, 0, pmoq_param_type_varint, NULL, NULL) == 0 ||
+        pmoq_param_registry_add(registry, 0x4000000000000000ull, 0, pmoq_param_type_varint, NULL, NULL) == 0 ||
+        pmoq_param_registry_add(registry, 0x40, 0, pmoq_param_type_custom, NULL, NULL) == 0) {
+        ret = -1;
+    }
+    /* The key spaces of the setup and other parameters are separate */
+    else if (pmoq_param_registry_add(registry, PARAMS_TEST_TENANT, 1, pmoq_param_type_bytes, NULL, NULL) != 0 ||
+        pmoq_param_registry_add(registry, PMOQ_SETUP_PARAMETER_PATH, 0, pmoq_param_type_bytes, NULL, NULL) != 0) {
+        ret = -1;
+    }
+    else {
+        /* Keys that share their low bits need another multiplier. All the
+         * keys remain found, until each space has PMOQ_PARAM_VALUES_MAX keys. */
+        uint64_t key = 0x1000;
+        int nb_added = 0;
+
+        while (pmoq_param_registry_add(registry, key, 0, pmoq_param_type_varint, NULL, NULL) == 0) {
+            key += 0x1000;
+            nb_added++;
+        }
+        if (nb_added != PMOQ_PARAM_VALUES_MAX - 4) {
+            ret = -1;
+        }
+        for (uint64_t k = 0x1000; ret == 0 && k < key; k += 0x1000) {
+            if (pmoq_param_registry_add(registry, k, 0, pmoq_param_type_varint, NULL, NULL) == 0) {
+                ret = -1;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        /* The keys are found when decoding */
+        uint8_t buf[256];
+        size_t length = params_test_subscribe(buf, sizeof(buf), params_test_trace, sizeof(params_test_trace), 0);
+        pmoq_param_value_t values[PMOQ_PARAM_VALUES_MAX];
+        pmoq_msg_t msg = { 0 };
+        int err = 0;
+
+        msg.registry = registry;
+        msg.param_values = values;
+        msg.param_values_max = PMOQ_PARAM_VALUES_MAX;
+        if (length == 0 || pmoq_msg_parse(buf, buf + length, &err, 0, &msg) != buf + length ||
+            params_test_check_subscribe(&msg) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Params registry test fails\n");
+    }
+    pmoq_param_registry_delete(registry);
+
+    return ret;
+}
+
+int pmoq_params_test_decode()
+{
+    int ret = 0;
+    int nb_calls = 0;
+    pmoq_param_registry_t* registry = params_test_registry(&nb_calls);
+    uint8_t buf[256];
+    uint8_t copy[256];
+    size_t length = params_test_subscribe(buf, sizeof(buf), params_test_trace, sizeof(params_test_trace), 0);
+    pmoq_param_value_t values[PMOQ_PARAM_VALUES_MAX];
+    pmoq_msg_t msg = { 0 };
+    int err = 0;
+
+    if (registry == NULL || length == 0) {
+        ret = -1;
+    }
+    /* The extensions are kept out of the message, in caller storage */
+    else if (sizeof(pmoq_subscribe_parameters_t) >= PMOQ_PARAM_VALUES_MAX * sizeof(pmoq_param_value_t) ||
+        sizeof(pmoq_setup_parameters_t) >= PMOQ_PARAM_VALUES_MAX * sizeof(pmoq_param_value_t)) {
+        ret = -1;
+    }
+    /* Without registry, only the keys known to the library are decoded */
+    else if (pmoq_msg_parse(buf, buf + length, &err, 0, &msg) != buf + length ||
+        msg.u.subscribe.subscribe_parameters.delivery_timeout != 1000 ||
+        msg.u.subscribe.subscribe_parameters.extensions.nb_values != 0) {
+        ret = -1;
+    }
+    else {
+        msg.registry = registry;
+        msg.param_values = values;
+        msg.param_values_max = PMOQ_PARAM_VALUES_MAX;
+        if (pmoq_msg_parse(buf, buf + length, &err, 0, &msg) != buf + length ||
+            params_test_check_subscribe(&msg) != 0 || nb_calls != 1) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* Without space for the values, the message cannot be decoded */
+        msg.param_values_max = 2;
+        if (pmoq_msg_parse(buf, buf + length, &err, 0, &msg) != NULL || err != -1) {
+            ret = -1;
+        }
+        msg.param_values = NULL;
+        if (pmoq_msg_parse(buf, buf + length, &err, 0, &msg) != NULL || err != -1) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* The values are copied in the arena */
+        uint8_t storage[256];
+        pmoq_arena_t arena;
+
+        pmoq_arena_init(&arena, storage, sizeof(storage));
+        memcpy(copy, buf, length);
+        memset(&msg, 0, sizeof(msg));
+        msg.registry = registry;
+        msg.arena = &arena;
+        if (pmoq_msg_parse(copy, copy + length, &err, 0, &msg) != copy + length) {
+            ret = -1;
+        }
+        memset(copy, 0, length);
+        if (ret == 0 && params_test_check_subscribe(&msg) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* The resumable parser decodes the same values, byte by byte */
+        pmoq_msg_parser_t* parser = pmoq_msg_parser_create();
+        const pmoq_msg_t* parsed = NULL;
+
+        if (parser == NULL) {
+            ret = -1;
+        }
+        else {
+            pmoq_msg_parser_set_registry(parser, registry);
+            for (size_t i = 0; ret == 0 && i < length; i++) {
+                if (pmoq_msg_parser_feed(parser, buf + i, buf + i + 1, &err) != buf + i + 1) {
+                    ret = -1;
+                }
+                else if ((parsed = pmoq_msg_parser_next(parser)) != NULL && i + 1 != length) {
+                    ret = -1;
+                }
+            }
+            if (ret == 0 && (parsed == NULL || params_test_check_subscribe(parsed) != 0)) {
+                ret = -1;
+            }
+            pmoq_msg_parser_delete(parser);
+        }
+    }
+
+    if (ret == 0) {
+        /* A key defined twice, or a value rejected by the decoder */
+        size_t l_twice = params_test_subscribe(buf, sizeof(buf), params_test_trace, sizeof(params_test_trace), 1);
+        size_t l_bad = params_test_subscribe(copy, sizeof(copy), params_test_bad_trace, sizeof(params_test_bad_trace), 0);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.registry = registry;
+        msg.param_values = values;
+        msg.param_values_max = PMOQ_PARAM_VALUES_MAX;
+        if (l_twice == 0 || pmoq_msg_parse(buf, buf + l_twice, &err, 0, &msg) != NULL || err != -1 ||
+            l_bad == 0 || pmoq_msg_parse(copy, copy + l_bad, &err, 0, &msg) != NULL || err != -1) {
+            ret = -1;
+        }
+        msg.registry = NULL;
+        if (ret == 0 && (pmoq_msg_parse(buf, buf + l_twice, &err, 0, &msg) == NULL ||
+            pmoq_msg_parse(copy, copy + l_bad, &err, 0, &msg) == NULL)) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* Setup parameters */
+        pmoq_msg_t setup = { 0 };
+        pmoq_param_value_t setup_values[2];
+        uint8_t* bytes;
+        const pmoq_param_value_t* value;
+
+        setup.msg_type = PMOQ_MSG_CLIENT_SETUP;
+        setup.u.client_setup.supported_versions_nb = 1;
+        setup.u.client_setup.supported_versions[0] = PMOQ_VERSION_DRAFT_07;
+        setup.u.client_setup.setup_parameters.role = pmoq_setup_role_pubsub;
+        setup.u.client_setup.setup_parameters.extensions.values = setup_values;
+        setup.u.client_setup.setup_parameters.extensions.values_max = 2;
+        memset(&msg, 0, sizeof(msg));
+        msg.registry = registry;
+        msg.param_values = values;
+        msg.param_values_max = PMOQ_PARAM_VALUES_MAX;
+        /* The bitrate is registered for the other parameters, ignored in setup */
+        if (params_test_set_value(&setup.u.client_setup.setup_parameters.extensions, PARAMS_TEST_REGION, 1, 7, NULL, 0) != 0 ||
+            params_test_set_value(&setup.u.client_setup.setup_parameters.extensions, PARAMS_TEST_BITRATE, 1, 8, NULL, 0) != 0 ||
+            (bytes = pmoq_msg_format(buf, buf + sizeof(buf), &setup)) == NULL ||
+            pmoq_msg_parse(buf, bytes, &err, 0, &msg) != bytes ||
+            msg.u.client_setup.setup_parameters.role != pmoq_setup_role_pubsub ||
+            msg.u.client_setup.setup_parameters.extensions.nb_values != 1 ||
+            (value = pmoq_param_values_find(&msg.u.client_setup.setup_parameters.extensions, PARAMS_TEST_REGION)) == NULL ||
+            value->varint != 7) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Params decode test fails\n");
+    }
+    pmoq_param_registry_delete(registry);
+
+    return ret;
+}
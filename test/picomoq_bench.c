@@ -0,0 +1,189 @@
+
+#ifdef _WINDOWS
+#include "getopt.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq_shard.h"
+#include "picomoq/picomoq_test.h"
+
+void picoquic_tls_api_unload();
+
+#define PMOQ_BENCH_CERT_FILE "../picoquic/certs/cert.pem"
+#define PMOQ_BENCH_KEY_FILE "../picoquic/certs/key.pem"
+#define PMOQ_BENCH_SHARD_PORT 4433
+
+int usage(char const * argv0)
+{
+    fprintf(stderr, "Picomoq codec and relay benchmarks\n");
+    fprintf(stderr, "Usage: %s [-i iterations] [-f json|csv] [-o file]\n", argv0);
+    fprintf(stderr, "       %s -r [-n subscribers] [-d seconds] [-c cert] [-k key] [-f json|csv] [-o file]\n", argv0);
+    fprintf(stderr, "       %s -s shards [-d seconds] [-p port] [-c cert] [-k key] [-f json|csv] [-o file]\n", argv0);
+    fprintf(stderr, "Options: \n");
+    fprintf(stderr, "  -i iterations     Number of iterations per message and operation, default 1000000.\n");
+    fprintf(stderr, "  -r                Run the relay benchmark instead of the codec benchmark.\n");
+    fprintf(stderr, "  -n subscribers    Number of subscribers of the relay, default 10.\n");
+    fprintf(stderr, "  -s shards         Run the loopback benchmark of the sharded relay, with 1, 2, 4...\n");
+    fprintf(stderr, "                    up to the given number of shards.\n");
+    fprintf(stderr, "  -d seconds        Simulated duration of the relay benchmark, or duration of\n");
+    fprintf(stderr, "                    each run of the shard benchmark, default 10.\n");
+    fprintf(stderr, "  -p port           Loopback port of the shards, default %d.\n", PMOQ_BENCH_SHARD_PORT);
+    fprintf(stderr, "  -c cert           Certificate of the relay, default %s.\n", PMOQ_BENCH_CERT_FILE);
+    fprintf(stderr, "  -k key            Private key of the relay, default %s.\n", PMOQ_BENCH_KEY_FILE);
+    fprintf(stderr, "  -f json|csv       Output format, default json.\n");
+    fprintf(stderr, "  -o file           Write the results to the file instead of stdout.\n");
+    fprintf(stderr, "  -h                Print this help message\n");
+
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret = 0;
+    int opt;
+    uint64_t nb_iterations = 1000000;
+    int is_csv = 0;
+    char const* out_file = NULL;
+    FILE* F = stdout;
+    int is_relay = 0;
+    pmoq_relay_bench_config_t config = { 0 };
+    pmoq_shard_bench_config_t shard_config = { 0 };
+
+    config.nb_subscribers = 10;
+    config.duration = 10000000;
+    config.link_latency = 10000;
+    config.link_rate = 1000000000;
+    config.cert_file = PMOQ_BENCH_CERT_FILE;
+    config.key_file = PMOQ_BENCH_KEY_FILE;
+    shard_config.duration = 10000000;
+    shard_config.port = PMOQ_BENCH_SHARD_PORT;
+
+    while (ret == 0 && (opt = getopt(argc, argv, "hi:f:o:rn:s:d:p:c:k:")) != -1) {
+        switch (opt) {
+        case 'i': {
+            long long i_iterations = atoll(optarg);
+            if (i_iterations <= 0) {
+                fprintf(stderr, "Incorrect number of iterations: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            else {
+                nb_iterations = (uint64_t)i_iterations;
+            }
+            break;
+        }
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                is_csv = 1;
+            }
+            else if (strcmp(optarg, "json") == 0) {
+                is_csv = 0;
+            }
+            else {
+                fprintf(stderr, "Incorrect output format: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'r':
+            is_relay = 1;
+            break;
+        case 'n': {
+            int n_subscribers = atoi(optarg);
+            if (n_subscribers <= 0) {
+                fprintf(stderr, "Incorrect number of subscribers: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            else {
+                config.nb_subscribers = (size_t)n_subscribers;
+            }
+            break;
+        }
+        case 'd': {
+            int d_seconds = atoi(optarg);
+            if (d_seconds <= 0) {
+                fprintf(stderr, "Incorrect duration: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            else {
+                config.duration = ((uint64_t)d_seconds) * 1000000;
+                shard_config.duration = config.duration;
+            }
+            break;
+        }
+        case 's': {
+            int s_shards = atoi(optarg);
+            if (s_shards <= 0 || s_shards > PMOQ_SHARD_MAX) {
+                fprintf(stderr, "Incorrect number of shards: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            else {
+                shard_config.nb_shards_max = (size_t)s_shards;
+            }
+            break;
+        }
+        case 'p': {
+            int p_port = atoi(optarg);
+            if (p_port <= 0 || p_port > 0xffff) {
+                fprintf(stderr, "Incorrect port: %s\n", optarg);
+                ret = usage(argv[0]);
+            }
+            else {
+                shard_config.port = (uint16_t)p_port;
+            }
+            break;
+        }
+        case 'c':
+            config.cert_file = optarg;
+            break;
+        case 'k':
+            config.key_file = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+            break;
+        default:
+            ret = usage(argv[0]);
+            break;
+        }
+    }
+
+    if (ret == 0 && out_file != NULL) {
+        if ((F = picoquic_file_open(out_file, "w")) == NULL) {
+            fprintf(stderr, "Cannot open %s\n", out_file);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        debug_printf_suspend();
+        if (shard_config.nb_shards_max > 0) {
+            shard_config.cert_file = config.cert_file;
+            shard_config.key_file = config.key_file;
+            ret = pmoq_shard_bench(F, &shard_config, is_csv);
+        }
+        else if (is_relay) {
+            ret = pmoq_relay_bench(F, &config, is_csv);
+        }
+        else {
+            ret = pmoq_format_bench(F, nb_iterations, is_csv);
+        }
+        if (ret != 0) {
+            fprintf(stderr, "Benchmark failed, error: %d.\n", ret);
+        }
+    }
+
+    if (F != NULL && F != stdout) {
+        (void)picoquic_file_close(F);
+    }
+    picoquic_tls_api_unload();
+
+    return (ret);
+}
@@ -28,7 +28,39 @@ typedef enum {
 static const picoquic_test_def_t test_table[] = {
     { "format_parse", pmoq_msg_format_test_parse },
     { "format_format", pmoq_msg_format_test_format },
-    { "format_varlen", pmoq_msg_format_test_varlen }
+    { "format_varlen", pmoq_msg_format_test_varlen },
+    { "format_stream", pmoq_msg_format_test_stream },
+    { "format_size", pmoq_msg_format_test_size },
+    { "format_arena", pmoq_msg_format_test_arena },
+    { "format_fast_decode", pmoq_msg_format_test_fast_decode },
+    { "format_subgroup_batch", pmoq_msg_format_test_subgroup_batch },
+    { "format_iov", pmoq_msg_format_test_iov },
+    { "format_codec", pmoq_msg_format_test_codec },
+    { "format_skip", pmoq_msg_format_test_skip },
+    { "format_view", pmoq_msg_format_test_view },
+    { "session_setup", pmoq_session_test_setup },
+    { "session_errors", pmoq_session_test_errors },
+    { "cache_basic", pmoq_cache_test_basic },
+    { "cache_eviction", pmoq_cache_test_eviction },
+    { "cache_expiry", pmoq_cache_test_expiry },
+    { "subs_basic", pmoq_subs_test_basic },
+    { "subs_scale", pmoq_subs_test_scale },
+    { "ns_basic", pmoq_ns_test_basic },
+    { "ns_scale", pmoq_ns_test_scale },
+    { "intern_basic", pmoq_intern_test_basic },
+    { "sched_order", pmoq_sched_test_order },
+    { "sched_deadline", pmoq_sched_test_deadline },
+    { "timer_wheel", pmoq_timer_test_wheel },
+    { "dgram_relay", pmoq_dgram_test_relay },
+    { "dgram_drops", pmoq_dgram_test_drops },
+    { "shard_route", pmoq_shard_test_route },
+    { "shard_threads", pmoq_shard_test_threads },
+    { "sendq_fanout", pmoq_sendq_test_fanout },
+    { "sendq_refcount", pmoq_sendq_test_refcount },
+    { "stats_histo", pmoq_stats_test_histo },
+    { "stats_counts", pmoq_stats_test_counts },
+    { "params_registry", pmoq_params_test_registry },
+    { "params_decode", pmoq_params_test_decode }
 };
 
 static size_t const nb_tests = sizeof(test_table) / sizeof(picoquic_test_def_t);
@@ -0,0 +1,1163 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include <picosocks.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_session.h"
+#include "picomoq_datagram.h"
+#include "picomoq_sendq.h"
+#include "picomoq/picomoq_test.h"
+
+/* End to end benchmark of a relay.
+*
+* A publisher, a relay and N subscribers run in the same process, each
+* with a picoquic context, over simulated links: the packets are queued
+* with the serialization delay of the link rate and the propagation delay,
+* and the time is simulated, so the run does not depend on the load of
+* the machine. The publisher connects to the relay, and so do the
+* subscribers, all from the same simulated address.
+*
+* Each subscriber subscribes to two tracks. The relay subscribes to the
+* publisher when it receives the first subscription, caches the objects,
+* and forwards them to the subscribers, sharing the payloads between them.
+* The video track is sent on subgroup streams, one per group of 30
+* frames at 30 frames per second, with a large first frame. The audio
+* track is sent in datagrams, 50 per second. Each payload starts with the
+* simulated time at which it was published, so the subscribers measure
+* the latency of each object.
+*
+* Reported:
+* - objects delivered per second of processing time, for the whole
+*   process and for the relay alone;
+* - latency percentiles of the objects, in simulated time, which account
+*   for the queues and congestion control but not for the processing;
+* - processing time per delivered megabyte, for the whole process (CPU
+*   time) and for the relay alone (wall clock time of the relay calls,
+*   the run being single threaded).
+*/
+
+#define PMOQ_RB_NB_TRACKS 2
+#define PMOQ_RB_TRACK_VIDEO 0
+#define PMOQ_RB_TRACK_AUDIO 1
+#define PMOQ_RB_VIDEO_INTERVAL 33333
+#define PMOQ_RB_VIDEO_GROUP_SIZE 30
+#define PMOQ_RB_VIDEO_KEY_FRAME_SIZE 40000
+#define PMOQ_RB_VIDEO_FRAME_SIZE 6000
+#define PMOQ_RB_AUDIO_INTERVAL 20000
+#define PMOQ_RB_AUDIO_GROUP_SIZE 50
+#define PMOQ_RB_AUDIO_FRAME_SIZE 160
+#define PMOQ_RB_TIMESTAMP_SIZE 8
+/* Objects are published after the connections are set up */
+#define PMOQ_RB_START_TIME 1000000
+#define PMOQ_RB_SAMPLES_MAX 1000000
+#define PMOQ_RB_CACHE_BUDGET 0x4000000
+#define PMOQ_RB_DATAGRAM_SIZE_MAX 1200
+#define PMOQ_RB_MATCHES_MAX 64
+#define PMOQ_RB_TRACKS_MAX 16
+#define PMOQ_RB_PACKETS_PER_ROUND 64
+
+#define PMOQ_RB_PORT_RELAY 4443
+#define PMOQ_RB_PORT_PUBLISHER 5001
+#define PMOQ_RB_PORT_SUBSCRIBERS 5002
+
+static char const* pmoq_rb_track_names[PMOQ_RB_NB_TRACKS] = { "video", "audio" };
+static char const* pmoq_rb_namespace = "bench";
+
+typedef enum {
+    pmoq_rb_node_publisher = 0,
+    pmoq_rb_node_relay,
+    pmoq_rb_node_subscribers,
+    pmoq_rb_nb_nodes
+} pmoq_rb_node_enum;
+
+/* Simulated links */
+typedef struct st_pmoq_rb_packet_t {
+    struct st_pmoq_rb_packet_t* next;
+    uint64_t arrival_time;
+    size_t length;
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_to;
+    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+} pmoq_rb_packet_t;
+
+typedef struct st_pmoq_rb_link_t {
+    pmoq_rb_node_enum target;
+    uint64_t latency;
+    uint64_t rate;
+    uint64_t busy_until;
+    pmoq_rb_packet_t* first;
+    pmoq_rb_packet_t* last;
+} pmoq_rb_link_t;
+
+typedef enum {
+    pmoq_rb_link_publisher_up = 0,
+    pmoq_rb_link_publisher_down,
+    pmoq_rb_link_subscribers_up,
+    pmoq_rb_link_subscribers_down,
+    pmoq_rb_nb_links
+} pmoq_rb_link_enum;
+
+typedef struct st_pmoq_relay_bench_t pmoq_relay_bench_t;
+typedef struct st_pmoq_rb_conn_t pmoq_rb_conn_t;
+
+/* Reader of the subgroup streams. The stream and object headers are
+ * reassembled in a small buffer; the payloads are passed through. */
+typedef struct st_pmoq_rb_reader_t {
+    pmoq_rb_conn_t* conn;
+    uint8_t pending[PMOQ_STRM_HEADER_SIZE_MAX];
+    size_t pending_length;
+    int has_header;
+    int in_payload;
+    pmoq_strm_t header;
+    /* Fields of the stream header and of the current object */
+    pmoq_strm_t object;
+    uint64_t remaining;
+    uint8_t timestamp[PMOQ_RB_TIMESTAMP_SIZE];
+    size_t timestamp_length;
+} pmoq_rb_reader_t;
+
+/* Streams in use, either sent from a send queue or read */
+typedef struct st_pmoq_rb_stream_t {
+    picoquic_cnx_t* cnx;
+    uint64_t stream_id;
+    pmoq_sendq_t* sendq;
+    pmoq_rb_reader_t* reader;
+} pmoq_rb_stream_t;
+
+struct st_pmoq_rb_conn_t {
+    pmoq_relay_bench_t* bench;
+    pmoq_rb_node_enum node;
+    uint64_t connection_id;
+    picoquic_cnx_t* cnx;
+    pmoq_session_t* session;
+    pmoq_dgram_t* dgram;
+    pmoq_rb_conn_t* next;
+};
+
+/* Subscription of a subscriber at the relay */
+typedef struct st_pmoq_rb_downstream_t {
+    pmoq_rb_conn_t* conn;
+    uint64_t subscribe_id;
+    uint64_t track_alias;
+    uint64_t group_id;
+    pmoq_sendq_t* sendq;
+    struct st_pmoq_rb_downstream_t* next;
+} pmoq_rb_downstream_t;
+
+/* Track at the publisher */
+typedef struct st_pmoq_rb_published_t {
+    int is_subscribed;
+    uint64_t subscribe_id;
+    uint64_t track_alias;
+    uint64_t next_time;
+    uint64_t nb_frames;
+    pmoq_sendq_t* sendq;
+} pmoq_rb_published_t;
+
+typedef struct st_pmoq_rb_relay_track_t {
+    pmoq_intern_id_t track_key;
+    int is_subscribed;
+} pmoq_rb_relay_track_t;
+
+struct st_pmoq_relay_bench_t {
+    pmoq_relay_bench_config_t config;
+    uint64_t simulated_time;
+    uint64_t end_time;
+    picoquic_quic_t* quic[pmoq_rb_nb_nodes];
+    struct sockaddr_in addr[pmoq_rb_nb_nodes];
+    pmoq_rb_link_t links[pmoq_rb_nb_links];
+    pmoq_rb_conn_t* conns;
+    uint64_t nb_conns;
+    pmoq_rb_stream_t* streams;
+    size_t nb_streams;
+    size_t streams_max;
+    /* Publisher */
+    pmoq_rb_conn_t* publisher;
+    pmoq_rb_published_t published[PMOQ_RB_NB_TRACKS];
+    /* Relay */
+    pmoq_rb_conn_t* upstream;
+    pmoq_cache_t* cache;
+    pmoq_subs_t* subs;
+    pmoq_intern_t* intern;
+    pmoq_rb_relay_track_t relay_tracks[PMOQ_RB_TRACKS_MAX];
+    size_t nb_relay_tracks;
+    pmoq_rb_downstream_t* downstreams;
+    uint64_t relay_time;
+    /* Results */
+    uint64_t nb_published;
+    uint64_t nb_delivered;
+    uint64_t bytes_delivered;
+    uint64_t* samples;
+    size_t nb_samples;
+    int nb_ready;
+    int nb_closed;
+};
+
+/* Simulated links */
+static void pmoq_rb_link_submit(pmoq_rb_link_t* link, pmoq_rb_packet_t* packet, uint64_t current_time)
+{
+    uint64_t transmit_time = (packet->length * 8 * 1000000) / link->rate;
+
+    if (link->busy_until < current_time) {
+        link->busy_until = current_time;
+    }
+    link->busy_until += transmit_time;
+    packet->arrival_time = link->busy_until + link->latency;
+    packet->next = NULL;
+    if (link->last == NULL) {
+        link->first = packet;
+    }
+    else {
+        link->last->next = packet;
+    }
+    link->last = packet;
+}
+
+static pmoq_rb_packet_t* pmoq_rb_link_dequeue(pmoq_rb_link_t* link, uint64_t current_time)
+{
+    pmoq_rb_packet_t* packet = link->first;
+
+    if (packet == NULL || packet->arrival_time > current_time) {
+        return NULL;
+    }
+    link->first = packet->next;
+    if (link->first == NULL) {
+        link->last = NULL;
+    }
+    return packet;
+}
+
+/* Streams */
+static int pmoq_rb_stream_add(pmoq_relay_bench_t* bench, picoquic_cnx_t* cnx, uint64_t stream_id,
+    pmoq_sendq_t* sendq, pmoq_rb_reader_t* reader)
+{
+    if (bench->nb_streams == bench->streams_max) {
+        size_t streams_max = (bench->streams_max == 0) ? 64 : 2 * bench->streams_max;
+        pmoq_rb_stream_t* streams = (pmoq_rb_stream_t*)realloc(bench->streams, streams_max * sizeof(pmoq_rb_stream_t));
+
+        if (streams == NULL) {
+            return -1;
+        }
+        bench->streams = streams;
+        bench->streams_max = streams_max;
+    }
+    bench->streams[bench->nb_streams].cnx = cnx;
+    bench->streams[bench->nb_streams].stream_id = stream_id;
+    bench->streams[bench->nb_streams].sendq = sendq;
+    bench->streams[bench->nb_streams].reader = reader;
+    bench->nb_streams++;
+    return 0;
+}
+
+/* Forget the stream once it is sent or read, and release its context */
+static void pmoq_rb_stream_remove(pmoq_relay_bench_t* bench, const void* stream_ctx)
+{
+    for (size_t i = 0; i < bench->nb_streams; i++) {
+        pmoq_rb_stream_t* stream = &bench->streams[i];
+
+        if (stream->sendq == stream_ctx || stream->reader == stream_ctx) {
+            (void)picoquic_set_app_stream_ctx(stream->cnx, stream->stream_id, NULL);
+            pmoq_sendq_delete(stream->sendq);
+            free(stream->reader);
+            bench->streams[i] = bench->streams[--bench->nb_streams];
+            break;
+        }
+    }
+}
+
+/* Open a unidirectional stream and queue its subgroup header */
+static pmoq_sendq_t* pmoq_rb_stream_open(pmoq_rb_conn_t* conn, const pmoq_strm_t* header)
+{
+    uint64_t stream_id = picoquic_get_next_local_stream_id(conn->cnx, 1);
+    pmoq_sendq_t* sendq = pmoq_sendq_create(conn->cnx, stream_id);
+
+    if (sendq != NULL) {
+        pmoq_sendq_set_codec(sendq, pmoq_session_codec(conn->session));
+        if (pmoq_rb_stream_add(conn->bench, conn->cnx, stream_id, sendq, NULL) != 0) {
+            pmoq_sendq_delete(sendq);
+            sendq = NULL;
+        }
+        else if (pmoq_sendq_push_header(sendq, header) != 0) {
+            /* The stream is released with the others */
+            sendq = NULL;
+        }
+    }
+    return sendq;
+}
+
+static void pmoq_rb_set_name(pmoq_bits_t* item, pmoq_tuple_t* track_namespace, pmoq_bits_t* track_name, size_t track)
+{
+    item->bits = (uint8_t*)pmoq_rb_namespace;
+    item->nb_bits = 8 * strlen(pmoq_rb_namespace);
+    track_namespace->nb_items = 1;
+    track_namespace->items_max = 1;
+    track_namespace->items = item;
+    track_name->bits = (uint8_t*)pmoq_rb_track_names[track];
+    track_name->nb_bits = 8 * strlen(pmoq_rb_track_names[track]);
+}
+
+static int pmoq_rb_send_subscribe_ok(pmoq_rb_conn_t* conn, uint64_t subscribe_id)
+{
+    pmoq_msg_t reply = { 0 };
+
+    reply.msg_type = PMOQ_MSG_SUBSCRIBE_OK;
+    reply.u.subscribe_ok.subscribe_id = subscribe_id;
+    return pmoq_session_send(conn->session, &reply);
+}
+
+/* Latency of a delivered object, from the timestamp of its payload */
+static void pmoq_rb_record(pmoq_relay_bench_t* bench, const uint8_t* timestamp, size_t timestamp_length, uint64_t payload_length)
+{
+    bench->nb_delivered++;
+    bench->bytes_delivered += payload_length;
+    if (timestamp_length == PMOQ_RB_TIMESTAMP_SIZE && bench->nb_samples < PMOQ_RB_SAMPLES_MAX) {
+        uint64_t published = 0;
+
+        for (size_t i = 0; i < PMOQ_RB_TIMESTAMP_SIZE; i++) {
+            published = (published << 8) | timestamp[i];
+        }
+        bench->samples[bench->nb_samples++] = bench->simulated_time - published;
+    }
+}
+
+/* Publisher */
+static pmoq_cache_payload_t* pmoq_rb_payload_create(pmoq_relay_bench_t* bench, size_t length)
+{
+    pmoq_cache_payload_t* payload = pmoq_cache_payload_create(length);
+
+    if (payload != NULL) {
+        uint64_t published = bench->simulated_time;
+
+        memset(payload->data, 0x5a, length);
+        for (size_t i = PMOQ_RB_TIMESTAMP_SIZE; i > 0; i--) {
+            payload->data[i - 1] = (uint8_t)published;
+            published >>= 8;
+        }
+    }
+    return payload;
+}
+
+static int pmoq_rb_publish_video(pmoq_relay_bench_t* bench, pmoq_rb_published_t* track)
+{
+    int ret = 0;
+    uint64_t group_id = track->nb_frames / PMOQ_RB_VIDEO_GROUP_SIZE;
+    uint64_t object_id = track->nb_frames % PMOQ_RB_VIDEO_GROUP_SIZE;
+    pmoq_strm_t object = { 0 };
+    pmoq_cache_payload_t* payload;
+
+    object.msg_type = PMOQ_STRM_HEADER_SUBGROUP;
+    object.subscribe_id = track->subscribe_id;
+    object.track_alias = track->track_alias;
+    object.group_id = group_id;
+    object.object_id = object_id;
+    object.publisher_priority = 1;
+    object.payload_length = (object_id == 0) ? PMOQ_RB_VIDEO_KEY_FRAME_SIZE : PMOQ_RB_VIDEO_FRAME_SIZE;
+
+    if (object_id == 0) {
+        if (track->sendq != NULL) {
+            ret = pmoq_sendq_finish(track->sendq);
+        }
+        if (ret == 0 && (track->sendq = pmoq_rb_stream_open(bench->publisher, &object)) == NULL) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        if ((payload = pmoq_rb_payload_create(bench, (size_t)object.payload_length)) == NULL) {
+            ret = -1;
+        }
+        else {
+            ret = pmoq_sendq_push_object(track->sendq, &object, payload);
+            pmoq_cache_payload_unref(payload);
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_publish_audio(pmoq_relay_bench_t* bench, pmoq_rb_published_t* track)
+{
+    int ret = 0;
+    pmoq_strm_t datagram = { 0 };
+    pmoq_cache_payload_t* payload;
+
+    datagram.msg_type = PMOQ_STRM_OBJECT_DATAGRAM;
+    datagram.subscribe_id = track->subscribe_id;
+    datagram.track_alias = track->track_alias;
+    datagram.group_id = track->nb_frames / PMOQ_RB_AUDIO_GROUP_SIZE;
+    datagram.object_id = track->nb_frames % PMOQ_RB_AUDIO_GROUP_SIZE;
+    datagram.publisher_priority = 0;
+    datagram.payload_length = PMOQ_RB_AUDIO_FRAME_SIZE;
+
+    if ((payload = pmoq_rb_payload_create(bench, PMOQ_RB_AUDIO_FRAME_SIZE)) == NULL) {
+        ret = -1;
+    }
+    else {
+        /* Datagrams dropped by the queue are part of the measurement */
+        (void)pmoq_dgram_send(bench->publisher->dgram, &datagram, payload);
+        pmoq_cache_payload_unref(payload);
+    }
+    return ret;
+}
+
+static int pmoq_rb_publish(pmoq_relay_bench_t* bench)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < PMOQ_RB_NB_TRACKS; i++) {
+        pmoq_rb_published_t* track = &bench->published[i];
+
+        while (ret == 0 && track->is_subscribed && track->next_time <= bench->simulated_time &&
+            track->next_time < bench->end_time) {
+            ret = (i == PMOQ_RB_TRACK_VIDEO) ? pmoq_rb_publish_video(bench, track) : pmoq_rb_publish_audio(bench, track);
+            track->nb_frames++;
+            track->next_time += (i == PMOQ_RB_TRACK_VIDEO) ? PMOQ_RB_VIDEO_INTERVAL : PMOQ_RB_AUDIO_INTERVAL;
+            bench->nb_published++;
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_publisher_subscribed(pmoq_relay_bench_t* bench, pmoq_rb_conn_t* conn, const pmoq_subscribe_t* subscribe)
+{
+    int ret = -1;
+
+    for (size_t i = 0; i < PMOQ_RB_NB_TRACKS; i++) {
+        size_t l = strlen(pmoq_rb_track_names[i]);
+
+        if (subscribe->track_name.nb_bits == 8 * l && memcmp(subscribe->track_name.bits, pmoq_rb_track_names[i], l) == 0) {
+            pmoq_rb_published_t* track = &bench->published[i];
+
+            if (!track->is_subscribed) {
+                track->is_subscribed = 1;
+                track->subscribe_id = subscribe->subscribe_id;
+                track->track_alias = subscribe->track_alias;
+                track->next_time = (bench->simulated_time > PMOQ_RB_START_TIME) ? bench->simulated_time : PMOQ_RB_START_TIME;
+            }
+            ret = pmoq_rb_send_subscribe_ok(conn, subscribe->subscribe_id);
+            break;
+        }
+    }
+    return ret;
+}
+
+/* Relay */
+static int pmoq_rb_relay_subscribe_upstream(pmoq_relay_bench_t* bench)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && bench->upstream != NULL && i < bench->nb_relay_tracks; i++) {
+        pmoq_rb_relay_track_t* track = &bench->relay_tracks[i];
+
+        if (!track->is_subscribed) {
+            pmoq_msg_t msg = { 0 };
+            pmoq_bits_t items[PMOQ_TUPLE_SIZE_MAX];
+
+            msg.msg_type = PMOQ_MSG_SUBSCRIBE;
+            msg.u.subscribe.subscribe_id = track->track_key;
+            msg.u.subscribe.track_alias = track->track_key;
+            msg.u.subscribe.track_namespace.items = items;
+            msg.u.subscribe.track_namespace.items_max = PMOQ_TUPLE_SIZE_MAX;
+            msg.u.subscribe.filter_type = pmoq_msg_filter_latest_object;
+            if ((ret = pmoq_intern_get(bench->intern, track->track_key, &msg.u.subscribe.track_namespace,
+                &msg.u.subscribe.track_name)) == 0 &&
+                (ret = pmoq_session_send(bench->upstream->session, &msg)) == 0) {
+                track->is_subscribed = 1;
+            }
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_relay_subscribe(pmoq_relay_bench_t* bench, pmoq_rb_conn_t* conn, const pmoq_subscribe_t* subscribe)
+{
+    int ret = 0;
+    pmoq_intern_id_t track_key = pmoq_intern_track(bench->intern, &subscribe->track_namespace, &subscribe->track_name);
+    pmoq_rb_downstream_t* downstream = (pmoq_rb_downstream_t*)calloc(1, sizeof(pmoq_rb_downstream_t));
+    size_t i;
+
+    if (track_key == PMOQ_INTERN_ID_NONE || downstream == NULL) {
+        free(downstream);
+        return -1;
+    }
+    downstream->conn = conn;
+    downstream->subscribe_id = subscribe->subscribe_id;
+    downstream->track_alias = subscribe->track_alias;
+    downstream->next = bench->downstreams;
+    bench->downstreams = downstream;
+
+    for (i = 0; i < bench->nb_relay_tracks && bench->relay_tracks[i].track_key != track_key; i++);
+    if (i == bench->nb_relay_tracks) {
+        if (i == PMOQ_RB_TRACKS_MAX) {
+            return -1;
+        }
+        bench->relay_tracks[i].track_key = track_key;
+        bench->relay_tracks[i].is_subscribed = 0;
+        bench->nb_relay_tracks++;
+    }
+
+    if ((ret = pmoq_subs_add(bench->subs, conn->connection_id, track_key, subscribe, downstream)) == 0 &&
+        (ret = pmoq_rb_send_subscribe_ok(conn, subscribe->subscribe_id)) == 0) {
+        ret = pmoq_rb_relay_subscribe_upstream(bench);
+    }
+    return ret;
+}
+
+/* Forward a complete object to the subscribers of the track. The header
+ * holds the track alias of the relay, the group and the object. */
+static int pmoq_rb_relay_forward(pmoq_relay_bench_t* bench, const pmoq_strm_t* header, pmoq_cache_payload_t* payload)
+{
+    int ret = 0;
+    pmoq_subscription_t* matches[PMOQ_RB_MATCHES_MAX];
+    size_t cursor = 0;
+    size_t nb_matches;
+
+    do {
+        nb_matches = pmoq_subs_match(bench->subs, header->track_alias, header->group_id, header->object_id,
+            &cursor, matches, PMOQ_RB_MATCHES_MAX);
+        for (size_t i = 0; ret == 0 && i < nb_matches; i++) {
+            pmoq_rb_downstream_t* downstream = (pmoq_rb_downstream_t*)matches[i]->app_ctx;
+            pmoq_strm_t object = *header;
+
+            object.subscribe_id = downstream->subscribe_id;
+            object.track_alias = downstream->track_alias;
+            if (header->msg_type == PMOQ_STRM_OBJECT_DATAGRAM) {
+                (void)pmoq_dgram_send(downstream->conn->dgram, &object, payload);
+            }
+            else {
+                if (downstream->sendq == NULL || downstream->group_id != header->group_id) {
+                    if (downstream->sendq != NULL) {
+                        ret = pmoq_sendq_finish(downstream->sendq);
+                    }
+                    object.msg_type = PMOQ_STRM_HEADER_SUBGROUP;
+                    downstream->group_id = header->group_id;
+                    if ((downstream->sendq = pmoq_rb_stream_open(downstream->conn, &object)) == NULL) {
+                        ret = -1;
+                    }
+                }
+                if (ret == 0) {
+                    ret = pmoq_sendq_push_object(downstream->sendq, &object, payload);
+                }
+            }
+        }
+    } while (ret == 0 && nb_matches == PMOQ_RB_MATCHES_MAX);
+
+    return ret;
+}
+
+static int pmoq_rb_relay_datagram(pmoq_relay_bench_t* bench, pmoq_rb_conn_t* conn, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+    pmoq_strm_t header = { 0 };
+    const uint8_t* bytes_max = bytes + length;
+    pmoq_cache_object_t* object;
+    int err = 0;
+
+    if ((bytes = pmoq_codec_strm_parse(pmoq_session_codec(conn->session), bytes, bytes_max, &err, 0, &header)) == NULL ||
+        header.msg_type != PMOQ_STRM_OBJECT_DATAGRAM || (uint64_t)(bytes_max - bytes) != header.payload_length) {
+        ret = -1;
+    }
+    else if ((object = pmoq_cache_add_object(bench->cache, &header, bytes)) != NULL) {
+        ret = pmoq_rb_relay_forward(bench, &header, object->payload);
+    }
+    return ret;
+}
+
+/* Objects of the subgroup streams, as they arrive from the reader */
+static int pmoq_rb_object_start(pmoq_rb_reader_t* reader)
+{
+    pmoq_relay_bench_t* bench = reader->conn->bench;
+
+    reader->timestamp_length = 0;
+    if (reader->conn->node == pmoq_rb_node_relay) {
+        (void)pmoq_cache_start_object(bench->cache, &reader->object);
+    }
+    return 0;
+}
+
+static int pmoq_rb_object_payload(pmoq_rb_reader_t* reader, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+    pmoq_relay_bench_t* bench = reader->conn->bench;
+
+    if (reader->conn->node == pmoq_rb_node_relay) {
+        /* The cached object is looked up each time, since other objects
+         * may have been added since the last chunk */
+        pmoq_cache_object_t* object = pmoq_cache_get_object(bench->cache, reader->object.track_alias,
+            reader->object.group_id, reader->object.object_id);
+
+        if (object != NULL && !pmoq_cache_object_is_complete(object)) {
+            ret = pmoq_cache_append_object(object, bytes, length);
+        }
+    }
+    else {
+        while (length > 0 && reader->timestamp_length < PMOQ_RB_TIMESTAMP_SIZE) {
+            reader->timestamp[reader->timestamp_length++] = *bytes++;
+            length--;
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_object_end(pmoq_rb_reader_t* reader)
+{
+    int ret = 0;
+    pmoq_relay_bench_t* bench = reader->conn->bench;
+
+    if (reader->conn->node == pmoq_rb_node_relay) {
+        pmoq_cache_object_t* object = pmoq_cache_get_object(bench->cache, reader->object.track_alias,
+            reader->object.group_id, reader->object.object_id);
+
+        if (object != NULL && pmoq_cache_object_is_complete(object)) {
+            ret = pmoq_rb_relay_forward(bench, &reader->object, object->payload);
+        }
+    }
+    else {
+        pmoq_rb_record(bench, reader->timestamp, reader->timestamp_length, reader->object.payload_length);
+    }
+    return ret;
+}
+
+static int pmoq_rb_reader_input(pmoq_rb_reader_t* reader, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+    const pmoq_codec_t* codec = pmoq_session_codec(reader->conn->session);
+
+    while (ret == 0 && length > 0) {
+        if (reader->in_payload) {
+            size_t l = (reader->remaining < length) ? (size_t)reader->remaining : length;
+
+            ret = pmoq_rb_object_payload(reader, bytes, l);
+            bytes += l;
+            length -= l;
+            reader->remaining -= l;
+            if (ret == 0 && reader->remaining == 0) {
+                reader->in_payload = 0;
+                ret = pmoq_rb_object_end(reader);
+            }
+        }
+        else {
+            size_t l = sizeof(reader->pending) - reader->pending_length;
+            const uint8_t* next;
+            int err = 0;
+
+            if (l > length) {
+                l = length;
+            }
+            memcpy(reader->pending + reader->pending_length, bytes, l);
+            if (!reader->has_header) {
+                next = pmoq_codec_strm_parse(codec, reader->pending, reader->pending + reader->pending_length + l,
+                    &err, 0, &reader->header);
+            }
+            else {
+                reader->object = reader->header;
+                next = pmoq_codec_object_parse(codec, reader->header.msg_type, reader->pending,
+                    reader->pending + reader->pending_length + l, &err, 0, &reader->object);
+            }
+
+            if (next == NULL) {
+                if (err > 0 && reader->pending_length + l < sizeof(reader->pending)) {
+                    /* Wait for the rest of the header */
+                    reader->pending_length += l;
+                    length = 0;
+                }
+                else {
+                    ret = -1;
+                }
+            }
+            else {
+                size_t used = (next - reader->pending) - reader->pending_length;
+
+                bytes += used;
+                length -= used;
+                reader->pending_length = 0;
+                if (!reader->has_header) {
+                    reader->has_header = 1;
+                }
+                else {
+                    reader->remaining = reader->object.payload_length;
+                    reader->in_payload = (reader->remaining > 0);
+                    if ((ret = pmoq_rb_object_start(reader)) == 0 && !reader->in_payload) {
+                        ret = pmoq_rb_object_end(reader);
+                    }
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+/* Connections */
+static int pmoq_rb_session_callback(pmoq_session_t* session, pmoq_session_event_enum event,
+    const pmoq_msg_t* msg, void* callback_ctx)
+{
+    int ret = 0;
+    pmoq_rb_conn_t* conn = (pmoq_rb_conn_t*)callback_ctx;
+    pmoq_relay_bench_t* bench = conn->bench;
+
+    switch (event) {
+    case pmoq_session_event_ready:
+        bench->nb_ready++;
+        pmoq_dgram_set_codec(conn->dgram, pmoq_session_codec(session));
+        if (conn->node == pmoq_rb_node_subscribers) {
+            for (size_t i = 0; ret == 0 && i < PMOQ_RB_NB_TRACKS; i++) {
+                pmoq_msg_t subscribe = { 0 };
+                pmoq_bits_t item;
+
+                subscribe.msg_type = PMOQ_MSG_SUBSCRIBE;
+                subscribe.u.subscribe.subscribe_id = i;
+                subscribe.u.subscribe.track_alias = i;
+                subscribe.u.subscribe.filter_type = pmoq_msg_filter_latest_object;
+                pmoq_rb_set_name(&item, &subscribe.u.subscribe.track_namespace, &subscribe.u.subscribe.track_name, i);
+                ret = pmoq_session_send(session, &subscribe);
+            }
+        }
+        else if (conn->node == pmoq_rb_node_relay && pmoq_session_peer_role(session) == pmoq_setup_role_publisher) {
+            bench->upstream = conn;
+            ret = pmoq_rb_relay_subscribe_upstream(bench);
+        }
+        break;
+    case pmoq_session_event_msg:
+        if (msg->msg_type == PMOQ_MSG_SUBSCRIBE) {
+            if (conn->node == pmoq_rb_node_publisher) {
+                ret = pmoq_rb_publisher_subscribed(bench, conn, &msg->u.subscribe);
+            }
+            else if (conn->node == pmoq_rb_node_relay) {
+                ret = pmoq_rb_relay_subscribe(bench, conn, &msg->u.subscribe);
+            }
+            else {
+                ret = -1;
+            }
+        }
+        else if (msg->msg_type == PMOQ_MSG_SUBSCRIBE_ERROR) {
+            ret = -1;
+        }
+        break;
+    case pmoq_session_event_closed:
+        bench->nb_closed++;
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+static int pmoq_rb_stream_callback(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t* bytes, size_t length,
+    picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx)
+{
+    int ret = 0;
+    pmoq_rb_conn_t* conn = (pmoq_rb_conn_t*)callback_ctx;
+    pmoq_relay_bench_t* bench = conn->bench;
+
+    switch (fin_or_event) {
+    case picoquic_callback_stream_data:
+    case picoquic_callback_stream_fin: {
+        pmoq_rb_reader_t* reader = (pmoq_rb_reader_t*)v_stream_ctx;
+
+        if (reader == NULL) {
+            if ((reader = (pmoq_rb_reader_t*)calloc(1, sizeof(pmoq_rb_reader_t))) == NULL ||
+                pmoq_rb_stream_add(bench, cnx, stream_id, NULL, reader) != 0) {
+                free(reader);
+                return -1;
+            }
+            reader->conn = conn;
+            (void)picoquic_set_app_stream_ctx(cnx, stream_id, reader);
+        }
+        ret = pmoq_rb_reader_input(reader, bytes, length);
+        if (fin_or_event == picoquic_callback_stream_fin) {
+            pmoq_rb_stream_remove(bench, reader);
+        }
+        break;
+    }
+    case picoquic_callback_stream_reset:
+        if (v_stream_ctx != NULL) {
+            pmoq_rb_stream_remove(bench, v_stream_ctx);
+        }
+        break;
+    case picoquic_callback_prepare_to_send:
+        if (v_stream_ctx != NULL) {
+            pmoq_sendq_t* sendq = (pmoq_sendq_t*)v_stream_ctx;
+
+            ret = pmoq_sendq_picoquic_prepare(sendq, bytes, length);
+            if (pmoq_sendq_is_done(sendq)) {
+                pmoq_rb_stream_remove(bench, sendq);
+            }
+        }
+        break;
+    case picoquic_callback_datagram:
+        if (conn->node == pmoq_rb_node_relay) {
+            ret = pmoq_rb_relay_datagram(bench, conn, bytes, length);
+        }
+        else if (conn->node == pmoq_rb_node_subscribers) {
+            pmoq_strm_t header = { 0 };
+            const uint8_t* payload;
+            int err = 0;
+
+            if ((payload = pmoq_codec_strm_parse(pmoq_session_codec(conn->session), bytes, bytes + length, &err, 0, &header)) == NULL ||
+                (uint64_t)(bytes + length - payload) != header.payload_length) {
+                ret = -1;
+            }
+            else {
+                pmoq_rb_record(bench, payload, (header.payload_length < PMOQ_RB_TIMESTAMP_SIZE) ? 0 : PMOQ_RB_TIMESTAMP_SIZE,
+                    header.payload_length);
+            }
+        }
+        break;
+    case picoquic_callback_prepare_datagram:
+        ret = pmoq_dgram_picoquic_prepare(conn->dgram, bytes, length);
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+static pmoq_rb_conn_t* pmoq_rb_conn_create(pmoq_relay_bench_t* bench, pmoq_rb_node_enum node, picoquic_cnx_t* cnx)
+{
+    pmoq_rb_conn_t* conn = (pmoq_rb_conn_t*)calloc(1, sizeof(pmoq_rb_conn_t));
+
+    if (conn != NULL) {
+        conn->bench = bench;
+        conn->node = node;
+        conn->cnx = cnx;
+        conn->connection_id = ++bench->nb_conns;
+        conn->next = bench->conns;
+        bench->conns = conn;
+        if ((conn->session = pmoq_session_create(cnx, node != pmoq_rb_node_relay, pmoq_rb_session_callback, conn)) == NULL ||
+            (conn->dgram = pmoq_dgram_create(cnx, 0, PMOQ_RB_DATAGRAM_SIZE_MAX)) == NULL) {
+            /* Released with the others */
+            conn = NULL;
+        }
+        else {
+            pmoq_session_set_app_callback(conn->session, pmoq_rb_stream_callback, conn);
+        }
+    }
+    return conn;
+}
+
+/* Default callback of the relay, for the new connections */
+static int pmoq_rb_relay_accept(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t* bytes, size_t length,
+    picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx)
+{
+    pmoq_rb_conn_t* conn = pmoq_rb_conn_create((pmoq_relay_bench_t*)callback_ctx, pmoq_rb_node_relay, cnx);
+
+    if (conn == NULL) {
+        return -1;
+    }
+    return pmoq_session_picoquic_callback(cnx, stream_id, bytes, length, fin_or_event, conn->session, v_stream_ctx);
+}
+
+static int pmoq_rb_connect(pmoq_relay_bench_t* bench, pmoq_rb_node_enum node)
+{
+    int ret = 0;
+    picoquic_cnx_t* cnx = picoquic_create_cnx(bench->quic[node], picoquic_null_connection_id, picoquic_null_connection_id,
+        (struct sockaddr*)&bench->addr[pmoq_rb_node_relay], bench->simulated_time, 0, "test.example.com", PMOQ_ALPN, 1);
+    pmoq_rb_conn_t* conn;
+
+    if (cnx == NULL || (conn = pmoq_rb_conn_create(bench, node, cnx)) == NULL) {
+        ret = -1;
+    }
+    else {
+        if (node == pmoq_rb_node_publisher) {
+            bench->publisher = conn;
+        }
+        if ((ret = pmoq_session_set_setup_parameters(conn->session, (node == pmoq_rb_node_publisher) ?
+            pmoq_setup_role_publisher : pmoq_setup_role_subscriber, NULL, 0)) == 0 &&
+            (ret = pmoq_session_start(conn->session)) == 0) {
+            ret = picoquic_start_client_cnx(cnx);
+        }
+    }
+    return ret;
+}
+
+/* Simulation */
+static int pmoq_rb_node_send(pmoq_relay_bench_t* bench, pmoq_rb_node_enum node, int* is_active)
+{
+    int ret = 0;
+
+    for (int i = 0; ret == 0 && i < PMOQ_RB_PACKETS_PER_ROUND; i++) {
+        pmoq_rb_packet_t* packet = (pmoq_rb_packet_t*)malloc(sizeof(pmoq_rb_packet_t));
+        struct sockaddr_storage addr_from;
+        picoquic_connection_id_t log_cid;
+        picoquic_cnx_t* last_cnx = NULL;
+        int if_index = 0;
+
+        if (packet == NULL) {
+            ret = -1;
+            break;
+        }
+        packet->length = 0;
+        ret = picoquic_prepare_next_packet(bench->quic[node], bench->simulated_time, packet->bytes, sizeof(packet->bytes),
+            &packet->length, &packet->addr_to, &addr_from, &if_index, &log_cid, &last_cnx);
+        if (ret != 0 || packet->length == 0) {
+            free(packet);
+            break;
+        }
+        memcpy(&packet->addr_from, &bench->addr[node], sizeof(struct sockaddr_in));
+        *is_active = 1;
+        if (node == pmoq_rb_node_publisher) {
+            pmoq_rb_link_submit(&bench->links[pmoq_rb_link_publisher_up], packet, bench->simulated_time);
+        }
+        else if (node == pmoq_rb_node_subscribers) {
+            pmoq_rb_link_submit(&bench->links[pmoq_rb_link_subscribers_up], packet, bench->simulated_time);
+        }
+        else if (((struct sockaddr_in*)&packet->addr_to)->sin_port == bench->addr[pmoq_rb_node_publisher].sin_port) {
+            pmoq_rb_link_submit(&bench->links[pmoq_rb_link_publisher_down], packet, bench->simulated_time);
+        }
+        else {
+            pmoq_rb_link_submit(&bench->links[pmoq_rb_link_subscribers_down], packet, bench->simulated_time);
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_run(pmoq_relay_bench_t* bench)
+{
+    int ret = 0;
+
+    while (ret == 0 && bench->simulated_time < bench->end_time) {
+        int is_active = 0;
+        uint64_t next_time = bench->end_time;
+
+        for (size_t i = 0; ret == 0 && i < pmoq_rb_nb_links; i++) {
+            pmoq_rb_link_t* link = &bench->links[i];
+            pmoq_rb_packet_t* packet;
+
+            while (ret == 0 && (packet = pmoq_rb_link_dequeue(link, bench->simulated_time)) != NULL) {
+                uint64_t start_time = (link->target == pmoq_rb_node_relay) ? picoquic_current_time() : 0;
+
+                ret = picoquic_incoming_packet(bench->quic[link->target], packet->bytes, packet->length,
+                    (struct sockaddr*)&packet->addr_from, (struct sockaddr*)&bench->addr[link->target], 0, 0,
+                    bench->simulated_time);
+                if (link->target == pmoq_rb_node_relay) {
+                    bench->relay_time += picoquic_current_time() - start_time;
+                }
+                free(packet);
+                is_active = 1;
+            }
+        }
+
+        if (ret == 0) {
+            ret = pmoq_rb_publish(bench);
+        }
+
+        for (int node = 0; ret == 0 && node < pmoq_rb_nb_nodes; node++) {
+            uint64_t start_time = (node == pmoq_rb_node_relay) ? picoquic_current_time() : 0;
+
+            ret = pmoq_rb_node_send(bench, (pmoq_rb_node_enum)node, &is_active);
+            if (node == pmoq_rb_node_relay) {
+                bench->relay_time += picoquic_current_time() - start_time;
+            }
+        }
+
+        /* Next event: arrival, timer of a picoquic context or object to publish */
+        for (size_t i = 0; i < pmoq_rb_nb_links; i++) {
+            if (bench->links[i].first != NULL && bench->links[i].first->arrival_time < next_time) {
+                next_time = bench->links[i].first->arrival_time;
+            }
+        }
+        for (int node = 0; node < pmoq_rb_nb_nodes; node++) {
+            uint64_t wake_time = picoquic_get_next_wake_time(bench->quic[node], bench->simulated_time);
+
+            if (wake_time < next_time) {
+                next_time = wake_time;
+            }
+        }
+        for (size_t i = 0; i < PMOQ_RB_NB_TRACKS; i++) {
+            if (bench->published[i].is_subscribed && bench->published[i].next_time < next_time) {
+                next_time = bench->published[i].next_time;
+            }
+        }
+        if (next_time > bench->simulated_time) {
+            bench->simulated_time = next_time;
+        }
+        else if (!is_active) {
+            bench->simulated_time++;
+        }
+    }
+    return ret;
+}
+
+static int pmoq_rb_compare_samples(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static uint64_t pmoq_rb_percentile(const pmoq_relay_bench_t* bench, double percentile)
+{
+    size_t rank = (size_t)(percentile * (double)bench->nb_samples / 100.0);
+
+    if (bench->nb_samples == 0) {
+        return 0;
+    }
+    return bench->samples[(rank < bench->nb_samples) ? rank : bench->nb_samples - 1];
+}
+
+static void pmoq_rb_report(FILE* F, pmoq_relay_bench_t* bench, uint64_t elapsed_us, double cpu_s, int is_csv)
+{
+    double elapsed_s = (elapsed_us == 0) ? 1e-6 : ((double)elapsed_us) / 1000000.0;
+    double relay_s = (bench->relay_time == 0) ? 1e-6 : ((double)bench->relay_time) / 1000000.0;
+    double megabytes = (bench->bytes_delivered == 0) ? 1e-6 : ((double)bench->bytes_delivered) / 1000000.0;
+    uint64_t p50, p90, p99, p999, max;
+
+    qsort(bench->samples, bench->nb_samples, sizeof(uint64_t), pmoq_rb_compare_samples);
+    p50 = pmoq_rb_percentile(bench, 50.0);
+    p90 = pmoq_rb_percentile(bench, 90.0);
+    p99 = pmoq_rb_percentile(bench, 99.0);
+    p999 = pmoq_rb_percentile(bench, 99.9);
+    max = pmoq_rb_percentile(bench, 100.0);
+
+    if (is_csv) {
+        fprintf(F, "relay,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,", bench->config.nb_subscribers,
+            bench->config.duration, bench->nb_published, bench->nb_delivered, bench->bytes_delivered,
+            ((double)bench->nb_delivered) / elapsed_s, ((double)bench->nb_delivered) / relay_s);
+        fprintf(F, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.2f,%.2f\n",
+            p50, p90, p99, p999, max, (cpu_s * 1000000.0) / megabytes, (relay_s * 1000000.0) / megabytes);
+    }
+    else {
+        fprintf(F, "{\n    \"subscribers\": %zu, \"duration_us\": %" PRIu64 ",\n", bench->config.nb_subscribers,
+            bench->config.duration);
+        fprintf(F, "    \"objects_published\": %" PRIu64 ", \"objects_delivered\": %" PRIu64 ", \"bytes_delivered\": %" PRIu64 ",\n",
+            bench->nb_published, bench->nb_delivered, bench->bytes_delivered);
+        fprintf(F, "    \"objects_per_s\": %.0f, \"relay_objects_per_s\": %.0f,\n",
+            ((double)bench->nb_delivered) / elapsed_s, ((double)bench->nb_delivered) / relay_s);
+        fprintf(F, "    \"latency_us\": { \"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"p999\": %" PRIu64 ", \"max\": %" PRIu64 " },\n",
+            p50, p90, p99, p999, max);
+        fprintf(F, "    \"cpu_us_per_mb\": %.2f, \"relay_us_per_mb\": %.2f\n}\n",
+            (cpu_s * 1000000.0) / megabytes, (relay_s * 1000000.0) / megabytes);
+    }
+}
+
+static void pmoq_rb_set_addr(struct sockaddr_in* addr, uint8_t host, uint16_t port)
+{
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    ((uint8_t*)&addr->sin_addr)[0] = 10;
+    ((uint8_t*)&addr->sin_addr)[3] = host;
+    addr->sin_port = htons(port);
+}
+
+static void pmoq_rb_delete(pmoq_relay_bench_t* bench)
+{
+    /* picoquic may still call back the connections while closing them */
+    for (int node = 0; node < pmoq_rb_nb_nodes; node++) {
+        if (bench->quic[node] != NULL) {
+            picoquic_free(bench->quic[node]);
+        }
+    }
+    for (size_t i = 0; i < pmoq_rb_nb_links; i++) {
+        while (bench->links[i].first != NULL) {
+            pmoq_rb_packet_t* packet = bench->links[i].first;
+
+            bench->links[i].first = packet->next;
+            free(packet);
+        }
+    }
+    for (size_t i = 0; i < bench->nb_streams; i++) {
+        pmoq_sendq_delete(bench->streams[i].sendq);
+        free(bench->streams[i].reader);
+    }
+    free(bench->streams);
+    while (bench->conns != NULL) {
+        pmoq_rb_conn_t* conn = bench->conns;
+
+        bench->conns = conn->next;
+        pmoq_session_delete(conn->session);
+        pmoq_dgram_delete(conn->dgram);
+        free(conn);
+    }
+    while (bench->downstreams != NULL) {
+        pmoq_rb_downstream_t* downstream = bench->downstreams;
+
+        bench->downstreams = downstream->next;
+        free(downstream);
+    }
+    pmoq_cache_delete(bench->cache);
+    pmoq_subs_delete(bench->subs);
+    pmoq_intern_delete(bench->intern);
+    free(bench->samples);
+    free(bench);
+}
+
+int pmoq_relay_bench(FILE* F, const pmoq_relay_bench_config_t* config, int is_csv)
+{
+    int ret = 0;
+    pmoq_relay_bench_t* bench = (pmoq_relay_bench_t*)calloc(1, sizeof(pmoq_relay_bench_t));
+    uint64_t start_time = picoquic_current_time();
+    clock_t start_cpu = clock();
+
+    if (bench == NULL) {
+        return -1;
+    }
+    bench->config = *config;
+    bench->end_time = PMOQ_RB_START_TIME + config->duration;
+    pmoq_rb_set_addr(&bench->addr[pmoq_rb_node_publisher], 1, PMOQ_RB_PORT_PUBLISHER);
+    pmoq_rb_set_addr(&bench->addr[pmoq_rb_node_relay], 2, PMOQ_RB_PORT_RELAY);
+    pmoq_rb_set_addr(&bench->addr[pmoq_rb_node_subscribers], 3, PMOQ_RB_PORT_SUBSCRIBERS);
+    for (size_t i = 0; i < pmoq_rb_nb_links; i++) {
+        bench->links[i].latency = config->link_latency;
+        bench->links[i].rate = config->link_rate;
+    }
+    bench->links[pmoq_rb_link_publisher_up].target = pmoq_rb_node_relay;
+    bench->links[pmoq_rb_link_publisher_down].target = pmoq_rb_node_publisher;
+    bench->links[pmoq_rb_link_subscribers_up].target = pmoq_rb_node_relay;
+    bench->links[pmoq_rb_link_subscribers_down].target = pmoq_rb_node_subscribers;
+
+    if ((bench->samples = (uint64_t*)malloc(PMOQ_RB_SAMPLES_MAX * sizeof(uint64_t))) == NULL ||
+        (bench->cache = pmoq_cache_create(PMOQ_RB_CACHE_BUDGET, 0)) == NULL ||
+        (bench->subs = pmoq_subs_create()) == NULL ||
+        (bench->intern = pmoq_intern_create()) == NULL) {
+        ret = -1;
+    }
+
+    for (int node = 0; ret == 0 && node < pmoq_rb_nb_nodes; node++) {
+        int is_server = (node == pmoq_rb_node_relay);
+        picoquic_tp_t tp;
+
+        if ((bench->quic[node] = picoquic_create((uint32_t)(config->nb_subscribers + 8),
+            (is_server) ? config->cert_file : NULL, (is_server) ? config->key_file : NULL, NULL, PMOQ_ALPN,
+            (is_server) ? pmoq_rb_relay_accept : NULL, (is_server) ? bench : NULL, NULL, NULL, NULL,
+            bench->simulated_time, &bench->simulated_time, NULL, NULL, 0)) == NULL) {
+            fprintf(stderr, "Cannot create the picoquic context, check the certificate and key files\n");
+            ret = -1;
+        }
+        else {
+            tp = *picoquic_get_default_tp(bench->quic[node]);
+            tp.max_datagram_frame_size = PICOQUIC_MAX_PACKET_SIZE;
+            ret = picoquic_set_default_tp(bench->quic[node], &tp);
+            if (!is_server) {
+                picoquic_set_null_verifier(bench->quic[node]);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        ret = pmoq_rb_connect(bench, pmoq_rb_node_publisher);
+    }
+    for (size_t i = 0; ret == 0 && i < config->nb_subscribers; i++) {
+        ret = pmoq_rb_connect(bench, pmoq_rb_node_subscribers);
+    }
+
+    if (ret == 0) {
+        ret = pmoq_rb_run(bench);
+    }
+    if (ret == 0 && bench->nb_ready != 2 * (int)(config->nb_subscribers + 1)) {
+        fprintf(stderr, "Only %d of the %zu sessions are set up\n", bench->nb_ready / 2, config->nb_subscribers + 1);
+        ret = -1;
+    }
+    if (ret == 0) {
+        pmoq_rb_report(F, bench, picoquic_current_time() - start_time,
+            ((double)(clock() - start_cpu)) / CLOCKS_PER_SEC, is_csv);
+    }
+
+    pmoq_rb_delete(bench);
+
+    return ret;
+}
@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_scheduler.h"
+#include "picomoq/picomoq_test.h"
+
+/* Send scheduler tests
+*/
+
+#define PMOQ_SCHED_TEST_NB_ENTRIES 2000
+
+static uint64_t pmoq_sched_test_random(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void pmoq_sched_test_randomize(pmoq_sched_entry_t* entry, uint64_t* state)
+{
+    uint64_t r = pmoq_sched_test_random(state);
+
+    /* Few distinct values, so that most ties are broken by the later fields */
+    entry->subscriber_priority = (uint8_t)((r & 3) * 64);
+    entry->publisher_priority = (uint8_t)(((r >> 2) & 3) * 64);
+    entry->group_order = ((r >> 4) & 1) ? PMOQ_GROUP_ORDER_DESCENDING : PMOQ_GROUP_ORDER_ASCENDING;
+    entry->group_id = (r >> 8) & 7;
+    entry->object_id = (r >> 16) & 15;
+}
+
+/* Pop all the entries, verify they come out in order, and count them */
+static int pmoq_sched_test_drain(pmoq_sched_t* sched, size_t expected)
+{
+    pmoq_sched_entry_t* previous = NULL;
+    pmoq_sched_entry_t* entry;
+    size_t nb_popped = 0;
+
+    while ((entry = pmoq_sched_pop(sched)) != NULL) {
+        if (pmoq_sched_is_queued(sched, entry) ||
+            (previous != NULL && pmoq_sched_compare(previous, entry) > 0)) {
+            return -1;
+        }
+        previous = entry;
+        nb_popped++;
+    }
+    return (nb_popped == expected && pmoq_sched_count(sched) == 0) ? 0 : -1;
+}
+
+int pmoq_sched_test_order()
+{
+    int ret = 0;
+    pmoq_sched_t* sched = pmoq_sched_create();
+    pmoq_sched_entry_t* entries = (pmoq_sched_entry_t*)calloc(PMOQ_SCHED_TEST_NB_ENTRIES, sizeof(pmoq_sched_entry_t));
+    uint64_t state = 0x123456789abcdefull;
+    size_t nb_queued = PMOQ_SCHED_TEST_NB_ENTRIES;
+
+    if (sched == NULL || entries == NULL) {
+        ret = -1;
+    }
+
+    /* Fixed cases of the comparison */
+    if (ret == 0) {
+        pmoq_sched_entry_t a = { 0 };
+        pmoq_sched_entry_t b = { 0 };
+
+        a.group_id = 1;
+        b.group_id = 2;
+        a.object_id = 5;
+        if (pmoq_sched_compare(&a, &b) >= 0) {
+            ret = -1;
+        }
+        a.group_order = PMOQ_GROUP_ORDER_DESCENDING;
+        b.group_order = PMOQ_GROUP_ORDER_DESCENDING;
+        if (pmoq_sched_compare(&a, &b) <= 0) {
+            ret = -1;
+        }
+        b.publisher_priority = 1;
+        if (pmoq_sched_compare(&a, &b) >= 0) {
+            ret = -1;
+        }
+        a.subscriber_priority = 1;
+        if (pmoq_sched_compare(&a, &b) <= 0 || pmoq_sched_compare(&a, &a) != 0 ||
+            pmoq_sched_stream_priority(&a) > pmoq_sched_stream_priority(&b)) {
+            ret = -1;
+        }
+        /* Coarser order for the picoquic stream priority. The priority is
+         * always odd, so that picoquic sends the streams of the same
+         * priority in order of stream ID, not round robin. */
+        for (int p = 0; ret == 0 && p < 255; p++) {
+            a.subscriber_priority = (uint8_t)p;
+            b.subscriber_priority = (uint8_t)(p + 1);
+            a.publisher_priority = (uint8_t)(p * 7);
+            b.publisher_priority = (uint8_t)(p * 7);
+            if (pmoq_sched_stream_priority(&a) > pmoq_sched_stream_priority(&b) ||
+                (pmoq_sched_stream_priority(&a) & 1) != 1) {
+                ret = -1;
+            }
+            a.subscriber_priority = 7;
+            b.subscriber_priority = 7;
+            a.publisher_priority = (uint8_t)p;
+            b.publisher_priority = (uint8_t)(p + 1);
+            if (pmoq_sched_stream_priority(&a) > pmoq_sched_stream_priority(&b) ||
+                (pmoq_sched_stream_priority(&a) & 1) != 1) {
+                ret = -1;
+            }
+        }
+    }
+
+    /* Random entries, all with the same group order */
+    for (size_t i = 0; ret == 0 && i < PMOQ_SCHED_TEST_NB_ENTRIES; i++) {
+        pmoq_sched_test_randomize(&entries[i], &state);
+        entries[i].group_order = PMOQ_GROUP_ORDER_DESCENDING;
+        if (pmoq_sched_push(sched, &entries[i]) != 0) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && (pmoq_sched_push(sched, &entries[10]) == 0 || pmoq_sched_count(sched) != PMOQ_SCHED_TEST_NB_ENTRIES)) {
+        ret = -1;
+    }
+
+    /* Update a third of the entries, remove another third */
+    for (size_t i = 0; ret == 0 && i < PMOQ_SCHED_TEST_NB_ENTRIES; i += 3) {
+        pmoq_sched_test_randomize(&entries[i], &state);
+        entries[i].group_order = PMOQ_GROUP_ORDER_DESCENDING;
+        pmoq_sched_update(sched, &entries[i]);
+        if (i + 1 < PMOQ_SCHED_TEST_NB_ENTRIES) {
+            pmoq_sched_remove(sched, &entries[i + 1]);
+            if (pmoq_sched_is_queued(sched, &entries[i + 1])) {
+                ret = -1;
+            }
+            nb_queued--;
+        }
+    }
+    if (ret == 0 && pmoq_sched_test_drain(sched, nb_queued) != 0) {
+        ret = -1;
+    }
+
+    /* Entries popped can be pushed again, and the group order can differ
+     * between subscriptions */
+    for (size_t i = 0; ret == 0 && i < PMOQ_SCHED_TEST_NB_ENTRIES; i++) {
+        pmoq_sched_test_randomize(&entries[i], &state);
+        if (pmoq_sched_push(sched, &entries[i]) != 0) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && pmoq_sched_test_drain(sched, PMOQ_SCHED_TEST_NB_ENTRIES) != 0) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_sched_peek(sched) != NULL || pmoq_sched_pop(sched) != NULL)) {
+        ret = -1;
+    }
+
+    pmoq_sched_delete(sched);
+    if (entries != NULL) {
+        free(entries);
+    }
+
+    return ret;
+}
+
+typedef struct st_pmoq_sched_test_expired_t {
+    pmoq_sched_t* sched;
+    size_t nb_expired;
+    uint64_t mask;
+    int is_error;
+} pmoq_sched_test_expired_t;
+
+static void pmoq_sched_test_expired_fn(void* callback_ctx, pmoq_sched_entry_t* entry)
+{
+    pmoq_sched_test_expired_t* ctx = (pmoq_sched_test_expired_t*)callback_ctx;
+
+    if (pmoq_sched_is_queued(ctx->sched, entry)) {
+        ctx->is_error = 1;
+    }
+    ctx->nb_expired++;
+    ctx->mask |= 1ull << entry->object_id;
+}
+
+int pmoq_sched_test_deadline()
+{
+    int ret = 0;
+    pmoq_sched_t* sched = pmoq_sched_create();
+    pmoq_sched_entry_t entries[16];
+    pmoq_sched_test_expired_t ctx = { 0 };
+    const uint64_t start_time = 10000000;
+
+    if (sched == NULL) {
+        return -1;
+    }
+    ctx.sched = sched;
+    memset(entries, 0, sizeof(entries));
+
+    /* Entry i has the deadline start + i ms, the odd entries are queued */
+    for (uint64_t i = 0; i < 16; i++) {
+        entries[i].object_id = i;
+        entries[i].stream_id = 4 * i;
+        pmoq_sched_set_deadline(sched, &entries[i], start_time + 1000 * i);
+        if ((i & 1) != 0 && pmoq_sched_push(sched, &entries[i]) != 0) {
+            ret = -1;
+        }
+    }
+    /* Entries 4 and 5 are sent on time, entry 6 gets a later deadline */
+    pmoq_sched_clear_deadline(sched, &entries[4]);
+    pmoq_sched_clear_deadline(sched, &entries[5]);
+    pmoq_sched_set_deadline(sched, &entries[6], start_time + 100000);
+    if (ret == 0 && (pmoq_sched_next_deadline(sched) != start_time ||
+        pmoq_sched_expire(sched, start_time - 1, pmoq_sched_test_expired_fn, &ctx) != 0)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_sched_expire(sched, start_time + 7999, pmoq_sched_test_expired_fn, &ctx) != 5 ||
+        ctx.is_error || ctx.mask != 0x8f || pmoq_sched_count(sched) != 5 ||
+        pmoq_sched_is_queued(sched, &entries[5]) == 0 || pmoq_sched_is_queued(sched, &entries[7]) ||
+        pmoq_sched_next_deadline(sched) != start_time + 8000)) {
+        ret = -1;
+    }
+    /* The remaining queued entries still come out in order */
+    if (ret == 0 && pmoq_sched_test_drain(sched, 5) != 0) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        ctx.mask = 0;
+        if (pmoq_sched_expire(sched, start_time + 100000, pmoq_sched_test_expired_fn, &ctx) != 9 ||
+            ctx.is_error || ctx.mask != 0xff40 || pmoq_sched_next_deadline(sched) != UINT64_MAX) {
+            ret = -1;
+        }
+    }
+
+    pmoq_sched_delete(sched);
+
+    return ret;
+}
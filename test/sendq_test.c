@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq_sendq.h"
+#include "picomoq_shard.h"
+#include "picomoq/picomoq_test.h"
+
+/* Stream send queue tests
+*/
+
+#define PMOQ_SENDQ_TEST_NB_SUBSCRIBERS 1000
+#define PMOQ_SENDQ_TEST_PAYLOAD_LENGTH 10000
+#define PMOQ_SENDQ_TEST_NB_SHARDS 4
+#define PMOQ_SENDQ_TEST_NB_REFS 100000
+
+static void pmoq_sendq_test_header(pmoq_strm_t* header, uint64_t msg_type, uint64_t subscribe_id, uint64_t object_id, uint64_t payload_length)
+{
+    memset(header, 0, sizeof(pmoq_strm_t));
+    header->msg_type = msg_type;
+    header->subscribe_id = subscribe_id;
+    header->track_alias = subscribe_id + PMOQ_SENDQ_TEST_NB_SUBSCRIBERS;
+    header->group_id = 5;
+    header->object_id = object_id;
+    header->payload_length = payload_length;
+    header->publisher_priority = 7;
+    header->object_status = (payload_length == 0) ? PMOQ_OBJECT_STATUS_END_OF_GROUP : PMOQ_OBJECT_STATUS_NORMAL;
+}
+
+/* Parse the data of the stream sent to a subscriber */
+static int pmoq_sendq_test_check(const uint8_t* bytes, size_t length, uint64_t subscribe_id)
+{
+    const uint8_t* bytes_max = bytes + length;
+    pmoq_strm_t header;
+    pmoq_strm_t object;
+    int err = 0;
+
+    if ((bytes = pmoq_strm_parse(bytes, bytes_max, &err, 0, &header)) == NULL ||
+        header.msg_type != PMOQ_STRM_HEADER_SUBGROUP || header.subscribe_id != subscribe_id ||
+        header.track_alias != subscribe_id + PMOQ_SENDQ_TEST_NB_SUBSCRIBERS || header.group_id != 5) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < 2; i++) {
+        uint64_t payload_length = (i == 0) ? PMOQ_SENDQ_TEST_PAYLOAD_LENGTH : 0;
+
+        if ((bytes = pmoq_strm_object_subgroup_parse(bytes, bytes_max, &err, 0, &object)) == NULL ||
+            object.object_id != i || object.payload_length != payload_length ||
+            (uint64_t)(bytes_max - bytes) < payload_length) {
+            return -1;
+        }
+        for (size_t j = 0; j < payload_length; j++) {
+            if (bytes[j] != (uint8_t)j) {
+                return -1;
+            }
+        }
+        bytes += payload_length;
+    }
+    return (bytes == bytes_max) ? 0 : -1;
+}
+
+/* One cached object is sent to many subscribers. Each queue holds a
+ * reference to the payload, which outlives its eviction from the cache
+ * and is freed after the last subscriber has sent it. */
+int pmoq_sendq_test_fanout()
+{
+    int ret = 0;
+    pmoq_cache_t* cache = pmoq_cache_create(1000000, 4);
+    pmoq_sendq_t** queues = (pmoq_sendq_t**)calloc(PMOQ_SENDQ_TEST_NB_SUBSCRIBERS, sizeof(pmoq_sendq_t*));
+    size_t stream_max = PMOQ_SENDQ_TEST_PAYLOAD_LENGTH + 4 * PMOQ_STRM_HEADER_SIZE_MAX;
+    uint8_t* stream = (uint8_t*)malloc(stream_max);
+    pmoq_cache_payload_t* payload = NULL;
+    pmoq_strm_t header;
+
+    if (cache == NULL || queues == NULL || stream == NULL) {
+        ret = -1;
+    }
+    else {
+        pmoq_cache_object_t* object;
+
+        for (size_t j = 0; j < PMOQ_SENDQ_TEST_PAYLOAD_LENGTH; j++) {
+            stream[j] = (uint8_t)j;
+        }
+        pmoq_sendq_test_header(&header, PMOQ_STRM_OBJECT_DATAGRAM, 0, 0, PMOQ_SENDQ_TEST_PAYLOAD_LENGTH);
+        if ((object = pmoq_cache_add_object(cache, &header, stream)) == NULL) {
+            ret = -1;
+        }
+        else {
+            payload = object->payload;
+            pmoq_cache_payload_ref(payload);
+        }
+    }
+
+    for (uint64_t i = 0; ret == 0 && i < PMOQ_SENDQ_TEST_NB_SUBSCRIBERS; i++) {
+        if ((queues[i] = pmoq_sendq_create(NULL, 4 * i + 3)) == NULL) {
+            ret = -1;
+        }
+        else {
+            pmoq_sendq_test_header(&header, PMOQ_STRM_HEADER_TRACK, i, 0, PMOQ_SENDQ_TEST_PAYLOAD_LENGTH);
+            /* Objects come after the stream header */
+            if (pmoq_sendq_push_object(queues[i], &header, payload) == 0) {
+                ret = -1;
+            }
+            header.msg_type = PMOQ_STRM_HEADER_SUBGROUP;
+            if (ret == 0 && (pmoq_sendq_push_header(queues[i], &header) != 0 ||
+                pmoq_sendq_push_header(queues[i], &header) == 0 ||
+                pmoq_sendq_push_object(queues[i], &header, payload) != 0)) {
+                ret = -1;
+            }
+            pmoq_sendq_test_header(&header, PMOQ_STRM_HEADER_SUBGROUP, i, 1, 0);
+            if (ret == 0 && (pmoq_sendq_push_object(queues[i], &header, NULL) != 0 ||
+                pmoq_sendq_finish(queues[i]) != 0 ||
+                pmoq_sendq_push_object(queues[i], &header, NULL) == 0 ||
+                pmoq_sendq_count(queues[i]) != 3)) {
+                ret = -1;
+            }
+        }
+    }
+
+    /* The cache, the test and each subscriber hold a reference */
+    if (ret == 0) {
+        if (pmoq_cache_payload_refcount(payload) != PMOQ_SENDQ_TEST_NB_SUBSCRIBERS + 2) {
+            ret = -1;
+        }
+        pmoq_cache_remove_track(cache, PMOQ_SENDQ_TEST_NB_SUBSCRIBERS);
+        if (ret == 0 && pmoq_cache_payload_refcount(payload) != PMOQ_SENDQ_TEST_NB_SUBSCRIBERS + 1) {
+            ret = -1;
+        }
+    }
+
+    /* Each subscriber sends its stream in packets of various sizes */
+    for (uint64_t i = 0; ret == 0 && i < PMOQ_SENDQ_TEST_NB_SUBSCRIBERS; i++) {
+        size_t packet_size = 100 + 37 * (size_t)i;
+        size_t length = 0;
+        int is_fin = 0;
+
+        while (ret == 0 && !is_fin) {
+            size_t pending = pmoq_sendq_pending(queues[i]);
+            size_t l = pmoq_sendq_output(queues[i], stream + length,
+                (packet_size < stream_max - length) ? packet_size : stream_max - length, &is_fin);
+
+            if (l == 0 && !is_fin) {
+                ret = -1;
+            }
+            else if (pmoq_sendq_pending(queues[i]) != pending - l) {
+                ret = -1;
+            }
+            length += l;
+        }
+        if (ret == 0 && (pmoq_sendq_count(queues[i]) != 0 || pmoq_sendq_pending(queues[i]) != 0 ||
+            !pmoq_sendq_is_done(queues[i]) || pmoq_sendq_test_check(stream, length, i) != 0 ||
+            pmoq_cache_payload_refcount(payload) != PMOQ_SENDQ_TEST_NB_SUBSCRIBERS - i)) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Send queue fan-out test fails\n");
+    }
+    pmoq_cache_payload_unref(payload);
+    for (size_t i = 0; queues != NULL && i < PMOQ_SENDQ_TEST_NB_SUBSCRIBERS; i++) {
+        pmoq_sendq_delete(queues[i]);
+    }
+    free(queues);
+    free(stream);
+    pmoq_cache_delete(cache);
+
+    return ret;
+}
+
+/* The references to a payload are taken and released by several threads.
+ * The payloads still queued are released when the queue is deleted. */
+static int pmoq_sendq_test_worker(pmoq_shard_t* shard, void* app_ctx)
+{
+    pmoq_cache_payload_t* payload = (pmoq_cache_payload_t*)app_ctx;
+
+    for (size_t i = 0; i < PMOQ_SENDQ_TEST_NB_REFS; i++) {
+        pmoq_cache_payload_ref(payload);
+        if (i % 3 == pmoq_shard_index(shard) % 3) {
+            pmoq_cache_payload_ref(payload);
+            pmoq_cache_payload_unref(payload);
+        }
+        pmoq_cache_payload_unref(payload);
+    }
+    return 0;
+}
+
+int pmoq_sendq_test_refcount()
+{
+    int ret = 0;
+    pmoq_shards_t* shards = pmoq_shards_create(PMOQ_SENDQ_TEST_NB_SHARDS, 0);
+    pmoq_cache_payload_t* payload = pmoq_cache_payload_create(100);
+    pmoq_sendq_t* sendq = pmoq_sendq_create(NULL, 3);
+    pmoq_strm_t header;
+
+    if (shards == NULL || payload == NULL || sendq == NULL ||
+        pmoq_cache_payload_refcount(payload) != 1 || payload->length != 100) {
+        ret = -1;
+    }
+    else if (pmoq_shards_start(shards, pmoq_sendq_test_worker, payload) != 0 ||
+        pmoq_shards_join(shards) != 0 || pmoq_cache_payload_refcount(payload) != 1) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        memset(payload->data, 0x55, payload->length);
+        pmoq_sendq_test_header(&header, PMOQ_STRM_HEADER_TRACK, 1, 0, payload->length);
+        if (pmoq_sendq_push_header(sendq, &header) != 0 ||
+            pmoq_sendq_push_object(sendq, &header, payload) != 0 ||
+            pmoq_sendq_push_object(sendq, &header, payload) != 0 ||
+            pmoq_cache_payload_refcount(payload) != 3) {
+            ret = -1;
+        }
+        /* Payload shorter than the object */
+        header.payload_length++;
+        if (ret == 0 && pmoq_sendq_push_object(sendq, &header, payload) == 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Send queue refcount test fails\n");
+    }
+    pmoq_sendq_delete(sendq);
+    if (ret == 0 && pmoq_cache_payload_refcount(payload) != 1) {
+        printf("Send queue refcount test fails\n");
+        ret = -1;
+    }
+    pmoq_cache_payload_unref(payload);
+    pmoq_shards_delete(shards);
+
+    return ret;
+}
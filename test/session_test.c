@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include "picomoq.h"
+#include "picomoq_session.h"
+#include "picomoq/picomoq_test.h"
+#include "format_test.h"
+
+/* Session tests. The sessions are created without connection, and the
+* bytes of the control stream are passed from one to the other in chunks
+* of various sizes.
+*/
+
+typedef struct st_pmoq_session_test_ctx_t {
+    int nb_ready;
+    int nb_closed;
+    size_t nb_msgs;
+    size_t nb_errors;
+    uint64_t last_msg_type;
+    /* Index of the next corpus message expected by the server */
+    size_t next_case;
+    int reply_to_unsubscribe;
+} pmoq_session_test_ctx_t;
+
+static int pmoq_session_test_is_sent(const pmoq_msg_format_test_case_t* test)
+{
+    return test->mode == pmoq_msg_test_mode_target &&
+        test->msg_type != PMOQ_MSG_CLIENT_SETUP && test->msg_type != PMOQ_MSG_SERVER_SETUP;
+}
+
+static int pmoq_session_test_callback(pmoq_session_t* session, pmoq_session_event_enum event,
+    const pmoq_msg_t* msg, void* callback_ctx)
+{
+    int ret = 0;
+    pmoq_session_test_ctx_t* ctx = (pmoq_session_test_ctx_t*)callback_ctx;
+
+    switch (event) {
+    case pmoq_session_event_ready:
+        ctx->nb_ready++;
+        break;
+    case pmoq_session_event_msg:
+        ctx->nb_msgs++;
+        ctx->last_msg_type = msg->msg_type;
+        if (ctx->next_case < format_test_cases_nb) {
+            /* Verify that the message is the next one of the corpus */
+            pmoq_msg_t expected = { 0 };
+
+            while (ctx->next_case < format_test_cases_nb &&
+                !pmoq_session_test_is_sent(&format_test_cases[ctx->next_case])) {
+                ctx->next_case++;
+            }
+            if (ctx->next_case >= format_test_cases_nb ||
+                pmoq_test_set_msg_from_test(&expected, &format_test_cases[ctx->next_case]) != 0 ||
+                mpoq_test_msg_compare(msg, &expected) != 0) {
+                ctx->nb_errors++;
+            }
+            ctx->next_case++;
+        }
+        if (ctx->reply_to_unsubscribe && msg->msg_type == PMOQ_MSG_UNSUBSCRIBE) {
+            pmoq_msg_t reply = { 0 };
+
+            reply.msg_type = PMOQ_MSG_MAX_SUBSCRIBE_ID;
+            reply.u.max_subscribe_id.subscribe_id = msg->u.unsubscribe.subscribe_id + 1;
+            ret = pmoq_session_send(session, &reply);
+        }
+        break;
+    case pmoq_session_event_closed:
+        ctx->nb_closed++;
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+    return ret;
+}
+
+static int pmoq_session_test_transfer(pmoq_session_t* from, pmoq_session_t* to, size_t chunk)
+{
+    int ret = 0;
+    uint8_t buf[256];
+    size_t l;
+
+    if (chunk > sizeof(buf)) {
+        chunk = sizeof(buf);
+    }
+    while (ret == 0 && (l = pmoq_session_output(from, buf, chunk)) > 0) {
+        ret = pmoq_session_input(to, buf, l);
+    }
+    return ret;
+}
+
+static int pmoq_session_test_pair(pmoq_session_t** client, pmoq_session_test_ctx_t* client_ctx,
+    pmoq_session_t** server, pmoq_session_test_ctx_t* server_ctx)
+{
+    int ret = 0;
+
+    memset(client_ctx, 0, sizeof(pmoq_session_test_ctx_t));
+    memset(server_ctx, 0, sizeof(pmoq_session_test_ctx_t));
+    client_ctx->next_case = format_test_cases_nb;
+    *client = pmoq_session_create(NULL, 1, pmoq_session_test_callback, client_ctx);
+    *server = pmoq_session_create(NULL, 0, pmoq_session_test_callback, server_ctx);
+    if (*client == NULL || *server == NULL) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int pmoq_session_test_setup_one(size_t chunk)
+{
+    int ret = 0;
+    pmoq_session_test_ctx_t client_ctx;
+    pmoq_session_test_ctx_t server_ctx;
+    pmoq_session_t* client = NULL;
+    pmoq_session_t* server = NULL;
+    const uint32_t offered_versions[2] = { PMOQ_VERSION_DRAFT_07 + 1, PMOQ_VERSION_DRAFT_07 };
+    size_t nb_sent = 0;
+    uint8_t path[] = { 'm', 'o', 'q' };
+
+    if (pmoq_session_test_pair(&client, &client_ctx, &server, &server_ctx) != 0 ||
+        pmoq_session_set_versions(client, offered_versions, 2) != 0 ||
+        pmoq_session_set_versions(server, offered_versions, 2) != 0 ||
+        pmoq_session_set_setup_parameters(client, pmoq_setup_role_subscriber, path, sizeof(path)) != 0 ||
+        pmoq_session_set_setup_parameters(server, pmoq_setup_role_publisher, NULL, 0) != 0) {
+        ret = -1;
+    }
+    else if (pmoq_session_start(client) != 0 || pmoq_session_start(server) == 0 ||
+        pmoq_session_state(client) != pmoq_session_state_setup_sent) {
+        ret = -1;
+    }
+    else if (pmoq_session_test_transfer(client, server, chunk) != 0 ||
+        server_ctx.nb_ready != 1 || pmoq_session_state(server) != pmoq_session_state_ready ||
+        pmoq_session_version(server) != PMOQ_VERSION_DRAFT_07 ||
+        pmoq_session_codec(server) != pmoq_codec_get(PMOQ_VERSION_DRAFT_07) ||
+        pmoq_session_peer_role(server) != pmoq_setup_role_subscriber) {
+        ret = -1;
+    }
+    else if (pmoq_session_test_transfer(server, client, chunk) != 0 ||
+        client_ctx.nb_ready != 1 || pmoq_session_state(client) != pmoq_session_state_ready ||
+        pmoq_session_version(client) != PMOQ_VERSION_DRAFT_07 ||
+        pmoq_session_codec(client) != pmoq_codec_get(PMOQ_VERSION_DRAFT_07) ||
+        pmoq_session_peer_role(client) != pmoq_setup_role_publisher) {
+        ret = -1;
+    }
+
+    /* Send all valid messages of the corpus, the server checks them in order */
+    server_ctx.reply_to_unsubscribe = 1;
+    for (size_t i = 0; ret == 0 && i < format_test_cases_nb; i++) {
+        if (pmoq_session_test_is_sent(&format_test_cases[i])) {
+            pmoq_msg_t msg = { 0 };
+
+            if (pmoq_test_set_msg_from_test(&msg, &format_test_cases[i]) != 0 ||
+                pmoq_session_send(client, &msg) != 0) {
+                ret = -1;
+            }
+            nb_sent++;
+        }
+    }
+
+    if (ret == 0 &&
+        (pmoq_session_test_transfer(client, server, chunk) != 0 ||
+            server_ctx.nb_msgs != nb_sent || server_ctx.nb_errors != 0 ||
+            pmoq_session_test_transfer(server, client, chunk) != 0 ||
+            client_ctx.nb_msgs == 0 || client_ctx.last_msg_type != PMOQ_MSG_MAX_SUBSCRIBE_ID ||
+            client_ctx.nb_closed != 0 || server_ctx.nb_closed != 0)) {
+        ret = -1;
+    }
+
+    pmoq_session_delete(client);
+    pmoq_session_delete(server);
+
+    return ret;
+}
+
+int pmoq_session_test_setup()
+{
+    int ret = 0;
+    const size_t chunks[] = { 1, 2, 3, 7, 16, 256 };
+
+    for (size_t i = 0; ret == 0 && i < sizeof(chunks) / sizeof(size_t); i++) {
+        if ((ret = pmoq_session_test_setup_one(chunks[i])) != 0) {
+            printf("Session setup test fails, chunk %zu\n", chunks[i]);
+        }
+    }
+    return ret;
+}
+
+static int pmoq_session_test_expect_close(pmoq_session_t* session, pmoq_session_test_ctx_t* ctx, uint64_t error_code)
+{
+    return (pmoq_session_state(session) == pmoq_session_state_closed &&
+        pmoq_session_error(session) == error_code && ctx->nb_closed == 1) ? 0 : -1;
+}
+
+int pmoq_session_test_errors()
+{
+    int ret = 0;
+    pmoq_session_test_ctx_t client_ctx;
+    pmoq_session_test_ctx_t server_ctx;
+    pmoq_session_t* client = NULL;
+    pmoq_session_t* server = NULL;
+    pmoq_msg_t msg = { 0 };
+    uint8_t buf[256];
+    uint8_t* bytes;
+
+    /* Control message before the setup */
+    msg.msg_type = PMOQ_MSG_UNSUBSCRIBE;
+    msg.u.unsubscribe.subscribe_id = 1;
+    if (pmoq_session_test_pair(&client, &client_ctx, &server, &server_ctx) != 0 ||
+        pmoq_session_send(client, &msg) == 0 ||
+        (bytes = pmoq_msg_format(buf, buf + sizeof(buf), &msg)) == NULL ||
+        pmoq_session_input(server, buf, bytes - buf) == 0 ||
+        pmoq_session_test_expect_close(server, &server_ctx, PMOQ_ERROR_PROTOCOL_VIOLATION) != 0 ||
+        pmoq_session_input(server, buf, bytes - buf) == 0 || server_ctx.nb_closed != 1) {
+        printf("Session error test fails: message before setup\n");
+        ret = -1;
+    }
+    pmoq_session_delete(client);
+    pmoq_session_delete(server);
+
+    /* No common version */
+    if (ret == 0) {
+        const uint32_t version = PMOQ_VERSION_DRAFT_07 + 1;
+
+        if (pmoq_session_test_pair(&client, &client_ctx, &server, &server_ctx) != 0 ||
+            pmoq_session_set_versions(client, &version, 1) != 0 ||
+            pmoq_session_start(client) != 0 ||
+            pmoq_session_test_transfer(client, server, sizeof(buf)) == 0 ||
+            pmoq_session_test_expect_close(server, &server_ctx, PMOQ_ERROR_PROTOCOL_VIOLATION) != 0 ||
+            server_ctx.nb_ready != 0 || pmoq_session_output_pending(server) != 0) {
+            printf("Session error test fails: no common version\n");
+            ret = -1;
+        }
+        pmoq_session_delete(client);
+        pmoq_session_delete(server);
+    }
+
+    /* Server selects a version that was not offered */
+    if (ret == 0) {
+        pmoq_msg_t server_setup = { 0 };
+
+        server_setup.msg_type = PMOQ_MSG_SERVER_SETUP;
+        server_setup.u.server_setup.selected_version = PMOQ_VERSION_DRAFT_07 + 1;
+        if (pmoq_session_test_pair(&client, &client_ctx, &server, &server_ctx) != 0 ||
+            pmoq_session_start(client) != 0 ||
+            (bytes = pmoq_msg_format(buf, buf + sizeof(buf), &server_setup)) == NULL ||
+            pmoq_session_input(client, buf, bytes - buf) == 0 ||
+            pmoq_session_test_expect_close(client, &client_ctx, PMOQ_ERROR_PROTOCOL_VIOLATION) != 0 ||
+            client_ctx.nb_ready != 0) {
+            printf("Session error test fails: version not offered\n");
+            ret = -1;
+        }
+        pmoq_session_delete(client);
+        pmoq_session_delete(server);
+    }
+
+    /* Second setup, then malformed message */
+    for (int is_malformed = 0; ret == 0 && is_malformed < 2; is_malformed++) {
+        if (pmoq_session_test_pair(&client, &client_ctx, &server, &server_ctx) != 0 ||
+            pmoq_session_start(client) != 0 ||
+            (bytes = pmoq_msg_format(buf, buf + sizeof(buf), &msg)) == NULL) {
+            ret = -1;
+        }
+        else {
+            /* Copy of the client setup, or an unknown message type */
+            size_t l = pmoq_session_output_pending(client);
+
+            if (l > sizeof(buf) / 2 || pmoq_session_output(client, buf, l) != l ||
+                pmoq_session_input(server, buf, l) != 0 || server_ctx.nb_ready != 1) {
+                ret = -1;
+            }
+            else {
+                if (is_malformed) {
+                    buf[0] = 0x3f;
+                    l = 4;
+                }
+                if (pmoq_session_input(server, buf, l) == 0 ||
+                    pmoq_session_test_expect_close(server, &server_ctx, PMOQ_ERROR_PROTOCOL_VIOLATION) != 0) {
+                    ret = -1;
+                }
+            }
+        }
+        if (ret != 0) {
+            printf("Session error test fails: %s\n", (is_malformed) ? "malformed" : "second setup");
+        }
+        pmoq_session_delete(client);
+        pmoq_session_delete(server);
+    }
+
+    return ret;
+}
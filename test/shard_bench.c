@@ -0,0 +1,300 @@
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include <picosocks.h>
+#include "picomoq.h"
+#include "picomoq_shard.h"
+#include "picomoq/picomoq_test.h"
+
+/* Loopback benchmark of the sharded relay.
+*
+* For 1, 2, 4... up to the maximum number of shards, the shards run
+* pmoq_shard_run() on their own socket, all bound to the same loopback
+* port with SO_REUSEPORT, each with a picoquic server context. As many
+* sender threads, in the same process, send packets to that port from
+* several UDP flows each, as fast as they can. The kernel spreads the
+* flows over the sockets of the shards.
+*
+* Each flow carries the connection ID of one shard, in the first byte, as
+* the connections of a relay do; when the kernel delivers a flow to
+* another shard, its packets are forwarded through the rings. The
+* connection IDs are not known to picoquic, which drops the packets or
+* answers with stateless resets: this measures the receive, routing and
+* forwarding path of the shards, not the processing of the objects,
+* which the relay benchmark covers.
+*
+* Reported, per number of shards: packets sent and received, packets
+* forwarded and dropped because a ring was full, received packets per
+* second of wall clock time, and the speedup relative to one shard. The
+* senders share the cores with the shards, so the speedup can only
+* approach the number of shards if there are at least twice as many
+* cores.
+*/
+
+#define PMOQ_SB_FLOWS_PER_SENDER 8
+#define PMOQ_SB_PACKET_SIZE 1200
+#define PMOQ_SB_BURST 16
+#define PMOQ_SB_CID_LENGTH 8
+
+typedef struct st_pmoq_shard_bench_t {
+    const pmoq_shard_bench_config_t* config;
+    int is_csv;
+    size_t nb_shards;
+    pmoq_shards_t* shards;
+    picoquic_quic_t** quic;
+    SOCKET_TYPE* fd;
+    /* The flows of sender i are at [i * PMOQ_SB_FLOWS_PER_SENDER] */
+    pmoq_shards_t* senders;
+    SOCKET_TYPE* flows;
+    uint64_t* nb_sent;
+    struct sockaddr_in addr_relay;
+} pmoq_shard_bench_t;
+
+static void pmoq_sb_sleep(uint64_t duration)
+{
+#ifdef _WINDOWS
+    Sleep((DWORD)(duration / 1000));
+#else
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(duration / 1000000);
+    ts.tv_nsec = (long)((duration % 1000000) * 1000);
+    (void)nanosleep(&ts, NULL);
+#endif
+}
+
+static void pmoq_sb_item(pmoq_shard_t* shard, size_t from, void* item, void* app_ctx)
+{
+    /* No items are posted */
+    (void)shard;
+    (void)from;
+    (void)item;
+    (void)app_ctx;
+}
+
+static int pmoq_sb_shard_worker(pmoq_shard_t* shard, void* app_ctx)
+{
+    pmoq_shard_bench_t* bench = (pmoq_shard_bench_t*)app_ctx;
+    size_t index = pmoq_shard_index(shard);
+
+    return pmoq_shard_run(shard, bench->quic[index], bench->fd[index], pmoq_sb_item, bench);
+}
+
+static int pmoq_sb_sender_worker(pmoq_shard_t* sender, void* app_ctx)
+{
+    pmoq_shard_bench_t* bench = (pmoq_shard_bench_t*)app_ctx;
+    size_t index = pmoq_shard_index(sender);
+    uint8_t packet[PMOQ_SB_PACKET_SIZE];
+    uint64_t nb_sent = 0;
+
+    memset(packet, 0, sizeof(packet));
+    while (!pmoq_shard_is_stopping(sender)) {
+        for (size_t i = 0; i < PMOQ_SB_FLOWS_PER_SENDER; i++) {
+            size_t flow = index * PMOQ_SB_FLOWS_PER_SENDER + i;
+
+            /* Short header, then the connection ID of the owner */
+            packet[0] = 0x40;
+            packet[1] = (uint8_t)(flow % bench->nb_shards);
+            for (int j = 0; j < PMOQ_SB_BURST; j++) {
+                memcpy(packet + 1 + PMOQ_SB_CID_LENGTH, &nb_sent, sizeof(nb_sent));
+                if (sendto(bench->flows[flow], (const char*)packet, (int)sizeof(packet), 0,
+                    (struct sockaddr*)&bench->addr_relay, sizeof(bench->addr_relay)) > 0) {
+                    nb_sent++;
+                }
+            }
+        }
+    }
+    bench->nb_sent[index] = nb_sent;
+
+    return 0;
+}
+
+static void pmoq_sb_delete(pmoq_shard_bench_t* bench)
+{
+    for (size_t i = 0; bench->flows != NULL && i < bench->nb_shards * PMOQ_SB_FLOWS_PER_SENDER; i++) {
+        if (bench->flows[i] != INVALID_SOCKET) {
+            SOCKET_CLOSE(bench->flows[i]);
+        }
+    }
+    for (size_t i = 0; i < bench->nb_shards; i++) {
+        if (bench->fd != NULL && bench->fd[i] != INVALID_SOCKET) {
+            SOCKET_CLOSE(bench->fd[i]);
+        }
+        if (bench->quic != NULL && bench->quic[i] != NULL) {
+            picoquic_free(bench->quic[i]);
+        }
+    }
+    pmoq_shards_delete(bench->senders);
+    pmoq_shards_delete(bench->shards);
+    free(bench->nb_sent);
+    free(bench->flows);
+    free(bench->fd);
+    free(bench->quic);
+}
+
+static int pmoq_sb_create(pmoq_shard_bench_t* bench, const pmoq_shard_bench_config_t* config, size_t nb_shards)
+{
+    int ret = 0;
+    size_t nb_flows = nb_shards * PMOQ_SB_FLOWS_PER_SENDER;
+
+    memset(bench, 0, sizeof(pmoq_shard_bench_t));
+    bench->config = config;
+    bench->nb_shards = nb_shards;
+    bench->addr_relay.sin_family = AF_INET;
+    bench->addr_relay.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bench->addr_relay.sin_port = htons(config->port);
+
+    if ((bench->shards = pmoq_shards_create(nb_shards, 0)) == NULL ||
+        (bench->senders = pmoq_shards_create(nb_shards, 0)) == NULL ||
+        (bench->quic = (picoquic_quic_t**)calloc(nb_shards, sizeof(picoquic_quic_t*))) == NULL ||
+        (bench->fd = (SOCKET_TYPE*)malloc(nb_shards * sizeof(SOCKET_TYPE))) == NULL ||
+        (bench->flows = (SOCKET_TYPE*)malloc(nb_flows * sizeof(SOCKET_TYPE))) == NULL ||
+        (bench->nb_sent = (uint64_t*)calloc(nb_shards, sizeof(uint64_t))) == NULL) {
+        /* The sockets are not open yet */
+        free(bench->fd);
+        free(bench->flows);
+        bench->fd = NULL;
+        bench->flows = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < nb_shards; i++) {
+        bench->fd[i] = INVALID_SOCKET;
+    }
+    for (size_t i = 0; i < nb_flows; i++) {
+        bench->flows[i] = INVALID_SOCKET;
+    }
+
+    for (size_t i = 0; ret == 0 && i < nb_shards; i++) {
+        if ((bench->fd[i] = pmoq_shard_socket_open(AF_INET, config->port)) == INVALID_SOCKET) {
+            fprintf(stderr, "Cannot open the socket of shard %zu on port %u, SO_REUSEPORT may not be supported\n",
+                i, (unsigned int)config->port);
+            ret = -1;
+        }
+        else if ((bench->quic[i] = picoquic_create(8, config->cert_file, config->key_file, NULL, PMOQ_ALPN,
+            NULL, NULL, pmoq_shard_cnx_id_callback, pmoq_shards_get(bench->shards, i), NULL,
+            picoquic_current_time(), NULL, NULL, NULL, 0)) == NULL) {
+            fprintf(stderr, "Cannot create the picoquic context, check the certificate and key files\n");
+            ret = -1;
+        }
+    }
+    for (size_t i = 0; ret == 0 && i < nb_flows; i++) {
+        if ((bench->flows[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static void pmoq_sb_report(FILE* F, pmoq_shard_bench_t* bench, uint64_t elapsed_us, double* base_rate, int is_first)
+{
+    double elapsed_s = (elapsed_us == 0) ? 1e-6 : ((double)elapsed_us) / 1000000.0;
+    pmoq_shard_stats_t total = { 0 };
+    uint64_t nb_sent = 0;
+    double rate;
+
+    for (size_t i = 0; i < bench->nb_shards; i++) {
+        pmoq_shard_stats_t stats;
+
+        pmoq_shard_stats(pmoq_shards_get(bench->shards, i), &stats);
+        total.nb_packets_received += stats.nb_packets_received;
+        total.nb_packets_forwarded += stats.nb_packets_forwarded;
+        total.drops_ring_full += stats.drops_ring_full;
+        nb_sent += bench->nb_sent[i];
+    }
+    rate = ((double)total.nb_packets_received) / elapsed_s;
+    if (is_first) {
+        *base_rate = rate;
+    }
+
+    if (bench->is_csv) {
+        fprintf(F, "shards,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.0f,%.2f\n",
+            bench->nb_shards, elapsed_us, nb_sent, total.nb_packets_received, total.nb_packets_forwarded,
+            total.drops_ring_full, rate, (*base_rate > 0) ? rate / *base_rate : 0);
+    }
+    else {
+        fprintf(F, "%s    { \"shards\": %zu, \"duration_us\": %" PRIu64 ",\n", (is_first) ? "" : ",\n",
+            bench->nb_shards, elapsed_us);
+        fprintf(F, "      \"packets_sent\": %" PRIu64 ", \"packets_received\": %" PRIu64 ", \"packets_forwarded\": %" PRIu64 ", \"drops_ring_full\": %" PRIu64 ",\n",
+            nb_sent, total.nb_packets_received, total.nb_packets_forwarded, total.drops_ring_full);
+        fprintf(F, "      \"packets_per_s\": %.0f, \"speedup\": %.2f }",
+            rate, (*base_rate > 0) ? rate / *base_rate : 0);
+    }
+}
+
+static int pmoq_sb_run_one(FILE* F, const pmoq_shard_bench_config_t* config, int is_csv, size_t nb_shards,
+    double* base_rate, int is_first)
+{
+    pmoq_shard_bench_t bench;
+    int ret = pmoq_sb_create(&bench, config, nb_shards);
+    uint64_t start_time = 0;
+    uint64_t elapsed = 0;
+
+    bench.is_csv = is_csv;
+    if (ret == 0 && (ret = pmoq_shards_start(bench.shards, pmoq_sb_shard_worker, &bench)) == 0) {
+        start_time = picoquic_current_time();
+        if ((ret = pmoq_shards_start(bench.senders, pmoq_sb_sender_worker, &bench)) == 0) {
+            pmoq_sb_sleep(config->duration);
+            pmoq_shards_stop(bench.senders);
+            (void)pmoq_shards_join(bench.senders);
+        }
+        elapsed = picoquic_current_time() - start_time;
+        pmoq_shards_stop(bench.shards);
+        if (pmoq_shards_join(bench.shards) != 0) {
+            fprintf(stderr, "A shard failed, with %zu shards\n", nb_shards);
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        pmoq_sb_report(F, &bench, elapsed, base_rate, is_first);
+    }
+    pmoq_sb_delete(&bench);
+
+    return ret;
+}
+
+int pmoq_shard_bench(FILE* F, const pmoq_shard_bench_config_t* config, int is_csv)
+{
+    int ret = 0;
+    double base_rate = 0;
+    size_t nb_shards = 1;
+    int is_first = 1;
+
+    if (config->nb_shards_max == 0 || config->nb_shards_max > PMOQ_SHARD_MAX) {
+        return -1;
+    }
+    if (is_csv) {
+        fprintf(F, "kind,shards,duration_us,packets_sent,packets_received,packets_forwarded,drops_ring_full,packets_per_s,speedup\n");
+    }
+    else {
+        fprintf(F, "{\n  \"results\": [\n");
+    }
+
+    while (ret == 0) {
+        ret = pmoq_sb_run_one(F, config, is_csv, nb_shards, &base_rate, is_first);
+        is_first = 0;
+        if (nb_shards >= config->nb_shards_max) {
+            break;
+        }
+        nb_shards = (2 * nb_shards < config->nb_shards_max) ? 2 * nb_shards : config->nb_shards_max;
+    }
+
+    if (!is_csv) {
+        fprintf(F, "\n  ],\n  \"status\": %d\n}\n", ret);
+    }
+    return ret;
+}
@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_shard.h"
+#include "picomoq/picomoq_test.h"
+
+/* Sharded relay tests
+*/
+
+#define PMOQ_SHARD_TEST_NB_SHARDS 4
+#define PMOQ_SHARD_TEST_NB_ITEMS 100000
+
+int pmoq_shard_test_route()
+{
+    int ret = 0;
+    pmoq_spsc_ring_t* ring = pmoq_spsc_ring_create(5);
+    pmoq_shards_t* shards = pmoq_shards_create(PMOQ_SHARD_TEST_NB_SHARDS, 16);
+    uint8_t packet[32];
+
+    if (ring == NULL || shards == NULL || pmoq_shards_count(shards) != PMOQ_SHARD_TEST_NB_SHARDS ||
+        pmoq_shards_get(shards, PMOQ_SHARD_TEST_NB_SHARDS) != NULL || pmoq_shards_create(0, 0) != NULL) {
+        ret = -1;
+    }
+
+    /* The ring holds 8 items, in order, across the wrap around */
+    for (uintptr_t round = 0; ret == 0 && round < 3; round++) {
+        for (uintptr_t i = 1; ret == 0 && i <= 8; i++) {
+            if (pmoq_spsc_ring_push(ring, (void*)(round * 8 + i)) != 0) {
+                ret = -1;
+            }
+        }
+        if (ret == 0 && (pmoq_spsc_ring_push(ring, (void*)1) == 0 || pmoq_spsc_ring_count(ring) != 8)) {
+            ret = -1;
+        }
+        for (uintptr_t i = 1; ret == 0 && i <= 8; i++) {
+            if (pmoq_spsc_ring_pop(ring) != (void*)(round * 8 + i)) {
+                ret = -1;
+            }
+        }
+        if (ret == 0 && (pmoq_spsc_ring_pop(ring) != NULL || pmoq_spsc_ring_count(ring) != 0)) {
+            ret = -1;
+        }
+    }
+
+    /* The connection IDs chosen by a shard route the packets to it */
+    for (size_t i = 0; ret == 0 && i < PMOQ_SHARD_TEST_NB_SHARDS; i++) {
+        picoquic_connection_id_t cid_local = { { 0xff, 2, 3, 4, 5, 6, 7, 8 }, 8 };
+        picoquic_connection_id_t cid_remote = { { 0 }, 0 };
+        picoquic_connection_id_t cid = { { 0 }, 0 };
+
+        pmoq_shard_cnx_id_callback(NULL, cid_local, cid_remote, pmoq_shards_get(shards, i), &cid);
+        if (cid.id_len != 8 || cid.id[0] != i || memcmp(cid.id + 1, cid_local.id + 1, 7) != 0) {
+            ret = -1;
+        }
+        else {
+            /* Short header */
+            memset(packet, 0, sizeof(packet));
+            packet[0] = 0x40;
+            memcpy(packet + 1, cid.id, cid.id_len);
+            if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 3) != i) {
+                ret = -1;
+            }
+            /* Handshake, version 1 then version 2 */
+            memset(packet, 0, sizeof(packet));
+            packet[0] = 0xe0;
+            packet[4] = 1;
+            packet[5] = cid.id_len;
+            memcpy(packet + 6, cid.id, cid.id_len);
+            if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 3) != i) {
+                ret = -1;
+            }
+            packet[0] = 0xf0;
+            packet[1] = 0x6b;
+            packet[2] = 0x33;
+            packet[3] = 0x43;
+            packet[4] = 0xcf;
+            if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 3) != i) {
+                ret = -1;
+            }
+        }
+    }
+
+    /* The Initial packets, unknown versions and connection IDs of other
+     * relays stay on the shard that received them */
+    if (ret == 0) {
+        memset(packet, 0, sizeof(packet));
+        packet[0] = 0xc0;
+        packet[4] = 1;
+        packet[5] = 8;
+        packet[6] = 1;
+        if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 2) != 2) {
+            ret = -1;
+        }
+        packet[0] = 0xe0;
+        packet[4] = 7;
+        if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 2) != 2) {
+            ret = -1;
+        }
+        packet[0] = 0x40;
+        packet[1] = PMOQ_SHARD_TEST_NB_SHARDS;
+        if (pmoq_shard_route_packet(packet, sizeof(packet), PMOQ_SHARD_TEST_NB_SHARDS, 2) != 2 ||
+            pmoq_shard_route_packet(packet, 1, PMOQ_SHARD_TEST_NB_SHARDS, 2) != 2 ||
+            pmoq_shard_route_packet(packet, 0, PMOQ_SHARD_TEST_NB_SHARDS, 2) != 2) {
+            ret = -1;
+        }
+    }
+
+    /* Items cannot be posted to the same shard or to a shard that does not exist */
+    if (ret == 0) {
+        pmoq_shard_t* shard = pmoq_shards_get(shards, 1);
+
+        if (pmoq_shard_post(shard, 1, (void*)1) == 0 || pmoq_shard_post(shard, PMOQ_SHARD_TEST_NB_SHARDS, (void*)1) == 0 ||
+            pmoq_shard_post(shard, 2, (void*)1) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Shard route test fails\n");
+    }
+    pmoq_spsc_ring_delete(ring);
+    pmoq_shards_delete(shards);
+
+    return ret;
+}
+
+/* Each worker sends a numbered sequence of items to every other shard,
+ * while receiving theirs, and checks that they arrive in order. The
+ * rings are small, so the producers often find them full. */
+typedef struct st_pmoq_shard_test_ctx_t {
+    uintptr_t next_expected[PMOQ_SHARD_TEST_NB_SHARDS][PMOQ_SHARD_TEST_NB_SHARDS];
+    size_t nb_errors[PMOQ_SHARD_TEST_NB_SHARDS];
+} pmoq_shard_test_ctx_t;
+
+static void pmoq_shard_test_item(pmoq_shard_t* shard, size_t from, void* item, void* app_ctx)
+{
+    pmoq_shard_test_ctx_t* ctx = (pmoq_shard_test_ctx_t*)app_ctx;
+    size_t index = pmoq_shard_index(shard);
+
+    if ((uintptr_t)item != ctx->next_expected[index][from]) {
+        ctx->nb_errors[index]++;
+    }
+    ctx->next_expected[index][from]++;
+}
+
+static int pmoq_shard_test_worker(pmoq_shard_t* shard, void* app_ctx)
+{
+    pmoq_shard_test_ctx_t* ctx = (pmoq_shard_test_ctx_t*)app_ctx;
+    size_t index = pmoq_shard_index(shard);
+    uintptr_t next_sent[PMOQ_SHARD_TEST_NB_SHARDS];
+    int is_done = 0;
+
+    for (size_t to = 0; to < PMOQ_SHARD_TEST_NB_SHARDS; to++) {
+        next_sent[to] = 1;
+    }
+    while (!is_done && !pmoq_shard_is_stopping(shard)) {
+        is_done = 1;
+        for (size_t to = 0; to < PMOQ_SHARD_TEST_NB_SHARDS; to++) {
+            if (to != index) {
+                while (next_sent[to] <= PMOQ_SHARD_TEST_NB_ITEMS && pmoq_shard_post(shard, to, (void*)next_sent[to]) == 0) {
+                    next_sent[to]++;
+                }
+                if (next_sent[to] <= PMOQ_SHARD_TEST_NB_ITEMS) {
+                    is_done = 0;
+                }
+            }
+        }
+        (void)pmoq_shard_drain(shard, pmoq_shard_test_item, ctx, SIZE_MAX);
+        for (size_t from = 0; from < PMOQ_SHARD_TEST_NB_SHARDS; from++) {
+            if (from != index && ctx->next_expected[index][from] <= PMOQ_SHARD_TEST_NB_ITEMS) {
+                is_done = 0;
+            }
+        }
+    }
+    return (is_done && ctx->nb_errors[index] == 0) ? 0 : -1;
+}
+
+static int pmoq_shard_test_idle(pmoq_shard_t* shard, void* app_ctx)
+{
+    while (!pmoq_shard_is_stopping(shard)) {
+        (void)pmoq_shard_drain(shard, pmoq_shard_test_item, app_ctx, SIZE_MAX);
+    }
+    return 0;
+}
+
+int pmoq_shard_test_threads()
+{
+    int ret = 0;
+    pmoq_shards_t* shards = pmoq_shards_create(PMOQ_SHARD_TEST_NB_SHARDS, 64);
+    pmoq_shard_test_ctx_t* ctx = (pmoq_shard_test_ctx_t*)calloc(1, sizeof(pmoq_shard_test_ctx_t));
+
+    if (shards == NULL || ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        for (size_t i = 0; i < PMOQ_SHARD_TEST_NB_SHARDS; i++) {
+            for (size_t j = 0; j < PMOQ_SHARD_TEST_NB_SHARDS; j++) {
+                ctx->next_expected[i][j] = 1;
+            }
+        }
+        if (pmoq_shards_start(shards, pmoq_shard_test_worker, ctx) != 0 ||
+            pmoq_shards_join(shards) != 0) {
+            ret = -1;
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < PMOQ_SHARD_TEST_NB_SHARDS; i++) {
+        pmoq_shard_stats_t stats;
+
+        pmoq_shard_stats(pmoq_shards_get(shards, i), &stats);
+        if (stats.nb_items_posted != (PMOQ_SHARD_TEST_NB_SHARDS - 1) * PMOQ_SHARD_TEST_NB_ITEMS ||
+            stats.nb_items_delivered != (PMOQ_SHARD_TEST_NB_SHARDS - 1) * PMOQ_SHARD_TEST_NB_ITEMS) {
+            ret = -1;
+        }
+    }
+
+    /* The workers return once stopped */
+    if (ret == 0) {
+        if (pmoq_shards_start(shards, pmoq_shard_test_idle, ctx) != 0) {
+            ret = -1;
+        }
+        else {
+            pmoq_shards_stop(shards);
+            ret = pmoq_shards_join(shards);
+        }
+    }
+
+    if (ret != 0) {
+        printf("Shard threads test fails\n");
+    }
+    pmoq_shards_delete(shards);
+    free(ctx);
+
+    return ret;
+}
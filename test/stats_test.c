@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_shard.h"
+#include "picomoq_stats.h"
+#include "picomoq/picomoq_test.h"
+
+/* Codec statistics tests
+*/
+
+#define PMOQ_STATS_TEST_NB_SHARDS 4
+#define PMOQ_STATS_TEST_NB_MESSAGES 1000
+
+int pmoq_stats_test_histo()
+{
+    int ret = 0;
+    pmoq_stats_t* stats = (pmoq_stats_t*)calloc(1, sizeof(pmoq_stats_t));
+    FILE* F = tmpfile();
+    uint64_t previous = 0;
+
+    if (stats == NULL || F == NULL) {
+        ret = -1;
+    }
+
+    /* Each value falls in a bucket that spans at most a quarter of it,
+     * and the buckets are in increasing order */
+    for (size_t bucket = 0; ret == 0 && bucket < PMOQ_STATS_HISTO_BUCKETS; bucket++) {
+        uint64_t v_min = pmoq_stats_histo_bucket_min(bucket);
+
+        if ((bucket > 0 && v_min <= previous) || pmoq_stats_histo_bucket(v_min) != bucket ||
+            (bucket > 0 && pmoq_stats_histo_bucket(v_min - 1) != bucket - 1)) {
+            ret = -1;
+        }
+        else if (bucket + 1 < PMOQ_STATS_HISTO_BUCKETS && v_min >= 4 &&
+            4 * (pmoq_stats_histo_bucket_min(bucket + 1) - v_min) > v_min) {
+            ret = -1;
+        }
+        previous = v_min;
+    }
+    if (ret == 0 && (pmoq_stats_histo_bucket(UINT64_MAX) != PMOQ_STATS_HISTO_BUCKETS - 1 ||
+        pmoq_stats_histo_bucket(((uint64_t)1) << 32) != PMOQ_STATS_HISTO_BUCKETS - 1)) {
+        ret = -1;
+    }
+
+    /* 90 values of 100 ns, 10 values of 10 us */
+    if (ret == 0) {
+        pmoq_stats_histo_t* histo = &stats->msg[pmoq_stats_msg_slot(PMOQ_MSG_SUBSCRIBE)].latency[pmoq_stats_op_parse];
+
+        if (pmoq_stats_histo_percentile(histo, 50.0) != 0) {
+            ret = -1;
+        }
+        histo->counts[pmoq_stats_histo_bucket(100)] = 90;
+        histo->counts[pmoq_stats_histo_bucket(10000)] = 10;
+        stats->msg[pmoq_stats_msg_slot(PMOQ_MSG_SUBSCRIBE)].nb_parsed = 100;
+        if (ret == 0 && (pmoq_stats_histo_count(histo) != 100 ||
+            pmoq_stats_histo_percentile(histo, 50.0) != pmoq_stats_histo_bucket_min(pmoq_stats_histo_bucket(100)) ||
+            pmoq_stats_histo_percentile(histo, 95.0) != pmoq_stats_histo_bucket_min(pmoq_stats_histo_bucket(10000)) ||
+            pmoq_stats_histo_percentile(histo, 100.0) != pmoq_stats_histo_bucket_min(pmoq_stats_histo_bucket(10000)))) {
+            ret = -1;
+        }
+    }
+
+    /* Slots */
+    if (ret == 0 && (pmoq_stats_msg_slot(PMOQ_MSG_SUBSCRIBE) != PMOQ_MSG_SUBSCRIBE ||
+        pmoq_stats_msg_slot(PMOQ_MSG_SERVER_SETUP) != PMOQ_STATS_MSG_SLOTS - 2 ||
+        pmoq_stats_msg_slot(PMOQ_MSG_CLIENT_SETUP) == pmoq_stats_msg_slot(PMOQ_MSG_MAX_SUBSCRIBE_ID) ||
+        pmoq_stats_msg_slot(0x30) != PMOQ_STATS_MSG_SLOTS - 1 ||
+        pmoq_stats_strm_slot(PMOQ_STRM_HEADER_SUBGROUP) != pmoq_stats_strm_header_subgroup ||
+        pmoq_stats_strm_slot(0x3) != pmoq_stats_strm_other)) {
+        ret = -1;
+    }
+
+    /* The dump has one line per entry that is not zero */
+    if (ret == 0) {
+        char line[1024];
+        int nb_lines = 0;
+
+        stats->strm[pmoq_stats_strm_object_subgroup].nb_needs_more_bytes = 1;
+        if (pmoq_stats_dump(F, stats) != 0) {
+            ret = -1;
+        }
+        rewind(F);
+        while (ret == 0 && fgets(line, sizeof(line), F) != NULL) {
+            nb_lines++;
+            if ((nb_lines == 1 && strstr(line, "\"type\": \"subscribe\", \"parsed\": 100,") == NULL) ||
+                (nb_lines == 2 && strstr(line, "\"type\": \"object_subgroup\"") == NULL)) {
+                ret = -1;
+            }
+        }
+        if (nb_lines != 2) {
+            ret = -1;
+        }
+    }
+
+    if (ret != 0) {
+        printf("Stats histogram test fails\n");
+    }
+    if (F != NULL) {
+        (void)fclose(F);
+    }
+    free(stats);
+
+    return ret;
+}
+
+/* Each worker formats and parses messages, and counts in its own block */
+static int pmoq_stats_test_messages()
+{
+    int ret = 0;
+    uint8_t buffer[256];
+
+    for (uint64_t i = 0; ret == 0 && i < PMOQ_STATS_TEST_NB_MESSAGES; i++) {
+        pmoq_msg_t msg = { 0 };
+        pmoq_msg_t parsed = { 0 };
+        uint8_t* bytes;
+        int err = 0;
+
+        msg.msg_type = PMOQ_MSG_UNSUBSCRIBE;
+        msg.u.unsubscribe.subscribe_id = i;
+        if ((bytes = pmoq_msg_format(buffer, buffer + sizeof(buffer), &msg)) == NULL ||
+            pmoq_msg_parse(buffer, bytes, &err, 0, &parsed) != bytes ||
+            parsed.u.unsubscribe.subscribe_id != i) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int pmoq_stats_test_worker(pmoq_shard_t* shard, void* app_ctx)
+{
+    return pmoq_stats_test_messages();
+}
+
+int pmoq_stats_test_counts()
+{
+    int ret = 0;
+    pmoq_stats_t* before = (pmoq_stats_t*)calloc(1, sizeof(pmoq_stats_t));
+    pmoq_stats_t* after = (pmoq_stats_t*)calloc(1, sizeof(pmoq_stats_t));
+    pmoq_shards_t* shards = pmoq_shards_create(PMOQ_STATS_TEST_NB_SHARDS, 0);
+    uint64_t nb_messages = (PMOQ_STATS_TEST_NB_SHARDS + 1) * PMOQ_STATS_TEST_NB_MESSAGES;
+    size_t slot = pmoq_stats_msg_slot(PMOQ_MSG_UNSUBSCRIBE);
+    pmoq_strm_t header = { 0 };
+    pmoq_strm_t parsed;
+    uint8_t buffer[PMOQ_STRM_HEADER_SIZE_MAX];
+    uint8_t* bytes = NULL;
+    int err = 0;
+
+    if (before == NULL || after == NULL || shards == NULL) {
+        ret = -1;
+    }
+    else {
+        pmoq_stats_aggregate(before);
+        ret = pmoq_stats_test_messages();
+    }
+    if (ret == 0 && (pmoq_shards_start(shards, pmoq_stats_test_worker, NULL) != 0 || pmoq_shards_join(shards) != 0)) {
+        ret = -1;
+    }
+
+    /* Subgroup header: formatted, parsed, parsed from too few bytes,
+     * and from malformed bytes */
+    if (ret == 0) {
+        header.msg_type = PMOQ_STRM_HEADER_SUBGROUP;
+        header.subscribe_id = 1;
+        header.track_alias = 2;
+        header.group_id = 3;
+        if ((bytes = pmoq_strm_format(buffer, buffer + sizeof(buffer), &header)) == NULL ||
+            pmoq_strm_parse(buffer, bytes, &err, 0, &parsed) != bytes ||
+            pmoq_strm_parse(buffer, bytes - 1, &err, 0, &parsed) != NULL || err <= 0) {
+            ret = -1;
+        }
+        buffer[0] = 0x3;
+        if (ret == 0 && pmoq_strm_parse(buffer, bytes, &err, 0, &parsed) != NULL) {
+            ret = -1;
+        }
+    }
+
+    /* A message whose type is truncated is counted as unknown, not as
+     * the type left in the message by a previous parse */
+    if (ret == 0) {
+        pmoq_msg_t msg = { 0 };
+
+        msg.msg_type = PMOQ_MSG_UNSUBSCRIBE;
+        buffer[0] = 0x40;
+        if (pmoq_msg_parse(buffer, buffer + 1, &err, 0, &msg) != NULL || err <= 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        pmoq_stats_aggregate(after);
+        if (!pmoq_stats_enabled()) {
+            /* Nothing is counted */
+            if (after->msg[slot].nb_parsed != 0 || after->strm[pmoq_stats_strm_header_subgroup].nb_formatted != 0 ||
+                pmoq_stats_histo_count(&after->msg[slot].latency[pmoq_stats_op_parse]) != 0) {
+                ret = -1;
+            }
+        }
+        else {
+            pmoq_stats_entry_t* e_msg = &after->msg[slot];
+            pmoq_stats_entry_t* e_strm = &after->strm[pmoq_stats_strm_header_subgroup];
+            pmoq_stats_entry_t* b_msg = &before->msg[slot];
+            pmoq_stats_entry_t* b_strm = &before->strm[pmoq_stats_strm_header_subgroup];
+
+            if (e_msg->nb_parsed - b_msg->nb_parsed != nb_messages ||
+                e_msg->nb_formatted - b_msg->nb_formatted != nb_messages ||
+                e_msg->bytes_parsed - b_msg->bytes_parsed != e_msg->bytes_formatted - b_msg->bytes_formatted ||
+                e_msg->bytes_parsed - b_msg->bytes_parsed < 2 * nb_messages ||
+                pmoq_stats_histo_count(&e_msg->latency[pmoq_stats_op_parse]) -
+                pmoq_stats_histo_count(&b_msg->latency[pmoq_stats_op_parse]) != nb_messages ||
+                pmoq_stats_histo_count(&e_msg->latency[pmoq_stats_op_format]) -
+                pmoq_stats_histo_count(&b_msg->latency[pmoq_stats_op_format]) != nb_messages) {
+                ret = -1;
+            }
+            else if (e_strm->nb_formatted - b_strm->nb_formatted != 1 ||
+                e_strm->nb_parsed - b_strm->nb_parsed != 1 ||
+                e_strm->nb_needs_more_bytes - b_strm->nb_needs_more_bytes != 1 ||
+                e_strm->bytes_parsed - b_strm->bytes_parsed != (uint64_t)(bytes - buffer) ||
+                after->strm[pmoq_stats_strm_other].nb_parse_failed - before->strm[pmoq_stats_strm_other].nb_parse_failed != 1) {
+                ret = -1;
+            }
+            else if (e_msg->nb_needs_more_bytes != b_msg->nb_needs_more_bytes ||
+                after->msg[PMOQ_STATS_MSG_SLOTS - 1].nb_needs_more_bytes -
+                before->msg[PMOQ_STATS_MSG_SLOTS - 1].nb_needs_more_bytes != 1) {
+                ret = -1;
+            }
+        }
+    }
+
+    if (ret != 0) {
+        printf("Stats count test fails\n");
+    }
+    pmoq_shards_delete(shards);
+    free(before);
+    free(after);
+
+    return ret;
+}
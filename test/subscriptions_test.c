@@ -0,0 +1,238 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq.h"
+#include "picomoq_relay.h"
+#include "picomoq/picomoq_test.h"
+
+/* Subscription table tests
+*/
+
+static int pmoq_subs_test_add(pmoq_subs_t* subs, uint64_t connection_id, uint64_t subscribe_id, uint64_t track_key,
+    uint64_t filter_type, uint64_t start_group, uint64_t start_object, uint64_t end_group, uint64_t end_object)
+{
+    pmoq_subscribe_t subscribe;
+
+    memset(&subscribe, 0, sizeof(subscribe));
+    subscribe.subscribe_id = subscribe_id;
+    subscribe.track_alias = subscribe_id + 1000;
+    subscribe.filter_type = filter_type;
+    subscribe.start_group = start_group;
+    subscribe.start_object = start_object;
+    subscribe.end_group = end_group;
+    subscribe.end_object = end_object;
+
+    return pmoq_subs_add(subs, connection_id, track_key, &subscribe, (void*)(uintptr_t)(connection_id + 1));
+}
+
+/* Number of subscriptions matching the object, retrieved a few at a time.
+ * The optional mask gets bit subscribe_id set for each match. */
+static size_t pmoq_subs_test_count(pmoq_subs_t* subs, uint64_t track_key, uint64_t group_id, uint64_t object_id, uint64_t* mask)
+{
+    pmoq_subscription_t* matches[3];
+    size_t cursor = 0;
+    size_t nb_total = 0;
+    size_t nb_matches;
+
+    if (mask != NULL) {
+        *mask = 0;
+    }
+    while ((nb_matches = pmoq_subs_match(subs, track_key, group_id, object_id, &cursor, matches, 3)) > 0) {
+        for (size_t i = 0; i < nb_matches; i++) {
+            if (mask != NULL && matches[i]->subscribe_id < 64) {
+                *mask |= 1ull << matches[i]->subscribe_id;
+            }
+            if (matches[i]->track_key != track_key) {
+                return SIZE_MAX;
+            }
+        }
+        nb_total += nb_matches;
+    }
+    return nb_total;
+}
+
+int pmoq_subs_test_basic()
+{
+    int ret = 0;
+    pmoq_subs_t* subs = pmoq_subs_create();
+    pmoq_subscription_t* sub;
+    pmoq_subscribe_update_t update;
+    uint64_t mask = 0;
+
+    if (subs == NULL) {
+        return -1;
+    }
+
+    /* One subscription of each filter type on track 7, from connection 1 */
+    if (pmoq_subs_test_add(subs, 1, 0, 7, pmoq_msg_filter_latest_group, 0, 0, 0, 0) != 0 ||
+        pmoq_subs_test_add(subs, 1, 1, 7, pmoq_msg_filter_latest_object, 0, 0, 0, 0) != 0 ||
+        pmoq_subs_test_add(subs, 1, 2, 7, pmoq_msg_filter_absolute_start, 5, 3, 0, 0) != 0 ||
+        pmoq_subs_test_add(subs, 1, 3, 7, pmoq_msg_filter_absolute_range, 5, 0, 6, 2) != 0 ||
+        pmoq_subs_test_add(subs, 1, 4, 7, pmoq_msg_filter_absolute_range, 4, 0, 5, 0) != 0 ||
+        pmoq_subs_test_add(subs, 2, 0, 8, pmoq_msg_filter_absolute_start, 0, 0, 0, 0) != 0) {
+        ret = -1;
+    }
+    /* Duplicate subscribe ID, invalid filters */
+    if (ret == 0 && (pmoq_subs_test_add(subs, 1, 2, 9, pmoq_msg_filter_absolute_start, 0, 0, 0, 0) == 0 ||
+        pmoq_subs_test_add(subs, 1, 5, 7, 0, 0, 0, 0, 0) == 0 ||
+        pmoq_subs_test_add(subs, 1, 5, 7, pmoq_msg_filter_absolute_range, 3, 0, 2, 0) == 0 ||
+        pmoq_subs_count(subs) != 6)) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        sub = pmoq_subs_find(subs, 1, 3);
+        if (sub == NULL || sub->connection_id != 1 || sub->subscribe_id != 3 || sub->track_alias != 1003 ||
+            sub->track_key != 7 || sub->filter_type != pmoq_msg_filter_absolute_range ||
+            sub->app_ctx != (void*)(uintptr_t)2 || pmoq_subs_find(subs, 2, 3) != NULL) {
+            ret = -1;
+        }
+    }
+
+    /* The latest filters start at the first object seen, (5, 2) */
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 5, 2, &mask) != 4 || mask != 0x1b)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 5, 1, &mask) != 3 || mask != 0x19)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 5, 3, &mask) != 5 || mask != 0x1f)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 6, 1, &mask) != 4 || mask != 0x0f)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 6, 2, &mask) != 3 || mask != 0x07)) {
+        ret = -1;
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 4, 0, &mask) != 1 || mask != 0x10 ||
+        pmoq_subs_test_count(subs, 8, 4, 0, &mask) != 1 || mask != 0x01 ||
+        pmoq_subs_test_count(subs, 9, 4, 0, NULL) != 0)) {
+        ret = -1;
+    }
+
+    /* Update: subscription 2 now ends with group 9, subscription 3 with
+     * object 0 of group 5 */
+    if (ret == 0) {
+        memset(&update, 0, sizeof(update));
+        update.subscribe_id = 2;
+        update.start_group = 6;
+        update.end_group = 10;
+        if (pmoq_subs_update(subs, 1, &update) != 0) {
+            ret = -1;
+        }
+        update.subscribe_id = 3;
+        update.start_group = 5;
+        update.end_group = 6;
+        update.end_object = 1;
+        if (pmoq_subs_update(subs, 1, &update) != 0) {
+            ret = -1;
+        }
+        update.subscribe_id = 9;
+        if (pmoq_subs_update(subs, 1, &update) == 0) {
+            ret = -1;
+        }
+        update.subscribe_id = 3;
+        update.start_group = 7;
+        if (pmoq_subs_update(subs, 1, &update) == 0) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && (pmoq_subs_test_count(subs, 7, 9, 100, &mask) != 3 || mask != 0x07 ||
+        pmoq_subs_test_count(subs, 7, 10, 0, &mask) != 2 || mask != 0x03 ||
+        pmoq_subs_test_count(subs, 7, 5, 0, &mask) != 3 || mask != 0x19 ||
+        pmoq_subs_test_count(subs, 7, 5, 1, &mask) != 2 || mask != 0x11)) {
+        ret = -1;
+    }
+
+    /* Removal */
+    if (ret == 0 && (pmoq_subs_remove(subs, 1, 0) != 0 || pmoq_subs_remove(subs, 1, 0) == 0 ||
+        pmoq_subs_find(subs, 1, 0) != NULL || pmoq_subs_count(subs) != 5 ||
+        pmoq_subs_test_count(subs, 7, 9, 100, &mask) != 2 || mask != 0x06)) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        pmoq_subs_remove_connection(subs, 1);
+        if (pmoq_subs_count(subs) != 1 || pmoq_subs_test_count(subs, 7, 9, 100, NULL) != 0 ||
+            pmoq_subs_test_count(subs, 8, 9, 100, NULL) != 1 || pmoq_subs_find(subs, 2, 0) == NULL) {
+            ret = -1;
+        }
+    }
+    /* IDs can be reused after removal */
+    if (ret == 0 && (pmoq_subs_test_add(subs, 1, 0, 7, pmoq_msg_filter_absolute_start, 0, 0, 0, 0) != 0 ||
+        pmoq_subs_test_count(subs, 7, 9, 100, &mask) != 1 || mask != 0x01)) {
+        ret = -1;
+    }
+
+    pmoq_subs_delete(subs);
+
+    return ret;
+}
+
+int pmoq_subs_test_scale()
+{
+    int ret = 0;
+    const uint64_t nb_connections = 1000;
+    const uint64_t nb_tracks = 50;
+    const uint64_t subs_per_connection = 20;
+    pmoq_subs_t* subs = pmoq_subs_create();
+
+    if (subs == NULL) {
+        return -1;
+    }
+
+    /* Each connection subscribes to 20 tracks, with subscribe IDs 0 to 19 */
+    for (uint64_t cnx = 0; ret == 0 && cnx < nb_connections; cnx++) {
+        for (uint64_t id = 0; ret == 0 && id < subs_per_connection; id++) {
+            if (pmoq_subs_test_add(subs, cnx, id, (cnx + id) % nb_tracks, pmoq_msg_filter_absolute_start, 0, 0, 0, 0) != 0) {
+                ret = -1;
+            }
+        }
+    }
+    for (uint64_t track = 0; ret == 0 && track < nb_tracks; track++) {
+        if (pmoq_subs_test_count(subs, track, 1, 1, NULL) != nb_connections * subs_per_connection / nb_tracks) {
+            ret = -1;
+        }
+    }
+
+    /* Unsubscribe the even IDs of the odd connections, then close the
+     * connections that are multiple of 4 */
+    for (uint64_t cnx = 1; ret == 0 && cnx < nb_connections; cnx += 2) {
+        for (uint64_t id = 0; ret == 0 && id < subs_per_connection; id += 2) {
+            if (pmoq_subs_remove(subs, cnx, id) != 0) {
+                ret = -1;
+            }
+        }
+    }
+    for (uint64_t cnx = 0; ret == 0 && cnx < nb_connections; cnx += 4) {
+        pmoq_subs_remove_connection(subs, cnx);
+    }
+    if (ret == 0) {
+        size_t expected = 0;
+        size_t nb_found = 0;
+
+        for (uint64_t cnx = 0; cnx < nb_connections; cnx++) {
+            for (uint64_t id = 0; id < subs_per_connection; id++) {
+                int is_expected = (cnx % 4) != 0 && ((cnx & 1) == 0 || (id & 1) != 0);
+                pmoq_subscription_t* sub = pmoq_subs_find(subs, cnx, id);
+
+                if ((sub != NULL) != is_expected ||
+                    (sub != NULL && (sub->track_key != (cnx + id) % nb_tracks || sub->subscribe_id != id))) {
+                    ret = -1;
+                }
+                expected += is_expected;
+            }
+        }
+        for (uint64_t track = 0; track < nb_tracks; track++) {
+            nb_found += pmoq_subs_test_count(subs, track, 1, 1, NULL);
+        }
+        if (ret != 0 || nb_found != expected || pmoq_subs_count(subs) != expected) {
+            printf("Subscription scale test fails, %zu found, %zu expected\n", nb_found, expected);
+            ret = -1;
+        }
+    }
+
+    pmoq_subs_delete(subs);
+
+    return ret;
+}
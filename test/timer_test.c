@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "picomoq_timer.h"
+#include "picomoq/picomoq_test.h"
+
+/* Timer wheel tests
+*/
+
+#define PMOQ_TIMER_TEST_NB 1000
+#define PMOQ_TIMER_TEST_TICK 1000
+
+typedef struct st_pmoq_timer_test_ctx_t {
+    pmoq_timer_wheel_t* wheel;
+    uint64_t current_time;
+    uint64_t previous_time;
+    size_t nb_fired[PMOQ_TIMER_TEST_NB];
+    int is_cancelled[PMOQ_TIMER_TEST_NB];
+    pmoq_timer_t timers[PMOQ_TIMER_TEST_NB];
+    int is_error;
+} pmoq_timer_test_ctx_t;
+
+static void pmoq_timer_test_fn(void* callback_ctx, pmoq_timer_t* timer)
+{
+    pmoq_timer_test_ctx_t* ctx = (pmoq_timer_test_ctx_t*)callback_ctx;
+    size_t rank = (size_t)(timer - ctx->timers);
+
+    if (rank >= PMOQ_TIMER_TEST_NB || timer->expiry > ctx->current_time ||
+        timer->expiry <= ctx->previous_time ||
+        pmoq_timer_is_set(timer)) {
+        ctx->is_error = 1;
+    }
+    else {
+        ctx->nb_fired[rank]++;
+        /* Timers of rank multiple of 10 set themselves again once, and
+         * cancel the timer of rank + 5 if it did not fire yet */
+        if ((rank % 10) == 0 && ctx->nb_fired[rank] == 1) {
+            pmoq_timer_set(ctx->wheel, timer, ctx->current_time + 5 * PMOQ_TIMER_TEST_TICK);
+            if (pmoq_timer_is_set(&ctx->timers[rank + 5])) {
+                ctx->is_cancelled[rank + 5] = 1;
+                pmoq_timer_cancel(ctx->wheel, &ctx->timers[rank + 5]);
+            }
+        }
+    }
+}
+
+int pmoq_timer_test_wheel()
+{
+    int ret = 0;
+    const uint64_t start_time = 1000000007;
+    pmoq_timer_test_ctx_t* ctx = (pmoq_timer_test_ctx_t*)calloc(1, sizeof(pmoq_timer_test_ctx_t));
+    uint64_t random_state = 0xdeadbeef12345678ull;
+    uint64_t last_expiry = 0;
+
+    if (ctx == NULL || (ctx->wheel = pmoq_timer_wheel_create(PMOQ_TIMER_TEST_TICK, 64, start_time)) == NULL) {
+        ret = -1;
+    }
+    else {
+        ctx->current_time = start_time;
+        /* Timers set in the past fire on the first advance */
+        ctx->previous_time = 0;
+        if (pmoq_timer_wheel_next_expiry(ctx->wheel) != UINT64_MAX) {
+            ret = -1;
+        }
+    }
+
+    /* Expiries spread over several turns of the wheel, some in the past */
+    for (size_t i = 0; ret == 0 && i < PMOQ_TIMER_TEST_NB; i++) {
+        uint64_t expiry;
+
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        expiry = start_time + (random_state % (300 * PMOQ_TIMER_TEST_TICK)) - 10 * PMOQ_TIMER_TEST_TICK;
+        pmoq_timer_set(ctx->wheel, &ctx->timers[i], expiry + 1000 * PMOQ_TIMER_TEST_TICK);
+        pmoq_timer_set(ctx->wheel, &ctx->timers[i], expiry);
+        if (expiry > last_expiry) {
+            last_expiry = expiry;
+        }
+    }
+    if (ret == 0 && pmoq_timer_wheel_count(ctx->wheel) != PMOQ_TIMER_TEST_NB) {
+        ret = -1;
+    }
+    /* Timers of rank 3 modulo 10 are cancelled */
+    for (size_t i = 3; ret == 0 && i < PMOQ_TIMER_TEST_NB; i += 10) {
+        pmoq_timer_cancel(ctx->wheel, &ctx->timers[i]);
+        pmoq_timer_cancel(ctx->wheel, &ctx->timers[i]);
+    }
+
+    /* Advance by irregular steps, checking the next expiry each time */
+    while (ret == 0 && pmoq_timer_wheel_count(ctx->wheel) > 0) {
+        uint64_t next_expiry = pmoq_timer_wheel_next_expiry(ctx->wheel);
+        uint64_t min_expiry = UINT64_MAX;
+
+        for (size_t i = 0; i < PMOQ_TIMER_TEST_NB; i++) {
+            if (pmoq_timer_is_set(&ctx->timers[i]) && ctx->timers[i].expiry < min_expiry) {
+                min_expiry = ctx->timers[i].expiry;
+            }
+        }
+        if (next_expiry != min_expiry) {
+            ret = -1;
+            break;
+        }
+        ctx->current_time += 1 + (ctx->current_time % (3 * PMOQ_TIMER_TEST_TICK));
+        (void)pmoq_timer_wheel_advance(ctx->wheel, ctx->current_time, pmoq_timer_test_fn, ctx);
+        ctx->previous_time = ctx->current_time;
+        if (ctx->is_error || ctx->current_time > last_expiry + 100 * PMOQ_TIMER_TEST_TICK) {
+            ret = -1;
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < PMOQ_TIMER_TEST_NB; i++) {
+        size_t expected = ((i % 10) == 0) ? 2 : (((i % 10) == 3 || ctx->is_cancelled[i]) ? 0 : 1);
+
+        if (ctx->nb_fired[i] != expected) {
+            ret = -1;
+        }
+    }
+
+    /* Timers still set when the wheel is deleted are cancelled */
+    if (ret == 0) {
+        pmoq_timer_set(ctx->wheel, &ctx->timers[0], ctx->current_time + PMOQ_TIMER_TEST_TICK);
+        pmoq_timer_wheel_delete(ctx->wheel);
+        ctx->wheel = NULL;
+        if (pmoq_timer_is_set(&ctx->timers[0])) {
+            ret = -1;
+        }
+    }
+
+    if (ctx != NULL) {
+        pmoq_timer_wheel_delete(ctx->wheel);
+        free(ctx);
+    }
+
+    return ret;
+}